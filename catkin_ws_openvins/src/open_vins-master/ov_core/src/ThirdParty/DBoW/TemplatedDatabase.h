@@ -16,6 +16,9 @@
 #include <string>
 #include <list>
 #include <set>
+#include <algorithm>
+
+#include <boost/thread.hpp>
 
 #include "TemplatedVocabulary.h"
 #include "QueryResults.h"
@@ -189,6 +192,14 @@ public:
   void query(const BowVector &vec, QueryResults &ret, 
     int max_results = 1, int max_id = -1) const;
 
+  /**
+   * Sets how many threads L1 queries can use to traverse the inverted file.
+   * Threads are only started if the query touches enough entries for it to
+   * be worth it.
+   * @param n number of threads (1 to always query serially)
+   */
+  inline void setQueryThreads(int n) { m_query_threads = std::max(1, n); }
+
   /**
    * Returns the a feature vector associated with a database entry
    * @param id entry id (must be < size())
@@ -197,6 +208,13 @@ public:
    */
   const FeatureVector& retrieveFeatures(EntryId id) const;
 
+  /**
+   * Returns the bow vector of a database entry (empty if it was deleted)
+   * @param id entry id (must be < size())
+   * @return const reference to the bow vector of the given entry
+   */
+  const BowVector& retrieveBowVector(EntryId id) const;
+
   /**
    * Stores the database in a file
    * @param filename
@@ -285,8 +303,9 @@ protected:
   };
   
   /// Row of InvertedFile
-  typedef std::list<IFPair> IFRow;
-  // IFRows are sorted in ascending entry_id order
+  typedef std::vector<IFPair> IFRow;
+  // IFRows are sorted in ascending entry_id order (so we can binary search
+  // the range of entries of each query thread)
   
   /// Inverted index
   typedef std::vector<IFRow> InvertedFile; 
@@ -321,6 +340,23 @@ protected:
 
   /// Number of valid entries in m_dfile
   int m_nentries;
+
+  /// Max number of threads an L1 query can use
+  int m_query_threads = 1;
+
+  /**
+   * Accumulates the L1 scores of the entries in [first, last) into an array
+   * and returns the best max_results of them (unsorted, scores not scaled)
+   * @param words query words sorted by descending weight
+   * @param first first entry id of this range
+   * @param last one past the last entry id of this range
+   * @param max_results number of results to keep (<= 0 means all)
+   * @param max_id same as in query()
+   * @param ret (out) best results of this range
+   */
+  void queryL1Range(const std::vector<std::pair<WordId, WordValue> > &words,
+    EntryId first, EntryId last, int max_results, int max_id,
+    QueryResults &ret) const;
   
 };
 
@@ -452,14 +488,17 @@ EntryId TemplatedDatabase<TDescriptor, F>::add(const BowVector &v,
     if(entry_id == m_dfile.size())
     {
       m_dfile.push_back(fv);
-      m_dBowfile.push_back(v);
     }
     else
     {
       m_dfile[entry_id] = fv;
-      m_dBowfile[entry_id] = v;
     }
   }
+
+  // keep the bow vector of every entry, so delete_entry() can find its rows
+  if(entry_id >= m_dBowfile.size())
+    m_dBowfile.resize(entry_id+1);
+  m_dBowfile[entry_id] = v;
   
   // update inverted file
   for(vit = v.begin(); vit != v.end(); ++vit)
@@ -479,7 +518,9 @@ EntryId TemplatedDatabase<TDescriptor, F>::add(const BowVector &v,
 template<class TDescriptor, class F>
 void TemplatedDatabase<TDescriptor, F>::delete_entry(const EntryId entry_id)
 {
-  BowVector v = m_dBowfile[entry_id];
+  if(entry_id >= m_dBowfile.size()) return;
+  BowVector v;
+  v.swap(m_dBowfile[entry_id]);
 
   BowVector::const_iterator vit;
 
@@ -497,8 +538,8 @@ void TemplatedDatabase<TDescriptor, F>::delete_entry(const EntryId entry_id)
       }
     }
   }
-  m_dBowfile[entry_id].clear();
-  m_dfile[entry_id].clear();
+  if(entry_id < m_dfile.size())
+    m_dfile[entry_id].clear();
 }
 
 
@@ -656,61 +697,59 @@ template<class TDescriptor, class F>
 void TemplatedDatabase<TDescriptor, F>::queryL1(const BowVector &vec, 
   QueryResults &ret, int max_results, int max_id) const
 {
-  BowVector::const_iterator vit;
-  typename IFRow::const_iterator rit;
-    
-  std::map<EntryId, double> pairs;
-  std::map<EntryId, double>::iterator pit;
-  
-  for(vit = vec.begin(); vit != vec.end(); ++vit)
+  // Go through the heaviest words first, so the bound on how much the
+  // remaining words can add to a score shrinks as fast as possible
+  std::vector<std::pair<WordId, WordValue> > words(vec.begin(), vec.end());
+  std::sort(words.begin(), words.end(),
+    [](const std::pair<WordId, WordValue> &a,
+       const std::pair<WordId, WordValue> &b) { return a.second > b.second; });
+
+  // Only split the entries between threads if we have enough postings
+  size_t num_postings = 0;
+  for(size_t i = 0; i < words.size(); ++i)
+    num_postings += m_ifile[words[i].first].size();
+  const int min_postings_per_thread = 20000;
+  int num_threads = std::min(m_query_threads,
+    (int)(num_postings / min_postings_per_thread) + 1);
+  num_threads = std::max(1, std::min(num_threads, m_nentries));
+
+  if(num_threads == 1)
   {
-    const WordId word_id = vit->first;
-    const WordValue& qvalue = vit->second;
-        
-    const IFRow& row = m_ifile[word_id];
-    
-    // IFRows are sorted in ascending entry_id order
-    
-    for(rit = row.begin(); rit != row.end(); ++rit)
-    {
-      const EntryId entry_id = rit->entry_id;
-      const WordValue& dvalue = rit->word_weight;
-      
-      if((int)entry_id < max_id || max_id == -1 || (int)entry_id == m_nentries - 1)
-      {
-        double value = fabs(qvalue - dvalue) - fabs(qvalue) - fabs(dvalue);
-        
-        pit = pairs.lower_bound(entry_id);
-        if(pit != pairs.end() && !(pairs.key_comp()(entry_id, pit->first)))
-        {
-          pit->second += value;
-        }
-        else
-        {
-          pairs.insert(pit, 
-            std::map<EntryId, double>::value_type(entry_id, value));
-        }
-      }
-      
-    } // for each inverted row
-  } // for each query word
-	
-  // move to vector
-  ret.reserve(pairs.size());
-  for(pit = pairs.begin(); pit != pairs.end(); ++pit)
+    queryL1Range(words, 0, m_nentries, max_results, max_id, ret);
+  }
+  else
   {
-    ret.push_back(Result(pit->first, pit->second));
+    // Each thread scores its own range of entries, so they do not share
+    // any accumulators, and then we merge their best results
+    std::vector<QueryResults> rets(num_threads);
+    boost::thread_group threads;
+    for(int t = 0; t < num_threads; ++t)
+    {
+      const EntryId first = (EntryId)((long)m_nentries * t / num_threads);
+      const EntryId last = (EntryId)((long)m_nentries * (t+1) / num_threads);
+      threads.create_thread(boost::bind(
+        &TemplatedDatabase<TDescriptor, F>::queryL1Range, this,
+        boost::cref(words), first, last, max_results, max_id,
+        boost::ref(rets[t])));
+    }
+    threads.join_all();
+    for(int t = 0; t < num_threads; ++t)
+      ret.insert(ret.end(), rets[t].begin(), rets[t].end());
   }
-	
+
   // resulting "scores" are now in [-2 best .. 0 worst]	
   
-  // sort vector in ascending order of score
-  std::sort(ret.begin(), ret.end());
+  // sort vector in ascending order of score, only keeping the best ones
   // (ret is inverted now --the lower the better--)
-
-  // cut vector
   if(max_results > 0 && (int)ret.size() > max_results)
+  {
+    std::partial_sort(ret.begin(), ret.begin() + max_results, ret.end());
     ret.resize(max_results);
+  }
+  else
+  {
+    std::sort(ret.begin(), ret.end());
+  }
   
   // complete and scale score to [0 worst .. 1 best]
   // ||v - w||_{L1} = 2 + Sum(|v_i - w_i| - |v_i| - |w_i|) 
@@ -724,6 +763,89 @@ void TemplatedDatabase<TDescriptor, F>::queryL1(const BowVector &vec,
 
 // --------------------------------------------------------------------------
 
+template<class TDescriptor, class F>
+void TemplatedDatabase<TDescriptor, F>::queryL1Range(
+  const std::vector<std::pair<WordId, WordValue> > &words,
+  EntryId first, EntryId last, int max_results, int max_id,
+  QueryResults &ret) const
+{
+  ret.resize(0);
+  if(last <= first) return;
+
+  // Accumulators of our range, and the entries we have touched
+  std::vector<double> scores(last - first, 0.0);
+  std::vector<char> touched(last - first, 0);
+  std::vector<EntryId> entries;
+
+  // Each word adds |q - d| - |q| - |d| >= -2|q| to a score, so an entry we
+  // have not touched yet can at best end at -2 * (weight of the words left).
+  // Once that is worse than our current k-th best score (scores only go
+  // down), no new entry can make it into the results and we stop adding them.
+  double remaining = 0;
+  for(size_t i = 0; i < words.size(); ++i)
+    remaining += fabs(words[i].second);
+  double next_check = remaining / 2;
+  bool admit_new = true;
+  std::vector<double> kth;
+
+  const IFPair key_first(first, 0);
+  for(size_t i = 0; i < words.size(); ++i)
+  {
+    const WordValue qvalue = words[i].second;
+    const IFRow& row = m_ifile[words[i].first];
+
+    // IFRows are sorted in ascending entry_id order
+    typename IFRow::const_iterator rit = std::lower_bound(row.begin(),
+      row.end(), key_first,
+      [](const IFPair &a, const IFPair &b) { return a.entry_id < b.entry_id; });
+
+    for(; rit != row.end() && rit->entry_id < last; ++rit)
+    {
+      const EntryId entry_id = rit->entry_id;
+      const WordValue& dvalue = rit->word_weight;
+      
+      if((int)entry_id < max_id || max_id == -1 || (int)entry_id == m_nentries - 1)
+      {
+        const EntryId idx = entry_id - first;
+        if(!touched[idx])
+        {
+          if(!admit_new) continue;
+          touched[idx] = 1;
+          entries.push_back(entry_id);
+        }
+        scores[idx] += fabs(qvalue - dvalue) - fabs(qvalue) - fabs(dvalue);
+      }
+    } // for each inverted row
+
+    // See if new entries can still make it (checking each time the weight
+    // left halves, so this is only done a few times per query)
+    remaining -= fabs(qvalue);
+    if(admit_new && max_results > 0 && remaining < next_check &&
+      (int)entries.size() >= max_results)
+    {
+      next_check = remaining / 2;
+      kth.resize(entries.size());
+      for(size_t j = 0; j < entries.size(); ++j)
+        kth[j] = scores[entries[j] - first];
+      std::nth_element(kth.begin(), kth.begin() + (max_results - 1), kth.end());
+      if(-2 * remaining > kth[max_results - 1])
+        admit_new = false;
+    }
+  } // for each query word
+
+  // move our best ones to the results
+  ret.reserve(entries.size());
+  for(size_t j = 0; j < entries.size(); ++j)
+    ret.push_back(Result(entries[j], scores[entries[j] - first]));
+  if(max_results > 0 && (int)ret.size() > max_results)
+  {
+    std::nth_element(ret.begin(), ret.begin() + (max_results - 1), ret.end());
+    ret.resize(max_results);
+  }
+}
+
+// --------------------------------------------------------------------------
+
 template<class TDescriptor, class F>
 void TemplatedDatabase<TDescriptor, F>::queryL2(const BowVector &vec, 
   QueryResults &ret, int max_results, int max_id) const
@@ -1163,6 +1285,16 @@ const FeatureVector& TemplatedDatabase<TDescriptor, F>::retrieveFeatures
   return m_dfile[id];
 }
 
+// ---------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+const BowVector& TemplatedDatabase<TDescriptor, F>::retrieveBowVector
+  (EntryId id) const
+{
+  assert(id < size());
+  return m_dBowfile[id];
+}
+
 // --------------------------------------------------------------------------
 
 template<class TDescriptor, class F>
@@ -13,6 +13,7 @@
 #include <cassert>
 
 #include <vector>
+#include <memory>
 #include <numeric>
 #include <fstream>
 #include <string>
@@ -260,6 +261,21 @@ public:
   // Added by VINS [[[
   virtual void loadBin(const std::string &filename);
   // Added by VINS ]]]
+
+  /**
+   * Maps a flat vocabulary file (see VINSLoop::MappedVocabulary), which is
+   * used in place instead of building the tree in memory.
+   * Copies of this vocabulary share the same mapping.
+   * @param filename
+   * @return false if this is not a valid flat vocabulary (this vocabulary is not changed)
+   */
+  bool loadMapped(const std::string &filename);
+
+  /**
+   * Returns whether this vocabulary is a mapped flat vocabulary
+   * @return true iff mapped
+   */
+  inline bool isMapped() const { return m_mapped != nullptr; }
     
   /** 
    * Stops those words whose weight is below minWeight.
@@ -348,6 +364,17 @@ protected:
    * @param id (out) word id
    */
   virtual void transform(const TDescriptor &feature, WordId &id) const;
+
+  /**
+   * Returns the word id associated to a feature using the mapped vocabulary
+   * @param feature
+   * @param id (out) word id
+   * @param weight (out) word weight
+   * @param nid (out) if given, id of the node "levelsup" levels up
+   * @param levelsup
+   */
+  void transformMapped(const TDescriptor &feature,
+    WordId &id, WordValue &weight, NodeId* nid, int levelsup) const;
       
   /**
    * Creates a level in the tree, under the parent, by running kmeans with
@@ -412,6 +439,9 @@ protected:
   /// Words of the vocabulary (tree leaves)
   /// this condition holds: m_words[wid]->word_id == wid
   std::vector<Node*> m_words;
+
+  /// Mapped flat vocabulary, if we use it the nodes and words are empty
+  std::shared_ptr<const VINSLoop::MappedVocabulary> m_mapped;
   
 };
 
@@ -545,6 +575,7 @@ TemplatedVocabulary<TDescriptor,F>::operator=
   
   this->m_nodes = voc.m_nodes;
   this->createWords();
+  this->m_mapped = voc.m_mapped;
   
   return *this;
 }
@@ -557,6 +588,7 @@ void TemplatedVocabulary<TDescriptor,F>::create(
 {
   m_nodes.clear();
   m_words.clear();
+  m_mapped.reset();
   
   // expected_nodes = Sum_{i=0..L} ( k^i )
 	int expected_nodes = 
@@ -999,6 +1031,7 @@ void TemplatedVocabulary<TDescriptor,F>::setNodeWeights
 template<class TDescriptor, class F>
 inline unsigned int TemplatedVocabulary<TDescriptor,F>::size() const
 {
+  if(m_mapped) return (unsigned int)m_mapped->nWords();
   return m_words.size();
 }
 
@@ -1007,6 +1040,7 @@ inline unsigned int TemplatedVocabulary<TDescriptor,F>::size() const
 template<class TDescriptor, class F>
 inline bool TemplatedVocabulary<TDescriptor,F>::empty() const
 {
+  if(m_mapped) return m_mapped->nWords() == 0;
   return m_words.empty();
 }
 
@@ -1032,6 +1066,12 @@ float TemplatedVocabulary<TDescriptor,F>::getEffectiveLevels() const
 template<class TDescriptor, class F>
 TDescriptor TemplatedVocabulary<TDescriptor,F>::getWord(WordId wid) const
 {
+  if(m_mapped)
+  {
+    // Sorry to break template here
+    const uint64_t *d = m_mapped->descriptor(m_mapped->wordNode(wid));
+    return TDescriptor(d, d + 4);
+  }
   return m_words[wid]->descriptor;
 }
 
@@ -1040,6 +1080,7 @@ TDescriptor TemplatedVocabulary<TDescriptor,F>::getWord(WordId wid) const
 template<class TDescriptor, class F>
 WordValue TemplatedVocabulary<TDescriptor, F>::getWordWeight(WordId wid) const
 {
+  if(m_mapped) return m_mapped->weight(m_mapped->wordNode(wid));
   return m_words[wid]->weight;
 }
 
@@ -1217,6 +1258,12 @@ template<class TDescriptor, class F>
 void TemplatedVocabulary<TDescriptor,F>::transform(const TDescriptor &feature, 
   WordId &word_id, WordValue &weight, NodeId *nid, int levelsup) const
 { 
+  if(m_mapped)
+  {
+    transformMapped(feature, word_id, weight, nid, levelsup);
+    return;
+  }
+
   // propagate the feature down the tree
   std::vector<NodeId> nodes;
   typename std::vector<NodeId>::const_iterator nit;
@@ -1259,10 +1306,71 @@ void TemplatedVocabulary<TDescriptor,F>::transform(const TDescriptor &feature,
 
 // --------------------------------------------------------------------------
 
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor,F>::transformMapped(const TDescriptor &feature,
+  WordId &word_id, WordValue &weight, NodeId *nid, int levelsup) const
+{
+  // Sorry to break template here (the mapped nodes are 256 bit BRIEF descriptors)
+  assert(feature.num_blocks() * sizeof(typename TDescriptor::block_type) == 4 * sizeof(uint64_t));
+  uint64_t f[4] = {0, 0, 0, 0};
+  boost::to_block_range(feature, reinterpret_cast<typename TDescriptor::block_type*>(f));
+
+  const VINSLoop::MappedVocabulary &voc = *m_mapped;
+
+  // level at which the node must be stored in nid, if given
+  const int nid_level = m_L - levelsup;
+  if(nid_level <= 0 && nid != NULL) *nid = 0; // root
+
+  // propagate the feature down the tree (the children of a node are next to each other)
+  NodeId final_id = 0; // root
+  int current_level = 0;
+
+  do
+  {
+    ++current_level;
+    const uint32_t *cit = voc.childrenBegin(final_id);
+    const uint32_t *cend = voc.childrenEnd(final_id);
+    final_id = *cit;
+
+    int best_d = VINSLoop::MappedVocabulary::distance(f, voc.descriptor(final_id));
+
+    for(++cit; cit != cend; ++cit)
+    {
+      int d = VINSLoop::MappedVocabulary::distance(f, voc.descriptor(*cit));
+      if(d < best_d)
+      {
+        best_d = d;
+        final_id = *cit;
+      }
+    }
+
+    if(nid != NULL && current_level == nid_level)
+      *nid = final_id;
+
+  } while( !voc.isLeaf(final_id) );
+
+  // turn node id into word id
+  word_id = voc.wordId(final_id);
+  weight = voc.weight(final_id);
+}
+
+// --------------------------------------------------------------------------
+
 template<class TDescriptor, class F>
 NodeId TemplatedVocabulary<TDescriptor,F>::getParentNode
   (WordId wid, int levelsup) const
 {
+  if(m_mapped)
+  {
+    NodeId ret = m_mapped->wordNode(wid);
+    while(levelsup > 0 && ret != 0)
+    {
+      --levelsup;
+      ret = m_mapped->parent(ret);
+    }
+    return ret;
+  }
+
   NodeId ret = m_words[wid]->id; // node id
   while(levelsup > 0 && ret != 0) // ret == 0 --> root
   {
@@ -1279,6 +1387,25 @@ void TemplatedVocabulary<TDescriptor,F>::getWordsFromNode
   (NodeId nid, std::vector<WordId> &words) const
 {
   words.clear();
+
+  if(m_mapped)
+  {
+    std::vector<NodeId> parents;
+    parents.push_back(nid);
+    while(!parents.empty())
+    {
+      NodeId parentid = parents.back();
+      parents.pop_back();
+      if(m_mapped->isLeaf(parentid))
+      {
+        words.push_back(m_mapped->wordId(parentid));
+        continue;
+      }
+      for(const uint32_t *cit = m_mapped->childrenBegin(parentid); cit != m_mapped->childrenEnd(parentid); ++cit)
+        parents.push_back(*cit);
+    }
+    return;
+  }
   
   if(m_nodes[nid].isLeaf())
   {
@@ -1458,6 +1585,7 @@ void TemplatedVocabulary<TDescriptor,F>::load(const cv::FileStorage &fs,
 {
   m_words.clear();
   m_nodes.clear();
+  m_mapped.reset();
   
   cv::FileNode fvoc = fs[name];
   
@@ -1510,6 +1638,7 @@ void TemplatedVocabulary<TDescriptor,F>::loadBin(const std::string &filename) {
     
   m_words.clear();
   m_nodes.clear();
+  m_mapped.reset();
   //printf("loop load bin\n");
   std::ifstream ifStream(filename);
   VINSLoop::Vocabulary voc;
@@ -1564,6 +1693,27 @@ void TemplatedVocabulary<TDescriptor,F>::loadBin(const std::string &filename) {
 
 // --------------------------------------------------------------------------
 
+template<class TDescriptor, class F>
+bool TemplatedVocabulary<TDescriptor,F>::loadMapped(const std::string &filename)
+{
+  std::shared_ptr<VINSLoop::MappedVocabulary> mapped = std::make_shared<VINSLoop::MappedVocabulary>();
+  if(!mapped->open(filename)) return false;
+
+  m_words.clear();
+  m_nodes.clear();
+  m_mapped = mapped;
+
+  m_k = m_mapped->k();
+  m_L = m_mapped->L();
+  m_scoring = (ScoringType)m_mapped->scoringType();
+  m_weighting = (WeightingType)m_mapped->weightingType();
+
+  createScoringObject();
+  return true;
+}
+
+// --------------------------------------------------------------------------
+
 /**
  * Writes printable information of the vocabulary
  * @param os stream to write to
@@ -1,7 +1,18 @@
 #include "VocabularyBinary.hpp"
 #include <opencv2/core/core.hpp>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 using namespace std;
 
+static const char MAPPED_MAGIC[8] = {'O','V','V','O','C','M','A','P'};
+static const uint32_t MAPPED_ENDIAN = 0x01020304;
+
 VINSLoop::Vocabulary::Vocabulary()
 : nNodes(0), nodes(nullptr), nWords(0), words(nullptr) {
 }
@@ -33,3 +44,194 @@ void VINSLoop::Vocabulary::deserialize(ifstream& stream) {
     words = new Word[nWords];
     stream.read((char *)words, sizeof(Word) * nWords);
 }
+
+VINSLoop::MappedVocabulary::~MappedVocabulary() {
+    close();
+}
+
+void VINSLoop::MappedVocabulary::close() {
+    if (data != nullptr) {
+        munmap(data, size);
+        data = nullptr;
+    }
+    size = 0;
+    header = nullptr;
+}
+
+bool VINSLoop::MappedVocabulary::open(const string& filename) {
+    close();
+
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(MappedHeader)) {
+        ::close(fd);
+        return false;
+    }
+
+    // Map read-only, so all processes using this file share the same pages
+    size = (size_t)st.st_size;
+    data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        data = nullptr;
+        size = 0;
+        return false;
+    }
+
+    // Check this is a flat vocabulary we can read
+    const char *base = (const char *)data;
+    header = (const MappedHeader *)base;
+    bool valid = memcmp(header->magic, MAPPED_MAGIC, sizeof(MAPPED_MAGIC)) == 0
+                 && header->version == VERSION && header->endian == MAPPED_ENDIAN
+                 && header->descriptorWords == 4 && header->fileSize == size
+                 && header->nNodes > 0 && header->nWords >= 0;
+    const uint64_t nNodes = valid ? (uint64_t)header->nNodes : 0;
+    const uint64_t nWords = valid ? (uint64_t)header->nWords : 0;
+    // Each array has to be aligned (we write them at multiples of 8) and inside the file
+    auto fits = [this](uint64_t off, uint64_t bytes) { return off % 8 == 0 && off <= size && bytes <= size - off; };
+    valid = valid && fits(header->offChildStart, sizeof(uint32_t)*(nNodes+1))
+            && fits(header->offChildren, sizeof(uint32_t)*(nNodes-1))
+            && fits(header->offDescriptors, sizeof(uint64_t)*4*nNodes)
+            && fits(header->offWeights, sizeof(double)*nNodes)
+            && fits(header->offParents, sizeof(int32_t)*nNodes)
+            && fits(header->offWordIds, sizeof(int32_t)*nNodes)
+            && fits(header->offWordNodes, sizeof(int32_t)*nWords);
+    if (!valid) {
+        close();
+        return false;
+    }
+
+    childStart = (const uint32_t *)(base + header->offChildStart);
+    children = (const uint32_t *)(base + header->offChildren);
+    descriptors = (const uint64_t *)(base + header->offDescriptors);
+    weights = (const double *)(base + header->offWeights);
+    parents = (const int32_t *)(base + header->offParents);
+    wordIds = (const int32_t *)(base + header->offWordIds);
+    wordNodes = (const int32_t *)(base + header->offWordNodes);
+    if (!validTree()) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool VINSLoop::MappedVocabulary::validTree() const {
+    // The children of each node are a range of the children array, and every node but the root is the child of its parent
+    const int32_t nNodes = header->nNodes, nWords = header->nWords;
+    if (childStart[0] != 0 || childStart[nNodes] != (uint32_t)(nNodes-1))
+        return false;
+    for (int32_t nid = 0; nid < nNodes; ++nid) {
+        if (childStart[nid] > childStart[nid+1])
+            return false;
+        if (nid > 0 && (parents[nid] < 0 || parents[nid] >= nNodes))
+            return false;
+        if (wordIds[nid] < 0 || wordIds[nid] >= std::max(nWords, 1))
+            return false;
+        for (const uint32_t *cit = childrenBegin(nid); cit != childrenEnd(nid); ++cit) {
+            if (*cit == 0 || *cit >= (uint32_t)nNodes || parents[*cit] != nid)
+                return false;
+        }
+    }
+    // Every word is a leaf that knows its word id
+    for (int32_t wid = 0; wid < nWords; ++wid) {
+        if (wordNodes[wid] <= 0 || wordNodes[wid] >= nNodes || !isLeaf(wordNodes[wid]) || wordIds[wordNodes[wid]] != wid)
+            return false;
+    }
+    return true;
+}
+
+bool VINSLoop::MappedVocabulary::convert(const string& binFilename, const string& mapFilename) {
+
+    // Read the binary vocabulary
+    ifstream inStream(binFilename, ios::binary);
+    if (!inStream.is_open())
+        return false;
+    Vocabulary voc;
+    voc.deserialize(inStream);
+    if (!inStream.good() || voc.nNodes <= 0 || voc.nWords <= 0)
+        return false;
+    inStream.close();
+
+    // Build the children of each node in the same order loading the binary vocabulary does (root is node 0)
+    const int32_t nNodes = voc.nNodes + 1;
+    vector<uint32_t> childStart((size_t)nNodes+1, 0);
+    for (int32_t i = 0; i < voc.nNodes; ++i) {
+        if (voc.nodes[i].nodeId <= 0 || voc.nodes[i].nodeId >= nNodes || voc.nodes[i].parentId < 0 || voc.nodes[i].parentId >= nNodes)
+            return false;
+        childStart[(size_t)voc.nodes[i].parentId+1]++;
+    }
+    for (size_t i = 1; i < childStart.size(); ++i)
+        childStart[i] += childStart[i-1];
+    vector<uint32_t> fill(childStart.begin(), childStart.end()-1);
+    vector<uint32_t> children((size_t)voc.nNodes);
+    vector<uint64_t> descriptors(4*(size_t)nNodes, 0);
+    vector<double> weights((size_t)nNodes, 0);
+    vector<int32_t> parents((size_t)nNodes, 0);
+    vector<int32_t> wordIds((size_t)nNodes, 0);
+    vector<int32_t> wordNodes((size_t)voc.nWords, 0);
+    for (int32_t i = 0; i < voc.nNodes; ++i) {
+        const Node &node = voc.nodes[i];
+        children[fill[(size_t)node.parentId]++] = (uint32_t)node.nodeId;
+        memcpy(&descriptors[4*(size_t)node.nodeId], node.descriptor, sizeof(node.descriptor));
+        weights[(size_t)node.nodeId] = node.weight;
+        parents[(size_t)node.nodeId] = node.parentId;
+    }
+    for (int32_t i = 0; i < voc.nWords; ++i) {
+        if (voc.words[i].wordId < 0 || voc.words[i].wordId >= voc.nWords || voc.words[i].nodeId <= 0 || voc.words[i].nodeId >= nNodes)
+            return false;
+        wordIds[(size_t)voc.words[i].nodeId] = voc.words[i].wordId;
+        wordNodes[(size_t)voc.words[i].wordId] = voc.words[i].nodeId;
+    }
+
+    // Get where each array goes in the file
+    auto align = [](uint64_t off) { return (off+7) & ~(uint64_t)7; };
+    MappedHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAPPED_MAGIC, sizeof(MAPPED_MAGIC));
+    header.version = VERSION;
+    header.endian = MAPPED_ENDIAN;
+    header.k = voc.k;
+    header.L = voc.L;
+    header.scoringType = voc.scoringType;
+    header.weightingType = voc.weightingType;
+    header.nNodes = nNodes;
+    header.nWords = voc.nWords;
+    header.descriptorWords = 4;
+    header.offChildStart = align(sizeof(MappedHeader));
+    header.offChildren = align(header.offChildStart + sizeof(uint32_t)*childStart.size());
+    header.offDescriptors = align(header.offChildren + sizeof(uint32_t)*children.size());
+    header.offWeights = align(header.offDescriptors + sizeof(uint64_t)*descriptors.size());
+    header.offParents = align(header.offWeights + sizeof(double)*weights.size());
+    header.offWordIds = align(header.offParents + sizeof(int32_t)*parents.size());
+    header.offWordNodes = align(header.offWordIds + sizeof(int32_t)*wordIds.size());
+    header.fileSize = align(header.offWordNodes + sizeof(int32_t)*wordNodes.size());
+
+    // Write it to a temp file, and move it into place once it is complete (so no one can map a partial file)
+    const string tmpFilename = mapFilename + ".tmp";
+    ofstream outStream(tmpFilename, ios::binary | ios::trunc);
+    if (!outStream.is_open())
+        return false;
+    auto writeAt = [&outStream](uint64_t off, const void *ptr, size_t bytes) {
+        static const char zeros[8] = {0};
+        uint64_t pos = (uint64_t)outStream.tellp();
+        outStream.write(zeros, (streamsize)(off-pos));
+        outStream.write((const char *)ptr, (streamsize)bytes);
+    };
+    writeAt(0, &header, sizeof(header));
+    writeAt(header.offChildStart, childStart.data(), sizeof(uint32_t)*childStart.size());
+    writeAt(header.offChildren, children.data(), sizeof(uint32_t)*children.size());
+    writeAt(header.offDescriptors, descriptors.data(), sizeof(uint64_t)*descriptors.size());
+    writeAt(header.offWeights, weights.data(), sizeof(double)*weights.size());
+    writeAt(header.offParents, parents.data(), sizeof(int32_t)*parents.size());
+    writeAt(header.offWordIds, wordIds.data(), sizeof(int32_t)*wordIds.size());
+    writeAt(header.offWordNodes, wordNodes.data(), sizeof(int32_t)*wordNodes.size());
+    writeAt(header.fileSize, nullptr, 0);
+    outStream.close();
+    if (!outStream.good() || rename(tmpFilename.c_str(), mapFilename.c_str()) != 0) {
+        remove(tmpFilename.c_str());
+        return false;
+    }
+    return true;
+}
@@ -2,6 +2,7 @@
 #define VocabularyBinary_hpp
 
 #include <cstdint>
+#include <cstddef>
 #include <fstream>
 #include <string>
 
@@ -42,6 +43,109 @@ struct Vocabulary {
     }
 };
 
+/**
+ * Flat vocabulary that is memory-mapped read-only and used in place.
+ *
+ * Loading a Vocabulary still has to build the whole tree in memory, which takes seconds.
+ * This format already has the tree in the layout the transform needs (children of each node, its descriptor, weight and word),
+ * so it is just mapped and the pages are loaded by the OS as they are used, and shared between processes.
+ *
+ * Layout (native endian, each array 8 byte aligned):
+ * - MappedHeader
+ * - uint32_t childStart[nNodes+1]: children of node i are children[childStart[i]] to children[childStart[i+1]-1]
+ * - uint32_t children[nNodes-1]
+ * - uint64_t descriptors[nNodes*4]: 256 bit descriptor of each node
+ * - double weights[nNodes]
+ * - int32_t parents[nNodes]
+ * - int32_t wordIds[nNodes]: word id of each leaf node
+ * - int32_t wordNodes[nWords]: node id of each word
+ *
+ * Node 0 is the root, and all other node and word ids are the same as in the Vocabulary it was converted from.
+ */
+class MappedVocabulary {
+public:
+
+    /// Version of the format we write and can read, increase this if the layout is changed
+    static const uint32_t VERSION = 1;
+
+    MappedVocabulary() = default;
+    ~MappedVocabulary();
+    MappedVocabulary(const MappedVocabulary&) = delete;
+    MappedVocabulary& operator=(const MappedVocabulary&) = delete;
+
+    /**
+     * Maps a flat vocabulary file
+     * @param filename path of the flat vocabulary
+     * @return false if it does not exist, or is not a valid flat vocabulary of our version (including every index in its arrays)
+     */
+    bool open(const std::string &filename);
+
+    /**
+     * Converts a binary vocabulary (see Vocabulary::serialize()) into a flat vocabulary
+     * @param binFilename path of the binary vocabulary
+     * @param mapFilename path we should write the flat vocabulary to
+     * @return false if we could not read or write the files
+     */
+    static bool convert(const std::string &binFilename, const std::string &mapFilename);
+
+    inline int32_t k() const { return header->k; }
+    inline int32_t L() const { return header->L; }
+    inline int32_t scoringType() const { return header->scoringType; }
+    inline int32_t weightingType() const { return header->weightingType; }
+    inline int32_t nNodes() const { return header->nNodes; }
+    inline int32_t nWords() const { return header->nWords; }
+
+    inline const uint32_t* childrenBegin(int32_t nid) const { return children + childStart[nid]; }
+    inline const uint32_t* childrenEnd(int32_t nid) const { return children + childStart[nid+1]; }
+    inline bool isLeaf(int32_t nid) const { return childStart[nid] == childStart[nid+1]; }
+    inline const uint64_t* descriptor(int32_t nid) const { return descriptors + 4*(size_t)nid; }
+    inline double weight(int32_t nid) const { return weights[nid]; }
+    inline int32_t parent(int32_t nid) const { return parents[nid]; }
+    inline int32_t wordId(int32_t nid) const { return wordIds[nid]; }
+    inline int32_t wordNode(int32_t wid) const { return wordNodes[wid]; }
+
+    /// Hamming distance between two 256 bit descriptors
+    static inline int distance(const uint64_t *a, const uint64_t *b) {
+        return __builtin_popcountll(a[0]^b[0]) + __builtin_popcountll(a[1]^b[1])
+               + __builtin_popcountll(a[2]^b[2]) + __builtin_popcountll(a[3]^b[3]);
+    }
+
+private:
+
+    struct MappedHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t endian;
+        int32_t k;
+        int32_t L;
+        int32_t scoringType;
+        int32_t weightingType;
+        int32_t nNodes;
+        int32_t nWords;
+        uint32_t descriptorWords;
+        uint32_t reserved;
+        uint64_t offChildStart, offChildren, offDescriptors, offWeights, offParents, offWordIds, offWordNodes;
+        uint64_t fileSize;
+    };
+
+    void close();
+
+    /// Checks the tree we have mapped only points inside of itself (a corrupt file would otherwise send a lookup out of our arrays)
+    bool validTree() const;
+
+    void *data = nullptr;
+    size_t size = 0;
+
+    const MappedHeader *header = nullptr;
+    const uint32_t *childStart = nullptr;
+    const uint32_t *children = nullptr;
+    const uint64_t *descriptors = nullptr;
+    const double *weights = nullptr;
+    const int32_t *parents = nullptr;
+    const int32_t *wordIds = nullptr;
+    const int32_t *wordNodes = nullptr;
+};
+
 }
 
 #endif /* VocabularyBinary_hpp */
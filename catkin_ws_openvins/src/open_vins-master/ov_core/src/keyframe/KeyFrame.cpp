@@ -4,6 +4,10 @@
 
 #include "KeyFrame.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 using namespace ov_core;
 
 template <typename Derived>
@@ -16,11 +20,6 @@ static void reduceVector(vector<Derived> &v, vector<uchar> status)
     v.resize(j);
 }
 
-void
-BriefExtractor::operator()(const cv::Mat &im, vector <cv::KeyPoint> &keys, vector <BRIEF::bitset> &descriptors) const {
-    m_brief.compute(im, keys, descriptors);
-}
-
 BriefExtractor::BriefExtractor(const std::string &pattern_file) {
     // The DVision::BRIEF extractor computes a random pattern by default when
     // the object is created.
@@ -31,20 +30,279 @@ BriefExtractor::BriefExtractor(const std::string &pattern_file) {
     cv::FileStorage fs(pattern_file.c_str(), cv::FileStorage::READ);
     if (!fs.isOpened()) throw string("Could not open file ") + pattern_file;
 
-    vector<int> x1, y1, x2, y2;
-    fs["x1"] >> x1;
-    fs["x2"] >> x2;
-    fs["y1"] >> y1;
-    fs["y2"] >> y2;
+    fs["x1"] >> m_x1;
+    fs["x2"] >> m_x2;
+    fs["y1"] >> m_y1;
+    fs["y2"] >> m_y2;
+    if (m_x1.size() != 256 || m_y1.size() != 256 || m_x2.size() != 256 || m_y2.size() != 256)
+        throw string("BRIEF pattern does not have 256 tests ") + pattern_file;
+
+    m_max_offset = 0;
+    for (size_t i = 0; i < m_x1.size(); i++) {
+        m_max_offset = std::max(m_max_offset, std::max(std::abs(m_x1[i]), std::abs(m_y1[i])));
+        m_max_offset = std::max(m_max_offset, std::max(std::abs(m_x2[i]), std::abs(m_y2[i])));
+    }
+}
 
-    m_brief.importPairs(x1, y1, x2, y2);
+void BriefExtractor::operator()(const cv::Mat &im, const vector<cv::KeyPoint> &keys, vector<BriefDescriptor> &descriptors) const {
+    // Same smoothing as DVision::BRIEF, so our descriptors match the vocabulary
+    cv::Mat im_smooth;
+    cv::GaussianBlur(im, im_smooth, cv::Size(9, 9), 2, 2);
+    compute_smoothed(im_smooth, keys, descriptors);
+}
+
+void BriefExtractor::compute_smoothed(const cv::Mat &im, const vector<cv::KeyPoint> &keys, vector<BriefDescriptor> &descriptors) const {
+    assert(im.type() == CV_8UC1);
+
+    // Offset of each pixel of each test from the keypoint pixel
+    const int step = (int) im.step[0];
+    int offsets1[256], offsets2[256];
+    for (int i = 0; i < 256; i++) {
+        offsets1[i] = m_y1[i] * step + m_x1[i];
+        offsets2[i] = m_y2[i] * step + m_x2[i];
+    }
+
+    descriptors.resize(keys.size());
+    const int W = im.cols, H = im.rows;
+    for (size_t k = 0; k < keys.size(); k++) {
+        const cv::Point2f &pt = keys[k].pt;
+        BriefDescriptor &desc = descriptors[k];
+        const int x = (int) pt.x, y = (int) pt.y;
+        if (pt.x >= 0 && pt.y >= 0 && x - m_max_offset >= 0 && y - m_max_offset >= 0 && x + m_max_offset < W && y + m_max_offset < H) {
+            // The whole patch is inside the image, so we do not need to check each test
+            const uchar *center = im.ptr<uchar>(y) + x;
+#if defined(__SSE2__)
+            // Gather the two pixels of every test, then compare sixteen tests at a time
+            // SSE2 only has a signed byte compare, so we flip the sign bit of both sides first
+            alignas(16) uchar pixels1[256], pixels2[256];
+            for (int i = 0; i < 256; i++) {
+                pixels1[i] = center[offsets1[i]];
+                pixels2[i] = center[offsets2[i]];
+            }
+            const __m128i sign = _mm_set1_epi8((char) 0x80);
+            for (int w = 0; w < 4; w++) {
+                uint64_t word = 0;
+                for (int j = 0; j < 4; j++) {
+                    const __m128i a = _mm_xor_si128(_mm_load_si128((const __m128i *) (pixels1 + 64 * w + 16 * j)), sign);
+                    const __m128i b = _mm_xor_si128(_mm_load_si128((const __m128i *) (pixels2 + 64 * w + 16 * j)), sign);
+                    word |= (uint64_t) (uint32_t) _mm_movemask_epi8(_mm_cmplt_epi8(a, b)) << (16 * j);
+                }
+                desc.bits[w] = word;
+            }
+#else
+            for (int w = 0; w < 4; w++) {
+                const int *o1 = offsets1 + 64 * w;
+                const int *o2 = offsets2 + 64 * w;
+                uint64_t word = 0;
+                for (int b = 0; b < 64; b++)
+                    word |= (uint64_t)(center[o1[b]] < center[o2[b]]) << b;
+                desc.bits[w] = word;
+            }
+#endif
+        } else {
+            // Tests outside of the image are zero
+            desc.bits[0] = desc.bits[1] = desc.bits[2] = desc.bits[3] = 0;
+            for (int i = 0; i < 256; i++) {
+                const int x1 = (int)(pt.x + m_x1[i]), y1 = (int)(pt.y + m_y1[i]);
+                const int x2 = (int)(pt.x + m_x2[i]), y2 = (int)(pt.y + m_y2[i]);
+                if (x1 >= 0 && x1 < W && y1 >= 0 && y1 < H && x2 >= 0 && x2 < W && y2 >= 0 && y2 < H
+                    && im.ptr<uchar>(y1)[x1] < im.ptr<uchar>(y2)[x2])
+                    desc.bits[i / 64] |= (uint64_t)1 << (i % 64);
+            }
+        }
+    }
+}
+
+void BriefExtractor::to_bitsets(const vector<BriefDescriptor> &descriptors, vector<BRIEF::bitset> &bitsets) {
+    bitsets.clear();
+    bitsets.reserve(descriptors.size());
+    for (const BriefDescriptor &desc : descriptors)
+        bitsets.emplace_back(desc.bits, desc.bits + 4);
 }
 
 KeyFrame::KeyFrame(double _timestamp, cv::Mat _img, size_t _cam_id, TrackBase *_trackBase, std::size_t _frame_id) :
-        timestamp(_timestamp), image(_img), cam_id(_cam_id), trackFEATS(_trackBase), frame_id(_frame_id) {
+        timestamp(_timestamp), image(_img), image_size(_img.size()), cam_id(_cam_id), trackFEATS(_trackBase), frame_id(_frame_id) {
     keyframe_id = -1;
 }
 
+void KeyFrame::reset(double _timestamp, cv::Mat _img, size_t _cam_id, TrackBase *_trackBase, std::size_t _frame_id) {
+    timestamp = _timestamp;
+    image = _img;
+    image_size = _img.size();
+    image_jpeg.clear();
+    cam_id = _cam_id;
+    trackFEATS = _trackBase;
+    frame_id = _frame_id;
+    keyframe_id = -1;
+    has_pose = false;
+    track_ids.clear();
+    track_descriptors.clear();
+    point_3d.clear();
+    point_3d_valid.clear();
+    point_2d_uv.clear();
+    point_2d_norm.clear();
+    keypoints.clear();
+    brief_descriptors.clear();
+    extraction_time = 0;
+}
+
+void KeyFrame::compact_image(double scale, int jpeg_quality) {
+    if (image.empty())
+        return;
+    image_size = image.size();
+    if (scale <= 0) {
+        image.release();
+        return;
+    }
+    // Downsize into our own buffer, so we do not hold onto the shared frame
+    cv::Mat small;
+    if (scale < 1)
+        cv::resize(image, small, cv::Size(), scale, scale, cv::INTER_AREA);
+    else
+        small = image.clone();
+    if (jpeg_quality > 0) {
+        cv::imencode(".jpg", small, image_jpeg, {cv::IMWRITE_JPEG_QUALITY, jpeg_quality});
+        image_jpeg.shrink_to_fit();
+        image.release();
+    } else {
+        image = small;
+    }
+}
+
+cv::Mat KeyFrame::get_image() const {
+    cv::Mat img = image;
+    if (img.empty() && !image_jpeg.empty())
+        img = cv::imdecode(image_jpeg, cv::IMREAD_UNCHANGED);
+    if (img.empty())
+        return cv::Mat::zeros(image_size, CV_8UC1);
+    if (img.size() != image_size)
+        cv::resize(img, img, image_size, 0, 0, cv::INTER_LINEAR);
+    return img;
+}
+
+size_t KeyFrame::memory_bytes() const {
+    size_t bytes = sizeof(KeyFrame);
+    bytes += brief_descriptors.capacity() * sizeof(BriefDescriptor);
+    bytes += keypoints.capacity() * sizeof(cv::KeyPoint);
+    bytes += (point_2d_uv.capacity() + point_2d_norm.capacity()) * sizeof(cv::Point2f);
+    bytes += point_3d.capacity() * sizeof(cv::Point3f) + point_3d_valid.capacity();
+    bytes += track_ids.capacity() * sizeof(size_t) + track_descriptors.capacity() * sizeof(BriefDescriptor);
+    bytes += image_jpeg.capacity();
+    if (!image.empty())
+        bytes += image.total() * image.elemSize();
+    return bytes;
+}
+
+void KeyFrame::serialize(std::ostream &out) const {
+    write_pod(out, (uint64_t) keyframe_id);
+    write_pod(out, (uint64_t) frame_id);
+    write_pod(out, (uint64_t) cam_id);
+    write_pod(out, timestamp);
+    write_pod(out, (uint8_t) has_pose);
+    write_pod(out, position);
+    write_pod(out, R_GtoC);
+    write_pod(out, R_ItoC);
+    write_pod(out, p_IinC);
+    write_vector(out, point_2d_uv);
+    write_vector(out, point_2d_norm);
+    write_vector(out, brief_descriptors);
+    std::vector<uint64_t> ids(track_ids.begin(), track_ids.end());
+    write_vector(out, ids);
+    write_vector(out, track_descriptors);
+    write_vector(out, point_3d);
+    write_vector(out, point_3d_valid);
+    write_pod(out, (int32_t) image_size.width);
+    write_pod(out, (int32_t) image_size.height);
+    std::vector<uchar> jpeg = image_jpeg;
+    if (jpeg.empty() && !image.empty())
+        cv::imencode(".jpg", image, jpeg);
+    write_vector(out, jpeg);
+}
+
+bool KeyFrame::deserialize(std::istream &in) {
+    uint64_t id, fid, cid;
+    uint8_t pose;
+    int32_t width, height;
+    std::vector<uint64_t> ids;
+    if (!read_pod(in, id) || !read_pod(in, fid) || !read_pod(in, cid) || !read_pod(in, timestamp) || !read_pod(in, pose)
+        || !read_pod(in, position) || !read_pod(in, R_GtoC) || !read_pod(in, R_ItoC) || !read_pod(in, p_IinC)
+        || !read_vector(in, point_2d_uv) || !read_vector(in, point_2d_norm) || !read_vector(in, brief_descriptors)
+        || !read_vector(in, ids) || !read_vector(in, track_descriptors) || !read_vector(in, point_3d)
+        || !read_vector(in, point_3d_valid) || !read_pod(in, width) || !read_pod(in, height) || !read_vector(in, image_jpeg))
+        return false;
+    if (point_2d_uv.size() != brief_descriptors.size() || point_2d_norm.size() != brief_descriptors.size()
+        || ids.size() != track_descriptors.size() || point_3d.size() != ids.size() || point_3d_valid.size() != ids.size())
+        return false;
+    keyframe_id = (size_t) id;
+    frame_id = (size_t) fid;
+    cam_id = (size_t) cid;
+    has_pose = (pose != 0);
+    track_ids.assign(ids.begin(), ids.end());
+    image_size = cv::Size(width, height);
+    image.release();
+    keypoints.clear();
+    for (const cv::Point2f &pt : point_2d_uv)
+        keypoints.emplace_back(pt, 1.f);
+    return true;
+}
+
+void ov_core::write_map_header(std::ostream &out, uint32_t voc_size, uint64_t num_keyframes) {
+    const char magic[8] = {'O', 'V', 'M', 'A', 'P', 0, 0, 0};
+    out.write(magic, sizeof(magic));
+    write_pod(out, (uint32_t) 1);
+    write_pod(out, voc_size);
+    write_pod(out, num_keyframes);
+}
+
+void ov_core::write_map_keyframe(std::ostream &out, const KeyFrame &keyframe, const DBoW2::BowVector &bow) {
+    keyframe.serialize(out);
+    write_pod(out, (uint64_t) bow.size());
+    for (const auto &word : bow) {
+        write_pod(out, (uint32_t) word.first);
+        write_pod(out, (double) word.second);
+    }
+}
+
+void ov_core::write_map_landmarks(std::ostream &out, const std::vector<Eigen::Vector3d> &landmarks) {
+    write_vector(out, landmarks);
+}
+
+bool ov_core::read_map(std::istream &in, uint32_t &voc_size, std::vector<KeyFrame> &keyframes,
+                       std::vector<DBoW2::BowVector> &bows, std::vector<Eigen::Vector3d> &landmarks) {
+    keyframes.clear();
+    bows.clear();
+    landmarks.clear();
+    char magic[8];
+    uint32_t version;
+    uint64_t num_keyframes;
+    if (!in.read(magic, sizeof(magic)) || std::string(magic, 5) != "OVMAP" || !read_pod(in, version) || version != 1
+        || !read_pod(in, voc_size) || !read_pod(in, num_keyframes))
+        return false;
+
+    // The count is not trusted to reserve with, a corrupt one just runs out of file
+    for (uint64_t k = 0; k < num_keyframes; k++) {
+        keyframes.emplace_back(0, cv::Mat(), 0, nullptr, 0);
+        bows.emplace_back();
+        uint64_t bow_size;
+        if (!keyframes.back().deserialize(in) || !read_pod(in, bow_size))
+            return false;
+        const int64_t remaining = remaining_bytes(in);
+        if (remaining >= 0 && bow_size > (uint64_t) remaining / (sizeof(uint32_t) + sizeof(double)))
+            return false;
+        DBoW2::BowVector &bow = bows.back();
+        for (uint64_t i = 0; i < bow_size; i++) {
+            uint32_t word;
+            double weight;
+            if (!read_pod(in, word) || !read_pod(in, weight))
+                return false;
+            bow.insert(bow.end(), std::make_pair((DBoW2::WordId) word, (DBoW2::WordValue) weight));
+        }
+    }
+
+    // Nothing should be left after the landmarks
+    return read_vector(in, landmarks) && in.peek() == std::char_traits<char>::eof();
+}
+
 void KeyFrame::set_keyframe_id(std::size_t id) {
     keyframe_id = id;
 }
@@ -64,74 +322,147 @@ std::size_t KeyFrame::get_keyframe_id() {
 //    extractor(image, window_keypoints, window_brief_descriptors);
 //}
 
-void KeyFrame::computeBRIEFPoint() {
-    string BRIEF_PATTERN_FILE = "/home/SENSETIME/yuanjin/Workspace/catkin_ws_openvins/src/open_vins-master/ov_core/src/ThirdParty/brief_pattern.yml";
-    BriefExtractor extractor(BRIEF_PATTERN_FILE);
+void KeyFrame::computeBRIEFPoint(const BriefExtractor &extractor, const std::shared_ptr<FrameContext> &frame) {
+    boost::posix_time::ptime rT1 = boost::posix_time::microsec_clock::local_time();
     const int fast_th = 20; // corner detector response threshold
-    cv::FAST(image, keypoints, fast_th, true);
+    if(frame != nullptr) {
+        FramePool::get_corners(frame, fast_th, keypoints);          // 直接使用当前帧共享的角点，不需要重新检测
+    } else {
+        cv::FAST(image, keypoints, fast_th, true);
+    }
 
     extractor(image, keypoints, brief_descriptors);
     for (int i = 0; i < (int) keypoints.size(); i++) {
-        Eigen::Vector3d tmp_p;
         point_2d_uv.push_back(keypoints[i].pt);
-        point_2d_norm.push_back(trackFEATS->undistort_point(keypoints[i].pt, cam_id));
     }
+    trackFEATS->undistort_points(point_2d_uv, point_2d_norm, cam_id);
+    boost::posix_time::ptime rT2 = boost::posix_time::microsec_clock::local_time();
+    extraction_time = (rT2 - rT1).total_microseconds() * 1e-6;
 }
 
 
-int KeyFrame::HammingDis(const BRIEF::bitset &a, const BRIEF::bitset &b) {
-    BRIEF::bitset xor_of_bitset = a ^b;
-    int dis = xor_of_bitset.count();
-    return dis;
-}
+/// Hamming distance with the POPCNT instruction (only inlined into functions compiled for it)
+struct HammingPopcnt {
+    static inline int dist(const BriefDescriptor &a, const BriefDescriptor &b) {
+        return __builtin_popcountll(a.bits[0] ^ b.bits[0]) + __builtin_popcountll(a.bits[1] ^ b.bits[1])
+               + __builtin_popcountll(a.bits[2] ^ b.bits[2]) + __builtin_popcountll(a.bits[3] ^ b.bits[3]);
+    }
+};
+
+/// Hamming distance that works on any CPU
+struct HammingPortable {
+    static inline int dist(const BriefDescriptor &a, const BriefDescriptor &b) {
+        return KeyFrame::HammingDis(a, b);
+    }
+};
 
-// 将window_descriptor和descriptors_old里面所有的描述符进行逐个匹配，查找最佳的匹配
-bool KeyFrame::searchInAera(const BRIEF::bitset window_descriptor,
-                            const std::vector<BRIEF::bitset> &descriptors_old,
-                            const std::vector<cv::Point2f> &point_2d_uv_old,        // 已知数组
-                            const std::vector<cv::Point2f> &point_2d_uv_norm_old,   // 已知数组
-                            cv::Point2f &best_match,                                // 存放回环帧中的图像点
-                            cv::Point2f &best_match_norm) {                         // 存放回环帧中归一化平面的点
-    cv::Point2f best_pt;
-    int bestDist = 128;
-    int bestIndex = -1;
-    for (int i = 0; i < (int) descriptors_old.size(); i++) {
+/// Blocked nearest neighbour search of match_descriptors(), inlined into a version for each distance
+template<typename Hamming>
+static inline __attribute__((always_inline))
+void match_blocks(const std::vector<BriefDescriptor> &query, const std::vector<BriefDescriptor> &train,
+                  std::vector<int> &best_index, std::vector<int> &best_dist,
+                  const std::vector<cv::Point2f> *query_pred, const std::vector<cv::Point2f> *train_pts, float radius) {
+    const int num_query = (int) query.size(), num_train = (int) train.size();
+    const bool use_prior = (query_pred != nullptr && train_pts != nullptr && radius > 0);
+    const float radius_sq = radius * radius;
 
-        int dis = HammingDis(window_descriptor, descriptors_old[i]);
-        if (dis < bestDist) {
-            bestDist = dis;
-            bestIndex = i;
+    // A block of 128 train descriptors is 4KB, so it stays in L1 while we go through a block of queries
+    const int block_query = 32, block_train = 128;
+    for (int q0 = 0; q0 < num_query; q0 += block_query) {
+        const int q1 = std::min(num_query, q0 + block_query);
+        for (int t0 = 0; t0 < num_train; t0 += block_train) {
+            const int t1 = std::min(num_train, t0 + block_train);
+            for (int q = q0; q < q1; q++) {
+                const BriefDescriptor &desc = query[q];
+                int index = best_index[q], dist = best_dist[q];
+                if (use_prior) {
+                    const cv::Point2f &pt = (*query_pred)[q];
+                    for (int t = t0; t < t1; t++) {
+                        const cv::Point2f diff = (*train_pts)[t] - pt;
+                        if (diff.x * diff.x + diff.y * diff.y > radius_sq)
+                            continue;
+                        const int d = Hamming::dist(desc, train[t]);
+                        if (d < dist) {
+                            dist = d;
+                            index = t;
+                        }
+                    }
+                } else {
+                    for (int t = t0; t < t1; t++) {
+                        const int d = Hamming::dist(desc, train[t]);
+                        if (d < dist) {
+                            dist = d;
+                            index = t;
+                        }
+                    }
+                }
+                best_index[q] = index;
+                best_dist[q] = dist;
+            }
         }
     }
-    //printf("best dist %d", bestDist);
-    if (bestIndex != -1 && bestDist < MIN_HAMMING_DIST) {
-        best_match = point_2d_uv_old[bestIndex];
-        best_match_norm = point_2d_uv_norm_old[bestIndex];
-        return true;
-    } else
-        return false;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/// Blocked search compiled for POPCNT, only called if the CPU has it
+__attribute__((target("popcnt")))
+static void match_blocks_popcnt(const std::vector<BriefDescriptor> &query, const std::vector<BriefDescriptor> &train,
+                                std::vector<int> &best_index, std::vector<int> &best_dist,
+                                const std::vector<cv::Point2f> *query_pred, const std::vector<cv::Point2f> *train_pts, float radius) {
+    match_blocks<HammingPopcnt>(query, train, best_index, best_dist, query_pred, train_pts, radius);
+}
+#endif
+
+void KeyFrame::match_descriptors(const std::vector<BriefDescriptor> &query, const std::vector<BriefDescriptor> &train,
+                                 std::vector<int> &best_index, std::vector<int> &best_dist,
+                                 const std::vector<cv::Point2f> *query_pred, const std::vector<cv::Point2f> *train_pts, float radius) {
+    best_index.assign(query.size(), -1);
+    best_dist.assign(query.size(), INT32_MAX);
+    assert(query_pred == nullptr || train_pts == nullptr || radius <= 0
+           || (query_pred->size() == query.size() && train_pts->size() == train.size()));
+
+    // Use the hardware popcount if the CPU has it (we only check once)
+#if defined(__x86_64__) || defined(__i386__)
+    static const bool has_popcnt = [] {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("popcnt") != 0;
+    }();
+    if (has_popcnt) {
+        match_blocks_popcnt(query, train, best_index, best_dist, query_pred, train_pts, radius);
+        return;
+    }
+#endif
+    match_blocks<HammingPortable>(query, train, best_index, best_dist, query_pred, train_pts, radius);
 }
 
 void KeyFrame::searchByBRIEFDes(std::vector<cv::Point2f> &matched_2d_old,                 // 存放环环帧中与当前帧匹配的图像点
                                 std::vector<cv::Point2f> &matched_2d_old_norm,            // 存放回环帧中与当前帧匹配的归一化点
                                 std::vector<uchar> &status,                               // 是否成功匹配的flag
-                                const std::vector<BRIEF::bitset> &descriptors_old,        //  已知
+                                const std::vector<BriefDescriptor> &descriptors_old,      //  已知
                                 const std::vector<cv::Point2f> &point_2d_uv_old,          //
-                                const std::vector<cv::Point2f> &point_2d_norm_old){       //
+                                const std::vector<cv::Point2f> &point_2d_norm_old,        //
+                                const std::vector<cv::Point2f> *predicted_norm_old,       // 预测的在回环帧中的归一化坐标(可选)
+                                float radius_norm){                                       // 归一化平面上的搜索半径
+    // 一次性计算所有描述子之间的最近邻 (same result as a brute force search for each of our descriptors)
+    std::vector<int> best_index, best_dist;
+    match_descriptors(brief_descriptors, descriptors_old, best_index, best_dist, predicted_norm_old, &point_2d_norm_old, radius_norm);
     for (int i = 0; i < (int) brief_descriptors.size(); i++) {
         cv::Point2f pt(0.f, 0.f);
         cv::Point2f pt_norm(0.f, 0.f);
-        if (searchInAera(brief_descriptors[i], descriptors_old, point_2d_uv_old, point_2d_norm_old, pt, pt_norm))
+        if (best_index[i] != -1 && best_dist[i] < MIN_HAMMING_DIST) {
+            pt = point_2d_uv_old[best_index[i]];
+            pt_norm = point_2d_norm_old[best_index[i]];
             status.push_back(1);
-        else
+        } else {
             status.push_back(0);
+        }
         matched_2d_old.push_back(pt);
         matched_2d_old_norm.push_back(pt_norm);
     }
 }
 
 bool KeyFrame::findConnection(ov_core::KeyFrame *old_kf,std::vector<cv::Point2f> &matched_2d_old,
-                              std::vector<cv::Point2f> &matched_2d_cur) {
+                              std::vector<cv::Point2f> &matched_2d_cur, double search_radius) {
     //vector <cv::Point2f> matched_2d_cur, matched_2d_old;
     vector <cv::Point2f> matched_2d_cur_norm, matched_2d_old_norm;
     vector <cv::Point3f> matched_3d;
@@ -143,8 +474,26 @@ bool KeyFrame::findConnection(ov_core::KeyFrame *old_kf,std::vector<cv::Point2f>
     matched_2d_cur_norm = point_2d_norm;
 //    matched_id = point_id;
 
+    // If we have both poses, predict where each of our points is in the old image from the relative rotation (ignoring the translation)
+    std::map<size_t, cv::Matx33d> camera_k_OPENCV = trackFEATS->get_camera_k_OPENCV();
+    std::vector<cv::Point2f> predicted_norm_old;
+    float radius_norm = -1;
+    if (search_radius > 0 && has_pose && old_kf->has_pose) {
+        const Eigen::Matrix3d R_CtoCold = old_kf->R_GtoC * R_GtoC.transpose();
+        const double focal_old = std::max(camera_k_OPENCV.at(old_kf->cam_id)(0,0), camera_k_OPENCV.at(old_kf->cam_id)(1,1));
+        radius_norm = (float) (search_radius / focal_old);
+        predicted_norm_old.reserve(point_2d_norm.size());
+        for (const cv::Point2f &pt : point_2d_norm) {
+            Eigen::Vector3d b_old = R_CtoCold * Eigen::Vector3d(pt.x, pt.y, 1);
+            // Points behind the old camera are put far away, so they will not have any candidates
+            if (b_old(2) <= 1e-3)
+                predicted_norm_old.emplace_back(1e6f, 1e6f);
+            else
+                predicted_norm_old.emplace_back((float) (b_old(0) / b_old(2)), (float) (b_old(1) / b_old(2)));
+        }
+    }
     searchByBRIEFDes(matched_2d_old, matched_2d_old_norm, status, old_kf->brief_descriptors, old_kf->point_2d_uv,
-                     old_kf->point_2d_norm);
+                     old_kf->point_2d_norm, (radius_norm > 0) ? &predicted_norm_old : nullptr, radius_norm);
     reduceVector(matched_2d_cur, status);
     reduceVector(matched_2d_old, status);
     reduceVector(matched_2d_cur_norm, status);
@@ -160,7 +509,6 @@ bool KeyFrame::findConnection(ov_core::KeyFrame *old_kf,std::vector<cv::Point2f>
 
         status.clear();
         // Do RANSAC outlier rejection (note since we normalized the max pixel error is now in the normalized cords)
-        std::map<size_t, cv::Matx33d> camera_k_OPENCV = trackFEATS->get_camera_k_OPENCV();
         double max_focallength_img0 = std::max(camera_k_OPENCV.at(old_kf->cam_id)(0,0),camera_k_OPENCV.at(old_kf->cam_id)(1,1));
         double max_focallength_img1 = std::max(camera_k_OPENCV.at(cam_id)(0,0),camera_k_OPENCV.at(cam_id)(1,1));
         double max_focallength = std::max(max_focallength_img0,max_focallength_img1);
@@ -174,4 +522,67 @@ bool KeyFrame::findConnection(ov_core::KeyFrame *old_kf,std::vector<cv::Point2f>
             return true;
         } else return false;
     } else return false;
-}
\ No newline at end of file
+}
+
+void KeyFrame::computeTrackBRIEF(const BriefExtractor &extractor, const std::vector<cv::Point2f> &track_pts, const std::vector<size_t> &track_ids) {
+    assert(track_pts.size() == track_ids.size());
+    std::vector<cv::KeyPoint> track_keypoints;
+    track_keypoints.reserve(track_pts.size());
+    for (const cv::Point2f &pt : track_pts)
+        track_keypoints.emplace_back(pt, 1.f);
+    extractor(image, track_keypoints, track_descriptors);
+    this->track_ids = track_ids;
+    point_3d.assign(track_ids.size(), cv::Point3f(0, 0, 0));
+    point_3d_valid.assign(track_ids.size(), 0);
+}
+
+bool KeyFrame::findLoopPose(const KeyFrame *old_kf, Eigen::Matrix3d &R_GtoI_loop, Eigen::Vector3d &p_IinG_loop, int &num_inliers) {
+    num_inliers = 0;
+
+    // Only the old tracks that have been triangulated can be used
+    std::vector<BriefDescriptor> descriptors_old;
+    std::vector<cv::Point3f> points_old;
+    for (size_t i = 0; i < old_kf->track_descriptors.size(); i++) {
+        if (!old_kf->point_3d_valid.at(i))
+            continue;
+        descriptors_old.push_back(old_kf->track_descriptors.at(i));
+        points_old.push_back(old_kf->point_3d.at(i));
+    }
+    if ((int) points_old.size() < MIN_PNP_NUM)
+        return false;
+
+    // 旧关键帧的3D点和当前帧的BRIEF点匹配
+    std::vector<int> best_index, best_dist;
+    match_descriptors(descriptors_old, brief_descriptors, best_index, best_dist);
+    std::vector<cv::Point3f> matched_3d;
+    std::vector<cv::Point2f> matched_2d_norm;
+    for (size_t i = 0; i < points_old.size(); i++) {
+        if (best_index[i] == -1 || best_dist[i] >= MIN_HAMMING_DIST)
+            continue;
+        matched_3d.push_back(points_old.at(i));
+        matched_2d_norm.push_back(point_2d_norm.at((size_t) best_index[i]));
+    }
+    if ((int) matched_3d.size() < MIN_PNP_NUM)
+        return false;
+
+    // PnP RANSAC on the normalized points (so the max pixel error is in the normalized cords)
+    std::map<size_t, cv::Matx33d> camera_k_OPENCV = trackFEATS->get_camera_k_OPENCV();
+    const double focal = std::max(camera_k_OPENCV.at(cam_id)(0,0), camera_k_OPENCV.at(cam_id)(1,1));
+    cv::Mat K = cv::Mat::eye(3, 3, CV_64F), D, rvec, tvec, inliers;
+    if (!cv::solvePnPRansac(matched_3d, matched_2d_norm, K, D, rvec, tvec, false, 100, (float) (10.0 / focal), 0.99, inliers))
+        return false;
+    num_inliers = inliers.rows;
+    if (num_inliers < MIN_PNP_NUM)
+        return false;
+
+    // The PnP gives the old landmark frame in our camera, so convert it to our IMU pose in that frame
+    cv::Mat R_cv;
+    cv::Rodrigues(rvec, R_cv);
+    Eigen::Matrix3d R_GtoC_loop;
+    Eigen::Vector3d p_GinC_loop;
+    cv::cv2eigen(R_cv, R_GtoC_loop);
+    cv::cv2eigen(tvec, p_GinC_loop);
+    R_GtoI_loop = R_ItoC.transpose() * R_GtoC_loop;
+    p_IinG_loop = R_GtoC_loop.transpose() * (p_IinC - p_GinC_loop);
+    return true;
+}
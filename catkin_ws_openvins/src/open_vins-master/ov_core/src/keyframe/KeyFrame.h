@@ -14,6 +14,7 @@
 #include "ThirdParty/DBoW/DBoW2.h"
 #include "ThirdParty/DVision/DVision.h"
 #define MIN_LOOP_NUM 25
+#define MIN_PNP_NUM 15
 #define MIN_HAMMING_DIST 30
 
 // #define MIN_HAMMING_DIST 80
@@ -25,42 +26,198 @@ namespace ov_core{
 
     class TrackBase;
 
+    // 二进制读写, 只用于POD类型和它们的vector
+    template <typename T>
+    inline void write_pod(std::ostream &out, const T &value) {
+        out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    template <typename T>
+    inline bool read_pod(std::istream &in, T &value) {
+        return (bool) in.read(reinterpret_cast<char *>(&value), sizeof(T));
+    }
+
+    template <typename T>
+    inline void write_vector(std::ostream &out, const std::vector<T> &values) {
+        write_pod(out, (uint64_t) values.size());
+        if (!values.empty())
+            out.write(reinterpret_cast<const char *>(values.data()), (std::streamsize) (values.size() * sizeof(T)));
+    }
+
+    // 流中剩余的字节数 (不能seek的流返回-1)
+    inline int64_t remaining_bytes(std::istream &in) {
+        const std::streampos pos = in.tellg();
+        if (pos < 0)
+            return -1;
+        in.seekg(0, std::ios::end);
+        const std::streampos end = in.tellg();
+        in.seekg(pos);
+        return (end < pos) ? -1 : (int64_t) (end - pos);
+    }
+
+    template <typename T>
+    inline bool read_vector(std::istream &in, std::vector<T> &values) {
+        uint64_t size;
+        if (!read_pod(in, size))
+            return false;
+        // 损坏的长度在这里就失败, 不去分配比文件剩余还大的内存
+        const int64_t remaining = remaining_bytes(in);
+        if ((remaining >= 0 && size > (uint64_t) remaining / sizeof(T)) || size > (1ULL << 32))
+            return false;
+        values.resize((size_t) size);
+        return values.empty() || (bool) in.read(reinterpret_cast<char *>(values.data()), (std::streamsize) (size * sizeof(T)));
+    }
+
+    /// 256 bit BRIEF descriptor, bit i is bit i%64 of word i/64 (the same as the blocks of a BRIEF::bitset)
+    struct BriefDescriptor {
+        uint64_t bits[4];
+    };
+
+    /**
+     * @brief Extracts BRIEF descriptors with the test pattern the vocabulary was built with.
+     *
+     * The pattern file should only be loaded once (e.g. by the loop closer) and then shared by all keyframes.
+     * The pixel offsets of each test are computed once per image, so each bit is just two loads and a compare without any bounds checks.
+     * Only keypoints whose patch goes outside the image check each test (giving a zero bit like DVision::BRIEF).
+     */
     class BriefExtractor
     {
     public:
-        virtual void operator()(const cv::Mat &im, vector<cv::KeyPoint> &keys, vector<BRIEF::bitset> &descriptors) const;
+        /// Loads the test pattern (throws if it can not be read or does not have 256 tests)
         BriefExtractor(const std::string &pattern_file);
 
-        DVision::BRIEF m_brief;
+        /// Smooths the image and extracts the descriptor of each keypoint (same as DVision::BRIEF::compute())
+        void operator()(const cv::Mat &im, const vector<cv::KeyPoint> &keys, vector<BriefDescriptor> &descriptors) const;
+
+        /// Extracts the descriptor of each keypoint from an already smoothed image
+        void compute_smoothed(const cv::Mat &im_smooth, const vector<cv::KeyPoint> &keys, vector<BriefDescriptor> &descriptors) const;
+
+        /// Converts our descriptors to the bitsets the vocabulary and database use
+        static void to_bitsets(const vector<BriefDescriptor> &descriptors, vector<BRIEF::bitset> &bitsets);
+
+    protected:
+        /// Test pattern (offsets of the two pixels compared by each bit)
+        vector<int> m_x1, m_y1, m_x2, m_y2;
+
+        /// Largest offset of any test from the keypoint
+        int m_max_offset = 0;
     };
 
     class KeyFrame{
     public:
 
         KeyFrame(double _timestamp, cv::Mat _img, size_t _cam_id, TrackBase * _trackBase, std::size_t _frame_id);
+
+        /// Reuses this keyframe for a new frame, keeping the capacity of our vectors so we do not allocate again
+        void reset(double _timestamp, cv::Mat _img, size_t _cam_id, TrackBase * _trackBase, std::size_t _frame_id);
+
+        /**
+         * @brief Shrinks the image we keep once this is added to the database
+         * @param scale scale to downsize the image by (1 keeps the full image, 0 or less drops it)
+         * @param jpeg_quality JPEG quality to compress the image with (0 or less keeps it uncompressed)
+         */
+        void compact_image(double scale, int jpeg_quality);
+
+        /// Gets our image at its original size (decompressing or upscaling the compacted image if needed)
+        cv::Mat get_image() const;
+
+        /// Approximate number of bytes this keyframe holds
+        size_t memory_bytes() const;
+
+        /**
+         * @brief Writes everything needed to relocalize against this keyframe in a compact binary form
+         *
+         * This is the pose, extrinsics, BRIEF points and descriptors, the tracks with their landmarks, and the compacted image.
+         * The full size image is only written as JPEG if it was not already compressed.
+         */
+        void serialize(std::ostream &out) const;
+
+        /// Reads a keyframe written by serialize() into this one (returns false if the stream ended early)
+        bool deserialize(std::istream &in);
         void setPoint(vector<cv::Point2f> &_point_2d_uv);
         void set_keyframe_id(std::size_t id);
         std::size_t get_keyframe_id();
-        void computeBRIEFPoint();
+        void computeBRIEFPoint(const BriefExtractor &extractor, const std::shared_ptr<FrameContext> &frame = nullptr);
 
 //        void computeWindowBRIEFPoint();
 
-        int HammingDis(const BRIEF::bitset &a, const BRIEF::bitset &b);
+        /**
+         * @brief Number of set bits of a 64 bit word
+         *
+         * If we are not compiled for the POPCNT instruction, __builtin_popcountll becomes a call into a byte table lookup,
+         * so on x86 we then count with shifts and masks instead (match_descriptors() still uses POPCNT if the CPU has it).
+         */
+        static inline int popcount64(uint64_t x) {
+#if defined(__POPCNT__) || !(defined(__x86_64__) || defined(__i386__))
+            return __builtin_popcountll(x);
+#else
+            x = x - ((x >> 1) & 0x5555555555555555ULL);
+            x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+            x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+            return (int)((x * 0x0101010101010101ULL) >> 56);
+#endif
+        }
+
+        static inline int HammingDis(const BriefDescriptor &a, const BriefDescriptor &b) {
+            return popcount64(a.bits[0] ^ b.bits[0]) + popcount64(a.bits[1] ^ b.bits[1])
+                   + popcount64(a.bits[2] ^ b.bits[2]) + popcount64(a.bits[3] ^ b.bits[3]);
+        }
+
+        /**
+         * @brief Finds the nearest train descriptor of each query descriptor
+         * @param query descriptors we want to match
+         * @param train descriptors we match against
+         * @param best_index index of the nearest train descriptor of each query (-1 if none was a candidate)
+         * @param best_dist Hamming distance to it
+         * @param query_pred predicted location of each query in the train image (nullptr to compare against all)
+         * @param train_pts location of each train descriptor
+         * @param radius only train descriptors within this distance of the prediction are candidates
+         *
+         * The distances are computed in blocks, so a block of train descriptors stays in cache while a block of queries is compared against it.
+         * On x86 we check once if the CPU has POPCNT, and then use it even if we were not compiled with -mpopcnt.
+         * Ties go to the lowest train index, the same as a brute force search.
+         */
+        static void match_descriptors(const std::vector<BriefDescriptor> &query, const std::vector<BriefDescriptor> &train,
+                                      std::vector<int> &best_index, std::vector<int> &best_dist,
+                                      const std::vector<cv::Point2f> *query_pred = nullptr,
+                                      const std::vector<cv::Point2f> *train_pts = nullptr, float radius = -1);
+
+        /**
+         * @brief Matches our BRIEF points to an old keyframe and rejects outliers with a fundamental matrix RANSAC
+         * @param old_kf old keyframe
+         * @param matched_2d_old matched points in the old image
+         * @param matched_2d_cur matched points in our image
+         * @param search_radius if both keyframes have a pose, only match within this many pixels of where their relative rotation puts each point (-1 to match against all)
+         */
         bool findConnection(KeyFrame* old_kf,std::vector<cv::Point2f> &matched_2d_old,
-                            std::vector<cv::Point2f> &matched_2d_cur);
+                            std::vector<cv::Point2f> &matched_2d_cur, double search_radius = -1);
+        /**
+         * @brief Extracts BRIEF descriptors at our tracked features, so a later frame can find their landmarks with findLoopPose()
+         * @param extractor BRIEF extractor
+         * @param track_pts raw pixel location of each track in our image
+         * @param track_ids feature id of each track (the landmarks are set later, once they are triangulated)
+         */
+        void computeTrackBRIEF(const BriefExtractor &extractor, const std::vector<cv::Point2f> &track_pts, const std::vector<size_t> &track_ids);
+
+        /**
+         * @brief Finds our pose in the frame of an old keyframe's landmarks with a PnP RANSAC
+         * @param old_kf old keyframe (with its landmarks, see computeTrackBRIEF())
+         * @param R_GtoI_loop our IMU orientation in the frame the old landmarks are in
+         * @param p_IinG_loop our IMU position in the frame the old landmarks are in
+         * @param num_inliers number of PnP inliers
+         *
+         * The old landmarks were triangulated with the old VIO poses, so this pose does not have the drift since the old keyframe.
+         */
+        bool findLoopPose(const KeyFrame* old_kf, Eigen::Matrix3d &R_GtoI_loop, Eigen::Vector3d &p_IinG_loop, int &num_inliers);
+
         void searchByBRIEFDes(std::vector<cv::Point2f> &matched_2d_old,
                               std::vector<cv::Point2f> &matched_2d_old_norm,
                               std::vector<uchar> &status,
-                              const std::vector<BRIEF::bitset> &descriptors_old,
+                              const std::vector<BriefDescriptor> &descriptors_old,
                               const std::vector<cv::Point2f> &point_2d_uv_old,
-                              const std::vector<cv::Point2f> &point_2d_norm_old);
-
-        bool searchInAera(const BRIEF::bitset window_descriptor,
-                          const std::vector<BRIEF::bitset> &descriptors_old,
-                          const std::vector<cv::Point2f> &point_2d_uv_old,
-                          const std::vector<cv::Point2f> &point_2d_uv_norm_old,
-                          cv::Point2f &best_match,
-                          cv::Point2f &best_match_norm);
+                              const std::vector<cv::Point2f> &point_2d_norm_old,
+                              const std::vector<cv::Point2f> *predicted_norm_old = nullptr,
+                              float radius_norm = -1);
 
 //        int num_features;
 
@@ -69,20 +226,59 @@ namespace ov_core{
         std::size_t cam_id;
         double timestamp;
         cv::Mat image;
+        cv::Size image_size;                                                   // 原始图像大小
+        std::vector<uchar> image_jpeg;                                         // 压缩后的图像(如果压缩了)
+
+        Eigen::Vector3d position = Eigen::Vector3d::Zero();                    // 全局位置,用于空间上的淘汰
+        Eigen::Matrix3d R_GtoC = Eigen::Matrix3d::Identity();                  // 全局到相机的旋转,用于预测匹配的位置
+        Eigen::Matrix3d R_ItoC = Eigen::Matrix3d::Identity();                  // IMU到相机的外参,用于把PnP的相机位姿转到IMU
+        Eigen::Vector3d p_IinC = Eigen::Vector3d::Zero();
+        bool has_pose = false;
 
         std::size_t keyframe_id;                                                 // 加入database后才有id,默认为-1
         std::size_t frame_id;
 
-        vector<cv::Point3f> point_3d;
+        vector<size_t> track_ids;                                          // 跟踪的特征点id
+        vector<BriefDescriptor> track_descriptors;                         // 跟踪点的BRIEF描述子
+        vector<cv::Point3f> point_3d;                                      // 跟踪点三角化后的全局坐标
+        vector<uchar> point_3d_valid;                                      // 是否已经三角化
         vector<cv::Point2f> point_2d_uv;                                   // 图像平面原始坐标
         vector<cv::Point2f> point_2d_norm;                                 // 归一化平面坐标
 
 //        vector<double> point_id;
         vector<cv::KeyPoint> keypoints;
 //        vector<cv::KeyPoint> keypoints_norm;
-        vector<BRIEF::bitset> brief_descriptors;
+        vector<BriefDescriptor> brief_descriptors;
+
+        double extraction_time = 0;                                        // 计算BRIEF描述子的耗时(秒)
     };
 
+    /**
+     * @brief Writes the header of a map file, which is then followed by each keyframe and the landmarks
+     * @param out stream we write to
+     * @param voc_size size of the vocabulary the bow vectors were computed with
+     * @param num_keyframes number of keyframes that will follow
+     */
+    void write_map_header(std::ostream &out, uint32_t voc_size, uint64_t num_keyframes);
+
+    /// Writes a keyframe of a map file with its bow vector
+    void write_map_keyframe(std::ostream &out, const KeyFrame &keyframe, const DBoW2::BowVector &bow);
+
+    /// Writes the landmarks at the end of a map file
+    void write_map_landmarks(std::ostream &out, const std::vector<Eigen::Vector3d> &landmarks);
+
+    /**
+     * @brief Reads a whole map file written with the functions above
+     * @param in stream we read from
+     * @param voc_size size of the vocabulary the bow vectors were computed with
+     * @param keyframes keyframes of the map (without their image decoded, or a tracker)
+     * @param bows bow vector of each keyframe
+     * @param landmarks landmarks of the map
+     * @return False if this is not a map, or it is truncated or corrupt (then nothing that was read should be used)
+     */
+    bool read_map(std::istream &in, uint32_t &voc_size, std::vector<KeyFrame> &keyframes,
+                  std::vector<DBoW2::BowVector> &bows, std::vector<Eigen::Vector3d> &landmarks);
+
 
 }
 #endif //CATKIN_WS_OPENVINS_KEYFRAME_H
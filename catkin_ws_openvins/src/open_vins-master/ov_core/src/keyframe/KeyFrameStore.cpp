@@ -0,0 +1,83 @@
+#include "KeyFrameStore.h"
+
+#include <cmath>
+#include <cassert>
+#include <algorithm>
+#include <tuple>
+#include <map>
+
+using namespace ov_core;
+
+KeyFrame *KeyFrameStore::acquire(double timestamp, cv::Mat img, size_t cam_id, TrackBase *trackBase, std::size_t frame_id) {
+    if (scratch == nullptr)
+        scratch.reset(new KeyFrame(timestamp, img, cam_id, trackBase, frame_id));
+    else
+        scratch->reset(timestamp, img, cam_id, trackBase, frame_id);
+    return scratch.get();
+}
+
+void KeyFrameStore::add(KeyFrame *keyframe, std::vector<size_t> &evicted) {
+    assert(keyframe == scratch.get());
+    evicted.clear();
+
+    // Take ownership, the next frame will get a new keyframe
+    const size_t id = keyframe->keyframe_id;
+    keyframe->compact_image(image_scale, jpeg_quality);
+    keyframe->brief_descriptors.shrink_to_fit();
+    keyframe->keypoints.shrink_to_fit();
+    keyframe->point_2d_uv.shrink_to_fit();
+    keyframe->point_2d_norm.shrink_to_fit();
+    const size_t bytes = keyframe->memory_bytes();
+    keyframes[id] = std::move(scratch);
+    if (id < num_pinned) {
+        pinned.push_back(id);
+        pinned_bytes += bytes;
+        return;
+    }
+    order.push_back(id);
+    keyframe_bytes[id] = bytes;
+    total_bytes += bytes;
+
+    // Evict until we are back in our budget
+    size_t evict_id;
+    while (memory_budget > 0 && total_bytes > memory_budget && select_eviction(evict_id)) {
+        total_bytes -= keyframe_bytes.at(evict_id);
+        keyframe_bytes.erase(evict_id);
+        keyframes.erase(evict_id);
+        order.erase(std::find(order.begin(), order.end(), evict_id));
+        evicted.push_back(evict_id);
+    }
+}
+
+bool KeyFrameStore::select_eviction(size_t &keyframe_id) const {
+    if (order.size() <= num_protected)
+        return false;
+    const size_t num_candidates = order.size() - num_protected;
+
+    // Count the keyframes in each voxel, remembering the oldest one in it
+    std::map<std::tuple<long, long, long>, std::pair<size_t, size_t>> voxels;
+    for (size_t i = 0; i < num_candidates; i++) {
+        const KeyFrame *kf = keyframes.at(order.at(i)).get();
+        if (!kf->has_pose)
+            continue;
+        std::tuple<long, long, long> key((long) std::floor(kf->position(0) / voxel_size),
+                                         (long) std::floor(kf->position(1) / voxel_size),
+                                         (long) std::floor(kf->position(2) / voxel_size));
+        auto it = voxels.find(key);
+        if (it == voxels.end())
+            voxels.insert({key, {1, i}});
+        else
+            it->second.first++;
+    }
+
+    // Evict the oldest keyframe of the most crowded voxel, else just the oldest keyframe
+    size_t best_count = 1, best_index = 0;
+    for (const auto &voxel : voxels) {
+        if (voxel.second.first > best_count) {
+            best_count = voxel.second.first;
+            best_index = voxel.second.second;
+        }
+    }
+    keyframe_id = order.at(best_index);
+    return true;
+}
@@ -0,0 +1,123 @@
+#ifndef CATKIN_WS_OPENVINS_KEYFRAMESTORE_H
+#define CATKIN_WS_OPENVINS_KEYFRAMESTORE_H
+
+#include <deque>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+
+#include "KeyFrame.h"
+
+namespace ov_core {
+
+    /**
+     * @brief Owns the keyframes of the loop closer and keeps their memory bounded.
+     *
+     * Every frame needs a keyframe to query the database with, but only a few are ever added to it.
+     * So the keyframe of a frame we do not keep is reused for the next frame (see acquire()), instead of a new one being allocated and leaked each time.
+     * Added keyframes can be looked up by their keyframe id in O(1), and their image is downsized and/or JPEG compressed since it is only used for visualization.
+     *
+     * Once the keyframes use more memory than our budget, we evict keyframes until they fit again.
+     * We first evict the oldest keyframe in the most crowded voxel, as it is the most redundant for loop closure.
+     * If no voxel has more than one keyframe (or we do not know their poses), we just evict the oldest keyframe.
+     * The newest few keyframes are never evicted, nor are pinned ones (see set_pinned()).
+     */
+    class KeyFrameStore {
+
+    public:
+
+        /**
+         * @brief Sets how we retain images and our memory budget
+         * @param image_scale scale to downsize kept images by (1 keeps the full image, 0 or less drops it)
+         * @param jpeg_quality JPEG quality of kept images (0 or less keeps them uncompressed)
+         * @param memory_budget max number of bytes our keyframes should use (0 for unlimited)
+         * @param voxel_size size in meters of the voxels we look for redundant keyframes in
+         * @param num_protected number of newest keyframes that are never evicted
+         */
+        void set_options(double image_scale, int jpeg_quality, size_t memory_budget, double voxel_size = 1.0, size_t num_protected = 5) {
+            this->image_scale = image_scale;
+            this->jpeg_quality = jpeg_quality;
+            this->memory_budget = memory_budget;
+            this->voxel_size = std::max(1e-3, voxel_size);
+            this->num_protected = num_protected;
+        }
+
+        /**
+         * @brief Pins the keyframes with an id below this, they are never evicted and do not count against our budget
+         * @param num_pinned keyframe ids below this are pinned (e.g. the keyframes of a loaded map)
+         *
+         * Pinned keyframes can also be in another frame than ours, so they are left out of the voxels too.
+         * This should be called before they are added.
+         */
+        void set_pinned(size_t num_pinned) {
+            this->num_pinned = num_pinned;
+        }
+
+        /**
+         * @brief Gets a keyframe for a new frame, reusing the last one if it was not added
+         * @return Keyframe that we still own (only valid until the next call if it is not added)
+         */
+        KeyFrame *acquire(double timestamp, cv::Mat img, size_t cam_id, TrackBase *trackBase, std::size_t frame_id);
+
+        /**
+         * @brief Keeps the last acquired keyframe under its keyframe id, compacting its image
+         * @param keyframe keyframe gotten from acquire() (with its keyframe id set)
+         * @param evicted ids of the keyframes we evicted to stay in our budget (they should be removed from the database)
+         */
+        void add(KeyFrame *keyframe, std::vector<size_t> &evicted);
+
+        /// Gets a kept keyframe, or nullptr if we do not have (or have evicted) it
+        KeyFrame *get(size_t keyframe_id) const {
+            auto it = keyframes.find(keyframe_id);
+            return (it == keyframes.end()) ? nullptr : it->second.get();
+        }
+
+        /// Number of kept keyframes
+        size_t size() const {
+            return keyframes.size();
+        }
+
+        /// Ids of the kept keyframes, the pinned ones first and then in the order they were added
+        std::vector<size_t> ids() const {
+            std::vector<size_t> all(pinned.begin(), pinned.end());
+            all.insert(all.end(), order.begin(), order.end());
+            return all;
+        }
+
+        /// Approximate number of bytes the kept keyframes use (pinned ones included)
+        size_t memory_bytes() const {
+            return total_bytes + pinned_bytes;
+        }
+
+    protected:
+
+        /// Picks the keyframe we should evict next (or returns false if all are protected)
+        bool select_eviction(size_t &keyframe_id) const;
+
+        // Image retention and memory budget
+        double image_scale = 1.0;
+        int jpeg_quality = -1;
+        size_t memory_budget = 0;
+        double voxel_size = 1.0;
+        size_t num_protected = 5;
+        size_t num_pinned = 0;
+
+        /// Last acquired keyframe, reused if it was not added
+        std::unique_ptr<KeyFrame> scratch;
+
+        /// Kept keyframes by their keyframe id
+        std::unordered_map<size_t, std::unique_ptr<KeyFrame>> keyframes;
+
+        /// Keyframe ids we can evict in the order they were added, and the pinned ones
+        std::deque<size_t> order;
+        std::vector<size_t> pinned;
+
+        /// Bytes used by each kept keyframe (as when it was added), in total for the ones we can evict and for the pinned ones
+        std::unordered_map<size_t, size_t> keyframe_bytes;
+        size_t total_bytes = 0;
+        size_t pinned_bytes = 0;
+
+    };
+
+}
+#endif //CATKIN_WS_OPENVINS_KEYFRAMESTORE_H
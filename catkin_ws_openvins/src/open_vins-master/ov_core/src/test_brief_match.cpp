@@ -0,0 +1,147 @@
+/*
+ * OpenVINS: An Open Platform for Visual-Inertial Research
+ * Copyright (C) 2019 Patrick Geneva
+ * Copyright (C) 2019 Kevin Eckenhoff
+ * Copyright (C) 2019 Guoquan Huang
+ * Copyright (C) 2019 OpenVINS Contributors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <cmath>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <random>
+
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include "keyframe/KeyFrame.h"
+
+
+using namespace ov_core;
+
+
+// Number of BRIEF points in each of the two keyframes we match
+std::vector<int> num_points = {100, 300, 500, 1000};
+
+// Number of times we repeat each match to time it
+int num_repeats = 50;
+
+// Search radius of the rotation prior (normalized, about 40 px with a 460 px focal length)
+float radius = 0.087f;
+
+
+/**
+ * Creates random descriptors and normalized points, and a revisit of them where a few bits of each descriptor
+ * are flipped and the points are moved a bit (so the prior still finds them)
+ */
+void create_points(std::mt19937_64 &rng, int num, std::vector<BriefDescriptor> &desc, std::vector<cv::Point2f> &pts,
+                   std::vector<BriefDescriptor> &desc_revisit, std::vector<cv::Point2f> &pts_revisit) {
+    std::uniform_real_distribution<float> norm(-0.8f, 0.8f), noise(-0.02f, 0.02f);
+    desc.resize((size_t)num);
+    pts.resize((size_t)num);
+    for(int i=0; i<num; i++) {
+        desc.at(i) = {{rng(), rng(), rng(), rng()}};
+        pts.at(i) = cv::Point2f(norm(rng), norm(rng));
+    }
+    desc_revisit = desc;
+    pts_revisit = pts;
+    for(int i=0; i<num; i++) {
+        for(int k=0; k<8; k++) {
+            const uint64_t bit = rng()%256;
+            desc_revisit.at(i).bits[bit/64] ^= (1ULL << (bit%64));
+        }
+        pts_revisit.at(i) += cv::Point2f(noise(rng), noise(rng));
+    }
+}
+
+
+/**
+ * Nearest neighbour of each query by comparing it against every train descriptor in turn (what searchByBRIEFDes used to do)
+ */
+void match_brute_force(const std::vector<BriefDescriptor> &query, const std::vector<BriefDescriptor> &train,
+                       std::vector<int> &best_index, std::vector<int> &best_dist) {
+    best_index.assign(query.size(), -1);
+    best_dist.assign(query.size(), INT32_MAX);
+    for(size_t q=0; q<query.size(); q++) {
+        for(size_t t=0; t<train.size(); t++) {
+            const int d = KeyFrame::HammingDis(query.at(q), train.at(t));
+            if(d < best_dist.at(q)) {
+                best_dist.at(q) = d;
+                best_index.at(q) = (int)t;
+            }
+        }
+    }
+}
+
+
+// Main function
+int main(int argc, char** argv)
+{
+
+    std::mt19937_64 rng(42);
+    bool success = true;
+    for(int num : num_points) {
+
+        // Our old keyframe, and the current one revisiting it in a random order
+        std::vector<BriefDescriptor> desc_old, desc_cur;
+        std::vector<cv::Point2f> pts_old, pts_cur;
+        create_points(rng, num, desc_old, pts_old, desc_cur, pts_cur);
+        std::vector<int> order((size_t)num);
+        for(int i=0; i<num; i++) order.at(i) = i;
+        std::shuffle(order.begin(), order.end(), rng);
+        std::vector<BriefDescriptor> desc_query((size_t)num);
+        std::vector<cv::Point2f> pts_query((size_t)num);
+        for(int i=0; i<num; i++) {
+            desc_query.at(i) = desc_cur.at(order.at(i));
+            pts_query.at(i) = pts_cur.at(order.at(i));
+        }
+
+        // Time the brute force, the blocked and the blocked with a prior match
+        std::vector<int> index_brute, dist_brute, index_block, dist_block, index_prior, dist_prior;
+        boost::posix_time::ptime rT1 = boost::posix_time::microsec_clock::local_time();
+        for(int r=0; r<num_repeats; r++) {
+            match_brute_force(desc_query, desc_old, index_brute, dist_brute);
+        }
+        boost::posix_time::ptime rT2 = boost::posix_time::microsec_clock::local_time();
+        for(int r=0; r<num_repeats; r++) {
+            KeyFrame::match_descriptors(desc_query, desc_old, index_block, dist_block);
+        }
+        boost::posix_time::ptime rT3 = boost::posix_time::microsec_clock::local_time();
+        for(int r=0; r<num_repeats; r++) {
+            KeyFrame::match_descriptors(desc_query, desc_old, index_prior, dist_prior, &pts_query, &pts_old, radius);
+        }
+        boost::posix_time::ptime rT4 = boost::posix_time::microsec_clock::local_time();
+
+        // The blocked match should give exactly the brute force result, and the prior should still find the revisits
+        int num_correct = 0;
+        for(int i=0; i<num; i++) {
+            if(index_prior.at(i) == order.at(i)) num_correct++;
+        }
+        const bool same = (index_block == index_brute && dist_block == dist_brute);
+        success = success && same;
+
+        // Debug print
+        printf("[MATCH]: %d x %d descriptors\n", num, num);
+        printf("\t- brute force: %.3f ms\n", (rT2-rT1).total_microseconds()*1e-3/num_repeats);
+        printf("\t- blocked:     %.3f ms (%s brute force)\n", (rT3-rT2).total_microseconds()*1e-3/num_repeats, same ? "same as" : "DIFFERENT from");
+        printf("\t- with prior:  %.3f ms (%d of %d revisits found)\n", (rT4-rT3).total_microseconds()*1e-3/num_repeats, num_correct, num);
+
+    }
+
+    // Done!
+    return success? EXIT_SUCCESS : EXIT_FAILURE;
+
+}
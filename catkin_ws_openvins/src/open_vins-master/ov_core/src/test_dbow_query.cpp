@@ -0,0 +1,230 @@
+/*
+ * OpenVINS: An Open Platform for Visual-Inertial Research
+ * Copyright (C) 2019 Patrick Geneva
+ * Copyright (C) 2019 Kevin Eckenhoff
+ * Copyright (C) 2019 Guoquan Huang
+ * Copyright (C) 2019 OpenVINS Contributors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <cmath>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <random>
+#include <list>
+#include <algorithm>
+#include <map>
+
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include "ThirdParty/DBoW/DBoW2.h"
+#include "ThirdParty/DVision/DVision.h"
+
+
+using namespace DBoW2;
+using namespace DVision;
+
+
+// Number of BRIEF descriptors in each image (about what the loop closer gets from FAST)
+int num_features = 300;
+
+// Database sizes we time the queries at
+std::vector<int> db_sizes = {1000, 2000, 5000, 10000, 20000, 40000};
+
+// Number of queries at each size, and the results we ask for (same as the loop closer)
+int num_queries = 50;
+int max_results = 4;
+
+// Threads the parallel query can use
+int num_threads = 4;
+
+
+/**
+ * Creates the descriptors of a random image.
+ * Each descriptor is a random bitset, so their words are spread over the whole vocabulary.
+ */
+void create_image(std::mt19937_64 &rng, std::vector<BRIEF::bitset> &descriptors) {
+    descriptors.resize((size_t)num_features);
+    for(auto &desc : descriptors) {
+        uint64_t blocks[4] = {rng(), rng(), rng(), rng()};
+        desc = BRIEF::bitset(blocks, blocks+4);
+    }
+}
+
+
+/**
+ * Creates a revisit of an image by flipping a few bits of each of its descriptors
+ */
+void create_revisit(std::mt19937_64 &rng, const std::vector<BRIEF::bitset> &descriptors, std::vector<BRIEF::bitset> &revisit) {
+    revisit = descriptors;
+    for(auto &desc : revisit) {
+        for(int i=0; i<8; i++) {
+            desc.flip(rng()%desc.size());
+        }
+    }
+}
+
+
+/**
+ * Inverted file laid out the way the database used to keep it (lists of entry ids and weights for each word)
+ */
+typedef std::vector<std::list<std::pair<EntryId, WordValue>>> InvertedFile;
+
+
+/**
+ * L1 query the way the database used to do it, for comparison.
+ * The score of every entry that shares a word is accumulated in a std::map, and then all of them are sorted.
+ */
+void query_baseline(const InvertedFile &ifile, const BowVector &vec, QueryResults &ret, int max_results) {
+    std::map<EntryId, double> pairs;
+    for(const auto &word : vec) {
+        const WordValue qvalue = word.second;
+        for(const auto &item : ifile.at(word.first)) {
+            const double value = std::fabs(qvalue - item.second) - std::fabs(qvalue) - std::fabs(item.second);
+            auto it = pairs.lower_bound(item.first);
+            if(it != pairs.end() && it->first == item.first) {
+                it->second += value;
+            } else {
+                pairs.insert(it, std::make_pair(item.first, value));
+            }
+        }
+    }
+    ret.clear();
+    ret.reserve(pairs.size());
+    for(const auto &pair : pairs) {
+        ret.push_back(Result(pair.first, pair.second));
+    }
+    std::sort(ret.begin(), ret.end());
+    if(max_results > 0 && (int)ret.size() > max_results)
+        ret.resize((size_t)max_results);
+    for(auto &result : ret) {
+        result.Score = -result.Score/2.0;
+    }
+}
+
+
+// Main function
+int main(int argc, char** argv)
+{
+
+    // We need the vocabulary the loop closer uses
+    if(argc < 2) {
+        printf("usage: test_dbow_query <vocabulary (binary or mapped)>\n");
+        return EXIT_FAILURE;
+    }
+    BriefVocabulary voc;
+    if(!voc.loadMapped(argv[1])) {
+        voc.loadBin(argv[1]);
+    }
+    if(voc.empty()) {
+        printf("unable to load vocabulary %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    printf("[DBOW]: vocabulary with %d words\n", (int)voc.size());
+
+    // Our databases, one queried serially and one with threads
+    BriefDatabase db_serial, db_parallel;
+    db_serial.setVocabulary(voc, false, 0);
+    db_parallel.setVocabulary(voc, false, 0);
+    db_parallel.setQueryThreads(num_threads);
+
+    // Our copy of the inverted file for the old query
+    InvertedFile ifile(voc.size());
+
+    // Keep the bow vector of some images we will revisit
+    std::mt19937_64 rng(42);
+    std::vector<std::vector<BRIEF::bitset>> revisits;
+    std::vector<EntryId> revisit_ids;
+
+    std::vector<BRIEF::bitset> descriptors;
+    for(int size : db_sizes) {
+
+        // Grow the database to this size
+        while((int)db_serial.size() < size) {
+            create_image(rng, descriptors);
+            BowVector vec;
+            voc.transform(descriptors, vec);
+            EntryId id = db_serial.add(vec);
+            db_parallel.add(vec);
+            for(const auto &word : vec) {
+                ifile.at(word.first).push_back(std::make_pair(id, word.second));
+            }
+            if(rng()%(size_t)(size/num_queries+1) == 0 && (int)revisits.size() < num_queries) {
+                revisits.emplace_back();
+                create_revisit(rng, descriptors, revisits.back());
+                revisit_ids.push_back(id);
+            }
+        }
+
+        // Transform our queries before we time them
+        std::vector<BowVector> queries(revisits.size());
+        for(size_t i=0; i<revisits.size(); i++) {
+            voc.transform(revisits.at(i), queries.at(i));
+        }
+
+        // Time all four queries (the old one, all entries for the reference, the pruned top results, and the parallel ones)
+        QueryResults ret_baseline, ret_all, ret_serial, ret_parallel;
+        int num_found = 0, num_same = 0;
+        boost::posix_time::ptime rT0 = boost::posix_time::microsec_clock::local_time();
+        for(size_t i=0; i<queries.size(); i++) {
+            query_baseline(ifile, queries.at(i), ret_baseline, max_results);
+        }
+        boost::posix_time::ptime rT1 = boost::posix_time::microsec_clock::local_time();
+        for(size_t i=0; i<queries.size(); i++) {
+            db_serial.query(queries.at(i), ret_all, 0);
+        }
+        boost::posix_time::ptime rT2 = boost::posix_time::microsec_clock::local_time();
+        for(size_t i=0; i<queries.size(); i++) {
+            db_serial.query(queries.at(i), ret_serial, max_results);
+            if(!ret_serial.empty() && ret_serial.at(0).Id == revisit_ids.at(i)) num_found++;
+        }
+        boost::posix_time::ptime rT3 = boost::posix_time::microsec_clock::local_time();
+        for(size_t i=0; i<queries.size(); i++) {
+            db_parallel.query(queries.at(i), ret_parallel, max_results);
+        }
+        boost::posix_time::ptime rT4 = boost::posix_time::microsec_clock::local_time();
+
+        // Check that the old, pruned and parallel queries give the same best results as scoring everything
+        for(size_t i=0; i<queries.size(); i++) {
+            query_baseline(ifile, queries.at(i), ret_baseline, max_results);
+            db_serial.query(queries.at(i), ret_all, 0);
+            db_serial.query(queries.at(i), ret_serial, max_results);
+            db_parallel.query(queries.at(i), ret_parallel, max_results);
+            bool same = (ret_serial.size() == std::min(ret_all.size(), (size_t)max_results) && ret_parallel.size() == ret_serial.size()
+                         && ret_baseline.size() == ret_serial.size());
+            for(size_t j=0; same && j<ret_serial.size(); j++) {
+                same = std::abs(ret_all.at(j).Score - ret_serial.at(j).Score) < 1e-9
+                       && std::abs(ret_all.at(j).Score - ret_parallel.at(j).Score) < 1e-9
+                       && std::abs(ret_all.at(j).Score - ret_baseline.at(j).Score) < 1e-9;
+            }
+            if(same) num_same++;
+        }
+
+        // Debug print
+        double n = (double)std::max((size_t)1, queries.size());
+        printf("[DBOW]: %d entries\n", (int)db_serial.size());
+        printf("\t- old query:   %.3f ms per query\n", (rT1-rT0).total_microseconds()*1e-3/n);
+        printf("\t- all entries: %.3f ms per query\n", (rT2-rT1).total_microseconds()*1e-3/n);
+        printf("\t- top %d:      %.3f ms per query (found %d of %d revisits)\n", max_results, (rT3-rT2).total_microseconds()*1e-3/n, num_found, (int)queries.size());
+        printf("\t- %d threads:   %.3f ms per query\n", num_threads, (rT4-rT3).total_microseconds()*1e-3/n);
+        printf("\t- same top %d from all four queries: %d of %d queries\n", max_results, num_same, (int)queries.size());
+
+    }
+
+    // Done!
+    return EXIT_SUCCESS;
+
+}
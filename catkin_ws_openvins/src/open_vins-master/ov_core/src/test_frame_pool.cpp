@@ -0,0 +1,105 @@
+/*
+ * OpenVINS: An Open Platform for Visual-Inertial Research
+ * Copyright (C) 2019 Patrick Geneva
+ * Copyright (C) 2019 Kevin Eckenhoff
+ * Copyright (C) 2019 Guoquan Huang
+ * Copyright (C) 2019 OpenVINS Contributors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <cmath>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+
+#include <opencv2/opencv.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include "utils/FramePool.h"
+
+
+using namespace ov_core;
+
+
+// Image sizes we try (EuRoC and a larger global shutter camera)
+std::vector<cv::Size> image_sizes = {cv::Size(752,480), cv::Size(1280,1024)};
+
+// KLT window and max pyramid level (same as our tracker's defaults)
+cv::Size win_size(15,15);
+int pyr_levels = 3;
+
+// Number of images we time
+int num_images = 200;
+
+
+// Main function
+int main(int argc, char** argv)
+{
+
+    bool success = true;
+    for(const cv::Size &size : image_sizes) {
+
+        // Some texture with noise, and a nearly flat third of the image
+        std::mt19937 rng(42);
+        std::normal_distribution<double> noise(0, 12), noise_flat(0, 1.5);
+        cv::Mat img(size, CV_8UC1);
+        for(int y=0; y<size.height; y++) {
+            for(int x=0; x<size.width; x++) {
+                if(x < size.width/3)
+                    img.at<uchar>(y,x) = cv::saturate_cast<uchar>(60+noise_flat(rng));
+                else
+                    img.at<uchar>(y,x) = cv::saturate_cast<uchar>(90+40*std::sin(x/7.0)*std::cos(y/11.0)+noise(rng));
+            }
+        }
+
+        // What OpenCV gives us with its own functions
+        cv::Mat img_eq;
+        std::vector<cv::Mat> pyr_opencv;
+        boost::posix_time::ptime rT1 = boost::posix_time::microsec_clock::local_time();
+        for(int i=0; i<num_images; i++) {
+            cv::equalizeHist(img, img_eq);
+            cv::buildOpticalFlowPyramid(img_eq, pyr_opencv, win_size, pyr_levels);
+        }
+        boost::posix_time::ptime rT2 = boost::posix_time::microsec_clock::local_time();
+
+        // And our single pass (a new timestamp each time, so it is not just shared)
+        FramePool pool;
+        std::shared_ptr<FrameContext> frame;
+        for(int i=0; i<num_images; i++) {
+            frame = pool.get_frame((double)i, 0, img, win_size, pyr_levels);
+            FramePool::build_pyramid(frame, win_size, pyr_levels);
+        }
+        boost::posix_time::ptime rT3 = boost::posix_time::microsec_clock::local_time();
+
+        // They should be the same, bit for bit, else our KLT would track differently
+        bool same = (frame->pyramid.size() == pyr_opencv.size());
+        for(size_t i=0; same && i<pyr_opencv.size(); i++) {
+            same = (frame->pyramid.at(i).size() == pyr_opencv.at(i).size() && frame->pyramid.at(i).type() == pyr_opencv.at(i).type()
+                    && cv::norm(frame->pyramid.at(i), pyr_opencv.at(i), cv::NORM_INF) == 0);
+        }
+        success = success && same;
+
+        // Debug print
+        printf("[FRAME POOL]: %d x %d image, %d levels\n", size.width, size.height, (int)pyr_opencv.size()/2);
+        printf("\t- opencv:      %.3f ms\n", (rT2-rT1).total_microseconds()*1e-3/num_images);
+        printf("\t- single pass: %.3f ms (%s)\n", (rT3-rT2).total_microseconds()*1e-3/num_images, same ? "same as opencv" : "DIFFERENT");
+
+    }
+
+    // Done!
+    return success? EXIT_SUCCESS : EXIT_FAILURE;
+
+}
@@ -0,0 +1,171 @@
+/*
+ * OpenVINS: An Open Platform for Visual-Inertial Research
+ * Copyright (C) 2019 Patrick Geneva
+ * Copyright (C) 2019 Kevin Eckenhoff
+ * Copyright (C) 2019 Guoquan Huang
+ * Copyright (C) 2019 OpenVINS Contributors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <cmath>
+#include <vector>
+#include <string>
+#include <cstdio>
+
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include "track/Grider_FAST.h"
+#include "track/Grider_AdaptiveFAST.h"
+
+
+using namespace ov_core;
+
+
+// Our detector settings (same as the launch files)
+int num_pts = 200;
+int fast_threshold = 15;
+int grid_x = 5;
+int grid_y = 3;
+
+// Number of times we should extract from each image
+int num_runs = 100;
+
+
+/**
+ * Creates an image with a high texture left half and a low contrast right half.
+ * This is what a single global FAST threshold has problems with.
+ */
+cv::Mat create_image(int width, int height) {
+    cv::Mat img(height, width, CV_8UC1);
+    cv::randu(img, cv::Scalar(0), cv::Scalar(255));
+    cv::GaussianBlur(img, img, cv::Size(5,5), 1.5);
+    cv::Mat right = img(cv::Rect(width/2, 0, width-width/2, height));
+    right.convertTo(right, CV_8UC1, 0.15, 100);
+    return img;
+}
+
+
+/**
+ * Counts the features of each grid cell, and checks that no cell has more than its share of the features.
+ * Also returns how many features the cells completely inside the left and right half of the image have, and how many they should have.
+ */
+bool count_cells(const std::vector<cv::KeyPoint> &pts, int width, int height, std::vector<int> &counts,
+                 int &num_left, int &num_right, int &target_left, int &target_right) {
+    const int size_x = width/grid_x, size_y = height/grid_y;
+    const int num_features_grid = num_pts/(grid_x*grid_y)+1;
+    counts = std::vector<int>((size_t)(grid_x*grid_y), 0);
+    for(const cv::KeyPoint &kpt : pts) {
+        counts.at((size_t)((int)kpt.pt.y/size_y*grid_x+(int)kpt.pt.x/size_x))++;
+    }
+    bool success = true;
+    num_left = num_right = target_left = target_right = 0;
+    for(int r=0; r<grid_x*grid_y; r++) {
+        success = success && counts.at(r) <= num_features_grid;
+        const int x = r%grid_x*size_x;
+        if(x+size_x <= width/2) {
+            num_left += counts.at(r);
+            target_left += num_features_grid;
+        } else if(x >= width/2) {
+            num_right += counts.at(r);
+            target_right += num_features_grid;
+        }
+    }
+    return success;
+}
+
+
+/**
+ * Times the extraction of the fixed and adaptive threshold griders on an image of a given size.
+ * If the image is empty we will create one, otherwise it is resized to the given size.
+ * On our created image, the adaptive thresholds should give every cell its share of the features, in both the textured and low contrast half.
+ */
+bool run_timing(const cv::Mat &img_in, int width, int height) {
+
+    // Get our image
+    cv::Mat img;
+    if(img_in.empty()) img = create_image(width, height);
+    else cv::resize(img_in, img, cv::Size(width, height));
+
+    // Fixed global threshold
+    std::vector<cv::KeyPoint> pts_fixed;
+    boost::posix_time::ptime rT1 = boost::posix_time::microsec_clock::local_time();
+    for(int i=0; i<num_runs; i++) {
+        pts_fixed.clear();
+        Grider_FAST::perform_griding(img, pts_fixed, num_pts, grid_x, grid_y, fast_threshold, true);
+    }
+    boost::posix_time::ptime rT2 = boost::posix_time::microsec_clock::local_time();
+
+    // Adaptive per-cell thresholds (these will have converged after the first few runs)
+    Grider_AdaptiveFAST grider(fast_threshold, num_pts);
+    std::vector<cv::KeyPoint> pts_adaptive;
+    boost::posix_time::ptime rT3 = boost::posix_time::microsec_clock::local_time();
+    for(int i=0; i<num_runs; i++) {
+        pts_adaptive.clear();
+        grider.perform_griding(img, pts_adaptive, num_pts, grid_x, grid_y);
+    }
+    boost::posix_time::ptime rT4 = boost::posix_time::microsec_clock::local_time();
+
+    // Print the thresholds each cell has converged to
+    std::string str_thresholds;
+    for(size_t r=0; r<grider.get_thresholds().size(); r++) {
+        str_thresholds += std::to_string(grider.get_thresholds().at(r)) + " ";
+    }
+
+    // Count the features of each cell and of each half of the image
+    std::vector<int> counts_fixed, counts_adaptive;
+    int fixed_left, fixed_right, adaptive_left, adaptive_right, target_left, target_right;
+    bool success = count_cells(pts_fixed, width, height, counts_fixed, fixed_left, fixed_right, target_left, target_right);
+    success = count_cells(pts_adaptive, width, height, counts_adaptive, adaptive_left, adaptive_right, target_left, target_right) && success;
+    if(img_in.empty()) {
+        success = success && adaptive_left >= target_left && adaptive_right >= target_right;
+    }
+
+    // Debug print
+    printf("[GRIDER]: %d x %d image\n", width, height);
+    printf("\t- fixed:    %.3f ms per image, %d features (%d of %d textured, %d of %d low contrast)\n", (rT2-rT1).total_microseconds()*1e-3/num_runs,
+           (int)pts_fixed.size(), fixed_left, target_left, fixed_right, target_right);
+    printf("\t- adaptive: %.3f ms per image, %d features (%d of %d textured, %d of %d low contrast)\n", (rT4-rT3).total_microseconds()*1e-3/num_runs,
+           (int)pts_adaptive.size(), adaptive_left, target_left, adaptive_right, target_right);
+    printf("\t- adaptive thresholds: %s\n", str_thresholds.c_str());
+    printf("\t- %s\n", success ? "passed" : "FAILED (a cell has too many features, or a half of the image did not get its share)");
+    return success;
+
+}
+
+
+// Main function
+int main(int argc, char** argv)
+{
+
+    // Load the image if we are given one, else we will create our own
+    cv::Mat img;
+    if(argc > 1) {
+        img = cv::imread(argv[1], cv::IMREAD_GRAYSCALE);
+        if(img.empty()) {
+            printf("unable to load image %s\n", argv[1]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Time both image sizes
+    bool success = run_timing(img, 752, 480);
+    success = run_timing(img, 1280, 1024) && success;
+
+    // Done!
+    return success? EXIT_SUCCESS : EXIT_FAILURE;
+
+}
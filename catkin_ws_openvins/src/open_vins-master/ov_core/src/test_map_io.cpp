@@ -0,0 +1,192 @@
+/*
+ * OpenVINS: An Open Platform for Visual-Inertial Research
+ * Copyright (C) 2019 Patrick Geneva
+ * Copyright (C) 2019 Kevin Eckenhoff
+ * Copyright (C) 2019 Guoquan Huang
+ * Copyright (C) 2019 OpenVINS Contributors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <cmath>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <sstream>
+
+
+#include "keyframe/KeyFrame.h"
+
+
+using namespace ov_core;
+using namespace DBoW2;
+
+
+// Number of keyframes and landmarks in our map
+int num_keyframes = 20;
+int num_landmarks = 2000;
+
+// Number of BRIEF points and tracks in each keyframe
+int num_points = 300;
+int num_tracks = 100;
+
+// Number of truncated maps we try to read
+int num_truncations = 200;
+
+
+/**
+ * Creates a keyframe with random points, tracks, pose and compressed image (everything a map keeps)
+ */
+void create_keyframe(std::mt19937_64 &rng, size_t id, KeyFrame &kf) {
+    std::uniform_real_distribution<float> pixel(0, 640), norm(-1, 1), meters(-20, 20);
+    kf.keyframe_id = id;
+    kf.frame_id = 10*id+3;
+    kf.cam_id = id%2;
+    kf.timestamp = 1403636579.76 + 0.5*id;
+    kf.has_pose = true;
+    kf.position = Eigen::Vector3d::Random();
+    kf.R_GtoC = Eigen::Quaterniond::UnitRandom().toRotationMatrix();
+    kf.R_ItoC = Eigen::Quaterniond::UnitRandom().toRotationMatrix();
+    kf.p_IinC = Eigen::Vector3d::Random();
+    for(int i=0; i<num_points; i++) {
+        kf.point_2d_uv.emplace_back(pixel(rng), pixel(rng));
+        kf.point_2d_norm.emplace_back(norm(rng), norm(rng));
+        kf.brief_descriptors.push_back({{rng(), rng(), rng(), rng()}});
+    }
+    for(int i=0; i<num_tracks; i++) {
+        kf.track_ids.push_back((size_t)rng()%100000);
+        kf.track_descriptors.push_back({{rng(), rng(), rng(), rng()}});
+        kf.point_3d.emplace_back(meters(rng), meters(rng), meters(rng));
+        kf.point_3d_valid.push_back((uchar)(rng()%2));
+    }
+    kf.image_size = cv::Size(752, 480);
+    kf.image_jpeg.resize(2000+rng()%1000);
+    for(auto &byte : kf.image_jpeg) {
+        byte = (uchar)rng();
+    }
+}
+
+
+/**
+ * Creates a random bow vector (increasing word ids, as in the map the database keeps)
+ */
+void create_bow(std::mt19937_64 &rng, BowVector &bow) {
+    WordId word = 0;
+    for(int i=0; i<200; i++) {
+        word += 1+(WordId)(rng()%50);
+        bow.insert(bow.end(), std::make_pair(word, (WordValue)(rng()%1000)/1000.0));
+    }
+}
+
+
+/**
+ * Checks that everything a map keeps of a keyframe was read back the same
+ */
+bool same_keyframe(const KeyFrame &a, const KeyFrame &b) {
+    bool same = a.keyframe_id == b.keyframe_id && a.frame_id == b.frame_id && a.cam_id == b.cam_id && a.timestamp == b.timestamp
+                && a.has_pose == b.has_pose && a.position == b.position && a.R_GtoC == b.R_GtoC && a.R_ItoC == b.R_ItoC && a.p_IinC == b.p_IinC
+                && a.point_2d_uv == b.point_2d_uv && a.point_2d_norm == b.point_2d_norm && a.track_ids == b.track_ids
+                && a.point_3d == b.point_3d && a.point_3d_valid == b.point_3d_valid && a.image_size == b.image_size && a.image_jpeg == b.image_jpeg
+                && a.brief_descriptors.size() == b.brief_descriptors.size() && a.track_descriptors.size() == b.track_descriptors.size()
+                && b.keypoints.size() == b.point_2d_uv.size();
+    for(size_t i=0; same && i<a.brief_descriptors.size(); i++) {
+        same = std::memcmp(a.brief_descriptors.at(i).bits, b.brief_descriptors.at(i).bits, sizeof(BriefDescriptor)) == 0;
+    }
+    for(size_t i=0; same && i<a.track_descriptors.size(); i++) {
+        same = std::memcmp(a.track_descriptors.at(i).bits, b.track_descriptors.at(i).bits, sizeof(BriefDescriptor)) == 0;
+    }
+    return same;
+}
+
+
+// Main function
+int main(int argc, char** argv)
+{
+
+    // Create our map
+    std::mt19937_64 rng(42);
+    const uint32_t voc_size = 1000000;
+    std::vector<KeyFrame> keyframes;
+    std::vector<BowVector> bows((size_t)num_keyframes);
+    for(int k=0; k<num_keyframes; k++) {
+        keyframes.emplace_back(0, cv::Mat(), 0, nullptr, 0);
+        create_keyframe(rng, (size_t)k, keyframes.back());
+        create_bow(rng, bows.at(k));
+    }
+    std::vector<Eigen::Vector3d> landmarks;
+    for(int i=0; i<num_landmarks; i++) {
+        landmarks.push_back(20*Eigen::Vector3d::Random());
+    }
+
+    // Write it the same way the loop closer does
+    std::stringstream out;
+    write_map_header(out, voc_size, (uint64_t)keyframes.size());
+    for(size_t k=0; k<keyframes.size(); k++) {
+        write_map_keyframe(out, keyframes.at(k), bows.at(k));
+    }
+    write_map_landmarks(out, landmarks);
+    const std::string map = out.str();
+    printf("[MAP]: %d keyframes, %d landmarks, %d bytes\n", num_keyframes, num_landmarks, (int)map.size());
+
+    // Everything should be read back the same
+    bool success = true;
+    uint32_t voc_size_read;
+    std::vector<KeyFrame> keyframes_read;
+    std::vector<BowVector> bows_read;
+    std::vector<Eigen::Vector3d> landmarks_read;
+    std::istringstream in(map);
+    bool read = read_map(in, voc_size_read, keyframes_read, bows_read, landmarks_read);
+    bool same = read && voc_size_read == voc_size && keyframes_read.size() == keyframes.size() && bows_read == bows && landmarks_read == landmarks;
+    for(size_t k=0; same && k<keyframes.size(); k++) {
+        same = same_keyframe(keyframes.at(k), keyframes_read.at(k));
+    }
+    printf("\t- round trip: %s\n", same ? "same keyframes, bow vectors and landmarks" : "FAILED");
+    success = success && same;
+
+    // Any truncation should be rejected (always try the end of the header, and just before the end of the file)
+    int num_rejected = 0;
+    std::vector<size_t> lengths = {0, 7, 20, map.size()-1};
+    for(int i=0; i<num_truncations; i++) {
+        lengths.push_back((size_t)(rng()%map.size()));
+    }
+    for(size_t length : lengths) {
+        std::istringstream in_truncated(map.substr(0, length));
+        if(!read_map(in_truncated, voc_size_read, keyframes_read, bows_read, landmarks_read)) num_rejected++;
+    }
+    printf("\t- truncated maps rejected: %d of %d\n", num_rejected, (int)lengths.size());
+    success = success && num_rejected == (int)lengths.size();
+
+    // So should a bad magic, trailing bytes and sizes that are larger than the file
+    // The first keyframe starts after the header (24 bytes), and its first vector size after its fixed fields
+    const size_t offset_header = 24;
+    const size_t offset_uv = offset_header + 3*sizeof(uint64_t) + sizeof(double) + sizeof(uint8_t) + 3*sizeof(double) + 9*sizeof(double) + 9*sizeof(double) + 3*sizeof(double);
+    std::vector<std::string> corrupt(4, map);
+    corrupt.at(0).at(0) = 'X';
+    corrupt.at(1) += "trailing";
+    const uint64_t huge_size = (1ULL << 40), big_size = 1000000;
+    std::memcpy(&corrupt.at(2).at(offset_uv), &huge_size, sizeof(uint64_t));
+    std::memcpy(&corrupt.at(3).at(offset_uv), &big_size, sizeof(uint64_t));
+    num_rejected = 0;
+    for(const std::string &bad : corrupt) {
+        std::istringstream in_corrupt(bad);
+        if(!read_map(in_corrupt, voc_size_read, keyframes_read, bows_read, landmarks_read)) num_rejected++;
+    }
+    printf("\t- corrupt maps rejected: %d of %d\n", num_rejected, (int)corrupt.size());
+    success = success && num_rejected == (int)corrupt.size();
+
+    // Done!
+    return success? EXIT_SUCCESS : EXIT_FAILURE;
+
+}
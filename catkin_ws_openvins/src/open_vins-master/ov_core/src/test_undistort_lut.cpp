@@ -0,0 +1,102 @@
+/*
+ * OpenVINS: An Open Platform for Visual-Inertial Research
+ * Copyright (C) 2019 Patrick Geneva
+ * Copyright (C) 2019 Kevin Eckenhoff
+ * Copyright (C) 2019 Guoquan Huang
+ * Copyright (C) 2019 OpenVINS Contributors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <cmath>
+#include <vector>
+#include <cstdio>
+#include <random>
+
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include "track/TrackKLT.h"
+
+
+using namespace ov_core;
+
+
+// Image size and calibration of the EuRoC cam0 (radtan)
+int width = 752;
+int height = 480;
+std::vector<double> calib = {458.654, 457.296, 367.215, 248.375, -0.28340811, 0.07395907, 0.00019359, 1.76187114e-05};
+
+// Cell sizes of the lookup tables we try
+std::vector<int> cell_sizes = {1, 2, 4, 8};
+
+// Number of random points we undistort, and how many times
+int num_points = 200;
+int num_repeats = 500;
+
+
+// Main function
+int main(int argc, char** argv)
+{
+
+    // Our tracker, we only use it to undistort
+    TrackKLT tracker;
+    std::map<size_t,Eigen::VectorXd> camera_calib;
+    std::map<size_t,bool> camera_fisheye;
+    camera_calib.insert({0, Eigen::Map<Eigen::VectorXd>(calib.data(), (int)calib.size())});
+    camera_fisheye.insert({0, false});
+    tracker.set_calibration(camera_calib, camera_fisheye);
+    std::map<size_t,std::pair<int,int>> camera_wh;
+    camera_wh.insert({0, std::make_pair(width, height)});
+
+    // Random points inside of the image (about how many a frame has)
+    std::mt19937_64 rng(42);
+    std::uniform_real_distribution<float> u(0, (float)(width-1)), v(0, (float)(height-1));
+    std::vector<cv::Point2f> pts;
+    for(int i=0; i<num_points; i++) {
+        pts.push_back(cv::Point2f(u(rng), v(rng)));
+    }
+
+    // Undistort them with the iterative solver first, this is what the tables are compared against
+    std::vector<cv::Point2f> pts_solver;
+    tracker.set_undistort_lut(camera_wh, 0);
+    boost::posix_time::ptime rT1 = boost::posix_time::microsec_clock::local_time();
+    for(int r=0; r<num_repeats; r++) {
+        tracker.undistort_points(pts, pts_solver, 0);
+    }
+    boost::posix_time::ptime rT2 = boost::posix_time::microsec_clock::local_time();
+    printf("[LUT]: %d x %d image, %d points\n", width, height, num_points);
+    printf("\t- solver: %.1f ns per point\n", (rT2-rT1).total_microseconds()*1e3/num_repeats/num_points);
+
+    // Then with each of our tables
+    for(int cell : cell_sizes) {
+        rT1 = boost::posix_time::microsec_clock::local_time();
+        tracker.set_undistort_lut(camera_wh, cell);
+        rT2 = boost::posix_time::microsec_clock::local_time();
+        std::vector<cv::Point2f> pts_lut;
+        for(int r=0; r<num_repeats; r++) {
+            tracker.undistort_points(pts, pts_lut, 0);
+        }
+        boost::posix_time::ptime rT3 = boost::posix_time::microsec_clock::local_time();
+        double max_error = 0;
+        for(int i=0; i<num_points; i++) {
+            max_error = std::max(max_error, std::hypot((double)(pts_lut.at(i).x-pts_solver.at(i).x), (double)(pts_lut.at(i).y-pts_solver.at(i).y)));
+        }
+        printf("\t- cell %d: %.2f ms to build, %.1f ns per point, max error %.4f px\n", cell,
+               (rT2-rT1).total_microseconds()*1e-3, (rT3-rT2).total_microseconds()*1e3/num_repeats/num_points, max_error*calib.at(0));
+    }
+
+    // Done!
+    return EXIT_SUCCESS;
+
+}
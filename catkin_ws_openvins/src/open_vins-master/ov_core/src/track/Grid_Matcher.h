@@ -0,0 +1,172 @@
+/*
+ * OpenVINS: An Open Platform for Visual-Inertial Research
+ * Copyright (C) 2019 Patrick Geneva
+ * Copyright (C) 2019 Kevin Eckenhoff
+ * Copyright (C) 2019 Guoquan Huang
+ * Copyright (C) 2019 OpenVINS Contributors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef OV_CORE_GRID_MATCHER_H
+#define OV_CORE_GRID_MATCHER_H
+
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+
+
+#include <opencv2/core/core.hpp>
+
+
+namespace ov_core {
+
+    /**
+     * @brief Binary descriptor matching restricted to a search window around where each point should be.
+     *
+     * The brute force matcher compares every descriptor against every other one, which is O(N^2) in the number of features.
+     * Here the points we match against are put into a bucket grid (with cells the size of the search radius),
+     * so each query only has to compare against the points in the few cells around its predicted location.
+     * The result has the same layout as cv::DescriptorMatcher::knnMatch() with k=2, so the same ratio and symmetry tests can be used.
+     */
+    class Grid_Matcher {
+
+    public:
+
+        /**
+         * @brief Hamming distance between two binary descriptors using 64 bit popcounts
+         * @param a first descriptor
+         * @param b second descriptor
+         * @param bytes number of bytes in each descriptor (32 for ORB)
+         */
+        static inline int hamming_distance(const uchar *a, const uchar *b, int bytes) {
+            int dist = 0;
+            int i = 0;
+            for(; i+8<=bytes; i+=8) {
+                uint64_t x, y;
+                std::memcpy(&x, a+i, 8);
+                std::memcpy(&y, b+i, 8);
+                dist += __builtin_popcountll(x^y);
+            }
+            for(; i<bytes; i++) {
+                dist += __builtin_popcount((unsigned int)(a[i]^b[i]));
+            }
+            return dist;
+        }
+
+        /**
+         * @brief Finds the two nearest descriptors of each query that are inside the search window of its predicted location
+         * @param pts_query predicted location of each query point (in the image of the train points)
+         * @param desc_query descriptors of the query points (CV_8U, one row each)
+         * @param pts_train location of each point we match against
+         * @param desc_train descriptors of the points we match against (CV_8U, one row each)
+         * @param radius search radius in pixels
+         * @param matches two nearest neighbours of each query (queryIdx/trainIdx are the indices of the passed points)
+         *
+         * If only one point is in the window, the second neighbour is given the max possible distance.
+         * A unique point in the window is a good match, so we do not want the ratio test to reject it.
+         */
+        static void knn_match(const std::vector<cv::Point2f> &pts_query, const cv::Mat &desc_query,
+                              const std::vector<cv::Point2f> &pts_train, const cv::Mat &desc_train,
+                              float radius, std::vector<std::vector<cv::DMatch>> &matches) {
+
+            // Return if we have nothing to match
+            matches.clear();
+            matches.resize(pts_query.size());
+            if(pts_query.empty() || pts_train.empty() || radius <= 0)
+                return;
+            assert(desc_query.rows == (int)pts_query.size() && desc_train.rows == (int)pts_train.size());
+            assert(desc_query.cols == desc_train.cols);
+
+            // Get the bounds of our train points
+            float min_x = pts_train.at(0).x, min_y = pts_train.at(0).y;
+            float max_x = min_x, max_y = min_y;
+            for(const cv::Point2f &pt : pts_train) {
+                min_x = std::min(min_x, pt.x);
+                min_y = std::min(min_y, pt.y);
+                max_x = std::max(max_x, pt.x);
+                max_y = std::max(max_y, pt.y);
+            }
+            const int cols = (int)((max_x-min_x)/radius)+1;
+            const int rows = (int)((max_y-min_y)/radius)+1;
+
+            // Sort the train points by their cell (counting sort), so each cell is a contiguous range of indices
+            std::vector<int> cell_of((size_t)pts_train.size());
+            std::vector<int> cell_start((size_t)(cols*rows+1), 0);
+            for(size_t i=0; i<pts_train.size(); i++) {
+                int x = (int)((pts_train.at(i).x-min_x)/radius);
+                int y = (int)((pts_train.at(i).y-min_y)/radius);
+                cell_of.at(i) = y*cols+x;
+                cell_start.at((size_t)cell_of.at(i)+1)++;
+            }
+            for(size_t c=1; c<cell_start.size(); c++) {
+                cell_start.at(c) += cell_start.at(c-1);
+            }
+            std::vector<int> cell_fill(cell_start.begin(), cell_start.end()-1);
+            std::vector<int> sorted((size_t)pts_train.size());
+            for(size_t i=0; i<pts_train.size(); i++) {
+                sorted.at((size_t)cell_fill.at((size_t)cell_of.at(i))++) = (int)i;
+            }
+
+            // Now find the best two of each query in the cells around it
+            const int bytes = desc_query.cols;
+            const float max_dist = (float)(8*bytes);
+            const float radius_sq = radius*radius;
+            for(size_t q=0; q<pts_query.size(); q++) {
+                const cv::Point2f &pt = pts_query.at(q);
+                if(!(pt.x >= min_x-radius && pt.x <= max_x+radius && pt.y >= min_y-radius && pt.y <= max_y+radius))
+                    continue;
+                int cx = (int)std::floor((pt.x-min_x)/radius);
+                int cy = (int)std::floor((pt.y-min_y)/radius);
+                const uchar *d_query = desc_query.ptr<uchar>((int)q);
+                int best1 = -1, best2 = -1;
+                int dist1 = INT32_MAX, dist2 = INT32_MAX;
+                for(int y=std::max(0,cy-1); y<=std::min(rows-1,cy+1); y++) {
+                    for(int x=std::max(0,cx-1); x<=std::min(cols-1,cx+1); x++) {
+                        const int c = y*cols+x;
+                        for(int k=cell_start.at((size_t)c); k<cell_start.at((size_t)c+1); k++) {
+                            const int t = sorted.at((size_t)k);
+                            const cv::Point2f diff = pts_train.at((size_t)t)-pt;
+                            if(diff.x*diff.x+diff.y*diff.y > radius_sq)
+                                continue;
+                            int dist = hamming_distance(d_query, desc_train.ptr<uchar>(t), bytes);
+                            if(dist < dist1) {
+                                best2 = best1;
+                                dist2 = dist1;
+                                best1 = t;
+                                dist1 = dist;
+                            } else if(dist < dist2) {
+                                best2 = t;
+                                dist2 = dist;
+                            }
+                        }
+                    }
+                }
+                if(best1 == -1)
+                    continue;
+                matches.at(q).emplace_back(cv::DMatch((int)q, best1, (float)dist1));
+                matches.at(q).emplace_back(cv::DMatch((int)q, best2, (best2 == -1)? max_dist : (float)dist2));
+            }
+
+        }
+
+    };
+
+}
+
+
+#endif /* OV_CORE_GRID_MATCHER_H */
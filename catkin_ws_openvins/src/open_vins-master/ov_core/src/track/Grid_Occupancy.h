@@ -0,0 +1,119 @@
+/*
+ * OpenVINS: An Open Platform for Visual-Inertial Research
+ * Copyright (C) 2019 Patrick Geneva
+ * Copyright (C) 2019 Kevin Eckenhoff
+ * Copyright (C) 2019 Guoquan Huang
+ * Copyright (C) 2019 OpenVINS Contributors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef OV_CORE_GRID_OCCUPANCY_H
+#define OV_CORE_GRID_OCCUPANCY_H
+
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+
+#include <opencv2/core/core.hpp>
+
+
+namespace ov_core {
+
+    /**
+     * @brief Reusable bitset occupancy grid used to keep features a min pixel distance apart.
+     *
+     * Each bit is a square cell of pixels, which is set once a feature is inside of it.
+     * The storage is only reallocated if the image or cell size changes, so clearing it for each new image is just a memset.
+     * This should be kept around between images (one for each camera) so detection does not allocate.
+     */
+    class Grid_Occupancy {
+
+    public:
+
+        /**
+         * @brief Clears the grid, and resizes it if the image or cell size has changed
+         * @param width width of the image in pixels
+         * @param height height of the image in pixels
+         * @param cell_size size of each cell in pixels
+         */
+        void reset(int width, int height, int cell_size) {
+            if(cell_size != cell || width != img_width || height != img_height) {
+                cell = std::max(1, cell_size);
+                img_width = width;
+                img_height = height;
+                cols = width/cell+1;
+                rows = height/cell+1;
+                bits.resize(((size_t)(cols*rows)+63)/64);
+            }
+            std::fill(bits.begin(), bits.end(), (uint64_t)0);
+        }
+
+        /**
+         * @brief Marks the cell of a point as occupied
+         * @param pt pixel location of the point
+         * @return True if the cell was already occupied (points outside of the image are never occupied)
+         */
+        bool test_and_set(const cv::Point2f &pt) {
+            size_t idx;
+            if(!get_index(pt, idx))
+                return false;
+            const uint64_t mask = (uint64_t)1 << (idx%64);
+            const bool occupied = (bits[idx/64] & mask) != 0;
+            bits[idx/64] |= mask;
+            return occupied;
+        }
+
+        /**
+         * @brief Checks if the cell of a point is occupied
+         * @param pt pixel location of the point
+         * @return True if the cell is occupied (points outside of the image are never occupied)
+         */
+        bool test(const cv::Point2f &pt) const {
+            size_t idx;
+            if(!get_index(pt, idx))
+                return false;
+            return (bits[idx/64] & ((uint64_t)1 << (idx%64))) != 0;
+        }
+
+    protected:
+
+        /// Gets the bit index of a point, returns false if it is outside of the grid
+        bool get_index(const cv::Point2f &pt, size_t &idx) const {
+            if(!(pt.x >= 0 && pt.y >= 0))
+                return false;
+            const int x = (int)(pt.x/cell);
+            const int y = (int)(pt.y/cell);
+            if(x >= cols || y >= rows)
+                return false;
+            idx = (size_t)(y*cols+x);
+            return true;
+        }
+
+        /// Size of the image and cells in pixels
+        int img_width = 0, img_height = 0, cell = 0;
+
+        /// Number of cells in each direction
+        int cols = 0, rows = 0;
+
+        /// Occupancy bit of each cell (row major)
+        std::vector<uint64_t> bits;
+
+    };
+
+}
+
+
+#endif /* OV_CORE_GRID_OCCUPANCY_H */
@@ -0,0 +1,211 @@
+/*
+ * OpenVINS: An Open Platform for Visual-Inertial Research
+ * Copyright (C) 2019 Patrick Geneva
+ * Copyright (C) 2019 Kevin Eckenhoff
+ * Copyright (C) 2019 Guoquan Huang
+ * Copyright (C) 2019 OpenVINS Contributors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef OV_CORE_GRIDER_ADAPTIVEFAST_H
+#define OV_CORE_GRIDER_ADAPTIVEFAST_H
+
+
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <Eigen/Eigen>
+
+
+#include <opencv/cv.hpp>
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include "Grider_FAST.h"
+
+
+namespace ov_core {
+
+    /**
+     * @brief Extracts FAST features in a grid pattern, with a threshold for each grid cell that adapts over time.
+     *
+     * As compared to Grider_FAST, which runs FAST on each cell with one global threshold and sorts all points,
+     * here we run a single FAST pass over the whole image (the OpenCV implementation is SIMD vectorized) and bin the points into the cells.
+     * Each cell only keeps its best points in a bounded heap, so we never sort the full set of points.
+     * Since FAST's response is the largest threshold a point is still a corner at, we can then apply each cell's own threshold to the binned points.
+     *
+     * After each image, the threshold of each cell is lowered if it did not find enough points, and raised if it found far too many.
+     * This allows textureless regions to still give features, while high-texture regions do not flood us with points.
+     * This is stateful, so one of these should be used for each camera.
+     */
+    class Grider_AdaptiveFAST {
+
+    public:
+
+        /**
+         * @brief Default constructor
+         * @param threshold starting FAST threshold of every cell
+         * @param num_features number of features we want in total from all cells, used to know how many each cell should find
+         * @param min_threshold smallest threshold a cell can go down to
+         * @param max_threshold largest threshold a cell can go up to
+         */
+        Grider_AdaptiveFAST(int threshold=10, int num_features=200, int min_threshold=5, int max_threshold=80) :
+                threshold_init(threshold), num_features_target(num_features), min_threshold(min_threshold), max_threshold(max_threshold) {}
+
+        /**
+         * @brief This function will perform grid extraction using FAST and update the thresholds of each cell.
+         * @param img Image we will do FAST extraction on
+         * @param pts vector of extracted points we will return
+         * @param num_features max number of features we want to extract
+         * @param grid_x size of grid in the x-direction / u-direction
+         * @param grid_y size of grid in the y-direction / v-direction
+         *
+         * Same layout as Grider_FAST::perform_griding() so they can be swapped (the last column and row of pixels which does not fit into a cell is skipped).
+         * Returned points are ordered by cell, and within each cell by their response.
+         */
+        void perform_griding(const cv::Mat &img, std::vector<cv::KeyPoint> &pts, int num_features, int grid_x, int grid_y) {
+
+            // Extract FAST features over the whole image using the lowest threshold of any cell
+            std::vector<cv::KeyPoint> pts_all;
+            cv::FAST(img, pts_all, get_min_threshold(img.size(), grid_x, grid_y), true);
+
+            // Bin them into our cells
+            perform_griding(img.size(), pts_all, pts, num_features, grid_x, grid_y);
+
+        }
+
+        /**
+         * @brief Same as above, but with FAST corners that have already been extracted over the whole image.
+         * @param img_size size of the image the corners are from
+         * @param pts_all FAST corners (with non-max suppression) with a threshold of at most get_min_threshold()
+         * @param pts vector of extracted points we will return
+         * @param num_features max number of features we want to extract
+         * @param grid_x size of grid in the x-direction / u-direction
+         * @param grid_y size of grid in the y-direction / v-direction
+         *
+         * This allows the corners of an image to be shared with others that need them (see FramePool::get_corners()).
+         */
+        void perform_griding(const cv::Size &img_size, const std::vector<cv::KeyPoint> &pts_all, std::vector<cv::KeyPoint> &pts,
+                             int num_features, int grid_x, int grid_y) {
+
+            // Calculate the size our extraction boxes should be
+            int size_x = img_size.width / grid_x;
+            int size_y = img_size.height / grid_y;
+
+            // Reset our thresholds if the grid has changed
+            update_grid(img_size, grid_x, grid_y);
+            int ct_cols = img_size.width / size_x;
+            int ct_rows = img_size.height / size_y;
+
+            // How many points we want from each cell, and how many each cell should be able to find
+            auto num_features_grid = (int) (num_features / (grid_x * grid_y)) + 1;
+            auto num_features_target_grid = (int) (num_features_target / (grid_x * grid_y)) + 1;
+
+            // Bin each point into its cell, each cell only keeps its best points
+            // Our heap has its lowest response on top (see Grider_FAST::compare_response()), so we can pop it if we have too many
+            std::vector<std::vector<cv::KeyPoint>> collection((size_t)(ct_cols*ct_rows));
+            std::vector<int> num_found((size_t)(ct_cols*ct_rows), 0);
+            for(const cv::KeyPoint &kpt : pts_all) {
+                int x = (int)kpt.pt.x/size_x;
+                int y = (int)kpt.pt.y/size_y;
+                if(x >= ct_cols || y >= ct_rows)
+                    continue;
+                size_t r = (size_t)(y*ct_cols+x);
+                if(kpt.response < thresholds.at(r))
+                    continue;
+                num_found.at(r)++;
+                std::vector<cv::KeyPoint> &heap = collection.at(r);
+                heap.push_back(kpt);
+                std::push_heap(heap.begin(), heap.end(), Grider_FAST::compare_response);
+                if(heap.size() > (size_t)num_features_grid) {
+                    std::pop_heap(heap.begin(), heap.end(), Grider_FAST::compare_response);
+                    heap.pop_back();
+                }
+            }
+
+            // Combine all the collections into our single vector (best point of each cell first)
+            for(size_t r=0; r<collection.size(); r++) {
+                std::sort_heap(collection.at(r).begin(), collection.at(r).end(), Grider_FAST::compare_response);
+                pts.insert(pts.end(),collection.at(r).begin(),collection.at(r).end());
+            }
+
+            // Adapt the threshold of each cell for the next image
+            // We lower it if we could not find enough points, and raise it if we found way more than needed
+            for(size_t r=0; r<thresholds.size(); r++) {
+                int step = std::max(1, thresholds.at(r)/5);
+                if(num_found.at(r) < num_features_target_grid) {
+                    thresholds.at(r) = std::max(min_threshold, thresholds.at(r)-step);
+                } else if(num_found.at(r) > 4*num_features_target_grid) {
+                    thresholds.at(r) = std::min(max_threshold, thresholds.at(r)+step);
+                }
+            }
+
+        }
+
+        /**
+         * @brief Gets the lowest threshold of any cell, which is what the whole image should be extracted with
+         * @param img_size size of the image we will extract from
+         * @param grid_x size of grid in the x-direction / u-direction
+         * @param grid_y size of grid in the y-direction / v-direction
+         */
+        int get_min_threshold(const cv::Size &img_size, int grid_x, int grid_y) {
+            update_grid(img_size, grid_x, grid_y);
+            return *std::min_element(thresholds.begin(), thresholds.end());
+        }
+
+        /// Get the current FAST threshold of each cell (row major)
+        const std::vector<int> &get_thresholds() const {
+            return thresholds;
+        }
+
+    protected:
+
+        /// Resets the thresholds of our cells if the grid has changed
+        void update_grid(const cv::Size &img_size, int grid_x, int grid_y) {
+
+            // Calculate the size our extraction boxes should be
+            int size_x = img_size.width / grid_x;
+            int size_y = img_size.height / grid_y;
+
+            // Make sure our sizes are not zero
+            assert(size_x > 0);
+            assert(size_y > 0);
+
+            // Reset our thresholds if the number of cells has changed
+            int ct_cols = img_size.width / size_x;
+            int ct_rows = img_size.height / size_y;
+            if(thresholds.size() != (size_t)(ct_cols*ct_rows)) {
+                thresholds = std::vector<int>((size_t)(ct_cols*ct_rows), threshold_init);
+            }
+
+        }
+
+        /// Threshold each cell starts at
+        int threshold_init;
+
+        /// Total number of features we want, so we know how many each cell should find
+        int num_features_target;
+
+        /// Bounds our thresholds can adapt between
+        int min_threshold, max_threshold;
+
+        /// Current threshold of each cell (row major)
+        std::vector<int> thresholds;
+
+    };
+
+}
+
+
+#endif /* OV_CORE_GRIDER_ADAPTIVEFAST_H */
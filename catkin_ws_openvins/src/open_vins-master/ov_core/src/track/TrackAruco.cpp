@@ -32,54 +32,21 @@ void TrackAruco::feed_monocular(double timestamp, cv::Mat &imgin, size_t cam_id)
     // Lock this data feed for this camera
     std::unique_lock<std::mutex> lck(mtx_feeds.at(cam_id));
 
-    // Histogram equalize
-    cv::Mat img;
-    cv::equalizeHist(imgin, img);
+    // Create the data of this camera if it is new (does nothing if feed_multicam() already has)
+    allocate_camera(cam_id);
 
-    // Clear the old data from the last timestep
-    ids_aruco[cam_id].clear();
-    corners[cam_id].clear();
-    rejects[cam_id].clear();
-
-    // If we are downsizing, then downsize
-    cv::Mat img0;
-    if(do_downsizing) {
-        cv::pyrDown(img,img0,cv::Size(img.cols/2,img.rows/2));
-    } else {
-        img0 = img;
-    }
+    // Histogram equalize (shared with our other trackers, and does not write into the passed image)
+    cv::Mat img = frame_pool->get_frame(timestamp, cam_id, imgin)->image;
 
 
     //===================================================================================
     //===================================================================================
 
-    // Perform extraction
-    cv::aruco::detectMarkers(img0,aruco_dict,corners[cam_id],ids_aruco[cam_id],aruco_params,rejects[cam_id]);
+    // Perform extraction (or track the corners of the tags we already have)
+    perform_extraction(img, cam_id);
     rT2 =  boost::posix_time::microsec_clock::local_time();
 
 
-    //===================================================================================
-    //===================================================================================
-
-    // If we downsized, scale all our u,v measurements by a factor of two
-    // Note: we do this so we can use these results for visulization later
-    // Note: and so that the uv added is in the same image size
-    if(do_downsizing) {
-        for(size_t i=0; i<corners[cam_id].size(); i++) {
-            for(size_t j=0; j<corners[cam_id].at(i).size(); j++) {
-                corners[cam_id].at(i).at(j).x *= 2;
-                corners[cam_id].at(i).at(j).y *= 2;
-            }
-        }
-        for(size_t i=0; i<rejects[cam_id].size(); i++) {
-            for(size_t j=0; j<rejects[cam_id].at(i).size(); j++) {
-                rejects[cam_id].at(i).at(j).x *= 2;
-                rejects[cam_id].at(i).at(j).y *= 2;
-            }
-        }
-    }
-
-
     //===================================================================================
     //===================================================================================
 
@@ -88,14 +55,20 @@ void TrackAruco::feed_monocular(double timestamp, cv::Mat &imgin, size_t cam_id)
     std::vector<size_t> ids_new;
 
     // Append to our feature database this new information
+    // Undistort the top left corner of all the tags at once
+    std::vector<cv::Point2f> corners_n;
+    for(size_t i=0; i<corners[cam_id].size(); i++) {
+        corners_n.push_back(corners[cam_id].at(i).at(0));
+    }
+    undistort_points(corners_n, corners_n, cam_id);
     for(size_t i=0; i<ids_aruco[cam_id].size(); i++) {
         // Skip if ID is greater then our max
         if(ids_aruco[cam_id].at(i) > max_tag_id)
             continue;
         // Assert we have 4 points (we will only use one of them)
         assert(corners[cam_id].at(i).size()==4);
-        // Try to undistort the point
-        cv::Point2f npt_l = undistort_point(corners[cam_id].at(i).at(0), cam_id);
+        // Get the undistorted point
+        cv::Point2f npt_l = corners_n.at(i);
         // Append to the ids vector and database
         ids_new.push_back((size_t)ids_aruco[cam_id].at(i));
         database->update_feature((size_t)ids_aruco[cam_id].at(i), timestamp, cam_id,
@@ -105,7 +78,7 @@ void TrackAruco::feed_monocular(double timestamp, cv::Mat &imgin, size_t cam_id)
 
 
     // Move forward in time
-    img_last[cam_id] = img.clone();
+    img_last[cam_id] = img;
     ids_last[cam_id] = ids_new;
     rT3 =  boost::posix_time::microsec_clock::local_time();
 
@@ -126,73 +99,24 @@ void TrackAruco::feed_stereo(double timestamp, cv::Mat &img_leftin, cv::Mat &img
     std::unique_lock<std::mutex> lck1(mtx_feeds.at(cam_id_left));
     std::unique_lock<std::mutex> lck2(mtx_feeds.at(cam_id_right));
 
-    // Histogram equalize
-    cv::Mat img_left, img_right;
-    cv::equalizeHist(img_leftin, img_left);
-    cv::equalizeHist(img_rightin, img_right);
-
-    // Clear the old data from the last timestep
-    ids_aruco[cam_id_left].clear();
-    ids_aruco[cam_id_right].clear();
-    corners[cam_id_left].clear();
-    corners[cam_id_right].clear();
-    rejects[cam_id_left].clear();
-    rejects[cam_id_right].clear();
+    // Create the data of these cameras if they are new (does nothing if feed_multicam() already has)
+    allocate_camera(cam_id_left);
+    allocate_camera(cam_id_right);
 
-    // If we are downsizing, then downsize
-    cv::Mat img0, img1;
-    if(do_downsizing) {
-        cv::pyrDown(img_left,img0,cv::Size(img_left.cols/2,img_left.rows/2));
-        cv::pyrDown(img_right,img1,cv::Size(img_right.cols/2,img_right.rows/2));
-    } else {
-        img0 = img_left;
-        img1 = img_right;
-    }
+    // Histogram equalize
+    cv::Mat img_left = frame_pool->get_frame(timestamp, cam_id_left, img_leftin)->image;
+    cv::Mat img_right = frame_pool->get_frame(timestamp, cam_id_right, img_rightin)->image;
 
 
     //===================================================================================
     //===================================================================================
 
     // Perform extraction (doing this is parallel is actually slower on my machine -pgeneva)
-    cv::aruco::detectMarkers(img0,aruco_dict,corners[cam_id_left],ids_aruco[cam_id_left],aruco_params,rejects[cam_id_left]);
-    cv::aruco::detectMarkers(img1,aruco_dict,corners[cam_id_right],ids_aruco[cam_id_right],aruco_params,rejects[cam_id_right]);
+    perform_extraction(img_left, cam_id_left);
+    perform_extraction(img_right, cam_id_right);
     rT2 =  boost::posix_time::microsec_clock::local_time();
 
 
-    //===================================================================================
-    //===================================================================================
-
-    // If we downsized, scale all our u,v measurements by a factor of two
-    // Note: we do this so we can use these results for visulization later
-    // Note: and so that the uv added is in the same image size
-    if(do_downsizing) {
-        for(size_t i=0; i<corners[cam_id_left].size(); i++) {
-            for(size_t j=0; j<corners[cam_id_left].at(i).size(); j++) {
-                corners[cam_id_left].at(i).at(j).x *= 2;
-                corners[cam_id_left].at(i).at(j).y *= 2;
-            }
-        }
-        for(size_t i=0; i<corners[cam_id_right].size(); i++) {
-            for(size_t j=0; j<corners[cam_id_right].at(i).size(); j++) {
-                corners[cam_id_right].at(i).at(j).x *= 2;
-                corners[cam_id_right].at(i).at(j).y *= 2;
-            }
-        }
-        for(size_t i=0; i<rejects[cam_id_left].size(); i++) {
-            for(size_t j=0; j<rejects[cam_id_left].at(i).size(); j++) {
-                rejects[cam_id_left].at(i).at(j).x *= 2;
-                rejects[cam_id_left].at(i).at(j).y *= 2;
-            }
-        }
-        for(size_t i=0; i<rejects[cam_id_right].size(); i++) {
-            for(size_t j=0; j<rejects[cam_id_right].at(i).size(); j++) {
-                rejects[cam_id_right].at(i).at(j).x *= 2;
-                rejects[cam_id_right].at(i).at(j).y *= 2;
-            }
-        }
-    }
-
-
     //===================================================================================
     //===================================================================================
 
@@ -201,28 +125,39 @@ void TrackAruco::feed_stereo(double timestamp, cv::Mat &img_leftin, cv::Mat &img
     std::vector<size_t> ids_left_new, ids_right_new;
 
     // Append to our feature database this new information
+    // Undistort the top left corner of all the tags at once
+    std::vector<cv::Point2f> corners_left_n;
+    for(size_t i=0; i<corners[cam_id_left].size(); i++) {
+        corners_left_n.push_back(corners[cam_id_left].at(i).at(0));
+    }
+    undistort_points(corners_left_n, corners_left_n, cam_id_left);
     for(size_t i=0; i<ids_aruco[cam_id_left].size(); i++) {
         // Skip if ID is greater then our max
         if(ids_aruco[cam_id_left].at(i) > max_tag_id)
             continue;
         // Assert we have 4 points (we will only use one of them)
         assert(corners[cam_id_left].at(i).size()==4);
-        // Try to undistort the point (could fail undistortion!)
-        cv::Point2f npt_l = undistort_point(corners[cam_id_left].at(i).at(0), cam_id_left);
+        // Get the undistorted point
+        cv::Point2f npt_l = corners_left_n.at(i);
         // Append to the ids vector and database
         ids_left_new.push_back((size_t)ids_aruco[cam_id_left].at(i));
         database->update_feature((size_t)ids_aruco[cam_id_left].at(i), timestamp, cam_id_left,
                                  corners[cam_id_left].at(i).at(0).x, corners[cam_id_left].at(i).at(0).y,
                                  npt_l.x, npt_l.y);
     }
+    std::vector<cv::Point2f> corners_right_n;
+    for(size_t i=0; i<corners[cam_id_right].size(); i++) {
+        corners_right_n.push_back(corners[cam_id_right].at(i).at(0));
+    }
+    undistort_points(corners_right_n, corners_right_n, cam_id_right);
     for(size_t i=0; i<ids_aruco[cam_id_right].size(); i++) {
         // Skip if ID is greater then our max
         if(ids_aruco[cam_id_right].at(i) > max_tag_id)
             continue;
         // Assert we have 4 points (we will only use one of them)
         assert(corners[cam_id_right].at(i).size()==4);
-        // Try to undistort the point (could fail undistortion!)
-        cv::Point2f npt_l = undistort_point(corners[cam_id_right].at(i).at(0), cam_id_right);
+        // Get the undistorted point
+        cv::Point2f npt_l = corners_right_n.at(i);
         // Append to the ids vector and database
         ids_right_new.push_back((size_t)ids_aruco[cam_id_right].at(i));
         database->update_feature((size_t)ids_aruco[cam_id_right].at(i), timestamp, cam_id_right,
@@ -232,8 +167,8 @@ void TrackAruco::feed_stereo(double timestamp, cv::Mat &img_leftin, cv::Mat &img
 
 
     // Move forward in time
-    img_last[cam_id_left] = img_left.clone();
-    img_last[cam_id_right] = img_right.clone();
+    img_last[cam_id_left] = img_left;
+    img_last[cam_id_right] = img_right;
     ids_last[cam_id_left] = ids_left_new;
     ids_last[cam_id_right] = ids_right_new;
     rT3 =  boost::posix_time::microsec_clock::local_time();
@@ -246,6 +181,123 @@ void TrackAruco::feed_stereo(double timestamp, cv::Mat &img_leftin, cv::Mat &img
 }
 
 
+void TrackAruco::perform_extraction(const cv::Mat &img, size_t cam_id) {
+
+    // Track the tags we have if it is not time for a full detection yet
+    // If we have no tags then there is nothing to track, and we just wait for the next detection
+    std::vector<cv::Mat> pyr;
+    bool tracked = false;
+    if(use_tag_tracking && frames_since_detect.at(cam_id) > 0 && frames_since_detect.at(cam_id) < detect_rate) {
+        if(ids_aruco.at(cam_id).empty()) {
+            rejects.at(cam_id).clear();
+            tracked = true;
+        } else if(!pyr_last.at(cam_id).empty()) {
+            cv::buildOpticalFlowPyramid(img, pyr, aruco_win_size, aruco_pyr_levels);
+            tracked = perform_tracking(img, pyr, cam_id);
+        }
+    }
+
+    // Else run the full detection (also if we have lost any tag)
+    if(tracked) {
+        frames_since_detect.at(cam_id)++;
+    } else {
+        perform_detection(img, cam_id);
+        frames_since_detect.at(cam_id) = 1;
+    }
+
+    // Keep our pyramid for the next image if we have tags to track from it
+    if(use_tag_tracking && !ids_aruco.at(cam_id).empty()) {
+        if(pyr.empty())
+            cv::buildOpticalFlowPyramid(img, pyr, aruco_win_size, aruco_pyr_levels);
+        pyr_last.at(cam_id) = pyr;
+    } else {
+        pyr_last.at(cam_id).clear();
+    }
+
+}
+
+
+void TrackAruco::perform_detection(const cv::Mat &img, size_t cam_id) {
+
+    // Clear the old data from the last timestep
+    ids_aruco.at(cam_id).clear();
+    corners.at(cam_id).clear();
+    rejects.at(cam_id).clear();
+
+    // If we are downsizing, then downsize
+    cv::Mat img0;
+    if(do_downsizing) {
+        cv::pyrDown(img,img0,cv::Size(img.cols/2,img.rows/2));
+    } else {
+        img0 = img;
+    }
+
+    // Perform extraction
+    cv::aruco::detectMarkers(img0,aruco_dict,corners.at(cam_id),ids_aruco.at(cam_id),aruco_params,rejects.at(cam_id));
+
+    // If we downsized, scale all our u,v measurements by a factor of two
+    // Note: we do this so we can use these results for visulization later
+    // Note: and so that the uv added is in the same image size
+    if(do_downsizing) {
+        for(size_t i=0; i<corners.at(cam_id).size(); i++) {
+            for(size_t j=0; j<corners.at(cam_id).at(i).size(); j++) {
+                corners.at(cam_id).at(i).at(j).x *= 2;
+                corners.at(cam_id).at(i).at(j).y *= 2;
+            }
+        }
+        for(size_t i=0; i<rejects.at(cam_id).size(); i++) {
+            for(size_t j=0; j<rejects.at(cam_id).at(i).size(); j++) {
+                rejects.at(cam_id).at(i).at(j).x *= 2;
+                rejects.at(cam_id).at(i).at(j).y *= 2;
+            }
+        }
+    }
+
+}
+
+
+bool TrackAruco::perform_tracking(const cv::Mat &img, const std::vector<cv::Mat> &pyr, size_t cam_id) {
+
+    // Track all four corners of each tag
+    std::vector<cv::Point2f> pts_last, pts_new;
+    for(size_t i=0; i<corners.at(cam_id).size(); i++) {
+        assert(corners.at(cam_id).at(i).size()==4);
+        pts_last.insert(pts_last.end(), corners.at(cam_id).at(i).begin(), corners.at(cam_id).at(i).end());
+    }
+    std::vector<uchar> mask_klt;
+    std::vector<float> error;
+    cv::TermCriteria term_crit = cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 20, 0.01);
+    cv::calcOpticalFlowPyrLK(pyr_last.at(cam_id), pyr, pts_last, pts_new, mask_klt, error, aruco_win_size, aruco_pyr_levels, term_crit);
+
+    // Check that each tag is still a valid tag
+    const float min_side = 4.0f;
+    std::vector<std::vector<cv::Point2f>> corners_new;
+    for(size_t i=0; i<corners.at(cam_id).size(); i++) {
+        std::vector<cv::Point2f> quad(pts_new.begin()+4*i, pts_new.begin()+4*i+4);
+        for(size_t j=0; j<4; j++) {
+            const cv::Point2f &pt = quad.at(j);
+            if(!mask_klt.at(4*i+j) || pt.x < 0 || pt.y < 0 || pt.x > img.cols-1 || pt.y > img.rows-1)
+                return false;
+            cv::Point2f side = quad.at((j+1)%4)-pt;
+            if(side.x*side.x+side.y*side.y < min_side*min_side)
+                return false;
+        }
+        // Same corner ordering (the oriented area keeps its sign), and not too large of a change in scale
+        double area_last = cv::contourArea(corners.at(cam_id).at(i), true);
+        double area_new = cv::contourArea(quad, true);
+        if(!cv::isContourConvex(quad) || area_last*area_new <= 0 || area_new/area_last > 2.0 || area_new/area_last < 0.5)
+            return false;
+        corners_new.push_back(quad);
+    }
+
+    // All tags are good, so we can use them
+    corners.at(cam_id) = corners_new;
+    rejects.at(cam_id).clear();
+    return true;
+
+}
+
+
 void TrackAruco::display_active(cv::Mat &img_out, int r1, int g1, int b1, int r2, int g2, int b2) {
 
     // Lock all our feeds (this prevents other threads from editing our data)
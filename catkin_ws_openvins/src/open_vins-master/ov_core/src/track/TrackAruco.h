@@ -77,6 +77,34 @@ namespace ov_core {
          */
         void feed_stereo(double timestamp, cv::Mat &img_left, cv::Mat &img_right, size_t cam_id_left, size_t cam_id_right) override;
 
+        /**
+         * @brief Process a synchronized set of images from any number of cameras
+         * @param timestamp timestamp this set of images occured at (all cameras are synchronised)
+         * @param images grayscaled images, one for each camera id
+         * @param cam_ids camera id that each image corresponds too
+         *
+         * Allocates our tags and last pyramids for each camera, and then calls on TrackBase::feed_multicam().
+         */
+        void feed_multicam(double timestamp, std::vector<cv::Mat> &images, std::vector<size_t> &cam_ids) override {
+            for(size_t i=0; i<cam_ids.size(); i++) {
+                allocate_camera(cam_ids.at(i));
+            }
+            TrackBase::feed_multicam(timestamp, images, cam_ids);
+        }
+
+        /**
+         * @brief Set if we should only detect tags every few images, and track the corners of the tags we have in between
+         * @param use true to track tag corners between detections, false to detect tags in every image
+         * @param rate run a full detection every this many images
+         *
+         * The four corners of each tag are tracked with pyramidal KLT, and then checked that they are still a valid tag (see perform_tracking()).
+         * If any tag fails this we run a full detection on the same image, so a lost tag is never missing for more then this image.
+         * New tags that come into view are found at the next full detection.
+         */
+        void set_tag_tracking(bool use, int rate) {
+            use_tag_tracking = use;
+            detect_rate = std::max(1, rate);
+        }
 
         /**
          * @brief We override the display equation so we can show the tags we extract.
@@ -89,6 +117,44 @@ namespace ov_core {
 
     protected:
 
+        /**
+         * @brief Creates the data of a camera if this is a new camera (does nothing if it already exists)
+         * @param cam_id camera id we want to allocate
+         */
+        void allocate_camera(size_t cam_id) {
+            ids_aruco[cam_id];
+            corners[cam_id];
+            rejects[cam_id];
+            frames_since_detect[cam_id];
+            pyr_last[cam_id];
+        }
+
+        /**
+         * @brief Gets the tags of a new image, either detecting them or tracking the ones we have
+         * @param img new histogram equalized image
+         * @param cam_id the camera id that this new image corresponds too
+         */
+        void perform_extraction(const cv::Mat &img, size_t cam_id);
+
+        /**
+         * @brief Runs the full aruco detector on an image
+         * @param img new histogram equalized image
+         * @param cam_id the camera id that this new image corresponds too
+         */
+        void perform_detection(const cv::Mat &img, size_t cam_id);
+
+        /**
+         * @brief Tracks the corners of our last tags into a new image
+         * @param img new histogram equalized image
+         * @param pyr optical flow pyramid of the new image
+         * @param cam_id the camera id that this new image corresponds too
+         * @return True if all tags are tracked, false if any has been lost (in which case our tags are not changed)
+         *
+         * A tracked tag must still be a convex quad with the same corner ordering, at least a few pixels on each side,
+         * inside the image, and its area can only have changed by up to a factor of two.
+         */
+        bool perform_tracking(const cv::Mat &img, const std::vector<cv::Mat> &pyr, size_t cam_id);
+
         // Timing variables
         boost::posix_time::ptime rT1, rT2, rT3, rT4, rT5, rT6, rT7;
 
@@ -111,6 +177,20 @@ namespace ov_core {
         std::unordered_map<size_t, std::vector<int>> ids_aruco;
         std::unordered_map<size_t, std::vector<std::vector<cv::Point2f>>> corners, rejects;
 
+        // If we track tag corners between detections, and how many images we wait between full detections
+        bool use_tag_tracking = false;
+        int detect_rate = 10;
+
+        // KLT window size and max pyramid level we track tag corners with
+        cv::Size aruco_win_size = cv::Size(21,21);
+        int aruco_pyr_levels = 3;
+
+        // Number of images since our last full detection
+        std::unordered_map<size_t, int> frames_since_detect;
+
+        // Optical flow pyramid of our last image (empty if we had no tags in it)
+        std::unordered_map<size_t, std::vector<cv::Mat>> pyr_last;
+
 
     };
 
@@ -160,3 +160,211 @@ void TrackBase::display_history(cv::Mat &img_out, int r1, int g1, int b1, int r2
 }
 
 
+
+
+void TrackBase::feed_multicam(double timestamp, std::vector<cv::Mat> &images, std::vector<size_t> &cam_ids) {
+
+    // Assert we have an image for each camera
+    assert(images.size()==cam_ids.size());
+
+    // Lookup of where each camera is in our passed vectors
+    std::map<size_t,size_t> cam_to_idx;
+    for(size_t i=0; i<cam_ids.size(); i++) {
+        assert(cam_to_idx.find(cam_ids.at(i))==cam_to_idx.end());
+        cam_to_idx.insert({cam_ids.at(i), i});
+    }
+
+    // Make sure that each camera has its storage allocated
+    // Our maps are not thread safe on insertion, so we need to do this before we spin off any threads
+    for(size_t i=0; i<cam_ids.size(); i++) {
+        img_last[cam_ids.at(i)];
+        pts_last[cam_ids.at(i)];
+        ids_last[cam_ids.at(i)];
+    }
+
+    // Group our cameras into stereo pairs and monocular cameras
+    // If one of a stereo pair is missing, then we will just track the other one monocular
+    std::vector<std::pair<size_t,size_t>> jobs_stereo;
+    std::vector<size_t> jobs_mono;
+    std::vector<bool> used(cam_ids.size(), false);
+    for(auto const &pair : stereo_pairs) {
+        if(cam_to_idx.find(pair.first)==cam_to_idx.end() || cam_to_idx.find(pair.second)==cam_to_idx.end())
+            continue;
+        size_t idx_left = cam_to_idx.at(pair.first);
+        size_t idx_right = cam_to_idx.at(pair.second);
+        if(used.at(idx_left) || used.at(idx_right))
+            continue;
+        used.at(idx_left) = true;
+        used.at(idx_right) = true;
+        jobs_stereo.emplace_back(idx_left, idx_right);
+    }
+    for(size_t i=0; i<cam_ids.size(); i++) {
+        if(!used.at(i))
+            jobs_mono.push_back(i);
+    }
+
+    // Track all cameras in parallel, each camera is only in one job so we can safely do this
+    boost::thread_group threads;
+    for(auto const &job : jobs_stereo) {
+        threads.create_thread(boost::bind(&TrackBase::feed_stereo, this, timestamp, boost::ref(images.at(job.first)), boost::ref(images.at(job.second)),
+                                          cam_ids.at(job.first), cam_ids.at(job.second)));
+    }
+    for(auto const &idx : jobs_mono) {
+        threads.create_thread(boost::bind(&TrackBase::feed_monocular, this, timestamp, boost::ref(images.at(idx)), cam_ids.at(idx)));
+    }
+    threads.join_all();
+
+}
+
+
+void TrackBase::perform_ransac(const std::vector<cv::Point2f> &pts0_n, const std::vector<cv::Point2f> &pts1_n, size_t id0, size_t id1,
+                               bool has_rotation, const Eigen::Matrix3d &R_C0toC1, std::vector<uchar> &mask_rsc) {
+
+    // Our threshold in normalized coordinates (note since we normalized the max pixel error is now in the normalized cords)
+    double max_focallength_img0 = std::max(camera_k_OPENCV.at(id0)(0,0),camera_k_OPENCV.at(id0)(1,1));
+    double max_focallength_img1 = std::max(camera_k_OPENCV.at(id1)(0,0),camera_k_OPENCV.at(id1)(1,1));
+    double max_focallength = std::max(max_focallength_img0,max_focallength_img1);
+
+    // Check if we have the extrinsics for a stereo match
+    bool has_extrinsics = (id0 != id1 && camera_R_ItoC.find(id0) != camera_R_ItoC.end() && camera_R_ItoC.find(id1) != camera_R_ItoC.end());
+
+    // Run our two point ransac or known extrinsic epipolar check
+    boost::posix_time::ptime rT1 = boost::posix_time::microsec_clock::local_time();
+    bool used_2pt = false;
+    if(ransac_mode == GYRO_2PT && id0 == id1 && has_rotation) {
+        TwoPointRansac::ransac_known_rotation(pts0_n, pts1_n, R_C0toC1, 1/max_focallength, 0.999, mask_rsc);
+        used_2pt = true;
+    } else if(ransac_mode == GYRO_2PT && has_extrinsics) {
+        // Relative pose of the first camera in the second (R_C0toC1 = R_ItoC1*R_ItoC0^T, p_C0inC1 = p_IinC1 - R_C0toC1*p_IinC0)
+        Eigen::Matrix3d R_C0toC1_ext = camera_R_ItoC.at(id1)*camera_R_ItoC.at(id0).transpose();
+        Eigen::Vector3d p_C0inC1 = camera_p_IinC.at(id1)-R_C0toC1_ext*camera_p_IinC.at(id0);
+        TwoPointRansac::check_epipolar(pts0_n, pts1_n, R_C0toC1_ext, p_C0inC1, 1/max_focallength, mask_rsc);
+        used_2pt = true;
+    }
+    boost::posix_time::ptime rT2 = boost::posix_time::microsec_clock::local_time();
+
+    // Else fall back to the eight point fundamental matrix
+    std::vector<uchar> mask_8pt;
+    if(!used_2pt || ransac_compare) {
+        cv::findFundamentalMat(pts0_n, pts1_n, cv::FM_RANSAC, 1/max_focallength, 0.999, mask_8pt);
+    }
+    boost::posix_time::ptime rT3 = boost::posix_time::microsec_clock::local_time();
+    if(!used_2pt) {
+        mask_rsc = mask_8pt;
+    }
+
+    // Debug print the timing and inlier ratio of both methods
+    if(ransac_compare && used_2pt && !pts0_n.empty()) {
+        size_t inliers_2pt = (size_t)std::count(mask_rsc.begin(), mask_rsc.end(), (uchar)1);
+        size_t inliers_8pt = (size_t)std::count(mask_8pt.begin(), mask_8pt.end(), (uchar)1);
+        ROS_INFO("[RANSAC]: cam%d-cam%d | 2pt %.5f seconds (%.3f inliers) | 8pt %.5f seconds (%.3f inliers) | %d points",
+                 (int)id0, (int)id1, (rT2-rT1).total_microseconds()*1e-6, (double)inliers_2pt/pts0_n.size(),
+                 (rT3-rT2).total_microseconds()*1e-6, (double)inliers_8pt/pts0_n.size(), (int)pts0_n.size());
+    }
+
+}
+
+
+void TrackBase::set_undistort_lut(const std::map<size_t,std::pair<int,int>> &camera_wh, int cell_size) {
+
+    // Clear our old tables, and return if we are disabling them
+    std::unique_lock<std::mutex> lck(mtx_lut);
+    camera_lut.clear();
+    lut_camera_wh = camera_wh;
+    lut_cell_size = cell_size;
+    if(lut_cell_size <= 0)
+        return;
+
+    // Build the table of each camera we have a calibration of, and report how good they are
+    for(auto const &cam : lut_camera_wh) {
+        if(camera_k_OPENCV.find(cam.first) == camera_k_OPENCV.end())
+            continue;
+        boost::posix_time::ptime rT1 = boost::posix_time::microsec_clock::local_time();
+        std::shared_ptr<const UndistortLUT> lut = build_undistort_lut(cam.first, cam.second);
+        boost::posix_time::ptime rT2 = boost::posix_time::microsec_clock::local_time();
+        camera_lut[cam.first] = lut;
+        double max_focallength = std::max(camera_k_OPENCV.at(cam.first)(0,0),camera_k_OPENCV.at(cam.first)(1,1));
+        ROS_INFO("[LUT]: cam%d | %d x %d nodes (%d px cells) | %.5f seconds to build | max error %.2e (%.4f px)",
+                 (int)cam.first, lut->cols, lut->rows, lut->cell, (rT2-rT1).total_microseconds()*1e-6,
+                 lut->max_error, lut->max_error*max_focallength);
+    }
+
+}
+
+
+std::shared_ptr<const TrackBase::UndistortLUT> TrackBase::get_undistort_lut(size_t cam_id) {
+
+    // Return if we are not using tables for this camera
+    std::unique_lock<std::mutex> lck(mtx_lut);
+    if(lut_cell_size <= 0 || lut_camera_wh.find(cam_id) == lut_camera_wh.end())
+        return nullptr;
+
+    // Rebuild our table if our calibration changed since it was built
+    auto it_lut = camera_lut.find(cam_id);
+    if(it_lut != camera_lut.end())
+        return it_lut->second;
+    boost::posix_time::ptime rT1 = boost::posix_time::microsec_clock::local_time();
+    std::shared_ptr<const UndistortLUT> lut = build_undistort_lut(cam_id, lut_camera_wh.at(cam_id));
+    camera_lut[cam_id] = lut;
+    boost::posix_time::ptime rT2 = boost::posix_time::microsec_clock::local_time();
+    //ROS_INFO("[TIME-LUT]: %.4f seconds for rebuild of cam%d (max error %.2e)",(rT2-rT1).total_microseconds() * 1e-6,(int)cam_id,lut->max_error);
+    return lut;
+
+}
+
+
+std::shared_ptr<const TrackBase::UndistortLUT> TrackBase::build_undistort_lut(size_t cam_id, const std::pair<int,int> &wh) {
+
+    // Size of our grid, we want the last node to be on or past the last pixel
+    std::shared_ptr<UndistortLUT> lut = std::make_shared<UndistortLUT>();
+    lut->width = wh.first;
+    lut->height = wh.second;
+    lut->cell = lut_cell_size;
+    lut->cols = std::max(2, (int)std::ceil((double)(lut->width-1)/lut->cell)+1);
+    lut->rows = std::max(2, (int)std::ceil((double)(lut->height-1)/lut->cell)+1);
+
+    // Our grid nodes and the center of each cell (used to check the interpolation error)
+    std::vector<cv::Point2f> pts_node, pts_center;
+    for(int r=0; r<lut->rows; r++) {
+        for(int c=0; c<lut->cols; c++) {
+            pts_node.push_back(cv::Point2f((float)(c*lut->cell), (float)(r*lut->cell)));
+            if(r+1 < lut->rows && c+1 < lut->cols)
+                pts_center.push_back(cv::Point2f((float)((c+0.5)*lut->cell), (float)((r+0.5)*lut->cell)));
+        }
+    }
+
+    // Undistort them with the iterative solvers
+    cv::Matx33d camK;
+    cv::Vec4d camD;
+    bool fisheye;
+    get_calibration(cam_id, camK, camD, fisheye);
+    auto solve = [&](const std::vector<cv::Point2f> &pts, std::vector<double> &xs, std::vector<double> &ys) {
+        xs.resize(pts.size());
+        ys.resize(pts.size());
+        for(size_t i=0; i<pts.size(); i++) {
+            xs[i] = (pts[i].x-camK(0,2))/camK(0,0);
+            ys[i] = (pts[i].y-camK(1,2))/camK(1,1);
+        }
+        if(fisheye) {
+            undistort_points_fisheye(xs, ys, camD);
+        } else {
+            undistort_points_brown(xs, ys, camD);
+        }
+    };
+    std::vector<double> xs, ys;
+    solve(pts_node, xs, ys);
+    lut->xs.assign(xs.begin(), xs.end());
+    lut->ys.assign(ys.begin(), ys.end());
+
+    // The interpolation error is the largest near the center of the cells
+    lut->max_error = 0;
+    solve(pts_center, xs, ys);
+    for(size_t i=0; i<pts_center.size(); i++) {
+        cv::Point2f pt_n;
+        if(!lut->lookup(pts_center.at(i), pt_n))
+            continue;
+        lut->max_error = std::max(lut->max_error, std::sqrt(std::pow(pt_n.x-xs[i],2)+std::pow(pt_n.y-ys[i],2)));
+    }
+    return lut;
+
+}
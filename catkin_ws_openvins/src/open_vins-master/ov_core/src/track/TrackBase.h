@@ -26,6 +26,7 @@
 #include <thread>
 #include <mutex>
 #include <atomic>
+#include <memory>
 #include <unordered_map>
 #include <Eigen/StdVector>
 
@@ -37,6 +38,8 @@
 
 #include "Grider_FAST.h"
 #include "Grider_DOG.h"
+#include "TwoPointRansac.h"
+#include "utils/FramePool.h"
 #include "feat/FeatureDatabase.h"
 #include "keyframe/KeyFrame.h"
 
@@ -51,7 +54,7 @@ namespace ov_core {
      * We have something called the "feature database" which has all the tracking information inside of it.
      * The user can ask this database for features which can then be used in an MSCKF or batch-based setting.
      * The feature tracks store both the raw (distorted) and undistorted/normalized values.
-     * Right now we just support two camera models, see: undistort_point_brown() and undistort_point_fisheye().
+     * Right now we just support two camera models, see: undistort_points_brown() and undistort_points_fisheye().
      *
      * @m_class{m-note m-warning}
      *
@@ -72,6 +75,19 @@ namespace ov_core {
 
     public:
 
+        /**
+         * @brief What outlier rejection we should use on our feature matches
+         *
+         * - FUNDAMENTAL_8PT: OpenCV's findFundamentalMat eight point RANSAC
+         * - GYRO_2PT: two point translation only RANSAC if we have a rotation prior (see set_rotation_prior()),
+         *   and an epipolar check for stereo matches if we have the camera extrinsics (see set_extrinsics()).
+         *   Falls back to FUNDAMENTAL_8PT if we do not have these.
+         */
+        enum RansacMode {
+            FUNDAMENTAL_8PT,
+            GYRO_2PT
+        };
+
         /**
          * @brief Public default constructor
          */
@@ -89,6 +105,11 @@ namespace ov_core {
             currid = (size_t) numaruco + 1;
         }
 
+        /**
+         * @brief Virtual destructor so our derived trackers can clean up their threads
+         */
+        virtual ~TrackBase() {}
+
 
         /**
          * @brief Given a the camera intrinsic values, this will set what we should normalize points with.
@@ -113,6 +134,7 @@ namespace ov_core {
                 // See https://stackoverflow.com/a/24170141/7718197
                 std::vector<std::mutex> list(camera_calib.size());
                 mtx_feeds.swap(list);
+                std::unique_lock<std::mutex> lck_calib(mtx_calib);
                 // Overwrite our fisheye calibration
                 this->camera_fisheye = camera_fisheye;
                 // Convert values to the OpenCV format
@@ -139,6 +161,11 @@ namespace ov_core {
                     tempD(3) = cam.second(7);
                     camera_d_OPENCV.insert({cam.first, tempD});
                 }
+                // Allocate what we keep for each camera, before any image is fed
+                std::vector<size_t> cam_ids;
+                for (auto const &cam : camera_calib)
+                    cam_ids.push_back(cam.first);
+                allocate_cameras(cam_ids);
                 return;
             }
 
@@ -150,8 +177,6 @@ namespace ov_core {
             for (auto const &cam : camera_calib) {
                 // Lock this image feed
                 std::unique_lock<std::mutex> lck(mtx_feeds.at(cam.first));
-                // Fisheye value
-                this->camera_fisheye.at(cam.first) = camera_fisheye.at(cam.first);
                 // Assert we are of size eight
                 assert(cam.second.rows()==8);
                 // Camera matrix
@@ -165,13 +190,22 @@ namespace ov_core {
                 tempK(2, 0) = 0;
                 tempK(2, 1) = 0;
                 tempK(2, 2) = 1;
-                camera_k_OPENCV.at(cam.first) = tempK;
                 // Distortion parameters
                 cv::Vec4d tempD;
                 tempD(0) = cam.second(4);
                 tempD(1) = cam.second(5);
                 tempD(2) = cam.second(6);
                 tempD(3) = cam.second(7);
+                // Our lookup table is stale if the calibration has changed, it will be rebuilt on its next use
+                // Both are locked together so a table can not be rebuilt with the old calibration in between
+                std::unique_lock<std::mutex> lck_lut(mtx_lut);
+                std::unique_lock<std::mutex> lck_calib(mtx_calib);
+                if(camera_k_OPENCV.at(cam.first) != tempK || camera_d_OPENCV.at(cam.first) != tempD
+                   || this->camera_fisheye.at(cam.first) != camera_fisheye.at(cam.first)) {
+                    camera_lut.erase(cam.first);
+                }
+                this->camera_fisheye.at(cam.first) = camera_fisheye.at(cam.first);
+                camera_k_OPENCV.at(cam.first) = tempK;
                 camera_d_OPENCV.at(cam.first) = tempD;
             }
 
@@ -191,11 +225,14 @@ namespace ov_core {
                     for (auto const& meas_pair : feat->timestamps) {
                         size_t camid = meas_pair.first;
                         std::unique_lock<std::mutex> lck(mtx_feeds.at(camid));
+                        std::vector<cv::Point2f> pts, pts_n;
                         for(size_t m=0; m<feat->uvs.at(camid).size(); m++) {
-                            cv::Point2f pt(feat->uvs.at(camid).at(m)(0), feat->uvs.at(camid).at(m)(1));
-                            cv::Point2f pt_n = undistort_point(pt,camid);
-                            feat->uvs_norm.at(camid).at(m)(0) = pt_n.x;
-                            feat->uvs_norm.at(camid).at(m)(1) = pt_n.y;
+                            pts.push_back(cv::Point2f(feat->uvs.at(camid).at(m)(0), feat->uvs.at(camid).at(m)(1)));
+                        }
+                        undistort_points(pts, pts_n, camid);
+                        for(size_t m=0; m<pts_n.size(); m++) {
+                            feat->uvs_norm.at(camid).at(m)(0) = pts_n.at(m).x;
+                            feat->uvs_norm.at(camid).at(m)(1) = pts_n.at(m).y;
                         }
                     }
                 }
@@ -223,6 +260,105 @@ namespace ov_core {
          */
         virtual void feed_stereo(double timestamp, cv::Mat &img_left, cv::Mat &img_right, size_t cam_id_left, size_t cam_id_right) = 0;
 
+        /**
+         * @brief Process a synchronized set of images from any number of cameras
+         * @param timestamp timestamp this set of images occured at (all cameras are synchronised)
+         * @param images grayscaled images, one for each camera id
+         * @param cam_ids camera id that each image corresponds too
+         *
+         * Cameras that have been registered as a stereo pair with set_stereo_pairs() and are both present in this set
+         * are passed to feed_stereo(), all others are passed to feed_monocular().
+         * Each of these jobs is run in its own thread, and we return once all cameras have been tracked.
+         */
+        virtual void feed_multicam(double timestamp, std::vector<cv::Mat> &images, std::vector<size_t> &cam_ids);
+
+        /**
+         * @brief Set which cameras should be stereo tracked when calling feed_multicam()
+         * @param pairs map of left camera id => right camera id
+         */
+        void set_stereo_pairs(const std::map<size_t,size_t> &pairs) {
+            stereo_pairs = pairs;
+        }
+
+        /**
+         * @brief Set the frame pool we get our preprocessed images from
+         * @param pool frame pool, which should be the same for all trackers so they only equalize each image once
+         */
+        void set_frame_pool(std::shared_ptr<FramePool> pool) {
+            assert(pool != nullptr);
+            frame_pool = pool;
+        }
+
+        /**
+         * @brief Get the newest preprocessed (histogram equalized) frame of a camera
+         * @param cam_id camera id we want the frame of
+         * @return Shared frame, or nullptr if we have not gotten an image from this camera
+         */
+        std::shared_ptr<FrameContext> get_last_frame(size_t cam_id) {
+            return frame_pool->get_last_frame(cam_id);
+        }
+
+        /**
+         * @brief Get the features tracked in the last image of a camera
+         * @param cam_id camera id we want the tracks of
+         * @param pts pixel location of each track
+         * @param ids feature id of each track (same as in the feature database)
+         */
+        void get_last_tracks(size_t cam_id, std::vector<cv::Point2f> &pts, std::vector<size_t> &ids) {
+            std::unique_lock<std::mutex> lck(mtx_feeds.at(cam_id));
+            pts.clear();
+            ids.clear();
+            if(pts_last.find(cam_id) == pts_last.end() || ids_last.find(cam_id) == ids_last.end())
+                return;
+            pts.reserve(pts_last.at(cam_id).size());
+            for(const cv::KeyPoint &kpt : pts_last.at(cam_id)) {
+                pts.push_back(kpt.pt);
+            }
+            ids = ids_last.at(cam_id);
+        }
+
+        /**
+         * @brief Set the rotation of a camera since its last image, to be used to predict where features will be
+         * @param cam_id the camera id this rotation is for
+         * @param R_C0toC1 rotation from the last image's camera frame to the next image's camera frame
+         *
+         * This is normally the integrated gyro rotation (transformed into the camera frame with the extrinsics).
+         * It is only used for the next call to a feed function of this camera and then discarded.
+         * Trackers that do not do any prediction will simply ignore it.
+         */
+        void set_rotation_prior(size_t cam_id, const Eigen::Matrix3d &R_C0toC1) {
+            rotation_prior[cam_id] = std::make_pair(true, R_C0toC1);
+        }
+
+        /**
+         * @brief Removes the rotation prior of a camera (i.e. if we could not compute one for the next image)
+         * @param cam_id the camera id we want to clear
+         */
+        void clear_rotation_prior(size_t cam_id) {
+            if(rotation_prior.find(cam_id) != rotation_prior.end())
+                rotation_prior.at(cam_id).first = false;
+        }
+
+        /**
+         * @brief Set what outlier rejection we should use on our feature matches
+         * @param mode ransac method we will use
+         * @param compare if true, we will run both methods and print their timing and inlier ratio (debugging only)
+         */
+        void set_ransac_mode(RansacMode mode, bool compare=false) {
+            ransac_mode = mode;
+            ransac_compare = compare;
+        }
+
+        /**
+         * @brief Set the camera to IMU extrinsics, used to check stereo matches with their known epipolar geometry
+         * @param R_ItoC Map of camera_id => rotation from IMU to camera frame
+         * @param p_IinC Map of camera_id => position of the IMU in the camera frame
+         */
+        void set_extrinsics(const std::map<size_t,Eigen::Matrix3d> &R_ItoC, const std::map<size_t,Eigen::Vector3d> &p_IinC) {
+            camera_R_ItoC = R_ItoC;
+            camera_p_IinC = p_IinC;
+        }
+
         /**
          * @brief Shows features extracted in the last image
          * @param img_out image to which we will overlayed features on
@@ -274,10 +410,12 @@ namespace ov_core {
         }
 
         std::map<size_t, cv::Matx33d> get_camera_k_OPENCV() {
+            std::unique_lock<std::mutex> lck(mtx_calib);
             return camera_k_OPENCV;
         }
 
         std::map<size_t, cv::Vec4d> get_camera_d_OPENCV(){
+            std::unique_lock<std::mutex> lck(mtx_calib);
             return camera_d_OPENCV;
         }    // 相机组对应的畸变系数
 
@@ -289,67 +427,276 @@ namespace ov_core {
          * @return undistorted 2x1 point
          *
          * Given a uv point, this will undistort it based on the camera matrices.
+         * If you have more then one point, please use undistort_points() instead.
+         */
+         // 返回归一化平面坐标
+        cv::Point2f undistort_point(cv::Point2f pt_in, size_t cam_id) {
+            std::vector<cv::Point2f> pts_in = {pt_in}, pts_out;
+            undistort_points(pts_in, pts_out, cam_id);
+            return pts_out.at(0);
+        }
+
+        /**
+         * @brief Main function that will undistort/normalize a set of points from the same camera.
+         * @param pts_in uv 2x1 points that we will undistort
+         * @param pts_out undistorted 2x1 points (can be the same vector as the input)
+         * @param cam_id id of which camera these points are in
+         *
+         * Given uv points, this will undistort them based on the camera matrices.
          * This will call on the model needed, depending on what type of camera it is!
          * So if we have fisheye for camera_1 is true, we will undistort with the fisheye model.
          * In Kalibr's terms, the non-fisheye is `pinhole-radtan` while the fisheye is the `pinhole-equi` model.
+         * All points are processed together in flat arrays, so this is much faster than undistorting each point on its own.
          */
-         // opencv undistort_point 返回归一化平面坐标
-        cv::Point2f undistort_point(cv::Point2f pt_in, size_t cam_id) {
-            // Determine what camera parameters we should use
-            cv::Matx33d camK = this->camera_k_OPENCV.at(cam_id);
-            cv::Vec4d camD = this->camera_d_OPENCV.at(cam_id);
+        void undistort_points(const std::vector<cv::Point2f> &pts_in, std::vector<cv::Point2f> &pts_out, size_t cam_id) {
+            // Determine what camera parameters we should use (copied, as the loop closure thread can also call this)
+            cv::Matx33d camK;
+            cv::Vec4d camD;
+            bool fisheye;
+            get_calibration(cam_id, camK, camD, fisheye);
+            std::shared_ptr<const UndistortLUT> lut = get_undistort_lut(cam_id);
+            // Lookup what we can, and remove the camera matrix of the points we still need to solve for
+            size_t num_pts = pts_in.size();
+            pts_out.resize(num_pts);
+            std::vector<double> xs, ys;
+            std::vector<size_t> ids_solve;
+            const double ifx = 1.0/camK(0,0), ify = 1.0/camK(1,1), cx = camK(0,2), cy = camK(1,2);
+            for(size_t i=0; i<num_pts; i++) {
+                const cv::Point2f pt = pts_in[i];
+                if(lut != nullptr && lut->lookup(pt, pts_out[i]))
+                    continue;
+                xs.push_back((pt.x-cx)*ifx);
+                ys.push_back((pt.y-cy)*ify);
+                ids_solve.push_back(i);
+            }
+            if(ids_solve.empty())
+                return;
             // Call on the fisheye if we should!
-            if (this->camera_fisheye.at(cam_id)) {
-                return undistort_point_fisheye(pt_in, camK, camD);   // 如果是鱼眼相机，采用鱼眼相机去畸变模型
+            if (fisheye) {
+                undistort_points_fisheye(xs, ys, camD);   // 如果是鱼眼相机，采用鱼眼相机去畸变模型
+            } else {
+                undistort_points_brown(xs, ys, camD);     // 否则采用brown模型去畸变，针孔模型
+            }
+            // Copy back into our output
+            for(size_t k=0; k<ids_solve.size(); k++) {
+                pts_out[ids_solve[k]].x = (float)xs[k];
+                pts_out[ids_solve[k]].y = (float)ys[k];
+            }
+        }
+
+        /**
+         * @brief Enables the use of precomputed normalized coordinates for each camera
+         * @param camera_wh Map of camera_id => image width and height
+         * @param cell_size pixel spacing of the grid we precompute (1 gives a dense table)
+         *
+         * If the intrinsics are not calibrated online, the normalized coordinate of a pixel never changes.
+         * So we undistort a grid of pixels once, and then undistort_points() just bilinear interpolates inside of it.
+         * Points outside of the image are still passed to the iterative solvers.
+         * If set_calibration() changes the intrinsics of a camera, its table will be rebuilt the next time it is used.
+         * Needs to be called after set_calibration(), and a cell_size of zero or less disables the tables.
+         */
+        void set_undistort_lut(const std::map<size_t,std::pair<int,int>> &camera_wh, int cell_size);
+
+        /**
+         * @brief Main function that will distort a normalized point into the raw image.
+         * @param pt_in normalized 2x1 point that we will distort
+         * @param cam_id id of which camera this point is in
+         * @return distorted uv 2x1 point
+         *
+         * This is the inverse of undistort_point(), and uses the same camera model selection.
+         */
+        cv::Point2f distort_point(cv::Point2f pt_in, size_t cam_id) {
+            // Determine what camera parameters we should use
+            cv::Matx33d camK;
+            cv::Vec4d camD;
+            bool fisheye;
+            get_calibration(cam_id, camK, camD, fisheye);
+            // Distort the normalized point
+            double x = pt_in.x, y = pt_in.y;
+            double x_dist, y_dist;
+            if (fisheye) {
+                // Equidistant model, see cv::fisheye::distortPoints
+                double r = std::sqrt(x*x+y*y);
+                double theta = std::atan(r);
+                double theta2 = theta*theta, theta4 = theta2*theta2, theta6 = theta4*theta2, theta8 = theta4*theta4;
+                double thetad = theta*(1+camD(0)*theta2+camD(1)*theta4+camD(2)*theta6+camD(3)*theta8);
+                double scale = (r > 1e-8)? thetad/r : 1.0;
+                x_dist = x*scale;
+                y_dist = y*scale;
+            } else {
+                // Radial-tangential model, see cv::projectPoints
+                double r2 = x*x+y*y;
+                double r4 = r2*r2;
+                double radial = 1+camD(0)*r2+camD(1)*r4;
+                x_dist = x*radial+2*camD(2)*x*y+camD(3)*(r2+2*x*x);
+                y_dist = y*radial+camD(2)*(r2+2*y*y)+2*camD(3)*x*y;
             }
-            return undistort_point_brown(pt_in, camK, camD);        // 否则采用brown模型去畸变，针孔模型
+            // Finally project into the image with the intrinsics
+            return cv::Point2f((float)(camK(0,0)*x_dist+camK(0,2)), (float)(camK(1,1)*y_dist+camK(1,2)));
         }
 
     protected:
 
+        /**
+         * @brief Allocates the state we keep for each camera, called once by set_calibration()
+         * @param cam_ids camera ids we have a calibration for
+         *
+         * Our state is in maps keyed by camera id, and adding a camera to one while another thread reads a different camera is a data race.
+         * So everything is added here, and feeds (and their background work) only ever look up their own entries.
+         * Trackers that keep more state for each camera should override this (and call this one).
+         */
+        virtual void allocate_cameras(const std::vector<size_t> &cam_ids) {
+            for(size_t cam_id : cam_ids) {
+                pts_last[cam_id];
+                ids_last[cam_id];
+            }
+        }
+
+        /**
+         * @brief Normalized coordinates of a grid of pixels in a single camera, see set_undistort_lut()
+         *
+         * Grid nodes are spaced by `cell` pixels starting at the top left pixel, and the last row and column
+         * of nodes is at or past the last pixel, so any point inside the image can be bilinear interpolated.
+         */
+        struct UndistortLUT {
+
+            /// Image size and spacing of our grid in pixels
+            int width, height, cell;
+
+            /// Number of grid nodes in each direction
+            int cols, rows;
+
+            /// Normalized coordinates of each grid node (row major)
+            std::vector<float> xs, ys;
+
+            /// Max interpolation error (in normalized coordinates) found at the center of the cells
+            double max_error;
+
+            /// Bilinear interpolates the normalized coordinate, returns false if the point is outside the image
+            bool lookup(const cv::Point2f &pt, cv::Point2f &pt_n) const {
+                if(!(pt.x >= 0 && pt.y >= 0 && pt.x <= width-1 && pt.y <= height-1))
+                    return false;
+                const float u = pt.x/cell, v = pt.y/cell;
+                const int c = std::min((int)u, cols-2);
+                const int r = std::min((int)v, rows-2);
+                const float a = u-c, b = v-r;
+                const size_t i00 = (size_t)(r*cols+c), i10 = i00+1, i01 = i00+cols, i11 = i01+1;
+                pt_n.x = (1-b)*((1-a)*xs[i00]+a*xs[i10]) + b*((1-a)*xs[i01]+a*xs[i11]);
+                pt_n.y = (1-b)*((1-a)*ys[i00]+a*ys[i10]) + b*((1-a)*ys[i01]+a*ys[i11]);
+                return true;
+            }
+
+        };
+
+        /**
+         * @brief Copies the calibration of a camera, as set_calibration() can change it while another thread undistorts
+         * @param cam_id id of the camera we want the calibration of
+         * @param camK camera intrinsics
+         * @param camD camera distortion
+         * @param fisheye if the camera is a fisheye model
+         */
+        void get_calibration(size_t cam_id, cv::Matx33d &camK, cv::Vec4d &camD, bool &fisheye) {
+            std::unique_lock<std::mutex> lck(mtx_calib);
+            camK = camera_k_OPENCV.at(cam_id);
+            camD = camera_d_OPENCV.at(cam_id);
+            fisheye = camera_fisheye.at(cam_id);
+        }
+
+        /**
+         * @brief Gets the lookup table of a camera, building it if it is stale
+         * @param cam_id id of the camera we want the table of
+         * @return Lookup table, or nullptr if we are not using them
+         */
+        std::shared_ptr<const UndistortLUT> get_undistort_lut(size_t cam_id);
+
+        /**
+         * @brief Undistorts the grid of pixels of a camera with its current calibration
+         * @param cam_id id of the camera we want to build the table of
+         * @param wh width and height of the camera
+         * @return Newly built lookup table
+         */
+        std::shared_ptr<const UndistortLUT> build_undistort_lut(size_t cam_id, const std::pair<int,int> &wh);
+
+        /**
+         * @brief Gets the rotation prior of this camera, and marks it as used so it is only used for one image
+         * @param cam_id id of the camera we want the rotation prior of
+         * @param R_C0toC1 rotation from the last image to the current image
+         * @return True if we have a valid rotation prior
+         */
+        bool use_rotation_prior(size_t cam_id, Eigen::Matrix3d &R_C0toC1) {
+            auto it_prior = rotation_prior.find(cam_id);
+            if(it_prior == rotation_prior.end() || !it_prior->second.first)
+                return false;
+            R_C0toC1 = it_prior->second.second;
+            it_prior->second.first = false;
+            return true;
+        }
+
+        /**
+         * @brief Outlier rejection of matches between two images
+         * @param pts0_n normalized points in the first image
+         * @param pts1_n normalized points in the second image
+         * @param id0 id of the first camera
+         * @param id1 id of the second camera
+         * @param has_rotation if we know the rotation between the two images (temporal tracking)
+         * @param R_C0toC1 rotation from the first image to the second image
+         * @param mask_rsc mask of which matches are inliers
+         *
+         * This will use the outlier rejection selected with set_ransac_mode().
+         * If the camera ids are different we are matching a stereo pair, and thus can use the extrinsics if we have them.
+         */
+        void perform_ransac(const std::vector<cv::Point2f> &pts0_n, const std::vector<cv::Point2f> &pts1_n, size_t id0, size_t id1,
+                            bool has_rotation, const Eigen::Matrix3d &R_C0toC1, std::vector<uchar> &mask_rsc);
+
         /**
          * @brief Undistort function RADTAN/BROWN.
          *
-         * Given a uv point, this will undistort it based on the camera matrices.
+         * Given distorted normalized points, this will undistort them in place.
          * To equate this to Kalibr's models, this is what you would use for `pinhole-radtan`.
+         * This is the same fixed-point iteration as cv::undistortPoints(), but with a fixed number of iterations
+         * over flat arrays so the inner loop has no branches and can be vectorized.
          */
-         // 回回的是归化化平面坐标
-        cv::Point2f undistort_point_brown(cv::Point2f pt_in, cv::Matx33d &camK, cv::Vec4d &camD) {
-            // Convert to opencv format
-            cv::Mat mat(1, 2, CV_32F);
-            mat.at<float>(0, 0) = pt_in.x;
-            mat.at<float>(0, 1) = pt_in.y;
-            mat = mat.reshape(2); // Nx1, 2-channel
-            // Undistort it!
-            cv::undistortPoints(mat, mat, camK, camD);
-            // Construct our return vector
-            cv::Point2f pt_out;
-            mat = mat.reshape(1); // Nx2, 1-channel
-            pt_out.x = mat.at<float>(0, 0);
-            pt_out.y = mat.at<float>(0, 1);
-            return pt_out;
+         // 返回的是归一化平面坐标
+        static void undistort_points_brown(std::vector<double> &xs, std::vector<double> &ys, const cv::Vec4d &camD) {
+            const double k1 = camD(0), k2 = camD(1), p1 = camD(2), p2 = camD(3);
+            const std::vector<double> xs0 = xs, ys0 = ys;
+            const size_t num_pts = xs.size();
+            for(int iter=0; iter<10; iter++) {
+                for(size_t i=0; i<num_pts; i++) {
+                    const double x = xs[i], y = ys[i];
+                    const double r2 = x*x+y*y;
+                    const double icdist = 1.0/(1.0+(k2*r2+k1)*r2);
+                    const double dx = 2*p1*x*y+p2*(r2+2*x*x);
+                    const double dy = p1*(r2+2*y*y)+2*p2*x*y;
+                    xs[i] = (xs0[i]-dx)*icdist;
+                    ys[i] = (ys0[i]-dy)*icdist;
+                }
+            }
         }
 
         /**
          * @brief Undistort function FISHEYE/EQUIDISTANT.
          *
-         * Given a uv point, this will undistort it based on the camera matrices.
+         * Given distorted normalized points, this will undistort them in place.
          * To equate this to Kalibr's models, this is what you would use for `pinhole-equi`.
+         * This is the same Newton iteration on the angle as cv::fisheye::undistortPoints().
          */
-        cv::Point2f undistort_point_fisheye(cv::Point2f pt_in, cv::Matx33d &camK, cv::Vec4d &camD) {
-            // Convert point to opencv format          输入图像坐标系坐标，返回去畸变后的图像坐标系坐标
-            cv::Mat mat(1, 2, CV_32F);
-            mat.at<float>(0, 0) = pt_in.x;
-            mat.at<float>(0, 1) = pt_in.y;
-            mat = mat.reshape(2); // Nx1, 2-channel
-            // Undistort it!
-            cv::fisheye::undistortPoints(mat, mat, camK, camD);
-            // Construct our return vector
-            cv::Point2f pt_out;
-            mat = mat.reshape(1); // Nx2, 1-channel
-            pt_out.x = mat.at<float>(0, 0);
-            pt_out.y = mat.at<float>(0, 1);
-            return pt_out;
+        static void undistort_points_fisheye(std::vector<double> &xs, std::vector<double> &ys, const cv::Vec4d &camD) {
+            const double k1 = camD(0), k2 = camD(1), k3 = camD(2), k4 = camD(3);
+            const size_t num_pts = xs.size();
+            for(size_t i=0; i<num_pts; i++) {
+                const double theta_d = std::min(std::sqrt(xs[i]*xs[i]+ys[i]*ys[i]), M_PI/2);
+                double theta = theta_d;
+                for(int iter=0; iter<10; iter++) {
+                    const double theta2 = theta*theta, theta4 = theta2*theta2, theta6 = theta4*theta2, theta8 = theta6*theta2;
+                    const double f = theta*(1+k1*theta2+k2*theta4+k3*theta6+k4*theta8)-theta_d;
+                    const double df = 1+3*k1*theta2+5*k2*theta4+7*k3*theta6+9*k4*theta8;
+                    theta -= f/df;
+                }
+                const double scale = (theta_d > 1e-8)? std::tan(theta)/theta_d : 1.0;
+                xs[i] *= scale;
+                ys[i] *= scale;
+            }
         }
 
         /// Database with all our current features
@@ -382,6 +729,40 @@ namespace ov_core {
         /// Master ID for this tracker (atomic to allow for multi-threading)
         std::atomic<size_t> currid;
 
+        /// Stereo pairs used by feed_multicam() (left camera id => right camera id)
+        std::map<size_t, size_t> stereo_pairs;
+
+        /// Pool of preprocessed images, which can be shared with other trackers
+        std::shared_ptr<FramePool> frame_pool = std::make_shared<FramePool>();
+
+        /// Rotation of each camera since its last image (if valid), see set_rotation_prior()
+        std::map<size_t, std::pair<bool,Eigen::Matrix3d>> rotation_prior;
+
+        /// Outlier rejection method we use on our matches
+        RansacMode ransac_mode = FUNDAMENTAL_8PT;
+
+        /// If we should run all outlier rejection methods and print their timing and inliers
+        bool ransac_compare = false;
+
+        /// Camera extrinsics (rotation from IMU to camera, and IMU position in the camera)
+        std::map<size_t, Eigen::Matrix3d> camera_R_ItoC;
+        std::map<size_t, Eigen::Vector3d> camera_p_IinC;
+
+        /// Mutex for our lookup tables (the loop closure thread can also undistort points)
+        std::mutex mtx_lut;
+
+        /// Mutex for our calibration, which the loop closure thread reads while set_calibration() can change it (locked after mtx_lut)
+        std::mutex mtx_calib;
+
+        /// Pixel spacing of the undistortion lookup tables (zero or less if not used)
+        int lut_cell_size = 0;
+
+        /// Image size of each camera we build lookup tables for
+        std::map<size_t, std::pair<int,int>> lut_camera_wh;
+
+        /// Undistortion lookup table of each camera, removed if stale and rebuilt on its next use
+        std::map<size_t, std::shared_ptr<const UndistortLUT>> camera_lut;
+
 
     };
 
@@ -32,14 +32,13 @@ void TrackDescriptor::feed_monocular(double timestamp, cv::Mat &imgin, size_t ca
     // Lock this data feed for this camera
     std::unique_lock<std::mutex> lck(mtx_feeds.at(cam_id));
 
-    // Histogram equalize
-    cv::Mat img;
-    cv::equalizeHist(imgin, img);
+    // Histogram equalize (shared with our other trackers, and does not write into the passed image)
+    cv::Mat img = frame_pool->get_frame(timestamp, cam_id, imgin)->image;
 
     // If we are the first frame (or have lost tracking), initialize our descriptors
     if(pts_last.find(cam_id)==pts_last.end() || pts_last[cam_id].empty()) {
         perform_detection_monocular(img, pts_last[cam_id], desc_last[cam_id], ids_last[cam_id]);
-        img_last[cam_id] = img.clone();
+        img_last[cam_id] = img;
         return;
     }
 
@@ -111,8 +110,13 @@ void TrackDescriptor::feed_monocular(double timestamp, cv::Mat &imgin, size_t ca
 
 
     // Update our feature database, with theses new observations
+    std::vector<cv::Point2f> good_left_n;
+    for(size_t i=0; i<good_left.size(); i++) {
+        good_left_n.push_back(good_left.at(i).pt);
+    }
+    undistort_points(good_left_n, good_left_n, cam_id);
     for(size_t i=0; i<good_left.size(); i++) {
-        cv::Point2f npt_l = undistort_point(good_left.at(i).pt, cam_id);
+        cv::Point2f npt_l = good_left_n.at(i);
         database->update_feature(good_ids_left.at(i), timestamp, cam_id,
                                  good_left.at(i).pt.x, good_left.at(i).pt.y,
                                  npt_l.x, npt_l.y);
@@ -123,7 +127,7 @@ void TrackDescriptor::feed_monocular(double timestamp, cv::Mat &imgin, size_t ca
 
 
     // Move forward in time
-    img_last[cam_id] = img.clone();
+    img_last[cam_id] = img;
     pts_last[cam_id] = good_left;
     ids_last[cam_id] = good_ids_left;
     desc_last[cam_id] = good_desc_left;
@@ -149,9 +153,8 @@ void TrackDescriptor::feed_stereo(double timestamp, cv::Mat &img_leftin, cv::Mat
     std::unique_lock<std::mutex> lck2(mtx_feeds.at(cam_id_right));
 
     // Histogram equalize
-    cv::Mat img_left, img_right;
-    cv::equalizeHist(img_leftin, img_left);
-    cv::equalizeHist(img_rightin, img_right);
+    cv::Mat img_left = frame_pool->get_frame(timestamp, cam_id_left, img_leftin)->image;
+    cv::Mat img_right = frame_pool->get_frame(timestamp, cam_id_right, img_rightin)->image;
 
     // If we are the first frame (or have lost tracking), initialize our descriptors
     if(pts_last[cam_id_left].empty() || pts_last[cam_id_right].empty()) {
@@ -160,8 +163,14 @@ void TrackDescriptor::feed_stereo(double timestamp, cv::Mat &img_leftin, cv::Mat
                                  desc_last[cam_id_left], desc_last[cam_id_right],
                                  cam_id_left, cam_id_right,
                                  ids_last[cam_id_left], ids_last[cam_id_right]);
-        img_last[cam_id_left] = img_left.clone();
-        img_last[cam_id_right] = img_right.clone();
+        img_last[cam_id_left] = img_left;
+        img_last[cam_id_right] = img_right;
+        return;
+    }
+
+    // If we are reusing our stereo pairs, then we do not match all left to right features
+    if(use_stereo_reuse) {
+        feed_stereo_reuse(timestamp, img_left, img_right, cam_id_left, cam_id_right);
         return;
     }
 
@@ -261,12 +270,19 @@ void TrackDescriptor::feed_stereo(double timestamp, cv::Mat &img_leftin, cv::Mat
 
 
     // Update our feature database, with theses new observations
+    std::vector<cv::Point2f> good_left_n, good_right_n;
+    for(size_t i=0; i<good_left.size(); i++) {
+        good_left_n.push_back(good_left.at(i).pt);
+        good_right_n.push_back(good_right.at(i).pt);
+    }
+    undistort_points(good_left_n, good_left_n, cam_id_left);
+    undistort_points(good_right_n, good_right_n, cam_id_right);
     for(size_t i=0; i<good_left.size(); i++) {
         // Assert that our IDs are the same
         assert(good_ids_left.at(i)==good_ids_right.at(i));
-        // Try to undistort the point
-        cv::Point2f npt_l = undistort_point(good_left.at(i).pt, cam_id_left);
-        cv::Point2f npt_r = undistort_point(good_right.at(i).pt, cam_id_right);
+        // Our undistorted points
+        cv::Point2f npt_l = good_left_n.at(i);
+        cv::Point2f npt_r = good_right_n.at(i);
         // Append to the database
         database->update_feature(good_ids_left.at(i), timestamp, cam_id_left,
                                  good_left.at(i).pt.x, good_left.at(i).pt.y,
@@ -283,8 +299,8 @@ void TrackDescriptor::feed_stereo(double timestamp, cv::Mat &img_leftin, cv::Mat
 
 
     // Move forward in time
-    img_last[cam_id_left] = img_left.clone();
-    img_last[cam_id_right] = img_right.clone();
+    img_last[cam_id_left] = img_left;
+    img_last[cam_id_right] = img_right;
     pts_last[cam_id_left] = good_left;
     pts_last[cam_id_right] = good_right;
     ids_last[cam_id_left] = good_ids_left;
@@ -302,6 +318,170 @@ void TrackDescriptor::feed_stereo(double timestamp, cv::Mat &img_leftin, cv::Mat
 
 }
 
+void TrackDescriptor::feed_stereo_reuse(double timestamp, const cv::Mat &img_left, const cv::Mat &img_right, size_t cam_id_left, size_t cam_id_right) {
+
+    // Our new keypoints and descriptor for the new image (not matched left to right yet)
+    std::vector<cv::KeyPoint> pts_left_new, pts_right_new;
+    cv::Mat desc_left_new, desc_right_new;
+
+    // First, extract new descriptors for this new image
+    perform_extraction_stereo(img_left, img_right, pts_left_new, pts_right_new, desc_left_new, desc_right_new);
+    rT2 =  boost::posix_time::microsec_clock::local_time();
+
+
+    //===================================================================================
+    //===================================================================================
+
+
+    // Our matches temporally
+    std::vector<cv::DMatch> matches_ll, matches_rr;
+
+    // Lets match temporally
+    boost::thread t_ll = boost::thread(&TrackDescriptor::robust_match, this, boost::ref(pts_last[cam_id_left]), boost::ref(pts_left_new),
+                                       boost::ref(desc_last[cam_id_left]), boost::ref(desc_left_new), cam_id_left, cam_id_left, boost::ref(matches_ll));
+    boost::thread t_rr = boost::thread(&TrackDescriptor::robust_match, this, boost::ref(pts_last[cam_id_right]), boost::ref(pts_right_new),
+                                       boost::ref(desc_last[cam_id_right]), boost::ref(desc_right_new), cam_id_right, cam_id_right, boost::ref(matches_rr));
+
+    // Wait till both threads finish
+    t_ll.join();
+    t_rr.join();
+    rT3 =  boost::posix_time::microsec_clock::local_time();
+
+
+    //===================================================================================
+    //===================================================================================
+
+    // Get our "good tracks"
+    std::vector<cv::KeyPoint> good_left, good_right;
+    std::vector<size_t> good_ids_left, good_ids_right;
+    cv::Mat good_desc_left, good_desc_right;
+
+    // Points must be of equal size
+    assert(pts_last[cam_id_left].size() == pts_last[cam_id_right].size());
+
+    // Old index each new point was matched to (the old left and right points are pairs at the same index)
+    std::vector<int> old_of_left(pts_left_new.size(), -1), old_of_right(pts_right_new.size(), -1);
+    for(const cv::DMatch &match : matches_ll) {
+        old_of_left.at((size_t)match.trainIdx) = match.queryIdx;
+    }
+    std::vector<int> right_of_old(pts_last[cam_id_right].size(), -1);
+    for(const cv::DMatch &match : matches_rr) {
+        old_of_right.at((size_t)match.trainIdx) = match.queryIdx;
+        right_of_old.at((size_t)match.queryIdx) = match.trainIdx;
+    }
+
+    // If both the left and right points were tracked from the same old pair, then we keep that pair
+    // Their descriptors are carried over with the track, so we do not need to match them left to right again
+    int num_tracklast = 0;
+    std::vector<bool> paired_left(pts_left_new.size(), false), paired_right(pts_right_new.size(), false);
+    for(size_t i=0; i<pts_left_new.size(); i++) {
+        int idll = old_of_left.at(i);
+        if(idll == -1)
+            continue;
+        int j = right_of_old.at((size_t)idll);
+        if(j == -1 || ids_last[cam_id_left][idll] != ids_last[cam_id_right][idll])
+            continue;
+        good_left.push_back(pts_left_new[i]);
+        good_right.push_back(pts_right_new[(size_t)j]);
+        good_desc_left.push_back(desc_left_new.row((int)i));
+        good_desc_right.push_back(desc_right_new.row(j));
+        good_ids_left.push_back(ids_last[cam_id_left][idll]);
+        good_ids_right.push_back(ids_last[cam_id_left][idll]);
+        paired_left.at(i) = true;
+        paired_right.at((size_t)j) = true;
+        num_tracklast++;
+    }
+
+    // Get all the points that we could not pair from the last images
+    std::vector<cv::KeyPoint> pts_left_un, pts_right_un;
+    cv::Mat desc_left_un, desc_right_un;
+    std::vector<size_t> index_left_un, index_right_un;
+    for(size_t i=0; i<pts_left_new.size(); i++) {
+        if(paired_left.at(i))
+            continue;
+        pts_left_un.push_back(pts_left_new[i]);
+        desc_left_un.push_back(desc_left_new.row((int)i));
+        index_left_un.push_back(i);
+    }
+    for(size_t j=0; j<pts_right_new.size(); j++) {
+        if(paired_right.at(j))
+            continue;
+        pts_right_un.push_back(pts_right_new[j]);
+        desc_right_un.push_back(desc_right_new.row((int)j));
+        index_right_un.push_back(j);
+    }
+
+    // Now match just these left to right along their epipolar lines
+    std::vector<cv::DMatch> matches_lr;
+    epipolar_match(pts_left_un, pts_right_un, desc_left_un, desc_right_un, cam_id_left, cam_id_right, matches_lr);
+
+    // Append the new pairs, if the left (or right) was tracked then we continue its track, else it is a new feature
+    for(size_t m=0; m<matches_lr.size(); m++) {
+        size_t i = index_left_un.at((size_t)matches_lr.at(m).queryIdx);
+        size_t j = index_right_un.at((size_t)matches_lr.at(m).trainIdx);
+        size_t id;
+        if(old_of_left.at(i) != -1) id = ids_last[cam_id_left][old_of_left.at(i)];
+        else if(old_of_right.at(j) != -1) id = ids_last[cam_id_right][old_of_right.at(j)];
+        else id = ++currid;
+        good_left.push_back(pts_left_new[i]);
+        good_right.push_back(pts_right_new[j]);
+        good_desc_left.push_back(desc_left_new.row((int)i));
+        good_desc_right.push_back(desc_right_new.row((int)j));
+        good_ids_left.push_back(id);
+        good_ids_right.push_back(id);
+    }
+    rT4 =  boost::posix_time::microsec_clock::local_time();
+
+
+    //===================================================================================
+    //===================================================================================
+
+
+    // Update our feature database, with theses new observations
+    std::vector<cv::Point2f> good_left_n, good_right_n;
+    for(size_t i=0; i<good_left.size(); i++) {
+        good_left_n.push_back(good_left.at(i).pt);
+        good_right_n.push_back(good_right.at(i).pt);
+    }
+    undistort_points(good_left_n, good_left_n, cam_id_left);
+    undistort_points(good_right_n, good_right_n, cam_id_right);
+    for(size_t i=0; i<good_left.size(); i++) {
+        cv::Point2f npt_l = good_left_n.at(i);
+        cv::Point2f npt_r = good_right_n.at(i);
+        database->update_feature(good_ids_left.at(i), timestamp, cam_id_left,
+                                 good_left.at(i).pt.x, good_left.at(i).pt.y,
+                                 npt_l.x, npt_l.y);
+        database->update_feature(good_ids_left.at(i), timestamp, cam_id_right,
+                                 good_right.at(i).pt.x, good_right.at(i).pt.y,
+                                 npt_r.x, npt_r.y);
+    }
+
+
+    // Debug info
+    //ROS_INFO("LtoL = %d | RtoR = %d | reused = %d | LtoR = %d | good = %d", (int)matches_ll.size(),
+    //         (int)matches_rr.size(),num_tracklast,(int)matches_lr.size(),(int)good_left.size());
+
+
+    // Move forward in time
+    img_last[cam_id_left] = img_left;
+    img_last[cam_id_right] = img_right;
+    pts_last[cam_id_left] = good_left;
+    pts_last[cam_id_right] = good_right;
+    ids_last[cam_id_left] = good_ids_left;
+    ids_last[cam_id_right] = good_ids_right;
+    desc_last[cam_id_left] = good_desc_left;
+    desc_last[cam_id_right] = good_desc_right;
+    rT5 =  boost::posix_time::microsec_clock::local_time();
+
+    // Our timing information
+    //ROS_INFO("[TIME-DESC]: %.4f seconds for detection",(rT2-rT1).total_microseconds() * 1e-6);
+    //ROS_INFO("[TIME-DESC]: %.4f seconds for matching",(rT3-rT2).total_microseconds() * 1e-6);
+    //ROS_INFO("[TIME-DESC]: %.4f seconds for pairing (%d reused, %d epipolar)",(rT4-rT3).total_microseconds() * 1e-6, num_tracklast, (int)matches_lr.size());
+    //ROS_INFO("[TIME-DESC]: %.4f seconds for feature DB update (%d features)",(rT5-rT4).total_microseconds() * 1e-6, (int)good_left.size());
+    //ROS_INFO("[TIME-DESC]: %.4f seconds for total",(rT5-rT1).total_microseconds() * 1e-6);
+
+}
+
 void TrackDescriptor::perform_detection_monocular(const cv::Mat& img0, std::vector<cv::KeyPoint>& pts0,
                                                   cv::Mat& desc0, std::vector<size_t>& ids0) {
 
@@ -338,8 +518,43 @@ void TrackDescriptor::perform_detection_stereo(const cv::Mat &img0, const cv::Ma
     assert(pts0.empty());
     assert(pts1.empty());
 
-    // Extract our features (use FAST with griding)
+    // Extract our features and their descriptors in both images
     std::vector<cv::KeyPoint> pts0_ext, pts1_ext;
+    cv::Mat desc0_ext, desc1_ext;
+    perform_extraction_stereo(img0, img1, pts0_ext, pts1_ext, desc0_ext, desc1_ext);
+
+    // Do matching from the left to the right image
+    // If we are reusing stereo pairs, we know the extrinsics so only need to search along the epipolar lines
+    std::vector<cv::DMatch> matches;
+    if(use_stereo_reuse) {
+        epipolar_match(pts0_ext, pts1_ext, desc0_ext, desc1_ext, cam_id0, cam_id1, matches);
+    } else {
+        robust_match(pts0_ext, pts1_ext, desc0_ext, desc1_ext, cam_id0, cam_id1, matches);
+    }
+
+    // For all good matches, lets append to our returned vectors
+    for(size_t i=0; i<matches.size(); i++) {
+        // Get our ids
+        int index_pt0 = matches.at(i).queryIdx;
+        int index_pt1 = matches.at(i).trainIdx;
+        // Append our keypoints and descriptors
+        pts0.push_back(pts0_ext[index_pt0]);
+        pts1.push_back(pts1_ext[index_pt1]);
+        desc0.push_back(desc0_ext.row(index_pt0));
+        desc1.push_back(desc1_ext.row(index_pt1));
+        // Set our IDs to be unique IDs here, will later replace with corrected ones, after temporal matching
+        size_t temp = ++currid;
+        ids0.push_back(temp);
+        ids1.push_back(temp);
+    }
+
+}
+
+void TrackDescriptor::perform_extraction_stereo(const cv::Mat &img0, const cv::Mat &img1,
+                                                std::vector<cv::KeyPoint> &pts0_ext, std::vector<cv::KeyPoint> &pts1_ext,
+                                                cv::Mat &desc0_ext, cv::Mat &desc1_ext) {
+
+    // Extract our features (use FAST with griding)
     boost::thread t_0 = boost::thread(&Grider_FAST::perform_griding, boost::cref(img0), boost::ref(pts0_ext),
                                       num_features, grid_x, grid_y, threshold, true);
     boost::thread t_1 = boost::thread(&Grider_FAST::perform_griding, boost::cref(img1), boost::ref(pts1_ext),
@@ -350,8 +565,6 @@ void TrackDescriptor::perform_detection_stereo(const cv::Mat &img0, const cv::Ma
     t_1.join();
 
     // For all new points, extract their descriptors
-    cv::Mat desc0_ext, desc1_ext;
-
     // Use C++11 lamdas so we can pass all theses variables by reference
     std::thread t_desc0 = std::thread([this,&img0,&pts0_ext,&desc0_ext]{this->orb0->compute(img0, pts0_ext, desc0_ext);});
     std::thread t_desc1 = std::thread([this,&img1,&pts1_ext,&desc1_ext]{this->orb1->compute(img1, pts1_ext, desc1_ext);});
@@ -362,37 +575,168 @@ void TrackDescriptor::perform_detection_stereo(const cv::Mat &img0, const cv::Ma
     t_desc0.join();
     t_desc1.join();
 
-    // Do matching from the left to the right image
-    std::vector<cv::DMatch> matches;
-    robust_match(pts0_ext, pts1_ext, desc0_ext, desc1_ext, cam_id0, cam_id1, matches);
+}
 
-    // For all good matches, lets append to our returned vectors
-    for(size_t i=0; i<matches.size(); i++) {
-        // Get our ids
-        int index_pt0 = matches.at(i).queryIdx;
-        int index_pt1 = matches.at(i).trainIdx;
-        // Append our keypoints and descriptors
-        pts0.push_back(pts0_ext[index_pt0]);
-        pts1.push_back(pts1_ext[index_pt1]);
-        desc0.push_back(desc0_ext.row(index_pt0));
-        desc1.push_back(desc1_ext.row(index_pt1));
-        // Set our IDs to be unique IDs here, will later replace with corrected ones, after temporal matching
-        size_t temp = ++currid;
-        ids0.push_back(temp);
-        ids1.push_back(temp);
+/**
+ * Finds the two nearest descriptors of each query whose rectified row is within the band of its own.
+ * The train rows must be sorted (see the order), and the result has the same layout as cv::DescriptorMatcher::knnMatch() with k=2.
+ */
+static void band_knn_match(const std::vector<float> &rows_query, const cv::Mat &desc_query,
+                           const std::vector<float> &rows_train, const std::vector<int> &order_train, const cv::Mat &desc_train,
+                           float band, std::vector<std::vector<cv::DMatch>> &matches) {
+    matches.clear();
+    matches.resize(rows_query.size());
+    const int bytes = desc_query.cols;
+    const float max_dist = (float)(8*bytes);
+    for(size_t q=0; q<rows_query.size(); q++) {
+        if(!std::isfinite(rows_query.at(q)))
+            continue;
+        // First train point that is in the band
+        auto it = std::lower_bound(order_train.begin(), order_train.end(), rows_query.at(q)-band,
+                                   [&rows_train](int t, float row) { return rows_train.at((size_t)t) < row; });
+        const uchar *d_query = desc_query.ptr<uchar>((int)q);
+        int best1 = -1, best2 = -1;
+        int dist1 = INT32_MAX, dist2 = INT32_MAX;
+        for(; it != order_train.end() && rows_train.at((size_t)*it) <= rows_query.at(q)+band; ++it) {
+            int dist = Grid_Matcher::hamming_distance(d_query, desc_train.ptr<uchar>(*it), bytes);
+            if(dist < dist1) {
+                best2 = best1;
+                dist2 = dist1;
+                best1 = *it;
+                dist1 = dist;
+            } else if(dist < dist2) {
+                best2 = *it;
+                dist2 = dist;
+            }
+        }
+        if(best1 == -1)
+            continue;
+        matches.at(q).emplace_back(cv::DMatch((int)q, best1, (float)dist1));
+        matches.at(q).emplace_back(cv::DMatch((int)q, best2, (best2 == -1)? max_dist : (float)dist2));
+    }
+}
+
+void TrackDescriptor::epipolar_match(std::vector<cv::KeyPoint> &pts0, std::vector<cv::KeyPoint> &pts1,
+                                     cv::Mat &desc0, cv::Mat &desc1, size_t id0, size_t id1, std::vector<cv::DMatch> &matches) {
+
+    // Return if we have nothing to match
+    if(pts0.empty() || pts1.empty())
+        return;
+
+    // We need the extrinsics of both cameras, else we just match them normally
+    if(camera_R_ItoC.find(id0) == camera_R_ItoC.end() || camera_R_ItoC.find(id1) == camera_R_ItoC.end()
+       || camera_p_IinC.find(id0) == camera_p_IinC.end() || camera_p_IinC.find(id1) == camera_p_IinC.end()) {
+        robust_match(pts0, pts1, desc0, desc1, id0, id1, matches);
+        return;
+    }
+
+    // Relative pose of the first camera in the second (R_C0toC1 = R_ItoC1*R_ItoC0^T, p_C0inC1 = p_IinC1 - R_C0toC1*p_IinC0)
+    Eigen::Matrix3d R_C0toC1 = camera_R_ItoC.at(id1)*camera_R_ItoC.at(id0).transpose();
+    Eigen::Vector3d p_C0inC1 = camera_p_IinC.at(id1)-R_C0toC1*camera_p_IinC.at(id0);
+    if(p_C0inC1.norm() < 1e-6 || p_C0inC1.head(2).norm() < 1e-6) {
+        robust_match(pts0, pts1, desc0, desc1, id0, id1, matches);
+        return;
+    }
+
+    // Rectifying rotation, which has its x-axis along the baseline so all epipolar lines are rows
+    Eigen::Vector3d r1 = p_C0inC1.normalized();
+    Eigen::Vector3d r2 = Eigen::Vector3d(-r1(1), r1(0), 0).normalized();
+    Eigen::Vector3d r3 = r1.cross(r2);
+    Eigen::Matrix3d R_C1toR;
+    R_C1toR.row(0) = r1.transpose();
+    R_C1toR.row(1) = r2.transpose();
+    R_C1toR.row(2) = r3.transpose();
+    Eigen::Matrix3d R_C0toR = R_C1toR*R_C0toC1;
+
+    // Get the rectified row of each normalized point (points behind the rectified cameras can not be matched)
+    std::vector<cv::Point2f> pts0_n, pts1_n;
+    for(size_t i=0; i<pts0.size(); i++) {
+        pts0_n.push_back(pts0.at(i).pt);
+    }
+    for(size_t i=0; i<pts1.size(); i++) {
+        pts1_n.push_back(pts1.at(i).pt);
+    }
+    undistort_points(pts0_n, pts0_n, id0);
+    undistort_points(pts1_n, pts1_n, id1);
+    std::vector<float> rows0(pts0_n.size()), rows1(pts1_n.size());
+    for(size_t i=0; i<pts0_n.size(); i++) {
+        Eigen::Vector3d b_R = R_C0toR*Eigen::Vector3d(pts0_n.at(i).x, pts0_n.at(i).y, 1);
+        rows0.at(i) = (b_R(2) > 0.1)? (float)(b_R(1)/b_R(2)) : NAN;
+    }
+    for(size_t i=0; i<pts1_n.size(); i++) {
+        Eigen::Vector3d b_R = R_C1toR*Eigen::Vector3d(pts1_n.at(i).x, pts1_n.at(i).y, 1);
+        rows1.at(i) = (b_R(2) > 0.1)? (float)(b_R(1)/b_R(2)) : NAN;
+    }
+
+    // Sort both by their row, so we can find the band of each point with a binary search
+    std::vector<int> order0, order1;
+    for(size_t i=0; i<rows0.size(); i++) {
+        if(std::isfinite(rows0.at(i))) order0.push_back((int)i);
+    }
+    for(size_t i=0; i<rows1.size(); i++) {
+        if(std::isfinite(rows1.at(i))) order1.push_back((int)i);
     }
+    std::sort(order0.begin(), order0.end(), [&rows0](int a, int b) { return rows0.at((size_t)a) < rows0.at((size_t)b); });
+    std::sort(order1.begin(), order1.end(), [&rows1](int a, int b) { return rows1.at((size_t)a) < rows1.at((size_t)b); });
+
+    // Our band in normalized coordinates
+    double max_focallength_img0 = std::max(camera_k_OPENCV.at(id0)(0,0),camera_k_OPENCV.at(id0)(1,1));
+    double max_focallength_img1 = std::max(camera_k_OPENCV.at(id1)(0,0),camera_k_OPENCV.at(id1)(1,1));
+    float band = (float)(stereo_band/std::max(max_focallength_img0,max_focallength_img1));
+
+    // Match descriptors in both directions (both use the same band, so the symmetry test is still valid)
+    std::vector<std::vector<cv::DMatch> > matches0to1, matches1to0;
+    band_knn_match(rows0, desc0, rows1, order1, desc1, band, matches0to1);
+    band_knn_match(rows1, desc1, rows0, order0, desc0, band, matches1to0);
+
+    // Do a ratio test for both matches
+    robust_ratio_test(matches0to1);
+    robust_ratio_test(matches1to0);
+
+    // Finally do a symmetry test (all of these already satisfy the epipolar constraint, so we do not need RANSAC)
+    robust_symmetry_test(matches0to1, matches1to0, matches);
 
 }
 
 void TrackDescriptor::robust_match(std::vector<cv::KeyPoint>& pts0, std::vector<cv::KeyPoint> pts1,
                                    cv::Mat& desc0, cv::Mat& desc1, size_t id0, size_t id1, std::vector<cv::DMatch>& matches) {
 
+    // Get the rotation since the last image if we are matching temporally
+    // NOTE: we get this before any early return, so it is never used for a later image
+    Eigen::Matrix3d R_C0toC1 = Eigen::Matrix3d::Identity();
+    bool has_rotation = (id0 == id1 && use_rotation_prior(id0, R_C0toC1));
+
     // Our 1to2 and 2to1 match vectors
     std::vector<std::vector<cv::DMatch> > matches0to1, matches1to0;
 
     // Match descriptors (return 2 nearest neighbours)
-    matcher->knnMatch(desc0, desc1, matches0to1, 2);
-    matcher->knnMatch(desc1, desc0, matches1to0, 2);
+    // If we are matching temporally, we can only look around where each point should be in the new image
+    if(use_grid_matching && id0 == id1) {
+        // Predict where the old points are, which is their old location if we do not know the rotation
+        std::vector<cv::Point2f> pts0_pred, pts1_pt;
+        for(size_t i=0; i<pts0.size(); i++) {
+            pts0_pred.push_back(pts0.at(i).pt);
+        }
+        for(size_t i=0; i<pts1.size(); i++) {
+            pts1_pt.push_back(pts1.at(i).pt);
+        }
+        if(has_rotation) {
+            std::vector<cv::Point2f> pts0_n;
+            undistort_points(pts0_pred, pts0_n, id0);
+            for(size_t i=0; i<pts0_n.size(); i++) {
+                Eigen::Vector3d b_C1 = R_C0toC1*Eigen::Vector3d(pts0_n.at(i).x, pts0_n.at(i).y, 1);
+                if(b_C1(2) < 0.1)
+                    continue;
+                pts0_pred.at(i) = distort_point(cv::Point2f((float)(b_C1(0)/b_C1(2)), (float)(b_C1(1)/b_C1(2))), id0);
+            }
+        }
+        // Both directions use the same windows, so the symmetry test is still valid
+        Grid_Matcher::knn_match(pts0_pred, desc0, pts1_pt, desc1, match_radius, matches0to1);
+        Grid_Matcher::knn_match(pts1_pt, desc1, pts0_pred, desc0, match_radius, matches1to0);
+    } else {
+        matcher->knnMatch(desc0, desc1, matches0to1, 2);
+        matcher->knnMatch(desc1, desc0, matches1to0, 2);
+    }
 
     // Do a ratio test for both matches
     robust_ratio_test(matches0to1);
@@ -420,17 +764,13 @@ void TrackDescriptor::robust_match(std::vector<cv::KeyPoint>& pts0, std::vector<
     // Normalize these points, so we can then do ransac
     // We don't want to do ransac on distorted image uvs since the mapping is nonlinear
     std::vector<cv::Point2f> pts0_n, pts1_n;
-    for(size_t i=0; i<pts0_rsc.size(); i++) {
-        pts0_n.push_back(undistort_point(pts0_rsc.at(i),id0));
-        pts1_n.push_back(undistort_point(pts0_rsc.at(i),id1));
-    }
+    undistort_points(pts0_rsc, pts0_n, id0);
+    undistort_points(pts1_rsc, pts1_n, id1);
 
     // Do RANSAC outlier rejection (note since we normalized the max pixel error is now in the normalized cords)
+    // If we are matching temporally, then we can use the rotation prior of this camera
     std::vector<uchar> mask_rsc;
-    double max_focallength_img0 = std::max(camera_k_OPENCV.at(id0)(0,0),camera_k_OPENCV.at(id0)(1,1));
-    double max_focallength_img1 = std::max(camera_k_OPENCV.at(id1)(0,0),camera_k_OPENCV.at(id1)(1,1));
-    double max_focallength = std::max(max_focallength_img0,max_focallength_img1);
-    cv::findFundamentalMat(pts0_n, pts1_n, cv::FM_RANSAC, 1/max_focallength, 0.999, mask_rsc);
+    perform_ransac(pts0_n, pts1_n, id0, id1, has_rotation, R_C0toC1, mask_rsc);
 
     // Loop through all good matches, and only append ones that have passed RANSAC
     for(size_t i=0; i<matches_good.size(); i++) {
@@ -473,19 +813,19 @@ void TrackDescriptor::robust_symmetry_test(std::vector<std::vector<cv::DMatch> >
         if (matchIterator1->empty() || matchIterator1->size() < 2)
             continue;
 
-        // for all matches image 2 -> image 1
-        for (auto matchIterator2 = matches2.begin(); matchIterator2 != matches2.end(); ++matchIterator2) {
-            // ignore deleted matches
-            if (matchIterator2->empty() || matchIterator2->size() < 2)
-                continue;
-
-            // Match symmetry test
-            if ((*matchIterator1)[0].queryIdx == (*matchIterator2)[0].trainIdx && (*matchIterator2)[0].queryIdx == (*matchIterator1)[0].trainIdx) {
-                // add symmetrical match
-                good_matches.emplace_back(cv::DMatch((*matchIterator1)[0].queryIdx,(*matchIterator1)[0].trainIdx,(*matchIterator1)[0].distance));
-                // next match in image 1 -> image 2
-                break;
-            }
+        // the matches image 2 -> image 1 are in the order of their query, so look up the one of our best match directly
+        int idx2 = (*matchIterator1)[0].trainIdx;
+        if (idx2 < 0 || idx2 >= (int)matches2.size())
+            continue;
+        const std::vector<cv::DMatch> &match2 = matches2.at((size_t)idx2);
+        // ignore deleted matches
+        if (match2.empty() || match2.size() < 2)
+            continue;
+
+        // Match symmetry test
+        if ((*matchIterator1)[0].queryIdx == match2[0].trainIdx && match2[0].queryIdx == (*matchIterator1)[0].trainIdx) {
+            // add symmetrical match
+            good_matches.emplace_back(cv::DMatch((*matchIterator1)[0].queryIdx,(*matchIterator1)[0].trainIdx,(*matchIterator1)[0].distance));
         }
     }
 
@@ -25,6 +25,7 @@
 #include <opencv2/xfeatures2d.hpp>
 
 #include "TrackBase.h"
+#include "Grid_Matcher.h"
 
 namespace ov_core {
 
@@ -76,6 +77,52 @@ namespace ov_core {
          */
         void feed_stereo(double timestamp, cv::Mat &img_left, cv::Mat &img_right, size_t cam_id_left, size_t cam_id_right) override;
 
+        /**
+         * @brief Process a synchronized set of images from any number of cameras
+         * @param timestamp timestamp this set of images occured at (all cameras are synchronised)
+         * @param images grayscaled images, one for each camera id
+         * @param cam_ids camera id that each image corresponds too
+         *
+         * Allocates our last descriptors for each camera, and then calls on TrackBase::feed_multicam().
+         */
+        void feed_multicam(double timestamp, std::vector<cv::Mat> &images, std::vector<size_t> &cam_ids) override {
+            for(size_t i=0; i<cam_ids.size(); i++) {
+                desc_last[cam_ids.at(i)];
+            }
+            TrackBase::feed_multicam(timestamp, images, cam_ids);
+        }
+
+        /**
+         * @brief Set if we should only match temporally within a search window around where each feature should be
+         * @param use true to use the windowed matcher (see Grid_Matcher), false to brute force match all descriptors
+         * @param radius search radius in pixels around the predicted location
+         *
+         * The predicted location is the feature's last location, rotated by the gyro prior of the camera if we have one.
+         * Stereo matches are still brute forced since we do not have a prediction for them.
+         */
+        void set_grid_matching(bool use, double radius) {
+            use_grid_matching = use;
+            match_radius = (float)std::max(1.0, radius);
+        }
+
+        /**
+         * @brief Set if we should reuse our stereo pairs, and only match new left-right pairs along their epipolar line
+         * @param use true to reuse stereo pairs, false to match all features left to right on each image
+         * @param band max pixel distance from the epipolar line a right feature can be to be matched
+         *
+         * If both the left and right features of a new image match to the same pair of the last image, we just keep that pair.
+         * Only the features that are left over are then matched left to right, and only against ones in the epipolar band (see set_extrinsics()).
+         * If we do not have the extrinsics of a pair, we fall back to brute force matching the left over features.
+         *
+         * The descriptors of each track are cached in desc_last, where row i is the descriptor of track ids_last[i].
+         * A kept pair takes the rows of its new left and right keypoints and is never matched left to right again.
+         * We do not key a second cache by track id, since ORB has to be computed at the new keypoint location anyway to match it temporally.
+         */
+        void set_stereo_reuse(bool use, double band) {
+            use_stereo_reuse = use;
+            stereo_band = std::max(0.5, band);
+        }
+
 
     protected:
 
@@ -117,6 +164,45 @@ namespace ov_core {
                                       size_t cam_id0, size_t cam_id1,
                                       std::vector<size_t> &ids0, std::vector<size_t> &ids1);
 
+        /**
+         * @brief Extracts features and their descriptors in both images of a stereo pair (without matching them)
+         * @param img0 left image we will detect features on
+         * @param img1 right image we will detect features on
+         * @param pts0 left vector of extracted keypoints
+         * @param pts1 right vector of extracted keypoints
+         * @param desc0 left descriptors of each keypoint
+         * @param desc1 right descriptors of each keypoint
+         */
+        void perform_extraction_stereo(const cv::Mat &img0, const cv::Mat &img1,
+                                       std::vector<cv::KeyPoint> &pts0, std::vector<cv::KeyPoint> &pts1,
+                                       cv::Mat &desc0, cv::Mat &desc1);
+
+        /**
+         * @brief Process a new stereo pair, reusing the stereo pairs of our last images (see set_stereo_reuse())
+         * @param timestamp timestamp this pair occured at (stereo is synchronised)
+         * @param img_left first histogram equalized image
+         * @param img_right second histogram equalized image
+         * @param cam_id_left first image camera id
+         * @param cam_id_right second image camera id
+         */
+        void feed_stereo_reuse(double timestamp, const cv::Mat &img_left, const cv::Mat &img_right, size_t cam_id_left, size_t cam_id_right);
+
+        /**
+         * @brief Match features left to right, only comparing descriptors of features that are within the epipolar band of each other
+         * @param pts0 left vector of keypoints
+         * @param pts1 right vector of keypoints
+         * @param desc0 left vector of descriptors
+         * @param desc1 right vector of descriptors
+         * @param id0 id of the left camera
+         * @param id1 id of the right camera
+         * @param matches vector of matches that we have found
+         *
+         * The same ratio and symmetry tests as robust_match() are used, but we do not need RANSAC since all matches satisfy the epipolar constraint.
+         * If we do not have the extrinsics of this pair, this will call robust_match() instead.
+         */
+        void epipolar_match(std::vector<cv::KeyPoint> &pts0, std::vector<cv::KeyPoint> &pts1,
+                            cv::Mat &desc0, cv::Mat &desc1, size_t id0, size_t id1, std::vector<cv::DMatch> &matches);
+
         /**
          * @brief Find matches between two keypoint+descriptor sets.
          * @param pts0 first vector of keypoints
@@ -129,6 +215,7 @@ namespace ov_core {
          *
          * This will perform a "robust match" between the two sets of points (slow but has great results).
          * First we do a simple KNN match from 1to2 and 2to1, which is followed by a ratio check and symmetry check.
+         * If we are matching temporally with grid matching enabled, the KNN match is only done within the search window of each point.
          * Original code is from the "RobustMatcher" in the opencv examples, and seems to give very good results in the matches.
          * https://github.com/opencv/opencv/blob/master/samples/cpp/tutorial_code/calib3d/real_time_pose_estimation/src/RobustMatcher.cpp
          */
@@ -158,11 +245,19 @@ namespace ov_core {
         int grid_x;
         int grid_y;
 
+        // If we should reuse our stereo pairs, and the max pixel distance from the epipolar line for new ones
+        bool use_stereo_reuse = false;
+        double stereo_band = 2.0;
+
+        // If we should match temporally in a search window, and its radius in pixels
+        bool use_grid_matching = false;
+        float match_radius = 40.0f;
+
         // The ratio between two kNN matches, if that ratio is larger then this threshold
         // then the two features are too close, so should be considered ambiguous/bad match
         double knn_ratio;
 
-        // Descriptor matrices
+        // Descriptor matrices of the last image, row i is the descriptor of the track ids_last[i]
         std::unordered_map<size_t, cv::Mat> desc_last;
 
 
@@ -27,34 +27,43 @@ using namespace ov_core;
 void TrackKLT::feed_monocular(double timestamp, cv::Mat &img, size_t cam_id) {
 
     // Start timing
-    rT1 =  boost::posix_time::microsec_clock::local_time();
+    boost::posix_time::ptime rT0 =  boost::posix_time::microsec_clock::local_time();
 
     // Lock this data feed for this camera
     std::unique_lock<std::mutex> lck(mtx_feeds.at(cam_id));
 
-    // Histogram equalize
-    cv::equalizeHist(img, img);                                      // 1. 对收到的图片首先做一个直方图均衡化
+    // Wait for our look-ahead detection on the last image, and merge its new features
+    bool detected_last = finish_lookahead(cam_id);
+    boost::posix_time::ptime rT1 =  boost::posix_time::microsec_clock::local_time();
 
-    // Extract the new image pyramid
-    std::vector<cv::Mat> imgpyr;                                     // 2. 对均衡化后的图像提取金字塔（按传入的窗口大小和金字塔层数来提取）
-    cv::buildOpticalFlowPyramid(img, imgpyr, win_size, pyr_levels);
-    rT2 =  boost::posix_time::microsec_clock::local_time();
+    // Histogram equalize (shared with our other trackers, and does not write into the passed image)
+    // Without CLAHE this also builds the pyramid in the same pass over the image
+    std::shared_ptr<FrameContext> frame = frame_pool->get_frame(timestamp, cam_id, img, win_size, pyr_levels);     // 1. 对收到的图片首先做一个直方图均衡化
+
+    // Extract the new image pyramid (into recycled buffers, the equalized image is already padded so it is used as the first level)
+    FramePool::build_pyramid(frame, win_size, pyr_levels);          // 2. 对均衡化后的图像提取金字塔（按传入的窗口大小和金字塔层数来提取）
+    std::vector<cv::Mat> imgpyr = frame->pyramid;
+    boost::posix_time::ptime rT2 =  boost::posix_time::microsec_clock::local_time();
 
     // If we didn't have any successful tracks last time, just extract this time
     // This also handles, the tracking initalization on the first call to this extractor
     if(pts_last[cam_id].empty()) {                                   // 3. 上一帧的关键点为空，直接提取，走检测初始化流程
         // Detect new features
-        perform_detection_monocular(imgpyr, pts_last[cam_id], ids_last[cam_id]);
+        perform_detection_monocular(frame, pts_last[cam_id], ids_last[cam_id], cam_id);
         // Save the current image and pyramid
-        img_last[cam_id] = img.clone();
-        img_pyramid_last[cam_id] = imgpyr;
+        img_last[cam_id] = frame->image;
+        frame_last[cam_id] = frame;
         return;
     }
 
     // First we should make that the last images have enough features so we can do KLT          // 4. 直接对原始图像提取特征点
     // This will "top-off" our number of tracks so always have a constant number
-    perform_detection_monocular(img_pyramid_last[cam_id], pts_last[cam_id], ids_last[cam_id]);  // 5. 先对上一帧提取新的特征点，再进行track
-    rT3 =  boost::posix_time::microsec_clock::local_time();
+    // If we did a look-ahead detection this has already been done after the last image
+    // Else this always removes points that have come too close, and only detects if we are tracking too few
+    if(!detected_last) {
+        perform_detection_monocular(frame_last[cam_id], pts_last[cam_id], ids_last[cam_id], cam_id);  // 5. 先对上一帧提取新的特征点，再进行track
+    }
+    boost::posix_time::ptime rT3 =  boost::posix_time::microsec_clock::local_time();
 
     //===================================================================================
     //===================================================================================
@@ -67,16 +76,16 @@ void TrackKLT::feed_monocular(double timestamp, cv::Mat &img, size_t cam_id) {
     std::vector<cv::KeyPoint> pts_left_new = pts_last[cam_id];
 
     // Lets track temporally         // 上一帧金字塔  // 当前帧金字塔 // 上一帧关键点(原图) // 当前帧关键点(原图)
-    perform_matching(img_pyramid_last[cam_id],imgpyr,pts_last[cam_id],pts_left_new,cam_id,cam_id,mask_ll);   // mask_ll 表明track是否成功
-    rT4 =  boost::posix_time::microsec_clock::local_time();
+    perform_matching(frame_last[cam_id]->pyramid,imgpyr,pts_last[cam_id],pts_left_new,cam_id,cam_id,mask_ll);   // mask_ll 表明track是否成功
+    boost::posix_time::ptime rT4 =  boost::posix_time::microsec_clock::local_time();
 
     //===================================================================================
     //===================================================================================
 
     // If any of our mask is empty, that means we didn't have enough to do ransac, so just return
     if(mask_ll.empty()) {
-        img_last[cam_id] = img.clone();
-        img_pyramid_last[cam_id] = imgpyr;
+        img_last[cam_id] = frame->image;
+        frame_last[cam_id] = frame;
         pts_last[cam_id].clear();
         ids_last[cam_id].clear();
         ROS_ERROR("[KLT-EXTRACTOR]: Failed to get enough points to do RANSAC, resetting.....");
@@ -105,27 +114,35 @@ void TrackKLT::feed_monocular(double timestamp, cv::Mat &img, size_t cam_id) {
 
 
     // Update our feature database, with theses new observations                    // 更新特征点database中的状态
+    std::vector<cv::Point2f> good_left_n;
+    for(size_t i=0; i<good_left.size(); i++) {
+        good_left_n.push_back(good_left.at(i).pt);
+    }
+    undistort_points(good_left_n, good_left_n, cam_id);                            // 原始图像上去畸变后的特征点
+    const size_t num_last = pts_last[cam_id].size();
     for(size_t i=0; i<good_left.size(); i++) {
-        cv::Point2f npt_l = undistort_point(good_left.at(i).pt, cam_id);           // 原始图像上去畸变后的特征点
+        cv::Point2f npt_l = good_left_n.at(i);
         database->update_feature(good_ids_left.at(i), timestamp, cam_id,
                                  good_left.at(i).pt.x, good_left.at(i).pt.y,
                                  npt_l.x, npt_l.y);
     }
 
     // Move forward in time
-    img_last[cam_id] = img.clone();                                                 // 时间上后移
-    img_pyramid_last[cam_id] = imgpyr;
+    img_last[cam_id] = frame->image;                                                // 时间上后移
+    frame_last[cam_id] = frame;
     pts_last[cam_id] = good_left;
     ids_last[cam_id] = good_ids_left;
-    rT5 =  boost::posix_time::microsec_clock::local_time();
 
-    // Timing information
-    //ROS_INFO("[TIME-KLT]: %.4f seconds for pyramid",(rT2-rT1).total_microseconds() * 1e-6);
-    //ROS_INFO("[TIME-KLT]: %.4f seconds for detection",(rT3-rT2).total_microseconds() * 1e-6);
-    //ROS_INFO("[TIME-KLT]: %.4f seconds for temporal klt",(rT4-rT3).total_microseconds() * 1e-6);
-    //ROS_INFO("[TIME-KLT]: %.4f seconds for feature DB update (%d features)",(rT5-rT4).total_microseconds() * 1e-6, (int)good_left.size());
-    //ROS_INFO("[TIME-KLT]: %.4f seconds for total",(rT5-rT1).total_microseconds() * 1e-6);
+    // Our tracks are final, so start the detection for the next image in the background
+    if(use_lookahead && need_detection(cam_id)) {
+        start_lookahead(cam_id, cam_id, false);
+    }
+    boost::posix_time::ptime rT5 =  boost::posix_time::microsec_clock::local_time();
 
+    // Timing and tracking quality (we have no stereo tracking)
+    if(stats_period > 0) {
+        update_stats(cam_id, {rT0, rT1, rT2, rT3, rT4, rT4, rT5}, num_last, good_left.size());
+    }
 
 }
 
@@ -133,50 +150,57 @@ void TrackKLT::feed_monocular(double timestamp, cv::Mat &img, size_t cam_id) {
 void TrackKLT::feed_stereo(double timestamp, cv::Mat &img_leftin, cv::Mat &img_rightin, size_t cam_id_left, size_t cam_id_right) {
 
     // Start timing
-    rT1 =  boost::posix_time::microsec_clock::local_time();
+    boost::posix_time::ptime rT0 =  boost::posix_time::microsec_clock::local_time();
 
     // Lock this data feed for this camera
     std::unique_lock<std::mutex> lck1(mtx_feeds.at(cam_id_left));
     std::unique_lock<std::mutex> lck2(mtx_feeds.at(cam_id_right));
 
-    // Histogram equalize
-    cv::Mat img_left, img_right;
-    boost::thread t_lhe = boost::thread(cv::equalizeHist, boost::cref(img_leftin), boost::ref(img_left));
-    boost::thread t_rhe = boost::thread(cv::equalizeHist, boost::cref(img_rightin), boost::ref(img_right));
-    t_lhe.join();
-    t_rhe.join();
-
-    // Extract image pyramids (boost seems to require us to put all the arguments even if there are defaults....)
-    std::vector<cv::Mat> imgpyr_left, imgpyr_right;
-    boost::thread t_lp = boost::thread(cv::buildOpticalFlowPyramid, boost::cref(img_left),
-                                       boost::ref(imgpyr_left), boost::ref(win_size), boost::ref(pyr_levels), false,
-                                       cv::BORDER_REFLECT_101, cv::BORDER_CONSTANT, true);
-    boost::thread t_rp = boost::thread(cv::buildOpticalFlowPyramid, boost::cref(img_right),
-                                       boost::ref(imgpyr_right), boost::ref(win_size), boost::ref(pyr_levels),
-                                       false, cv::BORDER_REFLECT_101, cv::BORDER_CONSTANT, true);
+    // Wait for our look-ahead detection on the last images, and merge its new features
+    bool detected_last = finish_lookahead(cam_id_left);
+    boost::posix_time::ptime rT1 =  boost::posix_time::microsec_clock::local_time();
+
+    // Histogram equalize and extract image pyramids (shared with our other trackers, and into recycled buffers)
+    std::shared_ptr<FrameContext> frame_left, frame_right;
+    boost::thread t_lp = boost::thread([&] {
+        frame_left = frame_pool->get_frame(timestamp, cam_id_left, img_leftin, win_size, pyr_levels);
+        FramePool::build_pyramid(frame_left, win_size, pyr_levels);
+    });
+    boost::thread t_rp = boost::thread([&] {
+        frame_right = frame_pool->get_frame(timestamp, cam_id_right, img_rightin, win_size, pyr_levels);
+        FramePool::build_pyramid(frame_right, win_size, pyr_levels);
+    });
     t_lp.join();
     t_rp.join();
-    rT2 =  boost::posix_time::microsec_clock::local_time();
+    const cv::Mat &img_left = frame_left->image;
+    const cv::Mat &img_right = frame_right->image;
+    std::vector<cv::Mat> imgpyr_left = frame_left->pyramid;
+    std::vector<cv::Mat> imgpyr_right = frame_right->pyramid;
+    boost::posix_time::ptime rT2 =  boost::posix_time::microsec_clock::local_time();
 
     // If we didn't have any successful tracks last time, just extract this time
     // This also handles, the tracking initalization on the first call to this extractor
     if(pts_last[cam_id_left].empty() || pts_last[cam_id_right].empty()) {
         // Track into the new image
-        perform_detection_stereo(imgpyr_left, imgpyr_right, pts_last[cam_id_left], pts_last[cam_id_right], ids_last[cam_id_left], ids_last[cam_id_right]);
+        perform_detection_stereo(frame_left, frame_right, pts_last[cam_id_left], pts_last[cam_id_right], ids_last[cam_id_left], ids_last[cam_id_right], cam_id_left);
         // Save the current image and pyramid
-        img_last[cam_id_left] = img_left.clone();
-        img_last[cam_id_right] = img_right.clone();
-        img_pyramid_last[cam_id_left] = imgpyr_left;
-        img_pyramid_last[cam_id_right] = imgpyr_right;
+        img_last[cam_id_left] = img_left;
+        img_last[cam_id_right] = img_right;
+        frame_last[cam_id_left] = frame_left;
+        frame_last[cam_id_right] = frame_right;
         return;
     }
 
     // First we should make that the last images have enough features so we can do KLT
     // This will "top-off" our number of tracks so always have a constant number
-    perform_detection_stereo(img_pyramid_last[cam_id_left], img_pyramid_last[cam_id_right],
-                             pts_last[cam_id_left], pts_last[cam_id_right],
-                             ids_last[cam_id_left], ids_last[cam_id_right]);
-    rT3 =  boost::posix_time::microsec_clock::local_time();
+    // If we did a look-ahead detection this has already been done after the last images
+    // Else this always removes points that have come too close, and only detects if we are tracking too few
+    if(!detected_last) {
+        perform_detection_stereo(frame_last[cam_id_left], frame_last[cam_id_right],
+                                 pts_last[cam_id_left], pts_last[cam_id_right],
+                                 ids_last[cam_id_left], ids_last[cam_id_right], cam_id_left);
+    }
+    boost::posix_time::ptime rT3 =  boost::posix_time::microsec_clock::local_time();
 
 
     //===================================================================================
@@ -188,15 +212,15 @@ void TrackKLT::feed_stereo(double timestamp, cv::Mat &img_leftin, cv::Mat &img_r
     std::vector<cv::KeyPoint> pts_right_new = pts_last[cam_id_right];
 
     // Lets track temporally
-    boost::thread t_ll = boost::thread(&TrackKLT::perform_matching, this, boost::cref(img_pyramid_last[cam_id_left]), boost::cref(imgpyr_left),
+    boost::thread t_ll = boost::thread(&TrackKLT::perform_matching, this, boost::cref(frame_last[cam_id_left]->pyramid), boost::cref(imgpyr_left),
                                        boost::ref(pts_last[cam_id_left]), boost::ref(pts_left_new), cam_id_left, cam_id_left, boost::ref(mask_ll));
-    boost::thread t_rr = boost::thread(&TrackKLT::perform_matching, this, boost::cref(img_pyramid_last[cam_id_right]), boost::cref(imgpyr_right),
+    boost::thread t_rr = boost::thread(&TrackKLT::perform_matching, this, boost::cref(frame_last[cam_id_right]->pyramid), boost::cref(imgpyr_right),
                                        boost::ref(pts_last[cam_id_right]), boost::ref(pts_right_new), cam_id_right, cam_id_right, boost::ref(mask_rr));
 
     // Wait till both threads finish
     t_ll.join();
     t_rr.join();
-    rT4 =  boost::posix_time::microsec_clock::local_time();
+    boost::posix_time::ptime rT4 =  boost::posix_time::microsec_clock::local_time();
 
 
     //===================================================================================
@@ -206,7 +230,7 @@ void TrackKLT::feed_stereo(double timestamp, cv::Mat &img_leftin, cv::Mat &img_r
     // left to right matching
     std::vector<uchar> mask_lr;
     perform_matching(imgpyr_left, imgpyr_right, pts_left_new, pts_right_new, cam_id_left, cam_id_right, mask_lr);
-    rT5 =  boost::posix_time::microsec_clock::local_time();
+    boost::posix_time::ptime rT5 =  boost::posix_time::microsec_clock::local_time();
 
 
     //===================================================================================
@@ -214,10 +238,10 @@ void TrackKLT::feed_stereo(double timestamp, cv::Mat &img_leftin, cv::Mat &img_r
 
     // If any of our masks are empty, that means we didn't have enough to do ransac, so just return
     if(mask_ll.empty() || mask_rr.empty() || mask_lr.empty()) {
-        img_last[cam_id_left] = img_left.clone();
-        img_last[cam_id_right] = img_right.clone();
-        img_pyramid_last[cam_id_left] = imgpyr_left;
-        img_pyramid_last[cam_id_right] = imgpyr_right;
+        img_last[cam_id_left] = img_left;
+        img_last[cam_id_right] = img_right;
+        frame_last[cam_id_left] = frame_left;
+        frame_last[cam_id_right] = frame_right;
         pts_last[cam_id_left].clear();
         pts_last[cam_id_right].clear();
         ids_last[cam_id_left].clear();
@@ -254,12 +278,20 @@ void TrackKLT::feed_stereo(double timestamp, cv::Mat &img_leftin, cv::Mat &img_r
     //===================================================================================
 
     // Update our feature database, with theses new observations
+    std::vector<cv::Point2f> good_left_n, good_right_n;
+    for(size_t i=0; i<good_left.size(); i++) {
+        good_left_n.push_back(good_left.at(i).pt);
+        good_right_n.push_back(good_right.at(i).pt);
+    }
+    undistort_points(good_left_n, good_left_n, cam_id_left);
+    undistort_points(good_right_n, good_right_n, cam_id_right);
+    const size_t num_last = pts_last[cam_id_left].size();
     for(size_t i=0; i<good_left.size(); i++) {
         // Assert that our IDs are the same (i.e., stereo )
         assert(good_ids_left.at(i)==good_ids_right.at(i));
-        // Try to undistort the point
-        cv::Point2f npt_l = undistort_point(good_left.at(i).pt, cam_id_left);
-        cv::Point2f npt_r = undistort_point(good_right.at(i).pt, cam_id_right);
+        // Our undistorted points
+        cv::Point2f npt_l = good_left_n.at(i);
+        cv::Point2f npt_r = good_right_n.at(i);
         // Append to the database
         database->update_feature(good_ids_left.at(i), timestamp, cam_id_left,
                                  good_left.at(i).pt.x, good_left.at(i).pt.y,
@@ -270,91 +302,76 @@ void TrackKLT::feed_stereo(double timestamp, cv::Mat &img_leftin, cv::Mat &img_r
     }
 
     // Move forward in time
-    img_last[cam_id_left] = img_left.clone();
-    img_last[cam_id_right] = img_right.clone();
-    img_pyramid_last[cam_id_left] = imgpyr_left;
-    img_pyramid_last[cam_id_right] = imgpyr_right;
+    img_last[cam_id_left] = img_left;
+    img_last[cam_id_right] = img_right;
+    frame_last[cam_id_left] = frame_left;
+    frame_last[cam_id_right] = frame_right;
     pts_last[cam_id_left] = good_left;
     pts_last[cam_id_right] = good_right;
     ids_last[cam_id_left] = good_ids_left;
     ids_last[cam_id_right] = good_ids_right;
-    rT6 =  boost::posix_time::microsec_clock::local_time();
-
 
-    // Timing information
-    //ROS_INFO("[TIME-KLT]: %.4f seconds for pyramid",(rT2-rT1).total_microseconds() * 1e-6);
-    //ROS_INFO("[TIME-KLT]: %.4f seconds for detection",(rT3-rT2).total_microseconds() * 1e-6);
-    //ROS_INFO("[TIME-KLT]: %.4f seconds for temporal klt",(rT4-rT3).total_microseconds() * 1e-6);
-    //ROS_INFO("[TIME-KLT]: %.4f seconds for stereo klt",(rT5-rT4).total_microseconds() * 1e-6);
-    //ROS_INFO("[TIME-KLT]: %.4f seconds for feature DB update (%d features)",(rT6-rT5).total_microseconds() * 1e-6, (int)good_left.size());
-    //ROS_INFO("[TIME-KLT]: %.4f seconds for total",(rT6-rT1).total_microseconds() * 1e-6);
+    // Our tracks are final, so start the detection for the next images in the background
+    if(use_lookahead && need_detection(cam_id_left)) {
+        start_lookahead(cam_id_left, cam_id_right, true);
+    }
+    boost::posix_time::ptime rT6 =  boost::posix_time::microsec_clock::local_time();
 
+    // Timing and tracking quality
+    if(stats_period > 0) {
+        update_stats(cam_id_left, {rT0, rT1, rT2, rT3, rT4, rT5, rT6}, num_last, good_left.size());
+    }
 
 }
 
-// 传入当前帧的金字塔，当前帧已跟踪到的特征点以及特征点对应的id
-void TrackKLT::perform_detection_monocular(const std::vector<cv::Mat> &img0pyr, std::vector<cv::KeyPoint> &pts0, std::vector<size_t> &ids0) {
+void TrackKLT::perform_detection_monocular(const std::shared_ptr<FrameContext> &frame0, std::vector<cv::KeyPoint> &pts0, std::vector<size_t> &ids0, size_t cam_id) {
+
+    // The pyramid of our frame
+    const std::vector<cv::Mat> &img0pyr = frame0->pyramid;
 
-    // Create a 2D occupancy grid for this current image
+    // Clear the 2D occupancy grid of this camera for this current image
     // Note that we scale this down, so that each grid point is equal to a set of pixels
     // This means that we will reject points that less then grid_px_size points away then existing features
-    Eigen::MatrixXi grid_2d_current = Eigen::MatrixXi::Zero((int)(img0pyr.at(0).cols / min_px_dist) + 10, (int)(img0pyr.at(0).rows / min_px_dist) + 10);
-    auto it0 = pts0.begin();
-    auto it2 = ids0.begin();
-    while(it0 != pts0.end()) {
-        // Get current left keypoint
-        cv::KeyPoint kpt = *it0;
+    Grid_Occupancy &grid_2d = grid_occupancy.at(cam_id);
+    grid_2d.reset(img0pyr.at(0).cols, img0pyr.at(0).rows, min_px_dist);
+
+    // Remove points that are near another point, and move the ones we keep forward (keeps their order)
+    size_t num_kept = 0;
+    for(size_t i=0; i<pts0.size(); i++) {
         // Check if this keypoint is near another point
-        if(grid_2d_current((int)(kpt.pt.x/min_px_dist),(int)(kpt.pt.y/min_px_dist)) == 1) {   // 检测每个最小的grid中是否有特征点，保证相邻的两个特征点之间的距离大于min_px_dist
-            it0 = pts0.erase(it0);                                                            // pts和ids已经剔除相距太近的冗余特征点
-            it2 = ids0.erase(it2);
+        if(grid_2d.test_and_set(pts0.at(i).pt))                                        // 检测每个最小的grid中是否有特征点，保证相邻的两个特征点之间的距离大于min_px_dist
             continue;
+        // Else we are good, move it to the end of our kept points
+        if(i != num_kept) {
+            pts0.at(num_kept) = pts0.at(i);
+            ids0.at(num_kept) = ids0.at(i);
         }
-        // Else we are good, move forward to the next point
-        grid_2d_current((int)(kpt.pt.x/min_px_dist),(int)(kpt.pt.y/min_px_dist)) = 1;
-        it0++;
-        it2++;
+        num_kept++;
     }
+    pts0.resize(num_kept);                                                              // pts和ids已经剔除相距太近的冗余特征点
+    ids0.resize(num_kept);
 
     // First compute how many more features we need to extract from this image
     int num_featsneeded = num_features - (int)pts0.size();
 
-    // If we don't need any features, just return
-    if(num_featsneeded < 1)
+    // If we don't need any features, or are still tracking enough (see set_detection_params()), just return
+    if(num_featsneeded < 1 || (double)pts0.size() >= min_tracked*num_features)
         return;
 
     // Extract our features (use fast with griding)
     std::vector<cv::KeyPoint> pts0_ext;
-    Grider_FAST::perform_griding(img0pyr.at(0), pts0_ext, num_featsneeded, grid_x, grid_y, threshold, true);              // 在每一个grid中检测fast角点
-
-    // Create a 2D occupancy grid for this current image
-    // Note that we scale this down, so that each grid point is equal to a set of pixels
-    // This means that we will reject points that less then grid_px_size points away then existing features
-    Eigen::MatrixXi grid_2d = Eigen::MatrixXi::Zero((int)(img0pyr.at(0).cols / min_px_dist) + 10, (int)(img0pyr.at(0).rows / min_px_dist) + 10);
-    for(auto& kpt : pts0) {
-        grid_2d((int)(kpt.pt.x/min_px_dist),(int)(kpt.pt.y/min_px_dist)) = 1;                                             // 对原来的特征点设置occupancy_grid
-    }
+    extract_features(frame0, num_featsneeded, cam_id, pts0_ext);                        // 在每一个grid中检测fast角点
 
     // Now, reject features that are close a current feature
-    std::vector<cv::KeyPoint> kpts0_new;
-    std::vector<cv::Point2f> pts0_new;
+    // Our occupancy grid already has all the current features in it
+    pts0.reserve(pts0.size()+pts0_ext.size());
+    ids0.reserve(ids0.size()+pts0_ext.size());
     for(auto& kpt : pts0_ext) {
         // See if there is a point at this location
-        if(grid_2d((int)(kpt.pt.x/min_px_dist),(int)(kpt.pt.y/min_px_dist)) == 1)     // 将新检测到的特征点和原来的特征点融合到同一个occupancy_grid 中
+        if(grid_2d.test_and_set(kpt.pt))                                              // 将新检测到的特征点和原来的特征点融合到同一个occupancy_grid 中
             continue;
-        // Else lets add it!
-        kpts0_new.push_back(kpt);                                                     // 如果新加入的特征点和已存在的特征点以及当前的特征点都没有冲突的话，直接加入
-        pts0_new.push_back(kpt.pt);
-        grid_2d((int)(kpt.pt.x/min_px_dist),(int)(kpt.pt.y/min_px_dist)) = 1;
-    }
-
-    // Loop through and record only ones that are valid
-    for(size_t i=0; i<pts0_new.size(); i++) {
-        // update the uv coordinates
-        kpts0_new.at(i).pt = pts0_new.at(i);
-        // append the new uv coordinate
-        pts0.push_back(kpts0_new.at(i));
-        // move id foward and append this new point
+        // Else lets add it, and move id foward for this new point
+        pts0.push_back(kpt);                                                          // 如果新加入的特征点和已存在的特征点以及当前的特征点都没有冲突的话，直接加入
         size_t temp = ++currid;                                                      // 给新检测到的特征点取一个id,并融合到原来的特征点中
         ids0.push_back(temp);
     }
@@ -362,68 +379,65 @@ void TrackKLT::perform_detection_monocular(const std::vector<cv::Mat> &img0pyr,
 }
 
 
-void TrackKLT::perform_detection_stereo(const std::vector<cv::Mat> &img0pyr, const std::vector<cv::Mat> &img1pyr,
+void TrackKLT::perform_detection_stereo(const std::shared_ptr<FrameContext> &frame0, const std::shared_ptr<FrameContext> &frame1,
                                         std::vector<cv::KeyPoint> &pts0, std::vector<cv::KeyPoint> &pts1,
-                                        std::vector<size_t> &ids0, std::vector<size_t> &ids1) {
+                                        std::vector<size_t> &ids0, std::vector<size_t> &ids1, size_t cam_id) {
+
+    // The pyramids of our frames
+    const std::vector<cv::Mat> &img0pyr = frame0->pyramid;
+    const std::vector<cv::Mat> &img1pyr = frame1->pyramid;
 
-    // Create a 2D occupancy grid for this current image
+    // Clear the 2D occupancy grid of this camera for this current image
     // Note that we scale this down, so that each grid point is equal to a set of pixels
     // This means that we will reject points that less then grid_px_size points away then existing features
-    Eigen::MatrixXi grid_2d_current = Eigen::MatrixXi::Zero((int)(img0pyr.at(0).cols / min_px_dist) + 10, (int)(img0pyr.at(0).rows / min_px_dist) + 10);
-    auto it0 = pts0.begin();
-    auto it1 = pts1.begin();
-    auto it2 = ids0.begin();
-    auto it3 = ids1.begin();
-    while(it0 != pts0.end()) {
-        // Get current left keypoint
-        cv::KeyPoint kpt = *it0;
+    Grid_Occupancy &grid_2d = grid_occupancy.at(cam_id);
+    grid_2d.reset(img0pyr.at(0).cols, img0pyr.at(0).rows, min_px_dist);
+
+    // Remove points that are near another point, and move the ones we keep forward (keeps their order)
+    size_t num_kept = 0;
+    for(size_t i=0; i<pts0.size(); i++) {
         // Check if this keypoint is near another point
-        if(grid_2d_current((int)(kpt.pt.x/min_px_dist),(int)(kpt.pt.y/min_px_dist)) == 1) {
-            it0 = pts0.erase(it0);
-            it1 = pts1.erase(it1);
-            it2 = ids0.erase(it2);
-            it3 = ids1.erase(it3);
+        if(grid_2d.test_and_set(pts0.at(i).pt))
             continue;
+        // Else we are good, move it to the end of our kept points
+        if(i != num_kept) {
+            pts0.at(num_kept) = pts0.at(i);
+            pts1.at(num_kept) = pts1.at(i);
+            ids0.at(num_kept) = ids0.at(i);
+            ids1.at(num_kept) = ids1.at(i);
         }
-        // Else we are good, move forward to the next point
-        grid_2d_current((int)(kpt.pt.x/min_px_dist),(int)(kpt.pt.y/min_px_dist)) = 1;
-        it0++;
-        it1++;
-        it2++;
-        it3++;
+        num_kept++;
     }
+    pts0.resize(num_kept);
+    pts1.resize(num_kept);
+    ids0.resize(num_kept);
+    ids1.resize(num_kept);
 
     // First compute how many more features we need to extract from this image
     int num_featsneeded = num_features - (int)pts0.size();
 
-    // If we don't need any features, just return
-    if(num_featsneeded < 1)
+    // If we don't need any features, or are still tracking enough (see set_detection_params()), just return
+    if(num_featsneeded < 1 || (double)pts0.size() >= min_tracked*num_features)
         return;
 
     // Extract our features (use fast with griding)
     std::vector<cv::KeyPoint> pts0_ext;
-    Grider_FAST::perform_griding(img0pyr.at(0), pts0_ext, num_featsneeded, grid_x, grid_y, threshold, true);
+    extract_features(frame0, num_featsneeded, cam_id, pts0_ext);                        // 在每一个grid中检测fast角点
 
 
-    // Create a 2D occupancy grid for this current image
-    // Note that we scale this down, so that each grid point is equal to a set of pixels
-    // This means that we will reject points that less then grid_px_size points away then existing features
-    Eigen::MatrixXi grid_2d = Eigen::MatrixXi::Zero((int)(img0pyr.at(0).cols / min_px_dist) + 10, (int)(img0pyr.at(0).rows / min_px_dist) + 10);
-    for(auto& kpt : pts0) {
-        grid_2d((int)(kpt.pt.x/min_px_dist),(int)(kpt.pt.y/min_px_dist)) = 1;
-    }
-
     // Now, reject features that are close a current feature
+    // Our occupancy grid already has all the current features in it
     std::vector<cv::KeyPoint> kpts0_new;
     std::vector<cv::Point2f> pts0_new;
+    kpts0_new.reserve(pts0_ext.size());
+    pts0_new.reserve(pts0_ext.size());
     for(auto& kpt : pts0_ext) {
         // See if there is a point at this location
-        if(grid_2d((int)(kpt.pt.x/min_px_dist),(int)(kpt.pt.y/min_px_dist)) == 1)
+        if(grid_2d.test_and_set(kpt.pt))
             continue;
         // Else lets add it!
         kpts0_new.push_back(kpt);
         pts0_new.push_back(kpt.pt);
-        grid_2d((int)(kpt.pt.x/min_px_dist),(int)(kpt.pt.y/min_px_dist)) = 1;
     }
 
     // TODO: Project points from the left frame into the right frame
@@ -464,6 +478,74 @@ void TrackKLT::perform_detection_stereo(const std::vector<cv::Mat> &img0pyr, con
 }
 
 
+void TrackKLT::extract_features(const std::shared_ptr<FrameContext> &frame0, int num_featsneeded, size_t cam_id, std::vector<cv::KeyPoint> &pts0_ext) {
+
+    // If we detect on the whole full resolution image, the adaptive thresholds can use the shared corners of the frame
+    const std::vector<cv::Mat> &img0pyr = frame0->pyramid;
+    if(track_level == 0 && track_roi.area() == 0) {
+        if(use_adaptive_fast) {
+            // Bin the full image corners of this frame, which are shared with the loop closer
+            Grider_AdaptiveFAST &grider = grider_fast.at(cam_id);
+            std::vector<cv::KeyPoint> corners;
+            FramePool::get_corners(frame0, grider.get_min_threshold(img0pyr.at(0).size(), grid_x, grid_y), corners);
+            grider.perform_griding(img0pyr.at(0).size(), corners, pts0_ext, num_featsneeded, grid_x, grid_y);
+        } else {
+            Grider_FAST::perform_griding(img0pyr.at(0), pts0_ext, num_featsneeded, grid_x, grid_y, threshold, true);
+        }
+        return;
+    }
+
+    // Get the image of our detection level, and our region in it
+    cv::Mat img_level;
+    int level = get_pyramid_level(img0pyr, track_level, img_level);
+    const float scale = (float)(1 << level);
+    cv::Rect roi(0, 0, img_level.cols, img_level.rows);
+    if(track_roi.area() > 0) {
+        roi = roi & cv::Rect((int)(track_roi.x/scale), (int)(track_roi.y/scale), (int)(track_roi.width/scale), (int)(track_roi.height/scale));
+    }
+    if(roi.width < grid_x || roi.height < grid_y)
+        return;
+
+    // Extract in our region, and then move the features into the full resolution image
+    cv::Mat img_roi = img_level(roi);
+    if(use_adaptive_fast) {
+        grider_fast.at(cam_id).perform_griding(img_roi, pts0_ext, num_featsneeded, grid_x, grid_y);
+    } else {
+        Grider_FAST::perform_griding(img_roi, pts0_ext, num_featsneeded, grid_x, grid_y, threshold, true);
+    }
+    for(auto &kpt : pts0_ext) {
+        kpt.pt.x = (kpt.pt.x+roi.x)*scale;
+        kpt.pt.y = (kpt.pt.y+roi.y)*scale;
+        kpt.size *= scale;
+    }
+
+}
+
+
+/**
+ * If the pyramid was built with derivatives, each level's image is followed by its derivatives.
+ * So this returns how many elements each level takes up.
+ */
+static size_t pyramid_step(const std::vector<cv::Mat> &pyr) {
+    return (pyr.size() > 1 && pyr.at(1).type() != pyr.at(0).type())? 2 : 1;
+}
+
+
+int TrackKLT::get_pyramid_level(const std::vector<cv::Mat> &pyr, int level, cv::Mat &img) {
+    size_t step = pyramid_step(pyr);
+    int num_levels = (int)((pyr.size()+step-1)/step);
+    level = std::max(0, std::min(level, num_levels-1));
+    img = pyr.at(step*(size_t)level);
+    return level;
+}
+
+
+std::vector<cv::Mat> TrackKLT::get_pyramid_from_level(const std::vector<cv::Mat> &pyr, int level) {
+    size_t step = pyramid_step(pyr);
+    return std::vector<cv::Mat>(pyr.begin()+step*(size_t)level, pyr.end());
+}
+
+
 void TrackKLT::perform_matching(const std::vector<cv::Mat>& img0pyr, const std::vector<cv::Mat>& img1pyr,
                                 std::vector<cv::KeyPoint>& kpts0, std::vector<cv::KeyPoint>& kpts1,
                                 size_t id0, size_t id1,
@@ -472,6 +554,11 @@ void TrackKLT::perform_matching(const std::vector<cv::Mat>& img0pyr, const std::
     // We must have equal vectors
     assert(kpts0.size() == kpts1.size());
 
+    // Get the rotation since the last image if we are tracking temporally
+    // NOTE: we get this before any early return, so it is never used for a later image
+    Eigen::Matrix3d R_C0toC1 = Eigen::Matrix3d::Identity();
+    bool has_rotation = (id0 == id1 && use_rotation_prior(id0, R_C0toC1));
+
     // Return if we don't have any points
     if(kpts0.empty() || kpts1.empty())
         return;
@@ -491,27 +578,147 @@ void TrackKLT::perform_matching(const std::vector<cv::Mat>& img0pyr, const std::
         return;
     }
 
+    // If we are tracking temporally and know how the camera has rotated, predict where the points will be
+    // We rotate the bearing of each point, and then project it back into the image to use as our initial guess
+    // Since the guess is only off by the translation, we can then track with less pyramid levels and iterations
+    int max_level = pyr_levels;
+    int max_iters = 15;
+    std::vector<cv::Point2f> pts0_n, pts1_n;
+    undistort_points(pts0, pts0_n, id0);                                          // 对前一帧特征点去畸变,得到去畸变归一化平面坐标
+    if(has_rotation) {
+        for(size_t i=0; i<pts0.size(); i++) {
+            const cv::Point2f &pt_n = pts0_n.at(i);
+            Eigen::Vector3d b_C1 = R_C0toC1*Eigen::Vector3d(pt_n.x, pt_n.y, 1);
+            if(b_C1(2) < 0.1)
+                continue;
+            cv::Point2f pt_pred = distort_point(cv::Point2f((float)(b_C1(0)/b_C1(2)), (float)(b_C1(1)/b_C1(2))), id0);
+            if(pt_pred.x < 0 || pt_pred.y < 0 || pt_pred.x >= img1pyr.at(0).cols || pt_pred.y >= img1pyr.at(0).rows)
+                continue;
+            pts1.at(i) = pt_pred;
+        }
+        max_level = pyr_levels_predicted;
+        max_iters = max_iters_predicted;
+    }
+
+    // If we are tracking temporally, choose our settings from how much the KLT had to correct our guesses on the last image
+    // Each pyramid level lets the KLT converge from about half a window further away, so we add levels until we cover the expected motion
+    // We only shrink the window if the motion is tiny (the pyramid border was made for the full window, so we can not grow it)
+    cv::Size win = win_size;
+    bool is_reduced = false;
+    if(use_adaptive_klt && id0 == id1 && !flow_stats.at(id0).lost && flow_stats.at(id0).residual >= 0) {
+        const float expected = 2.0f*flow_stats.at(id0).residual + 1.0f;
+        int levels = 0;
+        while(levels < pyr_levels && 0.5f*(float)win_size.width*(float)(1 << levels) < expected)
+            levels++;
+        int iters = (expected < 2.0f)? 5 : ((expected < 8.0f)? 10 : 15);
+        if(expected < 2.0f && win_size.width > 11)
+            win = cv::Size(11, 11);
+        is_reduced = (levels < max_level || iters < max_iters || win != win_size);
+        max_level = std::min(max_level, levels);
+        max_iters = std::min(max_iters, iters);
+    }
+    std::vector<cv::Point2f> pts1_guess = pts1;
+
     // Now do KLT tracking to get the valid new points
+    // If we are tracking on a downscaled level, we only track down to that level here, and refine the good tracks after RANSAC
     std::vector<uchar> mask_klt;
     std::vector<float> error;
-    cv::TermCriteria term_crit = cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 15, 0.01);
-    cv::calcOpticalFlowPyrLK(img0pyr, img1pyr, pts0, pts1, mask_klt, error, win_size, pyr_levels, term_crit, cv::OPTFLOW_USE_INITIAL_FLOW);
-    // 对原始图像上的特征点进行光流跟踪，pts1现在变成光流跟踪后的坐标
+    cv::TermCriteria term_crit = cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, max_iters, 0.01);
+    cv::Mat img_level;
+    int level = std::min(get_pyramid_level(img0pyr, track_level, img_level), get_pyramid_level(img1pyr, track_level, img_level));
+    if(level == 0) {
+        cv::calcOpticalFlowPyrLK(img0pyr, img1pyr, pts0, pts1, mask_klt, error, win, max_level, term_crit, cv::OPTFLOW_USE_INITIAL_FLOW);
+        // 对原始图像上的特征点进行光流跟踪，pts1现在变成光流跟踪后的坐标
+    } else {
+        const float scale = (float)(1 << level);
+        std::vector<cv::Point2f> pts0_l, pts1_l;
+        for(size_t i=0; i<pts0.size(); i++) {
+            pts0_l.push_back(pts0.at(i)*(1.0f/scale));
+            pts1_l.push_back(pts1.at(i)*(1.0f/scale));
+        }
+        cv::calcOpticalFlowPyrLK(get_pyramid_from_level(img0pyr, level), get_pyramid_from_level(img1pyr, level), pts0_l, pts1_l,
+                                 mask_klt, error, win, std::max(0, max_level-level), term_crit, cv::OPTFLOW_USE_INITIAL_FLOW);
+        for(size_t i=0; i<pts1.size(); i++) {
+            pts1.at(i) = pts1_l.at(i)*scale;
+        }
+    }
 
     // Normalize these points, so we can then do ransac
     // We don't want to do ransac on distorted image uvs since the mapping is nonlinear
-    std::vector<cv::Point2f> pts0_n, pts1_n;
-    for(size_t i=0; i<pts0.size(); i++) {
-        pts0_n.push_back(undistort_point(pts0.at(i),id0));                    // 对前一帧特征点去畸变,得到去畸变归一化平面坐标
-        pts1_n.push_back(undistort_point(pts1.at(i),id1));                    // 对当前帧特征点去畸变,得到去畸变归一化平面坐标
-    }
+    // The first image's points were already normalized above (KLT does not move them)
+    undistort_points(pts1, pts1_n, id1);                                          // 对当前帧特征点去畸变,得到去畸变归一化平面坐标
 
     // Do RANSAC outlier rejection (note since we normalized the max pixel error is now in the normalized cords)
     std::vector<uchar> mask_rsc;
-    double max_focallength_img0 = std::max(camera_k_OPENCV.at(id0)(0,0),camera_k_OPENCV.at(id0)(1,1));
-    double max_focallength_img1 = std::max(camera_k_OPENCV.at(id1)(0,0),camera_k_OPENCV.at(id1)(1,1));
-    double max_focallength = std::max(max_focallength_img0,max_focallength_img1);
-    cv::findFundamentalMat(pts0_n, pts1_n, cv::FM_RANSAC, 1/max_focallength, 0.999, mask_rsc);          // 通过OpenCV FindFundamentalMat Ransac来剔除噪声点，输入是去畸变后的归一化平面坐标
+    perform_ransac(pts0_n, pts1_n, id0, id1, has_rotation, R_C0toC1, mask_rsc);          // 剔除噪声点，输入是去畸变后的归一化平面坐标
+
+    // If we used reduced settings and lost a lot of tracks, the motion was larger than we expected
+    // The KLT often converges to a wrong nearby minimum instead of failing, so we also count the tracks RANSAC rejected
+    // We track these again from their initial guess with our full settings, and redo RANSAC with them
+    if(is_reduced) {
+        std::vector<size_t> idx_failed;
+        std::vector<cv::Point2f> pts0_failed, pts1_failed;
+        for(size_t i=0; i<mask_klt.size(); i++) {
+            if(!mask_klt[i] || i >= mask_rsc.size() || !mask_rsc[i]) {
+                idx_failed.push_back(i);
+                pts0_failed.push_back(pts0.at(i));
+                pts1_failed.push_back(pts1_guess.at(i));
+            }
+        }
+        if((double)idx_failed.size() > 0.3*(double)mask_klt.size()) {
+            std::vector<uchar> mask_retry;
+            std::vector<float> error_retry;
+            cv::TermCriteria term_crit_full = cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 15, 0.01);
+            cv::calcOpticalFlowPyrLK(img0pyr, img1pyr, pts0_failed, pts1_failed, mask_retry, error_retry, win_size, pyr_levels, term_crit_full, cv::OPTFLOW_USE_INITIAL_FLOW);
+            for(size_t i=0; i<idx_failed.size(); i++) {
+                pts1.at(idx_failed.at(i)) = pts1_failed.at(i);
+                mask_klt[idx_failed.at(i)] = mask_retry[i];
+            }
+            undistort_points(pts1, pts1_n, id1);
+            perform_ransac(pts0_n, pts1_n, id0, id1, has_rotation, R_C0toC1, mask_rsc);
+        }
+    }
+
+    // Record how far the KLT moved the inlier tracks from their guess, and if we lost too many, for the next image
+    // Using the RANSAC inliers means tracks that converged to the wrong place do not make the motion look small
+    if(id0 == id1) {
+        std::vector<float> residuals;
+        for(size_t i=0; i<mask_klt.size() && i<mask_rsc.size(); i++) {
+            if(mask_klt[i] && mask_rsc[i])
+                residuals.push_back((float)cv::norm(pts1.at(i)-pts1_guess.at(i)));
+        }
+        FlowStats &stats = flow_stats.at(id0);
+        stats.lost = ((double)residuals.size() < 0.5*(double)mask_klt.size());
+        stats.residual = -1;
+        if(!residuals.empty()) {
+            std::nth_element(residuals.begin(), residuals.begin()+residuals.size()/2, residuals.end());
+            stats.residual = residuals.at(residuals.size()/2);
+        }
+    }
+
+    // If we tracked on a downscaled level, refine the tracks that are still good on the full resolution image
+    // These are only off by the error of the downscaled level, so we only need to track on the first level
+    if(level > 0) {
+        std::vector<size_t> idx_good;
+        std::vector<cv::Point2f> pts0_good, pts1_good;
+        for(size_t i=0; i<mask_klt.size() && i<mask_rsc.size(); i++) {
+            if(mask_klt[i] && mask_rsc[i]) {
+                idx_good.push_back(i);
+                pts0_good.push_back(pts0.at(i));
+                pts1_good.push_back(pts1.at(i));
+            }
+        }
+        if(!pts0_good.empty()) {
+            std::vector<uchar> mask_refine;
+            std::vector<float> error_refine;
+            cv::calcOpticalFlowPyrLK(img0pyr, img1pyr, pts0_good, pts1_good, mask_refine, error_refine, win_size, 0, term_crit, cv::OPTFLOW_USE_INITIAL_FLOW);
+            for(size_t i=0; i<idx_good.size(); i++) {
+                pts1.at(idx_good.at(i)) = pts1_good.at(i);
+                if(!mask_refine[i])
+                    mask_klt[idx_good.at(i)] = 0;
+            }
+        }
+    }
 
     // Loop through and record only ones that are valid
     for(size_t i=0; i<mask_klt.size(); i++) {
@@ -528,4 +735,77 @@ void TrackKLT::perform_matching(const std::vector<cv::Mat>& img0pyr, const std::
 }
 
 
+void TrackKLT::start_lookahead(size_t cam_id_left, size_t cam_id_right, bool is_stereo) {
+
+    // Copy our current tracks, which the detection will append to
+    LookaheadDetection &job = lookahead.at(cam_id_left);
+    assert(!job.thread.joinable());
+    job.is_stereo = is_stereo;
+    job.cam_id_right = cam_id_right;
+    job.pts0 = pts_last[cam_id_left];
+    job.ids0 = ids_last[cam_id_left];
+    if(is_stereo) {
+        job.pts1 = pts_last[cam_id_right];
+        job.ids1 = ids_last[cam_id_right];
+    }
+
+    // Detect on our last frames, we hold onto them so they will not be recycled while we are running
+    std::shared_ptr<FrameContext> frame0 = frame_last.at(cam_id_left);
+    std::shared_ptr<FrameContext> frame1 = frame_last.at(cam_id_right);
+    job.thread = boost::thread([this, &job, frame0, frame1, cam_id_left] {
+        if(job.is_stereo) {
+            perform_detection_stereo(frame0, frame1, job.pts0, job.pts1, job.ids0, job.ids1, cam_id_left);
+        } else {
+            perform_detection_monocular(frame0, job.pts0, job.ids0, cam_id_left);
+        }
+    });
+
+}
+
+
+bool TrackKLT::finish_lookahead(size_t cam_id_left) {
 
+    // Return if we have not started a detection
+    LookaheadDetection &job = lookahead.at(cam_id_left);
+    if(!job.thread.joinable())
+        return false;
+
+    // Wait for it, and use its tracks as our last tracks
+    job.thread.join();
+    pts_last[cam_id_left].swap(job.pts0);
+    ids_last[cam_id_left].swap(job.ids0);
+    if(job.is_stereo) {
+        pts_last[job.cam_id_right].swap(job.pts1);
+        ids_last[job.cam_id_right].swap(job.ids1);
+    }
+    return true;
+
+}
+
+
+void TrackKLT::update_stats(size_t cam_id, const std::vector<boost::posix_time::ptime> &times, size_t num_last, size_t num_tracked) {
+
+    // Add the time of each stage of this image, and how many of the last image's features we tracked
+    assert(times.size() == 7);
+    TrackStats &stats = track_stats.at(cam_id);
+    for(size_t i=0; i<6; i++) {
+        stats.time.at(i) += (times.at(i+1)-times.at(i)).total_microseconds() * 1e-6;
+    }
+    stats.time.at(6) += (times.at(6)-times.at(0)).total_microseconds() * 1e-6;
+    stats.num_last += num_last;
+    stats.num_tracked += num_tracked;
+    stats.num_frames++;
+
+    // Print the average over the images since our last summary
+    if(stats.num_frames < stats_period)
+        return;
+    const double n = (double)stats.num_frames;
+    ROS_INFO("[KLT-STATS]: cam %d | %d images | tracked %.1f%% of %.1f features per image",
+             (int)cam_id, stats.num_frames, 100.0*stats.num_tracked/std::max((size_t)1, stats.num_last), stats.num_last/n);
+    ROS_INFO("[KLT-STATS]: %.2f ms look-ahead wait | %.2f ms equalization and pyramid | %.2f ms detection | %.2f ms temporal klt",
+             1e3*stats.time.at(0)/n, 1e3*stats.time.at(1)/n, 1e3*stats.time.at(2)/n, 1e3*stats.time.at(3)/n);
+    ROS_INFO("[KLT-STATS]: %.2f ms stereo klt | %.2f ms feature DB update | %.2f ms total",
+             1e3*stats.time.at(4)/n, 1e3*stats.time.at(5)/n, 1e3*stats.time.at(6)/n);
+    stats = TrackStats();
+
+}
@@ -23,6 +23,8 @@
 
 
 #include "TrackBase.h"
+#include "Grider_AdaptiveFAST.h"
+#include "Grid_Occupancy.h"
 
 
 namespace ov_core {
@@ -58,6 +60,16 @@ namespace ov_core {
         explicit TrackKLT(int numfeats, int numaruco, int fast_threshold, int gridx, int gridy, int minpxdist) :
                  TrackBase(numfeats, numaruco), threshold(fast_threshold), grid_x(gridx), grid_y(gridy), min_px_dist(minpxdist) {}
 
+        /**
+         * @brief Destructor, waits for any look-ahead detection that is still running
+         */
+        ~TrackKLT() override {
+            for(auto &job : lookahead) {
+                if(job.second.thread.joinable())
+                    job.second.thread.join();
+            }
+        }
+
 
         /**
          * @brief Process a new monocular image
@@ -78,36 +90,189 @@ namespace ov_core {
         void feed_stereo(double timestamp, cv::Mat &img_left, cv::Mat &img_right, size_t cam_id_left, size_t cam_id_right) override;
 
 
+        /**
+         * @brief Set the KLT settings used when we have a rotation prior for a camera (see TrackBase::set_rotation_prior())
+         * @param pyrlevels max pyramid level we track on when the points have been predicted
+         * @param maxiters max number of KLT iterations when the points have been predicted
+         *
+         * Since the predicted locations only have the error of the unknown translation, we can track on less pyramid levels.
+         */
+        void set_prediction_params(int pyrlevels, int maxiters) {
+            pyr_levels_predicted = std::max(0, std::min(pyrlevels, pyr_levels));
+            max_iters_predicted = std::max(1, maxiters);
+        }
+
+        /**
+         * @brief Set if we should detect with adaptive per-cell FAST thresholds (see Grider_AdaptiveFAST)
+         * @param use true to use adaptive thresholds, false to use the fixed threshold of Grider_FAST
+         */
+        void set_adaptive_fast(bool use) {
+            use_adaptive_fast = use;
+        }
+
+        /**
+         * @brief Set when and how we detect new features
+         * @param use_lookahead_detection if we should detect features for the next image in the background right after our tracks are final
+         * @param min_tracked_ratio we only detect new features if we are tracking less than this ratio of our max number of features
+         *                          (points that have come too close to each other are still removed on every image)
+         *
+         * Normally we "top-off" the last image's tracks with new features at the start of each new image, before we can do KLT.
+         * With look-ahead detection this is started in a background thread at the end of the last image, and we just wait for it to finish.
+         * Thus the detection time is taken out of the time from getting an image to having its tracks.
+         */
+        void set_detection_params(bool use_lookahead_detection, double min_tracked_ratio) {
+            use_lookahead = use_lookahead_detection;
+            min_tracked = std::max(0.0, std::min(1.0, min_tracked_ratio));
+        }
+
+        /**
+         * @brief Set if we should choose the KLT pyramid levels, window size and iterations of each image from how far we expect points to move
+         * @param use true to adapt the KLT settings, false to always use the full settings
+         *
+         * We use how far the KLT had to move each point from its initial guess (the rotated point if we have a gyro prior) on the last image.
+         * In slow motion this lets us track on fewer levels with fewer iterations, while fast motion or lost tracks go back to the full settings.
+         */
+        void set_adaptive_klt(bool use) {
+            use_adaptive_klt = use;
+        }
+
+        /**
+         * @brief Set the pyramid level and region we detect and track in (for high resolution cameras)
+         * @param level pyramid level we detect on and track down to, before refining the surviving tracks on the full image
+         * @param roi region of the full resolution image we detect new features in (empty to use the whole image)
+         *
+         * Detection (FAST) and the KLT both run on the downscaled image, so their cost is 4^level times smaller.
+         * Only the tracks that pass RANSAC are then refined back on the full resolution image.
+         * This way the front-end cost goes with the number of points, instead of the number of pixels of the camera.
+         */
+        void set_track_region(int level, cv::Rect roi = cv::Rect()) {
+            track_level = std::max(0, std::min(level, pyr_levels));
+            track_roi = roi;
+        }
+
+        /**
+         * @brief Set how often we print a summary of our timing and tracking quality
+         * @param num_images number of images of a camera between each summary (0 disables it)
+         *
+         * Each summary is the average over the images since the last one, of the time of each stage of our tracking
+         * and of the ratio of the last image's features we tracked into the new image.
+         */
+        void set_stats_period(int num_images) {
+            stats_period = std::max(0, num_images);
+        }
+
     protected:
 
+        /**
+         * @brief Allocates our last frames, detectors, occupancy grids, stats and look-ahead detections for each camera
+         * @param cam_ids camera ids we have a calibration for
+         *
+         * A look-ahead detection reads its camera's detector and grid while the next feed of another camera runs, so none of these can be added later.
+         */
+        void allocate_cameras(const std::vector<size_t> &cam_ids) override {
+            TrackBase::allocate_cameras(cam_ids);
+            for(size_t cam_id : cam_ids) {
+                frame_last[cam_id];
+                grider_fast.insert({cam_id, Grider_AdaptiveFAST(threshold, num_features)});
+                grid_occupancy[cam_id];
+                flow_stats[cam_id];
+                track_stats[cam_id];
+                lookahead[cam_id];
+            }
+        }
+
         /**
          * @brief Detects new features in the current image
-         * @param img0pyr image we will detect features on (first level of pyramid)
+         * @param frame0 frame we will detect features on (its pyramid, and its shared corners if using adaptive FAST)
          * @param pts0 vector of currently extracted keypoints in this image
          * @param ids0 vector of feature ids for each currently extracted keypoint
+         * @param cam_id id of the camera, used to get its adaptive FAST thresholds
          *
          * Given an image and its currently extracted features, this will try to add new features if needed.
          * Will try to always have the "max_features" being tracked through KLT at each timestep.
          * Passed images should already be grayscaled.
          */
-        void perform_detection_monocular(const std::vector<cv::Mat> &img0pyr, std::vector<cv::KeyPoint> &pts0, std::vector<size_t> &ids0);
+        void perform_detection_monocular(const std::shared_ptr<FrameContext> &frame0, std::vector<cv::KeyPoint> &pts0, std::vector<size_t> &ids0, size_t cam_id);
 
         /**
          * @brief Detects new features in the current stereo pair
-         * @param img0pyr left image we will detect features on (first level of pyramid)
-         * @param img1pyr right image we will detect features on (first level of pyramid)
+         * @param frame0 left frame we will detect features on (its pyramid, and its shared corners if using adaptive FAST)
+         * @param frame1 right frame we will track the new features into
          * @param pts0 left vector of currently extracted keypoints
          * @param pts1 right vector of currently extracted keypoints
          * @param ids0 left vector of feature ids for each currently extracted keypoint
          * @param ids1 right vector of feature ids for each currently extracted keypoint
+         * @param cam_id id of the left camera, used to get its adaptive FAST thresholds
          *
          * This does the same logic as the perform_detection_monocular() function, but we also enforce stereo contraints.
          * So we detect features in the left image, and then KLT track them onto the right image.
          * If we have valid tracks, then we have both the keypoint on the left and its matching point in the right image.
          * Will try to always have the "max_features" being tracked through KLT at each timestep.
          */
-        void perform_detection_stereo(const std::vector<cv::Mat> &img0pyr, const std::vector<cv::Mat> &img1pyr, std::vector<cv::KeyPoint> &pts0,
-                                      std::vector<cv::KeyPoint> &pts1, std::vector<size_t> &ids0, std::vector<size_t> &ids1);
+        void perform_detection_stereo(const std::shared_ptr<FrameContext> &frame0, const std::shared_ptr<FrameContext> &frame1, std::vector<cv::KeyPoint> &pts0,
+                                      std::vector<cv::KeyPoint> &pts1, std::vector<size_t> &ids0, std::vector<size_t> &ids1, size_t cam_id);
+
+        /**
+         * @brief Extracts new FAST features in a grid over our detection level and region of a frame
+         * @param frame0 frame we will detect features on
+         * @param num_featsneeded max number of features we want
+         * @param cam_id id of the camera, used to get its adaptive FAST thresholds
+         * @param pts0_ext extracted features (in full resolution pixels)
+         */
+        void extract_features(const std::shared_ptr<FrameContext> &frame0, int num_featsneeded, size_t cam_id, std::vector<cv::KeyPoint> &pts0_ext);
+
+        /**
+         * @brief Gets the image of a pyramid level
+         * @param pyr pyramid from cv::buildOpticalFlowPyramid() (which might have the derivatives of each level between them)
+         * @param level level we want, is reduced to the largest level of the pyramid
+         * @param img image of the level we return
+         * @return The level we returned
+         */
+        static int get_pyramid_level(const std::vector<cv::Mat> &pyr, int level, cv::Mat &img);
+
+        /**
+         * @brief Gets a pyramid that starts at one of the levels of another one (shares the same images)
+         * @param pyr pyramid from cv::buildOpticalFlowPyramid()
+         * @param level level the new pyramid should start at
+         * @return Pyramid with the given level as its first level
+         */
+        static std::vector<cv::Mat> get_pyramid_from_level(const std::vector<cv::Mat> &pyr, int level);
+
+        /**
+         * @brief If we are tracking few enough features that we should detect new ones
+         * @param cam_id id of the camera (left camera if stereo)
+         * @return True if we should detect new features
+         */
+        bool need_detection(size_t cam_id) {
+            return (double)pts_last[cam_id].size() < min_tracked*num_features;
+        }
+
+        /**
+         * @brief Starts detection of new features on our last image(s) in a background thread
+         * @param cam_id_left id of the camera (left camera if stereo)
+         * @param cam_id_right id of the right camera (same as the left if monocular)
+         * @param is_stereo if we should do stereo detection
+         *
+         * This copies our last tracks, and calls perform_detection_monocular() or perform_detection_stereo() on them.
+         * The result is used as our last tracks once finish_lookahead() is called on the next image.
+         */
+        void start_lookahead(size_t cam_id_left, size_t cam_id_right, bool is_stereo);
+
+        /**
+         * @brief Waits for the look-ahead detection of a camera, and replaces our last tracks with its result
+         * @param cam_id_left id of the camera (left camera if stereo)
+         * @return True if we had started a detection on the last image(s)
+         */
+        bool finish_lookahead(size_t cam_id_left);
+
+        /**
+         * @brief Adds the timing and tracking quality of an image, and prints their summary every stats_period images
+         * @param cam_id id of the camera (left camera if stereo)
+         * @param times start, after the look-ahead wait, pyramid, detection, temporal klt, stereo klt and feature DB update
+         * @param num_last number of features of the last image we tried to track
+         * @param num_tracked number of them we tracked into the new image
+         */
+        void update_stats(size_t cam_id, const std::vector<boost::posix_time::ptime> &times, size_t num_last, size_t num_tracked);
 
         /**
          * @brief KLT track between two images, and do RANSAC afterwards
@@ -122,12 +287,23 @@ namespace ov_core {
          * This will track features from the first image into the second image.
          * The two point vectors will be of equal size, but the mask_out variable will specify which points are good or bad.
          * If the second vector is non-empty, it will be used as an initial guess of where the keypoints are in the second image.
+         * If we are tracking temporally and have a rotation prior for this camera, the initial guess will be the rotated points.
          */
         void perform_matching(const std::vector<cv::Mat> &img0pyr, const std::vector<cv::Mat> &img1pyr, std::vector<cv::KeyPoint> &pts0,
                               std::vector<cv::KeyPoint> &pts1, size_t id0, size_t id1, std::vector<uchar> &mask_out);
 
-        // Timing variables
-        boost::posix_time::ptime rT1, rT2, rT3, rT4, rT5, rT6, rT7;
+        /// Timing (in seconds) and tracking quality of a camera, summed over the images since our last summary
+        struct TrackStats {
+            /// Look-ahead wait, pyramid, detection, temporal klt, stereo klt, feature DB update and total
+            std::vector<double> time = std::vector<double>(7, 0.0);
+            int num_frames = 0;
+            size_t num_last = 0;
+            size_t num_tracked = 0;
+        };
+
+        // How many images between each summary of our stats (0 disables them), and the stats of each camera
+        int stats_period = 0;
+        std::map<size_t, TrackStats> track_stats;
 
         // Parameters for our FAST grid detector
         int threshold;                       // Fast 角点检测阈值
@@ -137,12 +313,55 @@ namespace ov_core {
         // Minimum pixel distance to be "far away enough" to be a different extracted feature
         int min_px_dist;                     // 相邻两个特征点之间的最小距离
 
+        // If we should use adaptive FAST thresholds, and the detector of each camera (they are stateful)
+        bool use_adaptive_fast = false;
+        std::map<size_t, Grider_AdaptiveFAST> grider_fast;
+
+        // Occupancy grid of each camera, reused for each detection so we do not allocate
+        std::map<size_t, Grid_Occupancy> grid_occupancy;
+
+        /// Flow statistics of the last temporal tracking of a camera, used to choose the KLT settings for its next image
+        struct FlowStats {
+            /// Median pixel distance the KLT moved the good tracks from their initial guess (negative if unknown)
+            float residual = -1;
+            /// If we lost too many tracks, so the next image should use the full settings
+            bool lost = true;
+        };
+
+        // If we should adapt our KLT settings to the motion, and the flow statistics of each camera
+        bool use_adaptive_klt = false;
+        std::map<size_t, FlowStats> flow_stats;
+
+        // Pyramid level we detect and track on (0 is the full image), and the region we detect features in
+        int track_level = 0;
+        cv::Rect track_roi;
+
+        // If we should detect in the background after each image, and the ratio of tracks we detect new features below
+        bool use_lookahead = false;
+        double min_tracked = 1.0;
+
+        /// Background detection on the last image(s) of a camera, which will be merged at the start of the next image
+        struct LookaheadDetection {
+            boost::thread thread;
+            bool is_stereo = false;
+            size_t cam_id_right = 0;
+            std::vector<cv::KeyPoint> pts0, pts1;
+            std::vector<size_t> ids0, ids1;
+        };
+
+        // Look-ahead detection of each camera (stored under the left camera if stereo)
+        std::map<size_t, LookaheadDetection> lookahead;
+
         // How many pyramid levels to track on and the window size to reduce by
         int pyr_levels = 3;                  // 金字塔层数
         cv::Size win_size = cv::Size(15, 15);   // 光流法窗口大小
 
-        // Last set of image pyramids
-        std::map<size_t, std::vector<cv::Mat>> img_pyramid_last;   // 上一张图片的金字塔数据
+        // Pyramid levels and iterations we track with if we have predicted where the points should be
+        int pyr_levels_predicted = 1;
+        int max_iters_predicted = 10;
+
+        // Last set of frames (with their image pyramids)
+        std::map<size_t, std::shared_ptr<FrameContext>> frame_last;   // 上一张图片的金字塔数据
 
     };
 
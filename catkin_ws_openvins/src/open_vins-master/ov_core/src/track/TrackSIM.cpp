@@ -45,6 +45,7 @@ void TrackSIM::feed_measurement_simulation(double timestamp, const std::vector<i
         // Update our feature database, with theses new observations
         // NOTE: we add the "currid" since we need to offset the simulator
         // NOTE: ids by the number of aruoc tags we have specified as tracking
+        std::vector<cv::Point2f> good_left_n;
         for(const auto &feat : feats.at(i)) {
 
             // Get our id value
@@ -55,12 +56,15 @@ void TrackSIM::feed_measurement_simulation(double timestamp, const std::vector<i
             kpt.pt.x = feat.second(0);
             kpt.pt.y = feat.second(1);
             good_left.push_back(kpt);
+            good_left_n.push_back(kpt.pt);
             good_ids_left.push_back(id);
+        }
 
-            // Append to the database
-            cv::Point2f npt_l = undistort_point(kpt.pt, cam_id);
-            database->update_feature(id, timestamp, cam_id,
-                                     kpt.pt.x, kpt.pt.y, npt_l.x, npt_l.y);
+        // Append to the database
+        undistort_points(good_left_n, good_left_n, cam_id);
+        for(size_t j=0; j<good_left.size(); j++) {
+            database->update_feature(good_ids_left.at(j), timestamp, cam_id,
+                                     good_left.at(j).pt.x, good_left.at(j).pt.y, good_left_n.at(j).x, good_left_n.at(j).y);
         }
 
         // Get our width and height
@@ -0,0 +1,204 @@
+/*
+ * OpenVINS: An Open Platform for Visual-Inertial Research
+ * Copyright (C) 2019 Patrick Geneva
+ * Copyright (C) 2019 Kevin Eckenhoff
+ * Copyright (C) 2019 Guoquan Huang
+ * Copyright (C) 2019 OpenVINS Contributors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef OV_CORE_TWOPOINT_RANSAC_H
+#define OV_CORE_TWOPOINT_RANSAC_H
+
+
+#include <vector>
+#include <random>
+#include <Eigen/Eigen>
+
+#include <opencv/cv.hpp>
+#include <opencv2/core/core.hpp>
+
+
+namespace ov_core {
+
+    /**
+     * @brief Outlier rejection of feature matches when the relative rotation is known.
+     *
+     * If we know the rotation between the two views (e.g. from integrating the gyroscope) the epipolar constraint
+     * \f$ \mathbf{x}_1^\top \lfloor \mathbf{t} \times\rfloor \mathbf{R} \mathbf{x}_0 = \mathbf{t}^\top (\mathbf{R}\mathbf{x}_0 \times \mathbf{x}_1) = 0 \f$
+     * is linear in the unknown translation direction.
+     * Thus two correspondences are enough to find a model hypothesis, which needs far fewer RANSAC iterations than
+     * the eight point fundamental matrix (e.g. 16 vs 1177 for 50% outliers at 99.9% confidence).
+     * If both the rotation and translation are known (e.g. stereo with calibrated extrinsics), we can directly check the epipolar error.
+     * All points should be normalized (undistorted) coordinates.
+     */
+    class TwoPointRansac {
+
+    public:
+
+
+        /**
+         * @brief Translation only RANSAC given a known rotation.
+         * @param pts0_n normalized points in the first image
+         * @param pts1_n normalized points in the second image
+         * @param R_0to1 rotation from the first camera frame to the second camera frame
+         * @param threshold max epipolar error to be an inlier (normalized coordinates)
+         * @param confidence probability that we have found the best model
+         * @param mask output mask, 1 if the point is an inlier
+         * @param max_iters max number of hypotheses we will try
+         * @return number of inliers
+         *
+         * We also test the zero translation hypothesis (pure rotation), where the epipolar constraint is degenerate.
+         * The best model is refined using all of its inliers as the smallest eigenvector of \f$ \sum \mathbf{a}_i\mathbf{a}_i^\top \f$.
+         */
+        static int ransac_known_rotation(const std::vector<cv::Point2f> &pts0_n, const std::vector<cv::Point2f> &pts1_n,
+                                         const Eigen::Matrix3d &R_0to1, double threshold, double confidence,
+                                         std::vector<uchar> &mask, int max_iters = 200) {
+
+            // Compute our rotated bearings and the constraint vectors a_i = (R*x0) x x1 (t^T*a_i = 0)
+            assert(pts0_n.size()==pts1_n.size());
+            size_t num_pts = pts0_n.size();
+            std::vector<Eigen::Vector3d> rx0(num_pts), x1(num_pts), a(num_pts);
+            for(size_t i=0; i<num_pts; i++) {
+                rx0.at(i) = R_0to1*Eigen::Vector3d(pts0_n.at(i).x, pts0_n.at(i).y, 1);
+                x1.at(i) << pts1_n.at(i).x, pts1_n.at(i).y, 1;
+                a.at(i) = rx0.at(i).cross(x1.at(i));
+            }
+
+            // Our zero translation hypothesis, points should just be rotated
+            std::vector<uchar> mask_best(num_pts, 0);
+            int inliers_best = 0;
+            for(size_t i=0; i<num_pts; i++) {
+                if(rx0.at(i)(2) <= 0)
+                    continue;
+                Eigen::Vector2d res = rx0.at(i).head(2)/rx0.at(i)(2) - x1.at(i).head(2);
+                if(res.norm() < threshold) {
+                    mask_best.at(i) = 1;
+                    inliers_best++;
+                }
+            }
+
+            // If we do not have enough points, then we can only use the pure rotation model
+            if(num_pts < 2) {
+                mask = mask_best;
+                return inliers_best;
+            }
+
+            // Now lets try to find a better translation model with the smallest sample
+            std::mt19937 rng(0);
+            std::uniform_int_distribution<size_t> dist(0, num_pts-1);
+            std::vector<uchar> mask_curr(num_pts, 0);
+            int iters_needed = max_iters;
+            for(int iter=0; iter<iters_needed && iter<max_iters; iter++) {
+                // Get two unique points
+                size_t id0 = dist(rng);
+                size_t id1 = dist(rng);
+                if(id0 == id1)
+                    continue;
+                // Translation is orthogonal to both constraints
+                Eigen::Vector3d t = a.at(id0).cross(a.at(id1));
+                if(t.norm() < 1e-12)
+                    continue;
+                t.normalize();
+                // Count our inliers
+                int inliers = count_inliers(rx0, x1, R_0to1, t, threshold, mask_curr);
+                if(inliers > inliers_best) {
+                    inliers_best = inliers;
+                    mask_best = mask_curr;
+                    // Update how many iterations we need (two point minimal sample)
+                    double ratio = (double)inliers/(double)num_pts;
+                    double denom = std::log(std::max(1e-12, 1-ratio*ratio));
+                    if(denom < 0)
+                        iters_needed = (int)std::ceil(std::log(1-confidence)/denom);
+                }
+            }
+
+            // Refine our translation with all inliers, and then re-count
+            if(inliers_best >= 2) {
+                Eigen::Matrix3d A = Eigen::Matrix3d::Zero();
+                for(size_t i=0; i<num_pts; i++) {
+                    if(mask_best.at(i))
+                        A += a.at(i)*a.at(i).transpose();
+                }
+                Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> eig(A);
+                Eigen::Vector3d t = eig.eigenvectors().col(0);
+                int inliers = count_inliers(rx0, x1, R_0to1, t, threshold, mask_curr);
+                if(inliers >= inliers_best) {
+                    inliers_best = inliers;
+                    mask_best = mask_curr;
+                }
+            }
+
+            // Return our best model's inliers
+            mask = mask_best;
+            return inliers_best;
+
+        }
+
+
+        /**
+         * @brief Checks the epipolar error of all points given the full relative pose.
+         * @param pts0_n normalized points in the first image
+         * @param pts1_n normalized points in the second image
+         * @param R_0to1 rotation from the first camera frame to the second camera frame
+         * @param p_0in1 position of the first camera in the second camera frame
+         * @param threshold max epipolar error to be an inlier (normalized coordinates)
+         * @param mask output mask, 1 if the point is an inlier
+         * @return number of inliers
+         */
+        static int check_epipolar(const std::vector<cv::Point2f> &pts0_n, const std::vector<cv::Point2f> &pts1_n,
+                                  const Eigen::Matrix3d &R_0to1, const Eigen::Vector3d &p_0in1,
+                                  double threshold, std::vector<uchar> &mask) {
+            assert(pts0_n.size()==pts1_n.size());
+            std::vector<Eigen::Vector3d> rx0(pts0_n.size()), x1(pts0_n.size());
+            for(size_t i=0; i<pts0_n.size(); i++) {
+                rx0.at(i) = R_0to1*Eigen::Vector3d(pts0_n.at(i).x, pts0_n.at(i).y, 1);
+                x1.at(i) << pts1_n.at(i).x, pts1_n.at(i).y, 1;
+            }
+            return count_inliers(rx0, x1, R_0to1, p_0in1.normalized(), threshold, mask);
+        }
+
+
+    protected:
+
+
+        /**
+         * @brief Counts the points which have a small enough Sampson error for the essential matrix E = [t]x*R.
+         *
+         * With e = x1^T*E*x0, the Sampson error is e^2/(|(E*x0)_{1:2}|^2 + |(E^T*x1)_{1:2}|^2).
+         */
+        static int count_inliers(const std::vector<Eigen::Vector3d> &rx0, const std::vector<Eigen::Vector3d> &x1,
+                                 const Eigen::Matrix3d &R_0to1, const Eigen::Vector3d &t, double threshold, std::vector<uchar> &mask) {
+            int inliers = 0;
+            double threshold_sq = threshold*threshold;
+            mask.resize(rx0.size());
+            for(size_t i=0; i<rx0.size(); i++) {
+                // Epipolar lines in both images (l1 = E*x0 = [t]x*R*x0, l0 = E^T*x1 = -R^T*[t]x*x1)
+                Eigen::Vector3d l1 = t.cross(rx0.at(i));
+                Eigen::Vector3d l0 = -R_0to1.transpose()*t.cross(x1.at(i));
+                double e = x1.at(i).dot(l1);
+                double denom = l1.head(2).squaredNorm() + l0.head(2).squaredNorm();
+                mask.at(i) = (uchar)((denom > 1e-16 && e*e/denom < threshold_sq)? 1 : 0);
+                if(mask.at(i)) inliers++;
+            }
+            return inliers;
+        }
+
+
+    };
+
+}
+
+
+#endif /* OV_CORE_TWOPOINT_RANSAC_H */
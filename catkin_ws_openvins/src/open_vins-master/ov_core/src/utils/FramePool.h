@@ -0,0 +1,576 @@
+/*
+ * OpenVINS: An Open Platform for Visual-Inertial Research
+ * Copyright (C) 2019 Patrick Geneva
+ * Copyright (C) 2019 Kevin Eckenhoff
+ * Copyright (C) 2019 Guoquan Huang
+ * Copyright (C) 2019 OpenVINS Contributors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef OV_CORE_FRAME_POOL_H
+#define OV_CORE_FRAME_POOL_H
+
+
+#include <map>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+
+#include <opencv/cv.hpp>
+#include <opencv2/core/core.hpp>
+
+
+namespace ov_core {
+
+
+    /**
+     * @brief Everything we compute once for a camera image, shared between all our trackers and the loop closer.
+     *
+     * The image is our histogram equalized image, and the pyramid is built from it if a KLT tracker asks for it.
+     * The corners are full image FAST corners, which are only detected the first time someone asks for them (see FramePool::get_corners()).
+     * Everyone should hold onto the std::shared_ptr (or a cv::Mat header of the buffers) instead of cloning the image.
+     */
+    struct FrameContext {
+
+        /// Timestamp and camera id of this image
+        double timestamp = -1;
+        size_t cam_id = 0;
+
+        /// Histogram equalized image
+        cv::Mat image;
+
+        /// Buffer the image is in, with a border around it so it can directly be used as the first level of a pyramid
+        cv::Mat image_border;
+
+        /// Optical flow pyramid of the equalized image with the derivatives of each level (see cv::buildOpticalFlowPyramid)
+        std::vector<cv::Mat> pyramid;
+
+        /// Settings the pyramid was built with (levels is negative if we have not built it)
+        cv::Size pyr_win_size;
+        int pyr_levels = -1;
+
+        /// FAST corners (with non-max suppression) of the equalized image, the response of each is its FAST score
+        std::vector<cv::KeyPoint> corners;
+
+        /// Threshold the corners were detected with (negative if we have not detected them)
+        int corners_threshold = -1;
+
+        /// If the image has been equalized yet
+        bool has_image = false;
+
+        /// Mutex for our preprocessing, as two trackers might ask for the same frame at the same time
+        std::mutex mtx;
+
+    };
+
+
+    /**
+     * @brief Ref-counted pool of preprocessed frames that recycles its image buffers.
+     *
+     * Before, each tracker would histogram equalize the image it was given (sometimes writing into the caller's image),
+     * clone it to keep as its last image, and build a new pyramid each time with freshly allocated levels.
+     * Here the first tracker that gets an image equalizes it into a buffer from a frame nobody uses anymore,
+     * and any other tracker (or the loop closer) that gets the same camera and timestamp just shares it.
+     *
+     * A frame is only recycled once the pool holds the only reference to it.
+     * Its buffers are only written over if no cv::Mat header outside the frame still points to them, otherwise a new one is allocated.
+     * So it is always safe to keep a shallow copy of a frame's image or pyramid (e.g., as the last image of a tracker).
+     */
+    class FramePool {
+
+    public:
+
+        /**
+         * @brief Default constructor
+         * @param max_frames max number of frames we keep around to recycle
+         */
+        explicit FramePool(size_t max_frames = 16) : max_frames(max_frames) {}
+
+        /**
+         * @brief Sets how we equalize our images
+         * @param use_clahe if we should use tile based CLAHE instead of a global histogram equalization
+         * @param clip_limit CLAHE contrast limit of each tile
+         * @param tiles number of CLAHE tiles in each direction
+         */
+        void set_equalization(bool use_clahe, double clip_limit = 2.0, int tiles = 8) {
+            std::unique_lock<std::mutex> lck(mtx);
+            this->use_clahe = use_clahe;
+            this->clahe_clip_limit = clip_limit;
+            this->clahe_tiles = std::max(1, tiles);
+        }
+
+        /**
+         * @brief Gets the preprocessed frame of an image, equalizing it if this is the first time we have seen it
+         * @param timestamp timestamp of the image
+         * @param cam_id camera id of the image
+         * @param img raw grayscale image (we never write into this)
+         * @param border border the equalized image should have around it (the KLT window size, so build_pyramid() does not need to copy it)
+         * @param levels max pyramid level, if we should also build the optical flow pyramid with the border as its window size
+         * @return Shared frame with the equalized image
+         *
+         * The equalization writes straight into the padded buffer, and only the border pixels are then filled in.
+         * This replaces the extra full image copy cv::buildOpticalFlowPyramid() would do to add its border to the first level.
+         * If we are asked for a pyramid (and do not use CLAHE), see equalize_pyramid(), which builds it while we equalize.
+         */
+        std::shared_ptr<FrameContext> get_frame(double timestamp, size_t cam_id, const cv::Mat &img, cv::Size border = cv::Size(0,0), int levels = -1) {
+
+            // Find if we already have this frame, else get a free one
+            std::shared_ptr<FrameContext> frame;
+            bool clahe;
+            double clip_limit;
+            int tiles;
+            {
+                std::unique_lock<std::mutex> lck(mtx);
+                clahe = use_clahe;
+                clip_limit = clahe_clip_limit;
+                tiles = clahe_tiles;
+                auto it_last = last_frames.find(cam_id);
+                if(it_last != last_frames.end() && it_last->second->timestamp == timestamp) {
+                    frame = it_last->second;
+                } else {
+                    frame = get_free_frame();
+                    frame->timestamp = timestamp;
+                    frame->cam_id = cam_id;
+                    frame->has_image = false;
+                    frame->pyr_levels = -1;
+                    frame->corners_threshold = -1;
+                    last_frames[cam_id] = frame;
+                }
+            }
+
+            // Equalize into our recycled buffer if no one else has yet
+            std::unique_lock<std::mutex> lck(frame->mtx);
+            if(!frame->has_image) {
+
+                // Drop our own headers to the old buffer (the pyramid's first level is the image), so we only see outside references
+                frame->image.release();
+                if(!frame->pyramid.empty())
+                    frame->pyramid.at(0).release();
+                release_if_shared(frame->image_border);
+                frame->image_border.create(img.rows+2*border.height, img.cols+2*border.width, CV_8UC1);
+                frame->image = frame->image_border(cv::Rect(border.width, border.height, img.cols, img.rows));
+
+                // Equalize into the middle of our buffer (same size and type, so this does not reallocate)
+                if(!clahe && levels >= 0 && border.width > 2 && border.height > 2) {
+                    equalize_pyramid(*frame, img, border, levels);
+                } else if(clahe) {
+                    cv::Ptr<cv::CLAHE> equalizer = cv::createCLAHE(clip_limit, cv::Size(tiles, tiles));
+                    equalizer->apply(img, frame->image);
+                } else {
+                    cv::equalizeHist(img, frame->image);
+                }
+                if(frame->pyr_levels < 0)
+                    fill_border(frame->image_border, border);
+                frame->has_image = true;
+
+            }
+            return frame;
+
+        }
+
+        /**
+         * @brief Builds the optical flow pyramid of a frame, if it has not already been built with these settings
+         * @param frame frame we want the pyramid of
+         * @param win_size window size the pyramid should support
+         * @param levels max pyramid level
+         *
+         * If the image was gotten with a border of at least the window size, OpenCV will use it as the first level without copying it.
+         * The Scharr derivatives of each level are also computed here, so the KLT does not compute them again each time it tracks from this frame.
+         */
+        static void build_pyramid(const std::shared_ptr<FrameContext> &frame, cv::Size win_size, int levels) {
+            std::unique_lock<std::mutex> lck(frame->mtx);
+            if(frame->pyr_levels == levels && frame->pyr_win_size == win_size)
+                return;
+            for(auto &level : frame->pyramid) {
+                release_if_shared(level);
+            }
+            cv::buildOpticalFlowPyramid(frame->image, frame->pyramid, win_size, levels);
+            frame->pyr_win_size = win_size;
+            frame->pyr_levels = levels;
+        }
+
+        /**
+         * @brief Gets the FAST corners of a frame, only running the detector if it has not already been run with a low enough threshold
+         * @param frame frame we want the corners of
+         * @param threshold FAST threshold the corners should pass
+         * @param corners vector we will return the corners in
+         *
+         * A FAST score is the largest threshold a point is still a corner at, and a point can only be suppressed by a neighbour with a larger score.
+         * Thus taking the corners from a lower threshold pass that have a response of at least our threshold gives the same corners as running FAST again.
+         */
+        static void get_corners(const std::shared_ptr<FrameContext> &frame, int threshold, std::vector<cv::KeyPoint> &corners) {
+            std::unique_lock<std::mutex> lck(frame->mtx);
+            if(frame->corners_threshold < 0 || frame->corners_threshold > threshold) {
+                frame->corners.clear();
+                cv::FAST(frame->image, frame->corners, threshold, true);
+                frame->corners_threshold = threshold;
+            }
+            corners.clear();
+            corners.reserve(frame->corners.size());
+            for(const cv::KeyPoint &kpt : frame->corners) {
+                if(kpt.response >= threshold)
+                    corners.push_back(kpt);
+            }
+        }
+
+        /**
+         * @brief Gets the newest frame of a camera
+         * @param cam_id camera id we want the frame of
+         * @return Shared frame, or nullptr if we have not seen this camera
+         */
+        std::shared_ptr<FrameContext> get_last_frame(size_t cam_id) {
+            std::unique_lock<std::mutex> lck(mtx);
+            auto it_last = last_frames.find(cam_id);
+            if(it_last == last_frames.end())
+                return nullptr;
+            return it_last->second;
+        }
+
+    protected:
+
+        /**
+         * @brief Makes sure we do not write into a buffer someone else still points to
+         * @param mat buffer we want to write into
+         *
+         * OpenCV's create() will reuse a buffer of the same size even if its data is shared, so we drop our reference first.
+         * Buffers that we do not own (not ref-counted) are also dropped.
+         */
+        static void release_if_shared(cv::Mat &mat) {
+            if(!mat.empty() && (mat.u == nullptr || mat.u->refcount > 1))
+                mat.release();
+        }
+
+        /**
+         * @brief Fills the border around an image with its reflection (same as cv::BORDER_REFLECT_101)
+         * @param padded buffer with the image in its middle
+         * @param border size of the border on each side
+         */
+        static void fill_border(cv::Mat &padded, const cv::Size &border) {
+            if(border.width <= 0 && border.height <= 0)
+                return;
+            for(int y=border.height; y<padded.rows-border.height; y++) {
+                fill_border_row(padded.ptr<uchar>(y)+border.width, padded.cols-2*border.width, border.width);
+            }
+            fill_border_rows(padded, border);
+        }
+
+        /**
+         * @brief Fills the left and right border of one image row with its reflection
+         * @param row first pixel of the row (inside the border)
+         * @param cols width of the image
+         * @param bx size of the border on each side
+         */
+        static inline void fill_border_row(uchar *row, int cols, int bx) {
+            for(int x=1; x<=bx; x++) {
+                int r = std::min(x, cols-1);
+                row[-x] = row[r];
+                row[cols-1+x] = row[cols-1-r];
+            }
+        }
+
+        /**
+         * @brief Fills the top and bottom border of an image, whose rows already have their left and right border
+         * @param padded buffer with the image in its middle
+         * @param border size of the border on each side
+         */
+        static void fill_border_rows(cv::Mat &padded, const cv::Size &border) {
+            const int by = border.height;
+            const int rows = padded.rows-2*by;
+            for(int y=1; y<=by; y++) {
+                int r = std::min(y, rows-1);
+                padded.row(by+r).copyTo(padded.row(by-y));
+                padded.row(by+rows-1-r).copyTo(padded.row(by+rows-1+y));
+            }
+        }
+
+        /**
+         * @brief Gets a padded buffer for a pyramid level, recycling the one the level points into if we can
+         * @param level header of the level (inside its border), we will point it into the new buffer
+         * @param size size of the level
+         * @param border size of the border on each side
+         * @param type OpenCV type of the level
+         * @return Header of the whole padded buffer
+         */
+        static cv::Mat create_level(cv::Mat &level, const cv::Size &size, const cv::Size &border, int type) {
+            release_if_shared(level);
+            if(!level.empty())
+                level.adjustROI(border.height, border.height, border.width, border.width);
+            level.create(size.height+2*border.height, size.width+2*border.width, type);
+            cv::Mat padded = level;
+            level = padded(cv::Rect(border.width, border.height, size.width, size.height));
+            return padded;
+        }
+
+        /// Rows of one pyramid level (inside its border) as we build it in equalize_pyramid_rows()
+        struct PyramidRows {
+            uchar *img;
+            size_t img_step;
+            short *deriv;
+            size_t deriv_step;
+            int cols, rows;
+            int rows_img = 0;
+            int rows_deriv = 0;
+        };
+
+        /**
+         * @brief Histogram equalizes an image and builds its optical flow pyramid in one pass
+         * @param frame frame we equalize into (its image needs to already point into a buffer with the border)
+         * @param img raw grayscale image
+         * @param border border around each level, this is also the window size of the pyramid
+         * @param levels max pyramid level
+         *
+         * This gives the same image and pyramid as cv::equalizeHist() and cv::buildOpticalFlowPyramid() (with its derivatives), bit for bit.
+         * But instead of going over the full image once for each step, we go down the image in bands of rows.
+         * While a band is still in cache, we compute the derivatives and the next pyramid level of all the rows it completes.
+         * Only the histogram needs its own pass over the raw image.
+         */
+        static void equalize_pyramid(FrameContext &frame, const cv::Mat &img, const cv::Size &border, int levels) {
+
+            // Our look up table, the same as cv::equalizeHist() computes
+            uchar lut[256];
+            equalize_lut(img, lut);
+
+            // Sizes of our levels, we stop at the same level OpenCV does if the next one gets smaller than the window
+            std::vector<cv::Size> sizes = {img.size()};
+            for(int l=0; l<levels; l++) {
+                cv::Size size((sizes.back().width+1)/2, (sizes.back().height+1)/2);
+                if(size.width <= border.width || size.height <= border.height)
+                    break;
+                sizes.push_back(size);
+            }
+
+            // Get our buffers, the first level is the image we equalize into
+            std::vector<cv::Mat> padded_img(sizes.size()), padded_deriv(sizes.size());
+            std::vector<PyramidRows> rows(sizes.size());
+            frame.pyramid.resize(2*sizes.size());
+            for(size_t l=0; l<sizes.size(); l++) {
+                if(l == 0) {
+                    frame.pyramid.at(0) = frame.image;
+                    padded_img.at(0) = frame.image_border;
+                } else {
+                    padded_img.at(l) = create_level(frame.pyramid.at(2*l), sizes.at(l), border, CV_8UC1);
+                }
+                padded_deriv.at(l) = create_level(frame.pyramid.at(2*l+1), sizes.at(l), border, CV_16SC2);
+                rows.at(l).img = frame.pyramid.at(2*l).data;
+                rows.at(l).img_step = frame.pyramid.at(2*l).step;
+                rows.at(l).deriv = (short*)frame.pyramid.at(2*l+1).data;
+                rows.at(l).deriv_step = frame.pyramid.at(2*l+1).step/sizeof(short);
+                rows.at(l).cols = sizes.at(l).width;
+                rows.at(l).rows = sizes.at(l).height;
+            }
+
+            // Go down the image, and then the borders of each level
+            equalize_pyramid_rows(img.data, img.step, lut, rows, border);
+            for(size_t l=0; l<sizes.size(); l++) {
+                fill_border_rows(padded_img.at(l), border);
+                padded_deriv.at(l).rowRange(0, border.height).setTo(0);
+                padded_deriv.at(l).rowRange(padded_deriv.at(l).rows-border.height, padded_deriv.at(l).rows).setTo(0);
+            }
+            frame.pyr_win_size = border;
+            frame.pyr_levels = levels;
+
+        }
+
+        /**
+         * @brief Computes the look up table of a global histogram equalization (see cv::equalizeHist())
+         * @param img raw grayscale image
+         * @param lut look up table from raw to equalized intensity
+         */
+        static void equalize_lut(const cv::Mat &img, uchar lut[256]) {
+            // Four histograms, so pixels in a row with the same value do not wait on each other
+            int hist[4][256] = {{0}};
+            for(int y=0; y<img.rows; y++) {
+                const uchar *row = img.ptr<uchar>(y);
+                int x = 0;
+                for(; x+4<=img.cols; x+=4) {
+                    hist[0][row[x]]++;
+                    hist[1][row[x+1]]++;
+                    hist[2][row[x+2]]++;
+                    hist[3][row[x+3]]++;
+                }
+                for(; x<img.cols; x++)
+                    hist[0][row[x]]++;
+            }
+            for(int i=0; i<256; i++)
+                hist[0][i] += hist[1][i]+hist[2][i]+hist[3][i];
+            const int total = img.rows*img.cols;
+            int i = 0;
+            while(i < 255 && hist[0][i] == 0)
+                i++;
+            std::fill(lut, lut+256, (uchar)0);
+            if(hist[0][i] == total) {
+                std::fill(lut, lut+256, (uchar)i);
+                return;
+            }
+            const float scale = 255.f/(float)(total-hist[0][i]);
+            int sum = 0;
+            for(i++; i<256; i++) {
+                sum += hist[0][i];
+                lut[i] = cv::saturate_cast<uchar>((float)sum*scale);
+            }
+        }
+
+        /**
+         * @brief Equalizes the raw image into the first level, and computes all derivatives and smaller levels, a band of rows at a time
+         * @param src raw grayscale image
+         * @param src_step row step of the raw image in bytes
+         * @param lut equalization look up table
+         * @param levels rows of each level, the first one is the equalized image
+         * @param border border around each level
+         *
+         * A row of the derivatives needs the rows above and below it, and a row of the next level needs five rows around twice its index.
+         * So after each band we go down the levels, and compute everything the rows we have so far allow.
+         * Rows outside of a level are reflected (cv::BORDER_REFLECT_101), and the border of the derivatives is zero.
+         */
+        static void equalize_pyramid_rows(const uchar *src, size_t src_step, const uchar lut[256], std::vector<PyramidRows> &levels, const cv::Size &border) {
+
+            // Rows we keep in cache at a time
+            const int band = 16;
+
+            // Row buffers, with room to reflect two pixels on each side
+            const int cols = levels.at(0).cols;
+            std::vector<short> buf_t0(cols+4), buf_t1(cols+4);
+            std::vector<int> buf_sum(cols+4);
+
+            PyramidRows &base = levels.at(0);
+            while(base.rows_img < base.rows) {
+
+                // Equalize the next band straight into the first level
+                const int y1 = std::min(base.rows, base.rows_img+band);
+                for(int y=base.rows_img; y<y1; y++) {
+                    const uchar *s = src+y*src_step;
+                    uchar *d = base.img+y*base.img_step;
+                    for(int x=0; x<base.cols; x++)
+                        d[x] = lut[s[x]];
+                    fill_border_row(d, base.cols, border.width);
+                }
+                base.rows_img = y1;
+
+                // Then everything down the pyramid that these rows complete
+                for(size_t l=0; l<levels.size(); l++) {
+                    PyramidRows &level = levels.at(l);
+                    const bool done = (level.rows_img == level.rows);
+                    const int ready = done ? level.rows : level.rows_img-1;
+                    for(; level.rows_deriv<ready; level.rows_deriv++)
+                        scharr_row(level, level.rows_deriv, buf_t0.data()+2, buf_t1.data()+2, border.width);
+                    if(l+1 == levels.size())
+                        break;
+                    PyramidRows &next = levels.at(l+1);
+                    const int ready_next = done ? next.rows : std::max(0, (level.rows_img-1)/2);
+                    for(; next.rows_img<ready_next; next.rows_img++)
+                        pyrdown_row(level, next, next.rows_img, buf_sum.data()+2, border.width);
+                }
+
+            }
+
+        }
+
+        /**
+         * @brief Computes one row of the Scharr derivatives of a level (same as the one cv::buildOpticalFlowPyramid() uses)
+         * @param level level we compute the derivatives of
+         * @param y row we compute
+         * @param t0 buffer for the vertical smoothing of the row (with two pixels on each side)
+         * @param t1 buffer for the vertical difference of the row (with two pixels on each side)
+         * @param bx size of the border on each side
+         */
+        static inline void scharr_row(PyramidRows &level, int y, short *t0, short *t1, int bx) {
+            const int cols = level.cols, rows = level.rows;
+            const uchar *r0 = level.img+(y > 0 ? y-1 : (rows > 1 ? 1 : 0))*level.img_step;
+            const uchar *r1 = level.img+y*level.img_step;
+            const uchar *r2 = level.img+(y < rows-1 ? y+1 : (rows > 1 ? rows-2 : 0))*level.img_step;
+            for(int x=0; x<cols; x++) {
+                t0[x] = (short)((r0[x]+r2[x])*3+r1[x]*10);
+                t1[x] = (short)(r2[x]-r0[x]);
+            }
+            t0[-1] = t0[1];
+            t0[cols] = t0[cols-2];
+            t1[-1] = t1[1];
+            t1[cols] = t1[cols-2];
+            short *d = level.deriv+y*level.deriv_step;
+            for(int x=0; x<cols; x++) {
+                d[2*x] = (short)(t0[x+1]-t0[x-1]);
+                d[2*x+1] = (short)((t1[x+1]+t1[x-1])*3+t1[x]*10);
+            }
+            std::fill(d-2*bx, d, (short)0);
+            std::fill(d+2*cols, d+2*(cols+bx), (short)0);
+        }
+
+        /**
+         * @brief Computes one row of the next pyramid level, with the 5x5 Gaussian of cv::pyrDown()
+         * @param level level we downsample
+         * @param next level we write the row of
+         * @param y row of the next level we compute
+         * @param sum buffer for the vertical sums (with two pixels on each side)
+         * @param bx size of the border on each side
+         */
+        static inline void pyrdown_row(const PyramidRows &level, PyramidRows &next, int y, int *sum, int bx) {
+            const int cols = level.cols, rows = level.rows;
+            auto reflect = [rows](int r) { return r < 0 ? -r : (r >= rows ? 2*(rows-1)-r : r); };
+            const uchar *r0 = level.img+reflect(2*y-2)*level.img_step;
+            const uchar *r1 = level.img+reflect(2*y-1)*level.img_step;
+            const uchar *r2 = level.img+reflect(2*y)*level.img_step;
+            const uchar *r3 = level.img+reflect(2*y+1)*level.img_step;
+            const uchar *r4 = level.img+reflect(2*y+2)*level.img_step;
+            for(int x=0; x<cols; x++)
+                sum[x] = r0[x]+r4[x]+4*(r1[x]+r3[x])+6*r2[x];
+            sum[-2] = sum[2];
+            sum[-1] = sum[1];
+            sum[cols] = sum[cols-2];
+            sum[cols+1] = sum[cols-3];
+            uchar *d = next.img+y*next.img_step;
+            for(int x=0; x<next.cols; x++) {
+                const int *s = sum+2*x;
+                d[x] = (uchar)((s[-2]+s[2]+4*(s[-1]+s[1])+6*s[0]+128) >> 8);
+            }
+            fill_border_row(d, next.cols, bx);
+        }
+
+        /// Gets a frame that no one else holds (or a new one if they are all in use)
+        std::shared_ptr<FrameContext> get_free_frame() {
+            for(auto &frame : frames) {
+                if(frame.use_count() == 1)
+                    return frame;
+            }
+            std::shared_ptr<FrameContext> frame = std::make_shared<FrameContext>();
+            if(frames.size() < max_frames)
+                frames.push_back(frame);
+            return frame;
+        }
+
+        /// Max number of frames we keep around to recycle
+        size_t max_frames;
+
+        /// If we equalize with CLAHE, and its settings
+        bool use_clahe = false;
+        double clahe_clip_limit = 2.0;
+        int clahe_tiles = 8;
+
+        /// Mutex for our frames
+        std::mutex mtx;
+
+        /// All frames we have allocated
+        std::vector<std::shared_ptr<FrameContext>> frames;
+
+        /// Newest frame of each camera
+        std::map<size_t, std::shared_ptr<FrameContext>> last_frames;
+
+    };
+
+
+}
+
+
+#endif /* OV_CORE_FRAME_POOL_H */
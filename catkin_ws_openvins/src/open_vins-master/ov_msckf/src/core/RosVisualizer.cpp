@@ -38,6 +38,8 @@ RosVisualizer::RosVisualizer(ros::NodeHandle &nh, VioManager* app, Simulator *si
     ROS_INFO("Publishing: %s", pub_odomimu.getTopic().c_str());
     pub_pathimu = nh.advertise<nav_msgs::Path>("/ov_msckf/pathimu", 2);
     ROS_INFO("Publishing: %s", pub_pathimu.getTopic().c_str());
+    pub_poseimu_loop = nh.advertise<geometry_msgs::PoseStamped>("/ov_msckf/poseimu_loop", 2);
+    ROS_INFO("Publishing: %s", pub_poseimu_loop.getTopic().c_str());
 
     // 3D points publishing
     pub_points_msckf = nh.advertise<sensor_msgs::PointCloud2>("/ov_msckf/points_msckf", 2);
@@ -49,6 +51,32 @@ RosVisualizer::RosVisualizer(ros::NodeHandle &nh, VioManager* app, Simulator *si
     pub_points_sim = nh.advertise<sensor_msgs::PointCloud2>("/ov_msckf/points_sim", 2);
     ROS_INFO("Publishing: %s", pub_points_sim.getTopic().c_str());
 
+    // Landmarks of the loaded map never change, so publish them once (latched) in the map's frame
+    pub_points_map = nh.advertise<sensor_msgs::PointCloud2>("/ov_msckf/points_map", 2, true);
+    ROS_INFO("Publishing: %s", pub_points_map.getTopic().c_str());
+    const std::vector<Eigen::Vector3d> &feats_map = _app->get_loop_closer()->get_map_landmarks();
+    if(!feats_map.empty()) {
+        sensor_msgs::PointCloud2 cloud_map;
+        cloud_map.header.frame_id = "map";
+        cloud_map.header.stamp = ros::Time::now();
+        cloud_map.width  = feats_map.size();
+        cloud_map.height = 1;
+        cloud_map.is_bigendian = false;
+        cloud_map.is_dense = false;
+        sensor_msgs::PointCloud2Modifier modifier(cloud_map);
+        modifier.setPointCloud2FieldsByString(1,"xyz");
+        modifier.resize(feats_map.size());
+        sensor_msgs::PointCloud2Iterator<float> out_x(cloud_map, "x");
+        sensor_msgs::PointCloud2Iterator<float> out_y(cloud_map, "y");
+        sensor_msgs::PointCloud2Iterator<float> out_z(cloud_map, "z");
+        for(const auto &pt : feats_map) {
+            *out_x = pt(0); ++out_x;
+            *out_y = pt(1); ++out_y;
+            *out_z = pt(2); ++out_z;
+        }
+        pub_points_map.publish(cloud_map);
+    }
+
     // Our tracking image
     pub_tracks = nh.advertise<sensor_msgs::Image>("/ov_msckf/trackhist", 2);
     ROS_INFO("Publishing: %s", pub_tracks.getTopic().c_str());
@@ -255,6 +283,47 @@ void RosVisualizer::publish_state() {
     trans.setOrigin(orig);
     mTfBr->sendTransform(trans);
 
+    // Publish our drift corrected pose, and the drift as the transform from the corrected "loop" frame to our global frame
+    Eigen::Matrix3d R_drift;
+    Eigen::Vector3d p_drift;
+    if(_app->get_pose_graph() != nullptr && _app->get_pose_graph()->get_drift(R_drift, p_drift)) {
+        Eigen::Vector4d q_GtoI_loop = rot_2_quat(state->imu()->Rot()*R_drift.transpose());
+        Eigen::Vector3d p_IinG_loop = R_drift*state->imu()->pos()+p_drift;
+        geometry_msgs::PoseStamped poseIinL;
+        poseIinL.header = poseIinM.header;
+        poseIinL.header.frame_id = "loop";
+        poseIinL.pose.orientation.x = q_GtoI_loop(0);
+        poseIinL.pose.orientation.y = q_GtoI_loop(1);
+        poseIinL.pose.orientation.z = q_GtoI_loop(2);
+        poseIinL.pose.orientation.w = q_GtoI_loop(3);
+        poseIinL.pose.position.x = p_IinG_loop(0);
+        poseIinL.pose.position.y = p_IinG_loop(1);
+        poseIinL.pose.position.z = p_IinG_loop(2);
+        pub_poseimu_loop.publish(poseIinL);
+        tf::StampedTransform trans_loop;
+        trans_loop.stamp_ = trans.stamp_;
+        trans_loop.frame_id_ = "loop";
+        trans_loop.child_frame_id_ = "global";
+        Eigen::Vector4d q_drift = rot_2_quat(R_drift.transpose());
+        trans_loop.setRotation(tf::Quaternion(q_drift(0),q_drift(1),q_drift(2),q_drift(3)));
+        trans_loop.setOrigin(tf::Vector3(p_drift(0),p_drift(1),p_drift(2)));
+        mTfBr->sendTransform(trans_loop);
+    }
+
+    // Once we have relocalized in a loaded map, publish where our global frame is in it
+    Eigen::Matrix3d R_GtoM;
+    Eigen::Vector3d p_GinM;
+    if(_app->get_loop_closer()->get_map_transform(R_GtoM, p_GinM)) {
+        tf::StampedTransform trans_map;
+        trans_map.stamp_ = trans.stamp_;
+        trans_map.frame_id_ = "map";
+        trans_map.child_frame_id_ = "global";
+        Eigen::Vector4d q_map = rot_2_quat(R_GtoM.transpose());
+        trans_map.setRotation(tf::Quaternion(q_map(0),q_map(1),q_map(2),q_map(3)));
+        trans_map.setOrigin(tf::Vector3(p_GinM(0),p_GinM(1),p_GinM(2)));
+        mTfBr->sendTransform(trans_map);
+    }
+
     // Loop through each camera calibration and publish it
     for(const auto &calib : state->get_calib_IMUtoCAMs()) {
         // need to flip the transform to the IMU frame
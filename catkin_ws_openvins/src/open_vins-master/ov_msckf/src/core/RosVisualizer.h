@@ -111,10 +111,12 @@ namespace ov_msckf {
         ros::Publisher pub_poseimu;
         ros::Publisher pub_odomimu;
         ros::Publisher pub_pathimu;
+        ros::Publisher pub_poseimu_loop;
         ros::Publisher pub_points_msckf;
         ros::Publisher pub_points_slam;
         ros::Publisher pub_points_aruco;
         ros::Publisher pub_points_sim;
+        ros::Publisher pub_points_map;
         ros::Publisher pub_tracks;
         tf::TransformBroadcaster *mTfBr;
 
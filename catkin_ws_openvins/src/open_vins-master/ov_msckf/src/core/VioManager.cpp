@@ -19,6 +19,7 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 #include "VioManager.h"
+#include <ros/package.h>
 #include "types/Landmark.h"
 
 
@@ -187,6 +188,32 @@ VioManager::VioManager(ros::NodeHandle &nh) {
 
     }
 
+    // Stereo pairs when we feed more then two cameras at the same time
+    // These are given as a flat list of [left0,right0,left1,right1,...] camera ids
+    // By default we will pair up cameras in order (i.e. cam0-cam1, cam2-cam3) if we are doing stereo tracking
+    std::vector<int> vec_stereo_pairs;
+    std::vector<int> vec_stereo_pairs_default;
+    for(int i=0; use_stereo && i+1<state->options().num_cameras; i+=2) {
+        vec_stereo_pairs_default.push_back(i);
+        vec_stereo_pairs_default.push_back(i+1);
+    }
+    nh.param<std::vector<int>>("stereo_pairs", vec_stereo_pairs, vec_stereo_pairs_default);
+    if(vec_stereo_pairs.size()%2 != 0) {
+        ROS_ERROR("VioManager(): stereo_pairs needs to be a list of left and right camera ids");
+        std::exit(EXIT_FAILURE);
+    }
+    for(size_t i=0; i<vec_stereo_pairs.size(); i+=2) {
+        if(vec_stereo_pairs.at(i) < 0 || vec_stereo_pairs.at(i) >= state->options().num_cameras
+           || vec_stereo_pairs.at(i+1) < 0 || vec_stereo_pairs.at(i+1) >= state->options().num_cameras
+           || vec_stereo_pairs.at(i) == vec_stereo_pairs.at(i+1)) {
+            ROS_ERROR("VioManager(): invalid stereo pair cam%d - cam%d", vec_stereo_pairs.at(i), vec_stereo_pairs.at(i+1));
+            std::exit(EXIT_FAILURE);
+        }
+        if(!use_stereo) continue;
+        camera_stereo_pairs.insert({(size_t)vec_stereo_pairs.at(i),(size_t)vec_stereo_pairs.at(i+1)});
+        ROS_INFO("stereo pair: cam%d - cam%d", vec_stereo_pairs.at(i), vec_stereo_pairs.at(i+1));
+    }
+
     // Debug message
     ROS_INFO("=====================================");
 
@@ -232,7 +259,69 @@ VioManager::VioManager(ros::NodeHandle &nh) {
     nh.param<int>("grid_y", grid_y, 8);
     nh.param<int>("min_px_dist", min_px_dist, 10);
     nh.param<double>("knn_ratio", knn_ratio, 0.85);
+    bool use_grid_matching;
+    double match_radius;
+    nh.param<bool>("use_grid_matching", use_grid_matching, false);
+    nh.param<double>("match_radius", match_radius, 40.0);
+    bool use_stereo_reuse;
+    double stereo_band;
+    nh.param<bool>("use_stereo_reuse", use_stereo_reuse, false);
+    nh.param<double>("stereo_band", stereo_band, 2.0);
     nh.param<bool>("downsize_aruco", do_downsizing, true);
+    bool use_aruco_tracking;
+    int aruco_detect_rate;
+    nh.param<bool>("use_aruco_tracking", use_aruco_tracking, false);
+    nh.param<int>("aruco_detect_rate", aruco_detect_rate, 10);
+    bool use_adaptive_fast;
+    nh.param<bool>("use_adaptive_fast", use_adaptive_fast, false);
+    bool use_lookahead_detection;
+    double min_tracked_ratio;
+    nh.param<bool>("use_lookahead_detection", use_lookahead_detection, false);
+    nh.param<double>("min_tracked_ratio", min_tracked_ratio, 1.0);
+    int track_level;
+    std::vector<int> track_roi;
+    std::vector<int> track_roi_default = {};
+    nh.param<int>("klt_track_level", track_level, 0);
+    nh.param<std::vector<int>>("klt_track_roi", track_roi, track_roi_default);
+    cv::Rect track_roi_rect;
+    if(track_roi.size() == 4) {
+        track_roi_rect = cv::Rect(track_roi.at(0), track_roi.at(1), track_roi.at(2), track_roi.at(3));
+    } else if(!track_roi.empty()) {
+        ROS_ERROR("VioManager(): klt_track_roi should be [x,y,width,height], we will use the whole image");
+    }
+    int pyr_levels_predicted, max_iters_predicted;
+    std::string ransac_mode_str;
+    bool ransac_compare;
+    nh.param<bool>("use_gyro_prediction", use_gyro_prediction, false);
+    nh.param<int>("klt_pyr_levels_predicted", pyr_levels_predicted, 1);
+    nh.param<int>("klt_max_iters_predicted", max_iters_predicted, 10);
+    bool use_adaptive_klt;
+    nh.param<bool>("use_adaptive_klt", use_adaptive_klt, false);
+    nh.param<std::string>("ransac_mode", ransac_mode_str, "FUNDAMENTAL_8PT");
+    nh.param<bool>("ransac_compare", ransac_compare, false);
+    bool use_undistort_lut;
+    int undistort_lut_cell;
+    nh.param<bool>("use_undistort_lut", use_undistort_lut, false);
+    nh.param<int>("undistort_lut_cell", undistort_lut_cell, 4);
+    bool use_clahe;
+    double clahe_clip_limit;
+    int clahe_tiles;
+    nh.param<bool>("use_clahe", use_clahe, false);
+    nh.param<double>("clahe_clip_limit", clahe_clip_limit, 2.0);
+    nh.param<int>("clahe_tiles", clahe_tiles, 8);
+    int klt_stats_period;
+    nh.param<int>("klt_stats_period", klt_stats_period, 0);
+    std::transform(ransac_mode_str.begin(), ransac_mode_str.end(),ransac_mode_str.begin(), ::toupper);
+    TrackBase::RansacMode ransac_mode;
+    if(ransac_mode_str == "FUNDAMENTAL_8PT") ransac_mode = TrackBase::RansacMode::FUNDAMENTAL_8PT;
+    else if(ransac_mode_str == "GYRO_2PT") ransac_mode = TrackBase::RansacMode::GYRO_2PT;
+    else {
+        ROS_ERROR("VioManager(): invalid ransac mode specified = %s", ransac_mode_str.c_str());
+        ROS_ERROR("VioManager(): the valid types are:");
+        ROS_ERROR("\t- FUNDAMENTAL_8PT");
+        ROS_ERROR("\t- GYRO_2PT");
+        std::exit(EXIT_FAILURE);
+    }
 
     // Debug, print to the console!
     ROS_INFO("TRACKING PARAMETERS:");
@@ -243,7 +332,30 @@ VioManager::VioManager(ros::NodeHandle &nh) {
     ROS_INFO("\t- grid size: %d x %d", grid_x, grid_y);
     ROS_INFO("\t- fast threshold: %d", fast_threshold);
     ROS_INFO("\t- min pixel distance: %d", min_px_dist);
+    ROS_INFO("\t- grid matching: %d", use_grid_matching);
+    ROS_INFO("\t- match radius: %.1f", match_radius);
+    ROS_INFO("\t- stereo reuse: %d", use_stereo_reuse);
+    ROS_INFO("\t- stereo epipolar band: %.1f", stereo_band);
+    ROS_INFO("\t- adaptive fast threshold: %d", use_adaptive_fast);
+    ROS_INFO("\t- look-ahead detection: %d", use_lookahead_detection);
+    ROS_INFO("\t- min tracked ratio: %.2f", min_tracked_ratio);
+    ROS_INFO("\t- klt track level: %d", track_level);
+    ROS_INFO("\t- klt track roi: %d,%d %dx%d", track_roi_rect.x, track_roi_rect.y, track_roi_rect.width, track_roi_rect.height);
     ROS_INFO("\t- downsize aruco image: %d", do_downsizing);
+    ROS_INFO("\t- track aruco corners: %d", use_aruco_tracking);
+    ROS_INFO("\t- aruco detection rate: %d", aruco_detect_rate);
+    ROS_INFO("\t- use gyro prediction: %d", use_gyro_prediction);
+    ROS_INFO("\t- klt predicted pyramid levels: %d", pyr_levels_predicted);
+    ROS_INFO("\t- klt predicted max iterations: %d", max_iters_predicted);
+    ROS_INFO("\t- klt adaptive to motion: %d", use_adaptive_klt);
+    ROS_INFO("\t- ransac mode: %s", ransac_mode_str.c_str());
+    ROS_INFO("\t- ransac compare: %d", ransac_compare);
+    ROS_INFO("\t- use undistort lut: %d", use_undistort_lut);
+    ROS_INFO("\t- undistort lut cell size: %d", undistort_lut_cell);
+    ROS_INFO("\t- use clahe: %d", use_clahe);
+    ROS_INFO("\t- clahe clip limit: %.2f", clahe_clip_limit);
+    ROS_INFO("\t- clahe tiles: %d", clahe_tiles);
+    ROS_INFO("\t- klt stats period: %d", klt_stats_period);
 
 
     //===================================================================================
@@ -309,17 +421,53 @@ VioManager::VioManager(ros::NodeHandle &nh) {
 
     // Lets make a feature extractor                          // 9. 创建一个KLT特征提取器
     if(use_klt) {
-        trackFEATS = new TrackKLT(num_pts,state->options().max_aruco_features,fast_threshold,grid_x,grid_y,min_px_dist);
+        TrackKLT *trackKLT = new TrackKLT(num_pts,state->options().max_aruco_features,fast_threshold,grid_x,grid_y,min_px_dist);
+        trackKLT->set_prediction_params(pyr_levels_predicted, max_iters_predicted);
+        trackKLT->set_adaptive_klt(use_adaptive_klt);
+        trackKLT->set_adaptive_fast(use_adaptive_fast);
+        trackKLT->set_detection_params(use_lookahead_detection, min_tracked_ratio);
+        trackKLT->set_track_region(track_level, track_roi_rect);
+        trackKLT->set_stats_period(klt_stats_period);
+        trackFEATS = trackKLT;
         trackFEATS->set_calibration(camera_calib, camera_fisheye);
     } else {
-        trackFEATS = new TrackDescriptor(num_pts,state->options().max_aruco_features,fast_threshold,grid_x,grid_y,knn_ratio);
+        TrackDescriptor *trackDESC = new TrackDescriptor(num_pts,state->options().max_aruco_features,fast_threshold,grid_x,grid_y,knn_ratio);
+        trackDESC->set_grid_matching(use_grid_matching, match_radius);
+        trackDESC->set_stereo_reuse(use_stereo_reuse, stereo_band);
+        trackFEATS = trackDESC;
         trackFEATS->set_calibration(camera_calib, camera_fisheye);
     }
+    trackFEATS->set_stereo_pairs(camera_stereo_pairs);
+    trackFEATS->set_ransac_mode(ransac_mode, ransac_compare);
+    if(use_undistort_lut) {
+        trackFEATS->set_undistort_lut(camera_wh, undistort_lut_cell);
+    }
+
+    // All our trackers share the same preprocessed frames, so each image is only equalized once
+    std::shared_ptr<FramePool> frame_pool = std::make_shared<FramePool>();
+    frame_pool->set_equalization(use_clahe, clahe_clip_limit, clahe_tiles);
+    trackFEATS->set_frame_pool(frame_pool);
+
+    // Our camera extrinsics, used to check stereo matches
+    std::map<size_t, Eigen::Matrix3d> camera_R_ItoC;
+    std::map<size_t, Eigen::Vector3d> camera_p_IinC;
+    for(int i=0; i<state->options().num_cameras; i++) {
+        camera_R_ItoC.insert({i,state->get_calib_IMUtoCAM(i)->Rot()});
+        camera_p_IinC.insert({i,state->get_calib_IMUtoCAM(i)->pos()});
+    }
+    trackFEATS->set_extrinsics(camera_R_ItoC, camera_p_IinC);
 
     // Initialize our aruco tag extractor
     if(use_aruco) {
-        trackARUCO = new TrackAruco(state->options().max_aruco_features,do_downsizing);
+        TrackAruco *trackTAGS = new TrackAruco(state->options().max_aruco_features,do_downsizing);
+        trackTAGS->set_tag_tracking(use_aruco_tracking, aruco_detect_rate);
+        trackARUCO = trackTAGS;
         trackARUCO->set_calibration(camera_calib, camera_fisheye);
+        trackARUCO->set_stereo_pairs(camera_stereo_pairs);
+        if(use_undistort_lut) {
+            trackARUCO->set_undistort_lut(camera_wh, undistort_lut_cell);
+        }
+        trackARUCO->set_frame_pool(frame_pool);
     }
 
     // Initialize our state propagator                       // 10. 创建状态传播器
@@ -339,12 +487,109 @@ VioManager::VioManager(ros::NodeHandle &nh) {
     std::string vocabulary_file;
     nh.param<std::string>("vocabulary_file", vocabulary_file,
             "/home/SENSETIME/yuanjin/Workspace/catkin_ws_openvins/src/open_vins-master/ov_core/src/ThirdParty/brief_k10L6.bin");
-    loopCloser->load_vocabulary(vocabulary_file);
+    std::string vocabulary_map_file;
+    nh.param<std::string>("vocabulary_map_file", vocabulary_map_file, "");
+    loopCloser->load_vocabulary(vocabulary_file, vocabulary_map_file);
+    std::string brief_pattern_file;
+    nh.param<std::string>("brief_pattern_file", brief_pattern_file,
+            ros::package::getPath("ov_core") + "/src/ThirdParty/brief_pattern.yml");
+    loopCloser->load_brief_pattern(brief_pattern_file);
+
+    // Run the loop closure in the background so it does not slow down the estimator
+    bool use_loop_thread;
+    int loop_queue_size;
+    nh.param<bool>("use_loop_thread", use_loop_thread, false);
+    nh.param<int>("loop_queue_size", loop_queue_size, 2);
+    ROS_INFO("\t- use_loop_thread: %d", use_loop_thread);
+    ROS_INFO("\t- loop_queue_size: %d", loop_queue_size);
+
+    // Memory our loop closure keyframes can use
+    double keyframe_image_scale, keyframe_voxel_size;
+    int keyframe_jpeg_quality, keyframe_memory_mb;
+    nh.param<double>("keyframe_image_scale", keyframe_image_scale, 1.0);
+    nh.param<int>("keyframe_jpeg_quality", keyframe_jpeg_quality, -1);
+    nh.param<int>("keyframe_memory_mb", keyframe_memory_mb, 0);
+    nh.param<double>("keyframe_voxel_size", keyframe_voxel_size, 1.0);
+    ROS_INFO("\t- keyframe_image_scale: %.2f", keyframe_image_scale);
+    ROS_INFO("\t- keyframe_jpeg_quality: %d", keyframe_jpeg_quality);
+    ROS_INFO("\t- keyframe_memory_mb: %d", keyframe_memory_mb);
+    ROS_INFO("\t- keyframe_voxel_size: %.2f", keyframe_voxel_size);
+    loopCloser->set_keyframe_options(keyframe_image_scale, keyframe_jpeg_quality,
+                                     (size_t)std::max(0, keyframe_memory_mb)*1024*1024, keyframe_voxel_size);
+    bool use_keyframe_policy;
+    double keyframe_min_overlap, keyframe_min_parallax, keyframe_max_rotation;
+    int keyframe_min_frames;
+    nh.param<bool>("use_keyframe_policy", use_keyframe_policy, false);
+    nh.param<double>("keyframe_min_overlap", keyframe_min_overlap, 0.6);
+    nh.param<double>("keyframe_min_parallax", keyframe_min_parallax, 20);
+    nh.param<double>("keyframe_max_rotation", keyframe_max_rotation, 15);
+    nh.param<int>("keyframe_min_frames", keyframe_min_frames, 2);
+    ROS_INFO("\t- use_keyframe_policy: %d", use_keyframe_policy);
+    ROS_INFO("\t- keyframe_min_overlap: %.2f", keyframe_min_overlap);
+    ROS_INFO("\t- keyframe_min_parallax: %.2f", keyframe_min_parallax);
+    ROS_INFO("\t- keyframe_max_rotation: %.2f", keyframe_max_rotation);
+    ROS_INFO("\t- keyframe_min_frames: %d", keyframe_min_frames);
+    if(use_keyframe_policy) {
+        loopCloser->set_keyframe_policy(keyframe_min_overlap, keyframe_min_parallax, keyframe_max_rotation, keyframe_min_frames);
+    }
+    int loop_min_frames;
+    nh.param<int>("loop_min_frames", loop_min_frames, 50);
+    ROS_INFO("\t- loop_min_frames: %d", loop_min_frames);
+    loopCloser->set_loop_min_frames(loop_min_frames);
+    double loop_search_radius;
+    nh.param<double>("loop_search_radius", loop_search_radius, -1);
+    ROS_INFO("\t- loop_search_radius: %.2f", loop_search_radius);
+    loopCloser->set_search_radius(loop_search_radius);
+    int loop_query_threads;
+    nh.param<int>("loop_query_threads", loop_query_threads, 1);
+    ROS_INFO("\t- loop_query_threads: %d", loop_query_threads);
+    loopCloser->set_query_threads(loop_query_threads);
+
+    // Correct our drift with the loops in a background pose graph
+    bool use_pose_graph;
+    int pose_graph_iterations;
+    double pose_graph_yaw_weight;
+    nh.param<bool>("use_pose_graph", use_pose_graph, false);
+    nh.param<int>("pose_graph_iterations", pose_graph_iterations, 10);
+    nh.param<double>("pose_graph_yaw_weight", pose_graph_yaw_weight, 10.0);
+    ROS_INFO("\t- use_pose_graph: %d", use_pose_graph);
+    ROS_INFO("\t- pose_graph_iterations: %d", pose_graph_iterations);
+    ROS_INFO("\t- pose_graph_yaw_weight: %.2f", pose_graph_yaw_weight);
+    if(use_pose_graph) {
+        poseGraph = new PoseGraph();
+        poseGraph->set_options(pose_graph_iterations, pose_graph_yaw_weight);
+        poseGraph->start();
+        loopCloser->set_pose_graph(poseGraph);
+    }
+
+    // Load a map from a previous run to relocalize in, and where to save ours
+    std::string map_load_file;
+    nh.param<std::string>("map_load_file", map_load_file, "");
+    nh.param<std::string>("map_save_file", map_save_file, "");
+    ROS_INFO("\t- map_load_file: %s", map_load_file.c_str());
+    ROS_INFO("\t- map_save_file: %s", map_save_file.c_str());
+    if(!map_load_file.empty()) {
+        loopCloser->load_map(map_load_file);
+    }
+    loopCloser->set_keep_landmarks(!map_save_file.empty());
+    feed_loop_landmarks = (poseGraph != nullptr || !map_save_file.empty());
+    if(use_loop_thread) {
+        loopCloser->start((size_t)std::max(1, loop_queue_size));
+    }
 
 }
 
 
 
+void VioManager::save_map() {
+    if(map_save_file.empty())
+        return;
+    loopCloser->stop();
+    loopCloser->save_map(map_save_file);
+}
+
+
+
 // 接收到imu数据的回调函数，当接收到imu数据，直接传入propagator计算，如果没有完成初始化，还需要给初始化器传递数据，这里初始化器只用来存储数据，具体的初始化器在imageCallback实现
 void VioManager::feed_measurement_imu(double timestamp, Eigen::Vector3d wm, Eigen::Vector3d am) {
 
@@ -367,6 +612,9 @@ void VioManager::feed_measurement_monocular(double timestamp, cv::Mat& img0, siz
     // Start timing
     rT1 =  boost::posix_time::microsec_clock::local_time();
 
+    // Predict how the camera has rotated since its last image
+    feed_rotation_prior(timestamp, {cam_id});
+
     // Feed our trackers
     trackFEATS->feed_monocular(timestamp, img0, cam_id);               // 对图像进行track
 
@@ -383,7 +631,9 @@ void VioManager::feed_measurement_monocular(double timestamp, cv::Mat& img0, siz
         if(!is_initialized_vio) return;                               // 如果没有完成初始化，Image处理函数不继续执行，也就是不执行Image propagation 和 update
     }
 
-    loopCloser->feed_monocular(timestamp, img0, cam_id, trackFEATS);      // 进入回环检测
+    // 回环检测
+    feed_loop_closer(timestamp, cam_id);
+
     // Call on our propagate and update function
     do_feature_propagate_update(timestamp);                           // 当前Image的时间戳   先预积分IMU状态，然后根据跟踪丢失的特征点用于更新VIO系统
 
@@ -399,6 +649,9 @@ void VioManager::feed_measurement_stereo(double timestamp, cv::Mat& img0, cv::Ma
     // Assert we have good ids
     assert(cam_id0!=cam_id1);
 
+    // Predict how the cameras have rotated since their last image
+    feed_rotation_prior(timestamp, {cam_id0, cam_id1});
+
     // Feed our stereo trackers, if we are not doing binocular
     if(use_stereo) {
         trackFEATS->feed_stereo(timestamp, img0, img1, cam_id0, cam_id1);
@@ -430,6 +683,67 @@ void VioManager::feed_measurement_stereo(double timestamp, cv::Mat& img0, cv::Ma
 }
 
 
+void VioManager::feed_measurement_multicam(double timestamp, std::vector<cv::Mat>& imgs, std::vector<size_t>& cam_ids) {
+
+    // Start timing
+    rT1 =  boost::posix_time::microsec_clock::local_time();
+
+    // Assert we have an image for each camera
+    assert(imgs.size()==cam_ids.size());
+
+    // Predict how the cameras have rotated since their last image
+    feed_rotation_prior(timestamp, cam_ids);
+
+    // Feed our trackers, this will track all cameras in parallel
+    // NOTE: if we are doing binocular then we will not have any stereo pairs
+    trackFEATS->feed_multicam(timestamp, imgs, cam_ids);
+
+    // If aruoc is avalible, the also pass to it
+    if(trackARUCO != nullptr) {
+        trackARUCO->feed_multicam(timestamp, imgs, cam_ids);
+    }
+    rT2 =  boost::posix_time::microsec_clock::local_time();
+
+    // If we do not have VIO initialization, then try to initialize
+    // TODO: Or if we are trying to reset the system, then do that here!
+    if(!is_initialized_vio) {
+        is_initialized_vio = try_to_initialize();
+        if(!is_initialized_vio) return;
+    }
+
+    // Loop closure on our first camera only, the keyframe policy compares each frame to the last keyframe
+    // So feeding all cameras would interleave their views, and queue frames faster than the worker processes them
+    feed_loop_closer(timestamp, cam_ids.at(0));
+
+    // Call on our propagate and update function
+    // We only do this once for the whole synchronized set of images
+    do_feature_propagate_update(timestamp);
+
+}
+
+
+
+void VioManager::feed_loop_closer(double timestamp, size_t cam_id) {
+
+    // 回环检测直接使用tracker已经处理好的图像和角点 (shared, not copied)
+    std::shared_ptr<FrameContext> frame = trackFEATS->get_last_frame(cam_id);
+    if(frame != nullptr) {
+        // 这一帧的位姿还没有估计，用上一次更新后的位姿 (只用于预测匹配的位置和淘汰空间上冗余的关键帧)
+        Eigen::Matrix3d R_GtoC = state->get_calib_IMUtoCAM(cam_id)->Rot()*state->imu()->Rot();
+        loopCloser->feed_monocular(timestamp, frame, cam_id, trackFEATS, R_GtoC, state->imu()->pos(),
+                                   state->get_calib_IMUtoCAM(cam_id)->Rot(), state->get_calib_IMUtoCAM(cam_id)->pos());      // 进入回环检测
+    }
+
+    // Get any loops the loop closer has found since our last image
+    std::vector<LoopResult> loop_results;
+    loopCloser->get_loop_results(loop_results);
+    for(const LoopResult &loop : loop_results) {
+        ROS_INFO("[LOOP]: frame %d matched old frame %d with %d points (%d pnp inliers)",(int)loop.frame_id,(int)loop.old_frame_id,
+                 (int)loop.matched_2d_cur.size(),loop.num_inliers);
+    }
+
+}
+
 
 void VioManager::feed_measurement_simulation(double timestamp, const std::vector<int> &camids, const std::vector<std::vector<std::pair<size_t,Eigen::VectorXf>>> &feats) {
 
@@ -464,6 +778,26 @@ void VioManager::feed_measurement_simulation(double timestamp, const std::vector
     do_feature_propagate_update(timestamp);
 }
 
+void VioManager::feed_rotation_prior(double timestamp, const std::vector<size_t> &cam_ids) {
+
+    // Loop through each camera, and integrate from its last image time
+    for(const size_t &cam_id : cam_ids) {
+        trackFEATS->clear_rotation_prior(cam_id);
+        if(use_gyro_prediction && camera_last_timestamp.find(cam_id)!=camera_last_timestamp.end()) {
+            Eigen::Matrix3d R_I0toI1;
+            if(propagator->integrate_gyro(state, camera_last_timestamp.at(cam_id), timestamp, R_I0toI1)) {
+                // Transform into the camera frame (R_C0toC1 = R_ItoC * R_I0toI1 * R_ItoC^T)
+                Eigen::Matrix3d R_ItoC = state->get_calib_IMUtoCAM(cam_id)->Rot();
+                trackFEATS->set_rotation_prior(cam_id, R_ItoC*R_I0toI1*R_ItoC.transpose());
+            }
+        }
+        camera_last_timestamp[cam_id] = timestamp;
+    }
+
+}
+
+
+
 // 静止初始化
 bool VioManager::try_to_initialize() {
 
@@ -710,6 +1044,29 @@ void VioManager::do_feature_propagate_update(double timestamp) {
         feat->to_delete = true;
     }
 
+    // Give the pose graph and the loop closer our updated clones, and the loop closer the landmarks of its keyframes (all just copy them)
+    for(const auto &clone : state->get_clones()) {
+        if(poseGraph != nullptr)
+            poseGraph->feed_vio_pose(clone.first, clone.second->Rot(), clone.second->pos());
+        loopCloser->feed_vio_pose(clone.first, clone.second->Rot(), clone.second->pos());
+    }
+    if(feed_loop_landmarks) {
+        std::vector<size_t> landmark_ids;
+        std::vector<Eigen::Vector3d> landmark_positions;
+        for(Feature* feat : featsup_MSCKF) {
+            landmark_ids.push_back(feat->featid);
+            landmark_positions.push_back(feat->p_FinG);
+        }
+        std::vector<Eigen::Vector3d> slam_feats = get_features_SLAM();
+        size_t ct = 0;
+        for(const auto &f : state->features_SLAM()) {
+            if((int)f.first <= state->options().max_aruco_features) continue;
+            landmark_ids.push_back(f.first);
+            landmark_positions.push_back(slam_feats.at(ct++));
+        }
+        loopCloser->feed_landmarks(landmark_ids, landmark_positions);
+    }
+
     // Remove features that where used for the update from our extractors at the last timestep
     // This allows for measurements to be used in the future if they failed to be used this time
     // Note we need to do this before we feed a new image, as we want all new measurements to NOT be deleted
@@ -751,6 +1108,17 @@ void VioManager::do_feature_propagate_update(double timestamp) {
             trackARUCO->set_calibration(cameranew_calib, cameranew_fisheye, true);
         }
     }
+
+    // If we are optimizing our extrinsics, update our tracker's stereo epipolar check
+    if(state->options().do_calib_camera_pose) {
+        std::map<size_t, Eigen::Matrix3d> cameranew_R_ItoC;
+        std::map<size_t, Eigen::Vector3d> cameranew_p_IinC;
+        for(int i=0; i<state->options().num_cameras; i++) {
+            cameranew_R_ItoC.insert({i,state->get_calib_IMUtoCAM(i)->Rot()});
+            cameranew_p_IinC.insert({i,state->get_calib_IMUtoCAM(i)->pos()});
+        }
+        trackFEATS->set_extrinsics(cameranew_R_ItoC, cameranew_p_IinC);
+    }
     rT6 =  boost::posix_time::microsec_clock::local_time();
 
 
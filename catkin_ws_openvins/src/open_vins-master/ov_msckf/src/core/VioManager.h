@@ -92,6 +92,17 @@ namespace ov_msckf {
          */
         void feed_measurement_stereo(double timestamp, cv::Mat& img0, cv::Mat& img1, size_t cam_id0, size_t cam_id1);
 
+        /**
+         * @brief Feed function for a synchronized set of any number of cameras
+         * @param timestamp Time that these images were collected
+         * @param imgs Grayscale images
+         * @param cam_ids Unique id of what camera each image is from
+         *
+         * All cameras are tracked in parallel (stereo pairs are specified by the `stereo_pairs` parameter),
+         * and we only propagate and update once for the whole set of images.
+         */
+        void feed_measurement_multicam(double timestamp, std::vector<cv::Mat>& imgs, std::vector<size_t>& cam_ids);
+
         /**
          * @brief Feed function for a synchronized simulated cameras
          * @param timestamp Time that this image was collected
@@ -137,6 +148,23 @@ namespace ov_msckf {
             return trackFEATS;
         }
 
+        /// Get the loop closer
+        LoopCloser* get_loop_closer() {
+            return loopCloser;
+        }
+
+        /**
+         * @brief Saves the loop closure keyframes and landmarks to our map file (if we have one)
+         *
+         * This stops the loop closure thread, so it should only be called once we are done.
+         */
+        void save_map();
+
+        /// Get the loop closure pose graph (nullptr if we do not use it)
+        PoseGraph* get_pose_graph() {
+            return poseGraph;
+        }
+
         /// Get aruco feature tracker
         TrackBase* get_track_aruco() {
             return trackARUCO;
@@ -209,6 +237,27 @@ namespace ov_msckf {
         bool try_to_initialize();
 
 
+        /**
+         * @brief Passes the gyro integrated rotation since the last image of each camera to our feature tracker
+         * @param timestamp Time of the new images
+         * @param cam_ids Cameras we have new images for
+         *
+         * The tracker can use this to predict where the features will be in the new image.
+         * If we do not have the inertial readings for this interval then we do not pass anything.
+         */
+        void feed_rotation_prior(double timestamp, const std::vector<size_t> &cam_ids);
+
+        /**
+         * @brief Passes the last frame of a camera to our loop closer, and prints the loops it has found since our last image
+         * @param timestamp Time of the new image
+         * @param cam_id Camera we have the new image of
+         *
+         * The pose of this frame has not been estimated yet, so we use the one from our last update.
+         * This is only used to predict where matches should be, and to evict spatially redundant keyframes.
+         */
+        void feed_loop_closer(double timestamp, size_t cam_id);
+
+
         /**
          * @brief This will do the propagation and feature updates to the state
          * @param timestamp The most recent timestamp we have tracked to
@@ -248,6 +297,15 @@ namespace ov_msckf {
 
         LoopCloser* loopCloser;
 
+        /// Pose graph that corrects our drift with the loops we find
+        PoseGraph* poseGraph = nullptr;
+
+        /// File we save our map to when done (empty to not save it)
+        std::string map_save_file;
+
+        /// If we should give the loop closer our landmarks (for the pose graph and saved maps)
+        bool feed_loop_landmarks = false;
+
         // Timing variables
         boost::posix_time::ptime rT1, rT2, rT3, rT4, rT5, rT6;
 
@@ -264,6 +322,13 @@ namespace ov_msckf {
         std::map<size_t,Eigen::VectorXd> camera_calib;
         std::map<size_t,std::pair<int,int>> camera_wh;
 
+        // Stereo pairs (left => right camera id) we track when feeding many cameras at once
+        std::map<size_t,size_t> camera_stereo_pairs;
+
+        // If we should predict feature locations using the gyro, and the last image time of each camera
+        bool use_gyro_prediction = false;
+        std::map<size_t,double> camera_last_timestamp;
+
     };
 
 
@@ -4,38 +4,320 @@
 
 #include "LoopCloser.h"
 #include <iostream>
+#include <fstream>
 #include <opencv2/core/core.hpp>
 
 using namespace ov_msckf;
 
-void LoopCloser::load_vocabulary(std::string voc_path) {
-    voc = new BriefVocabulary(voc_path);
+void LoopCloser::load_vocabulary(std::string voc_path, std::string map_path) {
+    boost::posix_time::ptime rT1 = boost::posix_time::microsec_clock::local_time();
+
+    // Map the flat vocabulary, converting it from the binary one if this is the first time
+    if (map_path.empty())
+        map_path = voc_path + ".map";
+    voc = new BriefVocabulary();
+    bool mapped = voc->loadMapped(voc_path) || voc->loadMapped(map_path);
+    if (!mapped && VINSLoop::MappedVocabulary::convert(voc_path, map_path))
+        mapped = voc->loadMapped(map_path);
+    if (!mapped)
+        voc->loadBin(voc_path);
+
+    // The database makes its own copy (which just shares the mapping)
     db.setVocabulary(*voc, false, 0);
-    std::cout << "------------------load_vocabulary successful------------------" << std::endl;
+    boost::posix_time::ptime rT2 = boost::posix_time::microsec_clock::local_time();
+    std::cout << "------------------load_vocabulary successful (" << (mapped ? "mapped" : "binary") << ", "
+              << voc->size() << " words, " << (rT2-rT1).total_microseconds()*1e-3 << " ms)------------------" << std::endl;
+
+}
+
+void LoopCloser::load_brief_pattern(const std::string &pattern_path) {
+    extractor = std::make_shared<BriefExtractor>(pattern_path);
+    std::cout << "------------------load_brief_pattern successful------------------" << std::endl;
+}
+
+void LoopCloser::start(size_t max_queue) {
+    std::unique_lock<std::mutex> lck(mtx_queue);
+    if (is_running)
+        return;
+    this->max_queue = std::max((size_t) 1, max_queue);
+    is_running = true;
+    thread_worker = boost::thread(&LoopCloser::worker, this);
+}
+
+void LoopCloser::stop() {
+    {
+        std::unique_lock<std::mutex> lck(mtx_queue);
+        if (!is_running)
+            return;
+        is_running = false;
+        queue.clear();
+    }
+    cv_queue.notify_all();
+    thread_worker.join();
+}
+
+void LoopCloser::feed_monocular(double timestamp, std::shared_ptr<FrameContext> frame, size_t cam_id, TrackBase *trackBase,
+                                const Eigen::Matrix3d &R_GtoC, const Eigen::Vector3d &p_IinG,
+                                const Eigen::Matrix3d &R_ItoC, const Eigen::Vector3d &p_IinC) {
+    LoopCandidate candidate = {timestamp, frame, cam_id, trackBase, R_GtoC, p_IinG, R_ItoC, p_IinC, frame_id++};
+    if (use_keyframe_policy || keep_landmarks)
+        trackBase->get_last_tracks(cam_id, candidate.track_pts, candidate.track_ids);
+    {
+        // Queue it for the worker, dropping the oldest frame if it has fallen behind
+        std::unique_lock<std::mutex> lck(mtx_queue);
+        if (is_running) {
+            queue.push_back(candidate);
+            while (queue.size() > max_queue) {
+                queue.pop_front();
+                num_dropped++;
+            }
+            lck.unlock();
+            cv_queue.notify_one();
+            return;
+        }
+    }
+    // Else we do not have a worker, so process it right away
+    process_frame(candidate);
+}
+
+void LoopCloser::feed_landmarks(const std::vector<size_t> &ids, const std::vector<Eigen::Vector3d> &positions) {
+    assert(ids.size() == positions.size());
+    std::unique_lock<std::mutex> lck(mtx_landmarks);
+    for (size_t i = 0; i < ids.size(); i++)
+        new_landmarks.emplace_back(ids.at(i), positions.at(i));
+    // If the worker has fallen behind, drop the oldest ones
+    while (new_landmarks.size() > max_landmarks)
+        new_landmarks.pop_front();
+}
+
+void LoopCloser::feed_vio_pose(double timestamp, const Eigen::Matrix3d &R_GtoI, const Eigen::Vector3d &p_IinG) {
+    std::unique_lock<std::mutex> lck(mtx_poses);
+    recent_poses[timestamp] = std::make_pair(R_GtoI, p_IinG);
+    while (recent_poses.size() > max_recent_poses)
+        recent_poses.erase(recent_poses.begin());
+}
+
+void LoopCloser::resolve_map_loops() {
+    std::vector<std::pair<LoopResult, std::pair<Eigen::Matrix3d, Eigen::Vector3d>>> ready;
+    {
+        std::unique_lock<std::mutex> lck(mtx_poses);
+        for (auto it = map_loops_pending.begin(); it != map_loops_pending.end();) {
+            auto pose = recent_poses.find(it->timestamp);
+            if (pose != recent_poses.end()) {
+                ready.emplace_back(*it, pose->second);
+                it = map_loops_pending.erase(it);
+            } else if (!recent_poses.empty() && it->timestamp < recent_poses.begin()->first) {
+                // 这一帧的clone已经被边缘化了，拿不到更新后的位姿
+                it = map_loops_pending.erase(it);
+            } else {
+                it++;
+            }
+        }
+    }
+    for (const auto &loop : ready)
+        set_map_transform(loop.first, loop.second.first, loop.second.second);
+}
+
+void LoopCloser::update_landmarks() {
+    std::deque<std::pair<size_t, Eigen::Vector3d>> fed;
+    {
+        std::unique_lock<std::mutex> lck(mtx_landmarks);
+        fed.swap(new_landmarks);
+    }
+    for (const auto &landmark : fed) {
+        if (landmarks.find(landmark.first) == landmarks.end())
+            landmarks_order.push_back(landmark.first);
+        landmarks[landmark.first] = landmark.second;
+
+        // Give it to the keyframes that have been waiting for it
+        auto it = landmark_owners.find(landmark.first);
+        if (it == landmark_owners.end())
+            continue;
+        for (const auto &owner : it->second) {
+            KeyFrame *kf = keyframes.get(owner.first);
+            if (kf == nullptr)
+                continue;
+            kf->point_3d.at(owner.second) = cv::Point3f((float) landmark.second(0), (float) landmark.second(1), (float) landmark.second(2));
+            kf->point_3d_valid.at(owner.second) = 1;
+        }
+        landmark_owners.erase(it);
+    }
+
+    // Only keep the newest ones, tracks that never got a landmark are forgotten too
+    while (landmarks.size() > max_landmarks) {
+        landmarks.erase(landmarks_order.front());
+        landmarks_order.pop_front();
+    }
+    while (landmark_owners_order.size() > max_landmarks) {
+        landmark_owners.erase(landmark_owners_order.front());
+        landmark_owners_order.pop_front();
+    }
+}
+
+void LoopCloser::register_landmarks(KeyFrame *keyframe) {
+    for (size_t i = 0; i < keyframe->track_ids.size(); i++) {
+        const size_t id = keyframe->track_ids.at(i);
+        auto it = landmarks.find(id);
+        if (it != landmarks.end()) {
+            keyframe->point_3d.at(i) = cv::Point3f((float) it->second(0), (float) it->second(1), (float) it->second(2));
+            keyframe->point_3d_valid.at(i) = 1;
+            continue;
+        }
+        auto &owners = landmark_owners[id];
+        if (owners.empty())
+            landmark_owners_order.push_back(id);
+        owners.emplace_back(keyframe->keyframe_id, i);
+    }
+}
+
+void LoopCloser::worker() {
+    while (true) {
+        LoopCandidate candidate;
+        {
+            std::unique_lock<std::mutex> lck(mtx_queue);
+            cv_queue.wait(lck, [this] { return !is_running || !queue.empty(); });
+            if (!is_running)
+                return;
+            candidate = queue.front();
+            queue.pop_front();
+        }
+        process_frame(candidate);
+    }
+}
 
+void LoopCloser::process_frame(const LoopCandidate &candidate) {
+    // Reuses the last keyframe if we did not keep it
+    cur_keyframe = keyframes.acquire(candidate.timestamp, candidate.frame->image, candidate.cam_id, candidate.trackBase, candidate.frame_id);
+    cur_keyframe->position = candidate.p_IinG;
+    cur_keyframe->R_GtoC = candidate.R_GtoC;
+    cur_keyframe->R_ItoC = candidate.R_ItoC;
+    cur_keyframe->p_IinC = candidate.p_IinC;
+    cur_keyframe->has_pose = true;
+    cur_keyframe->computeBRIEFPoint(*extractor, candidate.frame);
+    if (keep_landmarks)
+        update_landmarks();
+    LoopResult result;
+    // Until we know where we are in the loaded map, only look for the map keyframes
+    const bool found = (num_map_keyframes > 0 && !is_relocalized) ? relocalize(result) : ransac_loop(result);
+    if (found) {
+        if (result.has_pose && result.is_map) {
+            // Our pose of this frame is from before its update, so wait for the updated one
+            std::unique_lock<std::mutex> lck(mtx_poses);
+            map_loops_pending.push_back(result);
+        } else if (result.has_pose && pose_graph != nullptr)
+            pose_graph->add_loop(result.timestamp, result.old_timestamp, result.R_GtoI, result.p_IinG);
+        std::unique_lock<std::mutex> lck(mtx_results);
+        results.push_back(result);
+    }
+    resolve_map_loops();
+    if (need_keyframe(candidate)) {
+        keyframe_log_count++;
+        keyframe_log_points += cur_keyframe->keypoints.size();
+        keyframe_log_time += cur_keyframe->extraction_time;
+        if (keyframe_log_count >= keyframe_log_period) {
+            std::cout << "new keyframe " << keyframe_id << " at frame " << candidate.frame_id << " (last " << keyframe_log_count
+                      << " keyframes: " << keyframe_log_points / keyframe_log_count << " brief points in "
+                      << keyframe_log_time / keyframe_log_count * 1e3 << " ms on average)" << std::endl;
+            keyframe_log_count = 0;
+            keyframe_log_points = 0;
+            keyframe_log_time = 0;
+        }
+        // The image is compacted once it is added, so get the descriptors of our tracks first
+        if (keep_landmarks)
+            cur_keyframe->computeTrackBRIEF(*extractor, candidate.track_pts, candidate.track_ids);
+        KeyFrame *keyframe = cur_keyframe;
+        add_keyframe_into_voc(keyframe);
+        set_last_keyframe(candidate);
+        if (keep_landmarks)
+            register_landmarks(keyframe);
+        if (pose_graph != nullptr)
+            pose_graph->add_keyframe(candidate.timestamp);
+    }
 }
 
-void LoopCloser::feed_monocular(double timestamp, cv::Mat img, size_t cam_id, TrackBase *trackBase) {
-    cur_keyframe = new KeyFrame(timestamp, img, cam_id, trackBase, frame_id);
-    cur_keyframe->computeBRIEFPoint();
-    ransac_loop();
-    if (frame_id % step == 0) {
-        add_keyframe_into_voc(cur_keyframe);
+bool LoopCloser::need_keyframe(const LoopCandidate &candidate) {
+
+    // Frames can be dropped, so take a keyframe once enough frames have passed since the last one
+    if (last_keyframe_frame_id < 0)
+        return true;
+    const int frames_since = candidate.frame_id - last_keyframe_frame_id;
+    if (!use_keyframe_policy)
+        return frames_since >= step;
+    if (frames_since < kf_min_frames)
+        return false;
+
+    // If we have rotated a lot we are looking at a new place, even if the tracks have not been lost yet
+    const Eigen::Matrix3d R_rel = candidate.R_GtoC * last_keyframe_R_GtoC.transpose();
+    const double angle = std::acos(std::max(-1.0, std::min(1.0, (R_rel.trace() - 1.0) / 2.0)));
+    if (angle > kf_max_rotation)
+        return true;
+
+    // Find how many of the last keyframe's tracks we still have, and their parallax once the rotation is removed
+    std::vector<cv::Point2f> pts_norm;
+    candidate.trackBase->undistort_points(candidate.track_pts, pts_norm, candidate.cam_id);
+    const Eigen::Matrix3d R_KFtoC = (candidate.cam_id == last_keyframe_cam_id) ? R_rel : Eigen::Matrix3d::Identity();
+    std::vector<double> parallax;
+    parallax.reserve(pts_norm.size());
+    for (size_t i = 0; i < candidate.track_ids.size(); i++) {
+        auto it = last_keyframe_tracks.find(candidate.track_ids.at(i));
+        if (it == last_keyframe_tracks.end())
+            continue;
+        Eigen::Vector3d b = R_KFtoC * Eigen::Vector3d(it->second.x, it->second.y, 1);
+        if (b(2) <= 1e-3)
+            continue;
+        parallax.push_back(std::hypot(pts_norm.at(i).x - b(0) / b(2), pts_norm.at(i).y - b(1) / b(2)));
     }
-    frame_id++;
+    const double overlap = (last_keyframe_tracks.empty()) ? 0.0 : (double) parallax.size() / last_keyframe_tracks.size();
+    if (overlap < kf_min_overlap || parallax.empty())
+        return true;
+    std::nth_element(parallax.begin(), parallax.begin() + parallax.size() / 2, parallax.end());
+    const cv::Matx33d K = candidate.trackBase->get_camera_k_OPENCV().at(candidate.cam_id);
+    const double median_parallax = parallax.at(parallax.size() / 2) * std::max(K(0, 0), K(1, 1));
+    if (median_parallax > kf_min_parallax)
+        return true;
+
+    // We are not seeing anything new (e.g. standing still), so skip it
+    return false;
+}
+
+void LoopCloser::set_last_keyframe(const LoopCandidate &candidate) {
+    last_keyframe_frame_id = candidate.frame_id;
+    last_keyframe_R_GtoC = candidate.R_GtoC;
+    last_keyframe_cam_id = candidate.cam_id;
+    last_keyframe_tracks.clear();
+    if (!use_keyframe_policy)
+        return;
+    std::vector<cv::Point2f> pts_norm;
+    candidate.trackBase->undistort_points(candidate.track_pts, pts_norm, candidate.cam_id);
+    for (size_t i = 0; i < candidate.track_ids.size(); i++)
+        last_keyframe_tracks.insert({candidate.track_ids.at(i), pts_norm.at(i)});
 }
 
-int LoopCloser::detect_loop(KeyFrame *keyframe, int frame_index) {
+void LoopCloser::get_loop_results(std::vector<LoopResult> &results) {
+    std::unique_lock<std::mutex> lck(mtx_results);
+    results.clear();
+    results.swap(this->results);
+}
+
+int LoopCloser::detect_loop(KeyFrame *keyframe) {
     // put image into image_pool; for visualization
     cv::Mat compressed_image;
     QueryResults ret;
 
-    db.query(keyframe->brief_descriptors, ret, 4, frame_index - 50);
-    bool find_loop = false;
-    std::cout<<"frame_index: "<<frame_index<<"ret_size: "<<ret.size()<<std::endl;
-    for(int i=0;i<ret.size();i++){
-        std::cout<<"ret "<<i <<" frame_id: "<< get_keyframe(ret[i].Id)->frame_id << " Score: "<<ret[i].Score<<std::endl;
+    // Database entries are keyframe ids, so find the newest keyframe that is at least loop_min_frames older than this frame
+    while (!loop_recent_keyframes.empty() && loop_recent_keyframes.front().second + loop_min_frames <= keyframe->frame_id) {
+        loop_max_id = loop_recent_keyframes.front().first;
+        loop_recent_keyframes.pop_front();
     }
+    const int max_id = loop_max_id;
+    if (max_id < 0)
+        return -1;
+
+    // The database works on bitsets, so only convert our descriptors here
+    std::vector<BRIEF::bitset> descriptors;
+    BriefExtractor::to_bitsets(keyframe->brief_descriptors, descriptors);
+    db.query(descriptors, ret, 4, max_id);
+    bool find_loop = false;
     if (ret.size() > 1 && ret[0].Score > 0.05)
         for (unsigned int i = 1; i < ret.size(); i++) {
             //if (ret[i].Score > ret[0].Score * 0.3)
@@ -45,7 +327,7 @@ int LoopCloser::detect_loop(KeyFrame *keyframe, int frame_index) {
             }
         }
 
-    if (find_loop && frame_index > 50) {
+    if (find_loop) {
         int min_index = -1;
         for (unsigned int i = 0; i < ret.size(); i++) {
             if (min_index == -1 || (ret[i].Id < min_index && ret[i].Score > 0.015))
@@ -57,16 +339,9 @@ int LoopCloser::detect_loop(KeyFrame *keyframe, int frame_index) {
 }
 
 KeyFrame *LoopCloser::get_keyframe(int index) {
-//    unique_lock<mutex> lock(m_keyframelist);
-    list<KeyFrame *>::iterator it = keyFrameList.begin();
-    for (; it != keyFrameList.end(); it++) {
-        if ((*it)->keyframe_id == index)
-            break;
-    }
-    if (it != keyFrameList.end())
-        return *it;
-    else
+    if (index < 0)
         return nullptr;
+    return keyframes.get((size_t) index);
 }
 
 
@@ -81,19 +356,32 @@ void LoopCloser::add_keyframe_into_voc(KeyFrame *keyframe) {
 //        image_pool[keyframe->index] = compressed_image;
 //    }
 
-    db.add(keyframe->brief_descriptors);
+    std::vector<BRIEF::bitset> descriptors;
+    BriefExtractor::to_bitsets(keyframe->brief_descriptors, descriptors);
+    db.add(descriptors);
     keyframe->set_keyframe_id(keyframe_id++);
-    keyFrameList.push_back(keyframe);
+    loop_recent_keyframes.emplace_back((int) keyframe->keyframe_id, keyframe->frame_id);
+
+    // The store now owns it, and we remove any keyframes it evicted from the database so they are never returned by a query
+    std::vector<size_t> evicted;
+    keyframes.add(keyframe, evicted);
+    for (size_t id : evicted)
+        db.delete_entry((EntryId) id);
+    if (!evicted.empty())
+        std::cout << "evicted " << evicted.size() << " keyframes (" << keyframes.size() << " kept, "
+                  << keyframes.memory_bytes() / 1024 << " KB)" << std::endl;
 }
 
-bool LoopCloser::ransac_loop() {
-    int old_keyframe_id = detect_loop(cur_keyframe, frame_id);
+bool LoopCloser::ransac_loop(LoopResult &result) {
+    int old_keyframe_id = detect_loop(cur_keyframe);
     if(old_keyframe_id == -1){
         std::cout<<"did not find loopcloser at frame:"<<cur_keyframe->frame_id<<std::endl;
         return false;
     }
 
     KeyFrame *old_keyframe = get_keyframe(old_keyframe_id);
+    if (old_keyframe == nullptr)
+        return false;
 
     std::cout<<"old_frame: "<<old_keyframe->frame_id<<std::endl;
 
@@ -101,34 +389,231 @@ bool LoopCloser::ransac_loop() {
     std::vector<cv::Point2f> matched_2d_cur;
 
     bool is_find_loop = false;
-    is_find_loop =  cur_keyframe->findConnection(old_keyframe,matched_2d_old,matched_2d_cur);
+    // Map keyframes are in the map's frame, so our rotation can not predict where their points are
+    const bool is_map = (old_keyframe->keyframe_id < num_map_keyframes);
+    is_find_loop =  cur_keyframe->findConnection(old_keyframe,matched_2d_old,matched_2d_cur,is_map ? -1 : search_radius);
     if (is_find_loop) {
-        int feature_num = cur_keyframe->keypoints.size();
-        cv::Mat compressed_image = cur_keyframe->image.clone();
-        putText(compressed_image, "image:" + to_string(cur_keyframe->frame_id) + " feature_num:"
-                                  + to_string(feature_num) + "keyframe_size:" + to_string(keyframe_id),
-                cv::Point2f(10, 50), CV_FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(0, 255, 255));
-        cv::Mat loop_result;
-        loop_result = compressed_image.clone();
-//        putText(loop_result, "neighbour score:" + to_string(ret[0].Score), cv::Point2f(10, 50),
-//                    CV_FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(255));
-
-        cv::Mat tmp_image = (old_keyframe->image).clone();
-        putText(tmp_image, "best index:  " + to_string(old_keyframe->frame_id),
-                cv::Point2f(10, 50), CV_FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(0, 255, 255));
-        cv::hconcat(loop_result, tmp_image, loop_result);
-        for(int i=0;i<matched_2d_cur.size();i++){
-            cv::RNG rng = cv::RNG(cv::getTickCount());
-            int r = rng.uniform(0,255);
-            int g = rng.uniform(0,255);
-            int b = rng.uniform(0,255);
-            cv::line(loop_result,matched_2d_cur[i],cv::Point2f(matched_2d_old[i].x+compressed_image.cols,matched_2d_old[i].y),cv::Scalar(r,g,b), 2);
+        result.timestamp = cur_keyframe->timestamp;
+        result.frame_id = cur_keyframe->frame_id;
+        result.old_timestamp = old_keyframe->timestamp;
+        result.old_frame_id = old_keyframe->frame_id;
+        result.matched_2d_cur = matched_2d_cur;
+        result.matched_2d_old = matched_2d_old;
+
+        result.is_map = is_map;
+
+        // Get our pose from the old keyframe's landmarks, for the pose graph or the map transform
+        if (pose_graph != nullptr || is_map) {
+            result.has_pose = cur_keyframe->findLoopPose(old_keyframe, result.R_GtoI, result.p_IinG, result.num_inliers);
         }
+
+        // Drawing (and the waitKey) would run on the worker thread if we have started it, so it is only for debugging
         if (DEBUG_IMAGE) {
+            int feature_num = cur_keyframe->keypoints.size();
+            cv::Mat compressed_image = cur_keyframe->image.clone();
+            putText(compressed_image, "image:" + to_string(cur_keyframe->frame_id) + " feature_num:"
+                                      + to_string(feature_num) + "keyframe_size:" + to_string(keyframe_id),
+                    cv::Point2f(10, 50), CV_FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(0, 255, 255));
+            cv::Mat loop_result;
+            loop_result = compressed_image.clone();
+            cv::Mat tmp_image = old_keyframe->get_image().clone();
+            putText(tmp_image, "best index:  " + to_string(old_keyframe->frame_id),
+                    cv::Point2f(10, 50), CV_FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(0, 255, 255));
+            cv::hconcat(loop_result, tmp_image, loop_result);
+            for(int i=0;i<matched_2d_cur.size();i++){
+                cv::RNG rng = cv::RNG(cv::getTickCount());
+                int r = rng.uniform(0,255);
+                int g = rng.uniform(0,255);
+                int b = rng.uniform(0,255);
+                cv::line(loop_result,matched_2d_cur[i],cv::Point2f(matched_2d_old[i].x+compressed_image.cols,matched_2d_old[i].y),cv::Scalar(r,g,b), 2);
+            }
             cv::imshow("loop_result", loop_result);
             cv::waitKey(20);
         }
 
     }
     return is_find_loop;
-}
\ No newline at end of file
+}
+
+bool LoopCloser::relocalize(LoopResult &result) {
+    std::vector<BRIEF::bitset> descriptors;
+    BriefExtractor::to_bitsets(cur_keyframe->brief_descriptors, descriptors);
+    QueryResults ret;
+    db.query(descriptors, ret, 4, (int) num_map_keyframes - 1);
+
+    // Try the best few map keyframes until one gives us a pose
+    for (unsigned int i = 0; i < ret.size() && ret[i].Score > 0.015; i++) {
+        KeyFrame *map_keyframe = get_keyframe((int) ret[i].Id);
+        if (map_keyframe == nullptr)
+            continue;
+        std::vector<cv::Point2f> matched_2d_old, matched_2d_cur;
+        if (!cur_keyframe->findConnection(map_keyframe, matched_2d_old, matched_2d_cur, -1))
+            continue;
+        if (!cur_keyframe->findLoopPose(map_keyframe, result.R_GtoI, result.p_IinG, result.num_inliers))
+            continue;
+        result.timestamp = cur_keyframe->timestamp;
+        result.frame_id = cur_keyframe->frame_id;
+        result.old_timestamp = map_keyframe->timestamp;
+        result.old_frame_id = map_keyframe->frame_id;
+        result.matched_2d_cur = matched_2d_cur;
+        result.matched_2d_old = matched_2d_old;
+        result.is_map = true;
+        result.has_pose = true;
+        std::cout << "relocalized at frame " << cur_keyframe->frame_id << " in map keyframe " << map_keyframe->keyframe_id
+                  << " (score " << ret[i].Score << ", " << result.num_inliers << " pnp inliers)" << std::endl;
+        return true;
+    }
+    return false;
+}
+
+void LoopCloser::set_map_transform(const LoopResult &result, const Eigen::Matrix3d &R_GtoI, const Eigen::Vector3d &p_IinG) {
+    // A PnP on few points can be wrong, so do not even consider it
+    if (result.num_inliers < reloc_min_inliers) {
+        std::cout << "map loop at frame " << result.frame_id << " rejected, only " << result.num_inliers << " pnp inliers" << std::endl;
+        return;
+    }
+
+    // Roll and pitch are the same in both frames (gravity aligned), so only the yaw and position differ
+    const Eigen::Matrix3d R_ItoG = R_GtoI.transpose();
+    const Eigen::Matrix3d R_ItoM = result.R_GtoI.transpose();
+    const Eigen::Matrix3d R = PoseGraph::rot_z(PoseGraph::yaw(R_ItoM) - PoseGraph::yaw(R_ItoG));
+    const Eigen::Vector3d p = result.p_IinG - R * p_IinG;
+
+    // Two transforms agree if they put us at the same place in the map with the same yaw
+    auto agrees = [&](const Eigen::Matrix3d &R_other, const Eigen::Vector3d &p_other) {
+        const double dyaw = std::abs(PoseGraph::yaw(R_other.transpose() * R));
+        const double dist = ((R_other * p_IinG + p_other) - result.p_IinG).norm();
+        return dyaw < reloc_max_yaw && dist < reloc_max_dist;
+    };
+
+    // Once relocalized, a map loop only refines our transform if it agrees with it
+    std::unique_lock<std::mutex> lck(mtx_map);
+    if (is_relocalized && agrees(R_GtoM, p_GinM)) {
+        R_GtoM = R;
+        p_GinM = p;
+        reloc_num_pending = 0;
+        return;
+    }
+
+    // Else it has to be confirmed by the next map loops (this is also how a wrong relocalization gets replaced)
+    if (reloc_num_pending > 0 && agrees(reloc_R_pending, reloc_p_pending)) {
+        reloc_num_pending++;
+    } else {
+        reloc_num_pending = 1;
+    }
+    reloc_R_pending = R;
+    reloc_p_pending = p;
+    std::cout << "map loop at frame " << result.frame_id << " (" << result.num_inliers << " pnp inliers), "
+              << reloc_num_pending << " of " << reloc_min_agree << " agreeing loops" << (is_relocalized ? " to replace our transform" : "") << std::endl;
+    if (reloc_num_pending < reloc_min_agree)
+        return;
+    R_GtoM = R;
+    p_GinM = p;
+    is_relocalized = true;
+    reloc_num_pending = 0;
+}
+
+bool LoopCloser::save_map(const std::string &path) {
+    boost::posix_time::ptime rT1 = boost::posix_time::microsec_clock::local_time();
+    std::ofstream out(path, std::ios::binary);
+    if (!out.is_open()) {
+        std::cout << "could not open map file " << path << std::endl;
+        return false;
+    }
+    if (keep_landmarks)
+        update_landmarks();
+
+    // Our keyframes can only be put in a loaded map if we know where we are in it
+    Eigen::Matrix3d R;
+    Eigen::Vector3d t;
+    const bool relocalized = get_map_transform(R, t);
+    const bool has_map = (num_map_keyframes > 0);
+    if (has_map && !relocalized)
+        std::cout << "never relocalized in the loaded map, only saving its keyframes" << std::endl;
+    std::vector<size_t> ids;
+    for (size_t id : keyframes.ids()) {
+        if (id < num_map_keyframes || !has_map || relocalized)
+            ids.push_back(id);
+    }
+
+    // Header, then each keyframe with its bow vector, then the landmarks
+    write_map_header(out, (uint32_t) voc->size(), (uint64_t) ids.size());
+    for (size_t id : ids) {
+        const KeyFrame *kf = keyframes.get(id);
+        const BowVector &bow = db.retrieveBowVector((EntryId) id);
+        if (has_map && id >= num_map_keyframes) {
+            KeyFrame kf_map(*kf);
+            kf_map.position = R * kf->position + t;
+            kf_map.R_GtoC = kf->R_GtoC * R.transpose();
+            for (size_t i = 0; i < kf_map.point_3d.size(); i++) {
+                const cv::Point3f &pt = kf->point_3d.at(i);
+                const Eigen::Vector3d p = R * Eigen::Vector3d(pt.x, pt.y, pt.z) + t;
+                kf_map.point_3d.at(i) = cv::Point3f((float) p(0), (float) p(1), (float) p(2));
+            }
+            write_map_keyframe(out, kf_map, bow);
+        } else {
+            write_map_keyframe(out, *kf, bow);
+        }
+    }
+    std::vector<Eigen::Vector3d> points = map_landmarks;
+    if (!has_map || relocalized) {
+        for (size_t id : landmarks_order)
+            points.push_back(R * landmarks.at(id) + t);
+    }
+    write_map_landmarks(out, points);
+    out.close();
+    if (!out) {
+        std::cout << "failed to write map file " << path << std::endl;
+        return false;
+    }
+    boost::posix_time::ptime rT2 = boost::posix_time::microsec_clock::local_time();
+    std::cout << "------------------save_map successful (" << ids.size() << " keyframes, " << points.size() << " landmarks, "
+              << (rT2 - rT1).total_microseconds() * 1e-3 << " ms)------------------" << std::endl;
+    return true;
+}
+
+bool LoopCloser::load_map(const std::string &path) {
+    boost::posix_time::ptime rT1 = boost::posix_time::microsec_clock::local_time();
+    if (voc == nullptr || keyframe_id != 0) {
+        std::cout << "the map should be loaded after the vocabulary and before any keyframes" << std::endl;
+        return false;
+    }
+    std::ifstream in(path, std::ios::binary);
+    uint32_t voc_size;
+    std::vector<KeyFrame> map_keyframes;
+    std::vector<BowVector> bows;
+
+    // Read all of it first, so a truncated or corrupt map is not partly loaded
+    if (!in.is_open() || !read_map(in, voc_size, map_keyframes, bows, map_landmarks)) {
+        std::cout << "could not read map file " << path << " (missing, truncated or corrupt)" << std::endl;
+        map_landmarks.clear();
+        return false;
+    }
+
+    // The map keyframes are in the map's frame and are all we can relocalize against, so they are never evicted
+    keyframes.set_pinned(map_keyframes.size());
+
+    // The bow vectors are only valid for the vocabulary they were computed with
+    const bool use_bow = (voc_size == voc->size());
+    std::vector<size_t> evicted;
+    for (size_t k = 0; k < map_keyframes.size(); k++) {
+        KeyFrame *kf = keyframes.acquire(0, cv::Mat(), 0, nullptr, 0);
+        *kf = std::move(map_keyframes.at(k));
+        if (use_bow) {
+            db.add(bows.at(k));
+        } else {
+            std::vector<BRIEF::bitset> descriptors;
+            BriefExtractor::to_bitsets(kf->brief_descriptors, descriptors);
+            db.add(descriptors);
+        }
+        kf->set_keyframe_id(keyframe_id++);
+        keyframes.add(kf, evicted);
+    }
+    num_map_keyframes = (size_t) keyframe_id;
+    loop_max_id = keyframe_id - 1;
+    boost::posix_time::ptime rT2 = boost::posix_time::microsec_clock::local_time();
+    std::cout << "------------------load_map successful (" << num_map_keyframes << " keyframes, "
+              << map_landmarks.size() << " landmarks, " << (use_bow ? "saved" : "recomputed") << " bow vectors, "
+              << (rT2 - rT1).total_microseconds() * 1e-3 << " ms)------------------" << std::endl;
+    return true;
+}
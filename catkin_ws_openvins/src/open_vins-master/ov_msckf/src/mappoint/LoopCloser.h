@@ -6,39 +6,400 @@
 #define CATKIN_WS_OPENVINS_LOOPCLOSER_H
 
 #include <list>
+#include <map>
+#include <deque>
+#include <unordered_map>
+#include <mutex>
 #include <vector>
+#include <condition_variable>
+#include <boost/thread.hpp>
 #include "ThirdParty/DBoW/DBoW2.h"
 #include "ThirdParty/DVision/DVision.h"
 #include "ThirdParty/DBoW/TemplatedDatabase.h"
 #include "ThirdParty/DBoW/TemplatedVocabulary.h"
 
 #include "keyframe/KeyFrame.h"
+#include "keyframe/KeyFrameStore.h"
 #include "track/TrackBase.h"
+#include "PoseGraph.h"
 
-#define DEBUG_IMAGE true
+// Shows each loop we find (highgui is not thread safe, so only enable this to debug without the ROS visualizer)
+#define DEBUG_IMAGE false
 using namespace DVision;
 using namespace DBoW2;
 using namespace ov_core;
 
 namespace ov_msckf {
+
+    /**
+     * @brief A loop we found between the current frame and an old keyframe
+     */
+    struct LoopResult {
+        /// Timestamp and frame id of the current frame
+        double timestamp = -1;
+        size_t frame_id = 0;
+
+        /// Timestamp and frame id of the old keyframe
+        double old_timestamp = -1;
+        size_t old_frame_id = 0;
+
+        /// Matched points in the current and old images
+        std::vector<cv::Point2f> matched_2d_cur, matched_2d_old;
+
+        /// If the old keyframe is from the loaded map
+        bool is_map = false;
+
+        /// Pose of the current frame in the frame of the old keyframe's landmarks (if the PnP found it)
+        bool has_pose = false;
+        int num_inliers = 0;
+        Eigen::Matrix3d R_GtoI = Eigen::Matrix3d::Identity();
+        Eigen::Vector3d p_IinG = Eigen::Vector3d::Zero();
+    };
+
+    /**
+     * @brief Loop closure with the keyframe database.
+     *
+     * Detecting a loop needs BRIEF extraction, a database query and descriptor matching, which should not slow down the estimator.
+     * If start() has been called, feed_monocular() just queues the frame and a worker thread does all of this.
+     * The queue is bounded and drops its oldest frame when full, so a busy loop closer only skips frames and never blocks the VIO.
+     * Found loops are then gotten with get_loop_results().
+     *
+     * The keyframes can be saved to a map with save_map() and loaded again in a later run with load_map().
+     * Until we have found where we are in a loaded map, each frame is queried against only the map keyframes,
+     * and the pose we get from the map's landmarks gives the transform from our global frame to the map (see get_map_transform()).
+     */
     class LoopCloser{
     public:
         LoopCloser()= default;
-        ~LoopCloser()= default;
-        void load_vocabulary(std::string voc_path);
-        void feed_monocular(double timestamp, cv::Mat img, size_t cam_id,TrackBase * trackBase);
-        int detect_loop(KeyFrame* keyframe, int frame_index);
+        ~LoopCloser() { stop(); }
+
+        /**
+         * @brief Starts the worker thread, after which frames are processed in the background
+         * @param max_queue max number of frames waiting to be processed (the oldest is dropped past this)
+         */
+        void start(size_t max_queue);
+
+        /// Stops the worker thread, frames still in the queue are dropped
+        void stop();
+
+        /**
+         * @brief Loads the vocabulary, mapping its flat version if we have it (see VINSLoop::MappedVocabulary)
+         * @param voc_path path of the binary vocabulary, or of a flat vocabulary
+         * @param map_path path of the flat vocabulary (empty to use voc_path with ".map" appended)
+         *
+         * If we do not have the flat vocabulary yet, it is converted from the binary one the first time and written to map_path.
+         * If that can not be written, we fall back to loading the binary vocabulary into memory.
+         */
+        void load_vocabulary(std::string voc_path, std::string map_path = "");
+
+        /**
+         * @brief Loads the BRIEF test pattern once, so each keyframe does not have to read the file again
+         * @param pattern_path path of the pattern the vocabulary was built with
+         */
+        void load_brief_pattern(const std::string &pattern_path);
+
+        /**
+         * @brief Sets how much memory our keyframes can use (see KeyFrameStore::set_options())
+         *
+         * This should be called before start(), as the worker thread owns the keyframes.
+         */
+        void set_keyframe_options(double image_scale, int jpeg_quality, size_t memory_budget, double voxel_size) {
+            keyframes.set_options(image_scale, jpeg_quality, memory_budget, voxel_size);
+        }
+
+        /**
+         * @brief Sets when we take a new keyframe, instead of every few frames
+         * @param min_overlap take one if less than this ratio of the last keyframe's tracks are still tracked
+         * @param min_parallax take one if the median rotation compensated parallax of the common tracks is more than this (pixels)
+         * @param max_rotation take one if we have rotated more than this since the last keyframe (degrees)
+         * @param min_frames min number of frames between keyframes
+         *
+         * This should be called before start(), as the worker thread decides on the keyframes.
+         */
+        void set_keyframe_policy(double min_overlap, double min_parallax, double max_rotation, int min_frames) {
+            use_keyframe_policy = true;
+            kf_min_overlap = min_overlap;
+            kf_min_parallax = min_parallax;
+            kf_max_rotation = max_rotation * M_PI / 180.0;
+            kf_min_frames = std::max(1, min_frames);
+        }
+
+        /**
+         * @brief Sets how many frames older than the current frame a keyframe has to be before we close a loop with it
+         * @param min_frames number of frames, newer keyframes are too recent for the VIO to have drifted from
+         *
+         * This is in frames and not keyframes, so the window stays the same whichever keyframe policy we use.
+         * This should be called before start(), as the worker thread queries the database.
+         */
+        void set_loop_min_frames(int min_frames) {
+            loop_min_frames = std::max(0, min_frames);
+        }
+
+        /**
+         * @brief Gives the loops we find to a pose graph
+         * @param graph pose graph, our keyframes are added as its nodes and each loop with a PnP pose as a constraint
+         *
+         * This should be called before start(), as the worker thread adds to it.
+         * The landmarks of our keyframe tracks should then be given with feed_landmarks(), as the PnP needs them.
+         */
+        void set_pose_graph(PoseGraph *graph) {
+            pose_graph = graph;
+            keep_landmarks = true;
+        }
+
+        /**
+         * @brief Keeps the landmarks of our keyframe tracks (given with feed_landmarks()) even without a pose graph
+         *
+         * A saved map needs them to relocalize in later, so this should be set if we will save one.
+         */
+        void set_keep_landmarks(bool keep) {
+            keep_landmarks = keep || (pose_graph != nullptr);
+        }
+
+        /**
+         * @brief Gives the landmarks the estimator has triangulated (or updated), so our keyframes can be given their 3d points
+         * @param ids feature id of each landmark
+         * @param positions position of each landmark in the global frame
+         */
+        void feed_landmarks(const std::vector<size_t> &ids, const std::vector<Eigen::Vector3d> &positions);
+
+        /**
+         * @brief Gives the VIO pose of a clone (called for all clones after each update, like PoseGraph::feed_vio_pose())
+         * @param timestamp timestamp of the clone
+         * @param R_GtoI orientation of the clone
+         * @param p_IinG position of the clone
+         *
+         * The pose fed with a frame is from the update before it, so a map loop waits for the pose of its frame before we use it.
+         */
+        void feed_vio_pose(double timestamp, const Eigen::Matrix3d &R_GtoI, const Eigen::Vector3d &p_IinG);
+
+        /**
+         * @brief Saves our keyframes and landmarks to a compact binary map
+         * @param path file to write the map to
+         *
+         * Each keyframe is written with its bow vector, BRIEF points, tracks and landmarks, pose and compacted image.
+         * If we loaded a map, our keyframes and landmarks are written in the map's frame, or left out if we never relocalized in it.
+         * The worker thread should be stopped first.
+         */
+        bool save_map(const std::string &path);
+
+        /**
+         * @brief Loads a map written by save_map(), which we will then relocalize in
+         * @param path file to read the map from
+         *
+         * This should be called after the vocabulary is loaded and before any frame is fed.
+         * The saved bow vectors are used if the map was built with a vocabulary of the same size, else they are computed again.
+         */
+        bool load_map(const std::string &path);
+
+        /**
+         * @brief Gets the transform from our global frame to the loaded map's frame, a pose in the map is R_GtoM*p_IinG+p_GinM
+         * @return False if we have not relocalized in a map
+         */
+        bool get_map_transform(Eigen::Matrix3d &R_GtoM, Eigen::Vector3d &p_GinM) {
+            std::unique_lock<std::mutex> lck(mtx_map);
+            R_GtoM = this->R_GtoM;
+            p_GinM = this->p_GinM;
+            return is_relocalized;
+        }
+
+        /// Landmarks of the loaded map in its frame (these are not changed after load_map())
+        const std::vector<Eigen::Vector3d> &get_map_landmarks() const {
+            return map_landmarks;
+        }
+
+        /**
+         * @brief Sets the pixel radius we match around where the pose estimate predicts each point (see KeyFrame::findConnection())
+         * @param radius search radius in pixels (-1 to match against all points)
+         *
+         * The prediction only uses the rotation of our (drifting) estimate, and loops are between keyframes that can be far apart.
+         * So a radius misses true matches once the translation or yaw drift is large, and it is off by default.
+         */
+        void set_search_radius(double radius) {
+            search_radius = radius;
+        }
+
+        /**
+         * @brief Sets how many threads a database query can use (see TemplatedDatabase::setQueryThreads())
+         *
+         * This should be called before start(), as the worker thread queries the database.
+         */
+        void set_query_threads(int num_threads) {
+            db.setQueryThreads(num_threads);
+        }
+
+        /**
+         * @brief Processes a new image, or queues it if the worker thread is running
+         * @param timestamp timestamp of the image
+         * @param frame shared preprocessed frame of the image
+         * @param cam_id camera id of the image
+         * @param trackBase tracker we undistort with
+         * @param R_GtoC current camera orientation estimate, used to predict where points should be in an old keyframe
+         * @param p_IinG current position estimate, only used to find spatially redundant keyframes to evict
+         * @param R_ItoC camera extrinsic rotation, used to get the IMU pose of a loop
+         * @param p_IinC camera extrinsic position, used to get the IMU pose of a loop
+         */
+        void feed_monocular(double timestamp, std::shared_ptr<FrameContext> frame, size_t cam_id, TrackBase * trackBase,
+                            const Eigen::Matrix3d &R_GtoC, const Eigen::Vector3d &p_IinG,
+                            const Eigen::Matrix3d &R_ItoC, const Eigen::Vector3d &p_IinC);
+
+        /**
+         * @brief Gets the loops found since the last call (which are then cleared)
+         * @param results vector we will return the loops in
+         */
+        void get_loop_results(std::vector<LoopResult> &results);
+
+        /// Number of frames dropped because the queue was full
+        size_t get_num_dropped() {
+            std::unique_lock<std::mutex> lck(mtx_queue);
+            return num_dropped;
+        }
+        /**
+         * @brief Queries the database for an old keyframe that closes a loop with this one
+         * @param keyframe current keyframe
+         * @return Id of the old keyframe, or -1 if we did not find one
+         *
+         * Only keyframes at least loop_min_frames older than this frame are returned (see set_loop_min_frames()).
+         */
+        int detect_loop(KeyFrame* keyframe);
         void add_keyframe_into_voc(KeyFrame* keyframe);
-        bool ransac_loop();
+        bool ransac_loop(LoopResult &result);
         KeyFrame* get_keyframe(int index);
 
     private:
+
+        /// Frame waiting to be processed by the worker
+        struct LoopCandidate {
+            double timestamp;
+            std::shared_ptr<FrameContext> frame;
+            size_t cam_id;
+            TrackBase *trackBase;
+            Eigen::Matrix3d R_GtoC;
+            Eigen::Vector3d p_IinG;
+            Eigen::Matrix3d R_ItoC;
+            Eigen::Vector3d p_IinC;
+            int frame_id;
+            std::vector<cv::Point2f> track_pts;
+            std::vector<size_t> track_ids;
+        };
+
+        /// Decides if a frame should be added to the database (see set_keyframe_policy())
+        bool need_keyframe(const LoopCandidate &candidate);
+
+        /// Remembers the tracks and pose of the keyframe we just added, to compare the next frames against
+        void set_last_keyframe(const LoopCandidate &candidate);
+
+        /// Extracts the keyframe of a frame, tries to find a loop and adds it to the database if it is a keyframe
+        void process_frame(const LoopCandidate &candidate);
+
+        /// Worker thread loop, processes queued frames until stopped
+        void worker();
+
+        /// Moves the landmarks we have been fed into our cache, and gives them to the keyframes waiting for them
+        void update_landmarks();
+
+        /// Gives a new keyframe the landmarks of its tracks we already have, the others will be set once they are fed
+        void register_landmarks(KeyFrame *keyframe);
+
+        /// Tries to find the current keyframe in the map keyframes (without the checks against recent keyframes of a loop)
+        bool relocalize(LoopResult &result);
+
+        /**
+         * @brief Sets the transform to the map from a loop to a map keyframe
+         * @param result loop to the map keyframe
+         * @param R_GtoI updated orientation of the frame of the loop
+         * @param p_IinG updated position of the frame of the loop
+         *
+         * We only relocalize once reloc_min_agree map loops in a row (each with enough PnP inliers) give the same transform.
+         * After that, a map loop that agrees with our transform refines it, and ones that do not have to agree with each other again to replace it.
+         */
+        void set_map_transform(const LoopResult &result, const Eigen::Matrix3d &R_GtoI, const Eigen::Vector3d &p_IinG);
+
+        /// Uses the map loops whose frame now has its updated pose (and drops the ones whose clone is already gone)
+        void resolve_map_loops();
+
+        // Worker thread and its queue of frames
+        boost::thread thread_worker;
+        std::mutex mtx_queue;
+        std::condition_variable cv_queue;
+        std::deque<LoopCandidate> queue;
+        size_t max_queue = 2;
+        size_t num_dropped = 0;
+        bool is_running = false;
+
+        // Loops found that have not been gotten yet
+        std::mutex mtx_results;
+        std::vector<LoopResult> results;
+
         BriefDatabase db;
-        BriefVocabulary* voc;
+        BriefVocabulary* voc = nullptr;
+        std::shared_ptr<BriefExtractor> extractor;
 
-        std::list<KeyFrame*> keyFrameList;
+        KeyFrameStore keyframes;
         int frame_id = 0;
         int step = 20;
+        int last_keyframe_frame_id = -1;
+
+        // Keyframe policy, and the normalized tracks and orientation of the last keyframe
+        bool use_keyframe_policy = false;
+        double kf_min_overlap = 0.6;
+        double kf_min_parallax = 20;
+        double kf_max_rotation = 15 * M_PI / 180.0;
+        int kf_min_frames = 2;
+        std::unordered_map<size_t, cv::Point2f> last_keyframe_tracks;
+        Eigen::Matrix3d last_keyframe_R_GtoC = Eigen::Matrix3d::Identity();
+        size_t last_keyframe_cam_id = 0;
+        double search_radius = -1;
+
+        // Number of frames a keyframe has to be older than the current frame before we close a loop with it
+        // Our keyframes still inside of this window (keyframe id, frame id), and the newest keyframe id outside of it
+        int loop_min_frames = 50;
+        std::deque<std::pair<int, size_t>> loop_recent_keyframes;
+        int loop_max_id = -1;
+
+        // We print a summary of our keyframes every this many, with their mean number of points and extraction time
+        int keyframe_log_period = 50;
+        int keyframe_log_count = 0;
+        size_t keyframe_log_points = 0;
+        double keyframe_log_time = 0;
+
+        // Pose graph we give our loops to, and the landmarks fed by the estimator that the worker has not gotten yet
+        PoseGraph *pose_graph = nullptr;
+        bool keep_landmarks = false;
+        std::mutex mtx_landmarks;
+        std::deque<std::pair<size_t, Eigen::Vector3d>> new_landmarks;
+
+        // Newest landmarks (by feature id), and the keyframe tracks (keyframe id and index) still waiting for their landmark
+        size_t max_landmarks = 20000;
+        std::unordered_map<size_t, Eigen::Vector3d> landmarks;
+        std::deque<size_t> landmarks_order;
+        std::unordered_map<size_t, std::vector<std::pair<size_t, size_t>>> landmark_owners;
+        std::deque<size_t> landmark_owners_order;
+
+        // Loaded map, its keyframes have the ids below num_map_keyframes
+        size_t num_map_keyframes = 0;
+        std::vector<Eigen::Vector3d> map_landmarks;
+
+        // Updated poses of the recent clones, and the map loops waiting for the pose of their frame
+        std::mutex mtx_poses;
+        size_t max_recent_poses = 100;
+        std::map<double, std::pair<Eigen::Matrix3d, Eigen::Vector3d>> recent_poses;
+        std::deque<LoopResult> map_loops_pending;
+
+        // Transform from our global frame to the map's
+        std::mutex mtx_map;
+        bool is_relocalized = false;
+        Eigen::Matrix3d R_GtoM = Eigen::Matrix3d::Identity();
+        Eigen::Vector3d p_GinM = Eigen::Vector3d::Zero();
+
+        // Map loops needed to agree on a transform, how close they need to be, and the last transform waiting to be confirmed
+        int reloc_min_inliers = 25;
+        int reloc_min_agree = 2;
+        double reloc_max_yaw = 5 * M_PI / 180.0;
+        double reloc_max_dist = 0.5;
+        int reloc_num_pending = 0;
+        Eigen::Matrix3d reloc_R_pending = Eigen::Matrix3d::Identity();
+        Eigen::Vector3d reloc_p_pending = Eigen::Vector3d::Zero();
         int keyframe_id = 0;
         KeyFrame *cur_keyframe = nullptr;
     };
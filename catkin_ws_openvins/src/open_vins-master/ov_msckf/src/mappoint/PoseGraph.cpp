@@ -0,0 +1,279 @@
+//
+// 4自由度位姿图, 用回环约束修正VIO的漂移
+//
+
+#include "PoseGraph.h"
+#include <iostream>
+#include <Eigen/Sparse>
+#include <Eigen/SparseCholesky>
+
+using namespace ov_msckf;
+
+/// Wraps an angle into [-pi,pi)
+static inline double wrap_angle(double angle) {
+    return angle - 2 * M_PI * std::floor((angle + M_PI) / (2 * M_PI));
+}
+
+void PoseGraph::start() {
+    std::unique_lock<std::mutex> lck(mtx);
+    if (is_running)
+        return;
+    is_running = true;
+    thread_worker = boost::thread(&PoseGraph::worker, this);
+}
+
+void PoseGraph::stop() {
+    {
+        std::unique_lock<std::mutex> lck(mtx);
+        if (!is_running)
+            return;
+        is_running = false;
+    }
+    cv_loop.notify_all();
+    thread_worker.join();
+}
+
+void PoseGraph::feed_vio_pose(double timestamp, const Eigen::Matrix3d &R_GtoI, const Eigen::Vector3d &p_IinG) {
+    std::unique_lock<std::mutex> lck(mtx);
+    recent_poses[timestamp] = std::make_pair(R_GtoI, p_IinG);
+    while (recent_poses.size() > max_recent_poses)
+        recent_poses.erase(recent_poses.begin());
+
+    // Clones are refined until they are marginalized, so keep updating our nodes with them
+    auto it = nodes.find(timestamp);
+    if (it == nodes.end())
+        return;
+    const bool is_new = !it->second.has_vio;
+    it->second.R_ItoG = R_GtoI.transpose();
+    it->second.p_IinG = p_IinG;
+    it->second.has_vio = true;
+
+    // A loop might have been waiting for this node (the loop closer can be ahead of the update)
+    if (is_new && has_pending_loop) {
+        has_pending_loop = false;
+        has_new_loop = true;
+        lck.unlock();
+        cv_loop.notify_one();
+    }
+}
+
+void PoseGraph::add_node(double timestamp) {
+    if (nodes.find(timestamp) != nodes.end())
+        return;
+    Node node;
+    auto it = recent_poses.find(timestamp);
+    if (it != recent_poses.end()) {
+        node.R_ItoG = it->second.first.transpose();
+        node.p_IinG = it->second.second;
+        node.has_vio = true;
+    }
+    nodes.insert({timestamp, node});
+}
+
+void PoseGraph::add_keyframe(double timestamp) {
+    std::unique_lock<std::mutex> lck(mtx);
+    add_node(timestamp);
+}
+
+void PoseGraph::add_loop(double timestamp, double old_timestamp, const Eigen::Matrix3d &R_GtoI, const Eigen::Vector3d &p_IinG) {
+    {
+        std::unique_lock<std::mutex> lck(mtx);
+        add_node(timestamp);
+        add_node(old_timestamp);
+        loops.push_back({timestamp, old_timestamp, R_GtoI.transpose(), p_IinG});
+        has_new_loop = true;
+    }
+    cv_loop.notify_one();
+}
+
+void PoseGraph::worker() {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lck(mtx);
+            cv_loop.wait(lck, [this] { return !is_running || has_new_loop; });
+            if (!is_running)
+                return;
+            has_new_loop = false;
+        }
+        optimize();
+    }
+}
+
+void PoseGraph::optimize() {
+    boost::posix_time::ptime rT1 = boost::posix_time::microsec_clock::local_time();
+
+    // Copy the part of our graph we optimize, only nodes that have their VIO pose can be used
+    // Everything before the oldest node a loop goes to stays fixed, so we do not need to copy it
+    std::vector<double> timestamps;
+    std::vector<Node> graph;
+    std::vector<Edge> edges;
+    Eigen::Matrix3d R_drift_old;
+    Eigen::Vector3d p_drift_old;
+    int max_iter, num_seq;
+    double w_yaw, huber;
+    {
+        std::unique_lock<std::mutex> lck(mtx);
+        if (loops.empty())
+            return;
+        double oldest = loops.front().old_timestamp;
+        for (const Loop &loop : loops)
+            oldest = std::min(oldest, std::min(loop.timestamp, loop.old_timestamp));
+        std::map<double, int> index;
+        for (auto it = nodes.lower_bound(oldest); it != nodes.end(); it++) {
+            if (!it->second.has_vio)
+                continue;
+            index.insert({it->first, (int) graph.size()});
+            timestamps.push_back(it->first);
+            graph.push_back(it->second);
+        }
+        for (const Loop &loop : loops) {
+            auto it_cur = index.find(loop.timestamp);
+            auto it_old = index.find(loop.old_timestamp);
+            if (it_cur == index.end() || it_old == index.end()) {
+                has_pending_loop = true;
+                continue;
+            }
+            const Node &old_node = graph.at((size_t) it_old->second);
+            Edge edge;
+            edge.i = it_old->second;
+            edge.j = it_cur->second;
+            edge.t_ij = old_node.R_ItoG.transpose() * (loop.p_IinG - old_node.p_IinG);
+            edge.yaw_ij = wrap_angle(yaw(loop.R_ItoG) - yaw(old_node.R_ItoG));
+            edge.is_loop = true;
+            edges.push_back(edge);
+        }
+        R_drift_old = R_drift;
+        p_drift_old = p_drift;
+        max_iter = max_iterations;
+        num_seq = num_sequential;
+        w_yaw = yaw_weight;
+        huber = loop_huber;
+    }
+    if (edges.empty())
+        return;
+
+    // Everything up to the oldest keyframe a loop goes to stays fixed (this also fixes our gauge)
+    int anchor = (int) graph.size();
+    for (const Edge &edge : edges)
+        anchor = std::min(anchor, std::min(edge.i, edge.j));
+    const int num_free = (int) graph.size() - anchor - 1;
+    if (num_free <= 0)
+        return;
+
+    // Tie each node to the few before it with their relative VIO pose
+    for (int j = anchor + 1; j < (int) graph.size(); j++) {
+        for (int i = std::max(anchor, j - num_seq); i < j; i++) {
+            Edge edge;
+            edge.i = i;
+            edge.j = j;
+            edge.t_ij = graph.at(i).R_ItoG.transpose() * (graph.at(j).p_IinG - graph.at(i).p_IinG);
+            edge.yaw_ij = wrap_angle(yaw(graph.at(j).R_ItoG) - yaw(graph.at(i).R_ItoG));
+            edge.is_loop = false;
+            edges.push_back(edge);
+        }
+    }
+
+    // Start from our last solution, new nodes get the current drift correction
+    std::vector<Eigen::Matrix3d> R_rp(graph.size());
+    for (size_t i = 0; i < graph.size(); i++) {
+        Node &node = graph.at(i);
+        R_rp.at(i) = rot_z(-yaw(node.R_ItoG)) * node.R_ItoG;
+        if (!node.is_optimized) {
+            node.yaw = yaw(R_drift_old * node.R_ItoG);
+            node.p = R_drift_old * node.p_IinG + p_drift_old;
+        }
+    }
+
+    // Gauss-Newton on the yaw and position of the free nodes (state index of node i is 4*(i-anchor-1))
+    const Eigen::Matrix3d skew_z = (Eigen::Matrix3d() << 0, -1, 0, 1, 0, 0, 0, 0, 0).finished();
+    Eigen::SimplicialLDLT<Eigen::SparseMatrix<double>> solver;
+    int iter = 0;
+    double cost = 0;
+    for (; iter < max_iter; iter++) {
+        std::vector<Eigen::Triplet<double>> triplets;
+        triplets.reserve(edges.size() * 64 + 4 * num_free);
+        Eigen::VectorXd b = Eigen::VectorXd::Zero(4 * num_free);
+        cost = 0;
+        for (const Edge &edge : edges) {
+            const Node &ni = graph.at(edge.i), &nj = graph.at(edge.j);
+            const Eigen::Matrix3d A = R_rp.at(edge.i).transpose() * rot_z(ni.yaw).transpose();
+            const Eigen::Vector3d d = nj.p - ni.p;
+
+            // Residual and Jacobians (columns are yaw then position)
+            Eigen::Matrix<double, 4, 1> r;
+            r.head<3>() = A * d - edge.t_ij;
+            r(3) = w_yaw * wrap_angle(nj.yaw - ni.yaw - edge.yaw_ij);
+            Eigen::Matrix<double, 4, 4> Ji = Eigen::Matrix<double, 4, 4>::Zero(), Jj = Eigen::Matrix<double, 4, 4>::Zero();
+            Ji.block<3, 1>(0, 0) = -R_rp.at(edge.i).transpose() * skew_z * rot_z(ni.yaw).transpose() * d;
+            Ji.block<3, 3>(0, 1) = -A;
+            Ji(3, 0) = -w_yaw;
+            Jj.block<3, 3>(0, 1) = A;
+            Jj(3, 0) = w_yaw;
+
+            // Loops can be wrong, so down weight large ones
+            double w = 1.0;
+            const double norm = r.norm();
+            if (edge.is_loop && norm > huber)
+                w = huber / norm;
+            cost += (edge.is_loop && norm > huber) ? huber * (2 * norm - huber) : norm * norm;
+
+            const int vi = edge.i - anchor - 1, vj = edge.j - anchor - 1;
+            const int idx[2] = {vi, vj};
+            const Eigen::Matrix<double, 4, 4> *J[2] = {&Ji, &Jj};
+            for (int a = 0; a < 2; a++) {
+                if (idx[a] < 0)
+                    continue;
+                b.segment<4>(4 * idx[a]) -= w * J[a]->transpose() * r;
+                for (int c = 0; c < 2; c++) {
+                    if (idx[c] < 0)
+                        continue;
+                    const Eigen::Matrix<double, 4, 4> H = w * J[a]->transpose() * (*J[c]);
+                    for (int row = 0; row < 4; row++)
+                        for (int col = 0; col < 4; col++)
+                            triplets.emplace_back(4 * idx[a] + row, 4 * idx[c] + col, H(row, col));
+                }
+            }
+        }
+        for (int k = 0; k < 4 * num_free; k++)
+            triplets.emplace_back(k, k, 1e-9);
+
+        // Solve and update our nodes
+        Eigen::SparseMatrix<double> H(4 * num_free, 4 * num_free);
+        H.setFromTriplets(triplets.begin(), triplets.end());
+        if (iter == 0)
+            solver.analyzePattern(H);
+        solver.factorize(H);
+        if (solver.info() != Eigen::Success) {
+            std::cout << "pose graph: failed to factorize the system" << std::endl;
+            return;
+        }
+        const Eigen::VectorXd dx = solver.solve(b);
+        for (int k = 0; k < num_free; k++) {
+            Node &node = graph.at((size_t) (anchor + 1 + k));
+            node.yaw = wrap_angle(node.yaw + dx(4 * k));
+            node.p += dx.segment<3>(4 * k + 1);
+        }
+        if (dx.lpNorm<Eigen::Infinity>() < 1e-6)
+            break;
+    }
+
+    // Copy our solution back, the drift is the correction of our newest node
+    {
+        std::unique_lock<std::mutex> lck(mtx);
+        for (size_t i = (size_t) anchor; i < graph.size(); i++) {
+            auto it = nodes.find(timestamps.at(i));
+            if (it == nodes.end())
+                continue;
+            it->second.yaw = graph.at(i).yaw;
+            it->second.p = graph.at(i).p;
+            it->second.is_optimized = true;
+        }
+        const Node &newest = graph.back();
+        R_drift = rot_z(wrap_angle(newest.yaw - yaw(newest.R_ItoG)));
+        p_drift = newest.p - R_drift * newest.p_IinG;
+        has_drift = true;
+    }
+    boost::posix_time::ptime rT2 = boost::posix_time::microsec_clock::local_time();
+    std::cout << "pose graph: " << num_free << " free nodes, " << edges.size() << " edges, " << std::min(iter + 1, max_iter) << " iterations, cost "
+              << cost << ", " << (rT2 - rT1).total_microseconds() * 1e-3 << " ms" << std::endl;
+}
@@ -0,0 +1,192 @@
+//
+// 4自由度位姿图, 用回环约束修正VIO的漂移
+//
+
+#ifndef CATKIN_WS_OPENVINS_POSEGRAPH_H
+#define CATKIN_WS_OPENVINS_POSEGRAPH_H
+
+#include <map>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include <condition_variable>
+#include <boost/thread.hpp>
+#include <Eigen/Dense>
+
+namespace ov_msckf {
+
+    /**
+     * @brief Background 4-DoF (yaw and position) pose graph that corrects the drift of the VIO with the loops we find.
+     *
+     * Roll and pitch are observable by the VIO (from gravity), so only yaw and position drift and are optimized here.
+     * The nodes are our keyframes (and the frames we found a loop at), with their pose taken from the state clones.
+     * Consecutive nodes are tied together by their relative VIO pose, and loops tie the current frame to an old keyframe
+     * with the pose the PnP against the old keyframe's landmarks gave (see LoopCloser).
+     *
+     * The estimator only ever copies poses in and the drift out under our mutex, the optimization runs on our own thread.
+     * Each optimization starts from the last solution, and only the nodes since the oldest keyframe a loop goes to are free.
+     * Only these nodes are copied out of the graph to optimize, so the copy does not grow with the older part of the trajectory.
+     * The drift is the correction of the newest optimized node, which is then applied to everything the VIO estimates after it.
+     */
+    class PoseGraph {
+
+    public:
+
+        PoseGraph() = default;
+        ~PoseGraph() { stop(); }
+
+        /**
+         * @brief Sets how we optimize
+         * @param max_iterations max number of Gauss-Newton iterations per optimization
+         * @param yaw_weight weight of the yaw residuals relative to the position ones (meters per radian)
+         * @param loop_huber Huber threshold on the weighted loop residuals (the loops can still be wrong)
+         * @param num_sequential number of previous nodes each node is tied to with its relative VIO pose
+         */
+        void set_options(int max_iterations, double yaw_weight = 10.0, double loop_huber = 1.0, int num_sequential = 4) {
+            std::unique_lock<std::mutex> lck(mtx);
+            this->max_iterations = std::max(1, max_iterations);
+            this->yaw_weight = yaw_weight;
+            this->loop_huber = loop_huber;
+            this->num_sequential = std::max(1, num_sequential);
+        }
+
+        /// Starts the optimization thread
+        void start();
+
+        /// Stops the optimization thread
+        void stop();
+
+        /**
+         * @brief Gives the VIO pose of a clone (called for all clones after each update, as they are still being refined)
+         * @param timestamp timestamp of the clone
+         * @param R_GtoI orientation of the clone
+         * @param p_IinG position of the clone
+         */
+        void feed_vio_pose(double timestamp, const Eigen::Matrix3d &R_GtoI, const Eigen::Vector3d &p_IinG);
+
+        /**
+         * @brief Adds a node for a keyframe, its pose is taken from the clones we have been or will be given
+         * @param timestamp timestamp of the keyframe
+         */
+        void add_keyframe(double timestamp);
+
+        /**
+         * @brief Adds a loop from a frame to an old keyframe
+         * @param timestamp timestamp of the current frame
+         * @param old_timestamp timestamp of the old keyframe
+         * @param R_GtoI orientation of the current frame in the frame of the old keyframe's landmarks (from the PnP)
+         * @param p_IinG position of the current frame in the frame of the old keyframe's landmarks (from the PnP)
+         */
+        void add_loop(double timestamp, double old_timestamp, const Eigen::Matrix3d &R_GtoI, const Eigen::Vector3d &p_IinG);
+
+        /**
+         * @brief Gets the drift correction, a corrected pose is R_drift*R_ItoG and R_drift*p_IinG+p_drift
+         * @return False if we have not optimized yet (the correction is then the identity)
+         */
+        bool get_drift(Eigen::Matrix3d &R_drift, Eigen::Vector3d &p_drift) {
+            std::unique_lock<std::mutex> lck(mtx);
+            R_drift = this->R_drift;
+            p_drift = this->p_drift;
+            return has_drift;
+        }
+
+        /// Number of nodes and loops in the graph
+        size_t num_nodes() {
+            std::unique_lock<std::mutex> lck(mtx);
+            return nodes.size();
+        }
+        size_t num_loops() {
+            std::unique_lock<std::mutex> lck(mtx);
+            return loops.size();
+        }
+
+        /// Runs one optimization on the calling thread (start() does this in the background for each new loop)
+        void optimize();
+
+        /// Yaw of a rotation from the IMU to the global frame
+        static double yaw(const Eigen::Matrix3d &R_ItoG) {
+            return std::atan2(R_ItoG(1, 0), R_ItoG(0, 0));
+        }
+
+        /// Rotation about the global z-axis
+        static Eigen::Matrix3d rot_z(double yaw) {
+            Eigen::Matrix3d R;
+            R << std::cos(yaw), -std::sin(yaw), 0, std::sin(yaw), std::cos(yaw), 0, 0, 0, 1;
+            return R;
+        }
+
+    protected:
+
+        /// Keyframe in the graph
+        struct Node {
+            /// Pose from the VIO, and if we have it yet
+            Eigen::Matrix3d R_ItoG = Eigen::Matrix3d::Identity();
+            Eigen::Vector3d p_IinG = Eigen::Vector3d::Zero();
+            bool has_vio = false;
+            /// Optimized yaw and position (roll and pitch stay the VIO's)
+            double yaw = 0;
+            Eigen::Vector3d p = Eigen::Vector3d::Zero();
+            bool is_optimized = false;
+        };
+
+        /// Loop from the current frame to an old keyframe
+        struct Loop {
+            double timestamp, old_timestamp;
+            Eigen::Matrix3d R_ItoG;
+            Eigen::Vector3d p_IinG;
+        };
+
+        /**
+         * @brief Relative pose measurement from node i to node j
+         *
+         * The translation is p_j-p_i in the frame of node i's full orientation R_ItoG (its yaw, roll and pitch).
+         * The yaw is the yaw of node j minus the yaw of node i, both about the global z-axis.
+         */
+        struct Edge {
+            int i, j;
+            Eigen::Vector3d t_ij;
+            double yaw_ij;
+            bool is_loop;
+        };
+
+        /// Adds a node if we do not have it yet, with its pose if we have already been fed it (mutex should be held)
+        void add_node(double timestamp);
+
+        /// Optimization thread loop, optimizes each time a new loop is added
+        void worker();
+
+        // Optimization settings
+        int max_iterations = 10;
+        double yaw_weight = 10.0;
+        double loop_huber = 1.0;
+        int num_sequential = 4;
+
+        /// Mutex for everything, only held to copy data in and out
+        std::mutex mtx;
+
+        /// Nodes by their timestamp
+        std::map<double, Node> nodes;
+
+        /// Newest VIO poses, so a keyframe can be added after its clone was fed
+        std::map<double, std::pair<Eigen::Matrix3d, Eigen::Vector3d>> recent_poses;
+        size_t max_recent_poses = 100;
+
+        /// All loops we have been given
+        std::vector<Loop> loops;
+
+        /// Current drift correction
+        Eigen::Matrix3d R_drift = Eigen::Matrix3d::Identity();
+        Eigen::Vector3d p_drift = Eigen::Vector3d::Zero();
+        bool has_drift = false;
+
+        // Optimization thread, woken up when we have a new loop
+        boost::thread thread_worker;
+        std::condition_variable cv_loop;
+        bool has_new_loop = false;
+        bool has_pending_loop = false;
+        bool is_running = false;
+
+    };
+
+}
+#endif //CATKIN_WS_OPENVINS_POSEGRAPH_H
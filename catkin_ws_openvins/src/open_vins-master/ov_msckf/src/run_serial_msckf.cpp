@@ -92,6 +92,14 @@ int main(int argc, char** argv)
     int max_cameras;
     nh.param<int>("max_cameras", max_cameras, 1);
 
+    // Topics for any extra cameras past the stereo pair (cam2, cam3, ...)
+    std::vector<std::string> topic_cameras = {topic_camera0, topic_camera1};
+    for(int i=2; i<max_cameras; i++) {
+        std::string topic_camera;
+        nh.param<std::string>("topic_camera"+std::to_string(i), topic_camera, "/cam"+std::to_string(i)+"/image_raw");
+        topic_cameras.push_back(topic_camera);
+    }
+
 
     //===================================================================================
     //===================================================================================
@@ -130,7 +138,9 @@ int main(int argc, char** argv)
     bool has_left = false;                                         // 是否接受到左图像数据
     bool has_right = false;                                        // 是否接受到右图像数据
     cv::Mat img0, img1;                                            // 左图像，右图像
-    cv::Mat img0_buffer, img1_buffer;
+    cv::Mat img0_buffer, img1_buffer;                              // shallow copies, the trackers never write into our images
+    std::vector<bool> has_cams((size_t)std::max(max_cameras,2), false);  // 额外相机是否接受到图像数据
+    std::vector<cv::Mat> imgs((size_t)std::max(max_cameras,2)), imgs_buffer((size_t)std::max(max_cameras,2));
     double time = time_init.toSec();
     double time_buffer = time_init.toSec();
 
@@ -163,16 +173,16 @@ int main(int argc, char** argv)
         sensor_msgs::Image::ConstPtr s0 = m.instantiate<sensor_msgs::Image>();
         if (s0 != NULL && m.getTopic() == topic_camera0) {
             // Get the image
-            cv_bridge::CvImageConstPtr cv_ptr;
+            cv_bridge::CvImagePtr cv_ptr;
             try {
-                cv_ptr = cv_bridge::toCvShare(s0, sensor_msgs::image_encodings::MONO8);
+                cv_ptr = cv_bridge::toCvCopy(s0, sensor_msgs::image_encodings::MONO8);
             } catch (cv_bridge::Exception &e) {
                 ROS_ERROR("cv_bridge exception: %s", e.what());
                 continue;
             }
             // Save to our temp variable
             has_left = true;
-            img0 = cv_ptr->image.clone();
+            img0 = cv_ptr->image;
             time = cv_ptr->header.stamp.toSec();
         }
 
@@ -180,9 +190,9 @@ int main(int argc, char** argv)
         sensor_msgs::Image::ConstPtr s1 = m.instantiate<sensor_msgs::Image>();
         if (s1 != NULL && m.getTopic() == topic_camera1) {
             // Get the image
-            cv_bridge::CvImageConstPtr cv_ptr;
+            cv_bridge::CvImagePtr cv_ptr;
             try {
-                cv_ptr = cv_bridge::toCvShare(s1, sensor_msgs::image_encodings::MONO8);
+                cv_ptr = cv_bridge::toCvCopy(s1, sensor_msgs::image_encodings::MONO8);
             } catch (cv_bridge::Exception &e) {
                 ROS_ERROR("cv_bridge exception: %s", e.what());
                 continue;
@@ -193,22 +203,49 @@ int main(int argc, char** argv)
             // TODO: https://github.com/rpng/MARS-VINS/blob/master/example_ros/ros_driver.cpp
             //if(std::abs(cv_ptr->header.stamp.toSec()-time) < 0.02) {
             has_right = true;
-            img1 = cv_ptr->image.clone();
+            img1 = cv_ptr->image;
             //}
         }
 
 
+        // Handle any extra cameras
+        sensor_msgs::Image::ConstPtr sn = m.instantiate<sensor_msgs::Image>();
+        for(size_t i=2; sn != NULL && i<topic_cameras.size(); i++) {
+            if(m.getTopic() != topic_cameras.at(i))
+                continue;
+            // Get the image
+            cv_bridge::CvImagePtr cv_ptr;
+            try {
+                cv_ptr = cv_bridge::toCvCopy(sn, sensor_msgs::image_encodings::MONO8);
+            } catch (cv_bridge::Exception &e) {
+                ROS_ERROR("cv_bridge exception: %s", e.what());
+                break;
+            }
+            // Save to our temp variable
+            has_cams.at(i) = true;
+            imgs.at(i) = cv_ptr->image;
+        }
+
+
+        // Fill our buffer if we have not
+        for(size_t i=2; i<has_cams.size(); i++) {
+            if(has_cams.at(i) && imgs_buffer.at(i).rows == 0) {
+                has_cams.at(i) = false;
+                imgs_buffer.at(i) = imgs.at(i);
+            }
+        }
+
         // Fill our buffer if we have not
         if(has_left && img0_buffer.rows == 0) {
             has_left = false;
             time_buffer = time;
-            img0_buffer = img0.clone();
+            img0_buffer = img0;
         }
 
         // Fill our buffer if we have not
         if(has_right && img1_buffer.rows == 0) {
             has_right = false;
-            img1_buffer = img1.clone();
+            img1_buffer = img1;
         }
 
 
@@ -229,7 +266,7 @@ int main(int argc, char** argv)
             has_left = false;
             // move buffer forward
             time_buffer = time;
-            img0_buffer = img0.clone();
+            img0_buffer = img0;
         }
 
 
@@ -251,8 +288,39 @@ int main(int argc, char** argv)
             has_right = false;
             // move buffer forward
             time_buffer = time;
-            img0_buffer = img0.clone();
-            img1_buffer = img1.clone();
+            img0_buffer = img0;
+            img1_buffer = img1;
+        }
+
+
+        // If we have more then two cameras, then process once we have an image from all of them
+        if(max_cameras>2 && has_left && has_right && std::find(has_cams.begin()+2,has_cams.end(),false)==has_cams.end()) {
+            // process once we have initialized with the GT
+            Eigen::Matrix<double, 17, 1> imustate;
+            if(!gt_states.empty() && !sys->intialized() && DatasetReader::get_gt_state(time_buffer,imustate,gt_states)) {
+                sys->initialize_with_gt(imustate);
+            } else if(gt_states.empty() || sys->intialized()) {
+                std::vector<cv::Mat> imgs_set = {img0_buffer, img1_buffer};
+                std::vector<size_t> cam_ids = {0, 1};
+                for(size_t i=2; i<imgs_buffer.size(); i++) {
+                    imgs_set.push_back(imgs_buffer.at(i));
+                    cam_ids.push_back(i);
+                }
+                sys->feed_measurement_multicam(time_buffer, imgs_set, cam_ids);
+            }
+            // visualize
+            viz->visualize();
+            // reset bools
+            has_left = false;
+            has_right = false;
+            std::fill(has_cams.begin(), has_cams.end(), false);
+            // move buffer forward
+            time_buffer = time;
+            img0_buffer = img0;
+            img1_buffer = img1;
+            for(size_t i=2; i<imgs_buffer.size(); i++) {
+                imgs_buffer.at(i) = imgs.at(i);
+            }
         }
 
     }
@@ -260,6 +328,9 @@ int main(int argc, char** argv)
     // Final visualization
     viz->visualize_final();
 
+    // Save our loop closure map for the next run
+    sys->save_map();
+
     // Finally delete our system
     delete sys;
     delete viz;
@@ -47,10 +47,18 @@ RosVisualizer* viz;
 double time_buffer = -1;
 cv::Mat img0_buffer, img1_buffer;
 
+// Buffer data for more then two cameras (newest image of each camera, and the last complete set)
+// The cameras should be hardware synchronized, so a set is only complete if all its images are this close in time
+double multicam_max_dt = 0.001;
+std::vector<double> time_cams;
+std::vector<cv::Mat> img_cams;
+std::vector<cv::Mat> imgs_buffer;
+
 // Callback functions
 void callback_inertial(const sensor_msgs::Imu::ConstPtr& msg);
 void callback_monocular(const sensor_msgs::ImageConstPtr& msg0);
 void callback_stereo(const sensor_msgs::ImageConstPtr& msg0, const sensor_msgs::ImageConstPtr& msg1);
+void callback_multicam(const sensor_msgs::ImageConstPtr& msg, size_t cam_id);
 
 
 
@@ -78,7 +86,7 @@ int main(int argc, char** argv) {
     nh.param<std::string>("topic_camera0", topic_camera0, "/cam0/image_raw");
     nh.param<std::string>("topic_camera1", topic_camera1, "/cam1/image_raw");
 
-    // Read in what mode we should be processing in (1=mono, 2=stereo)
+    // Read in what mode we should be processing in (1=mono, 2=stereo, more=multicam)
     int max_cameras;
     nh.param<int>("max_cameras", max_cameras, 1);
 
@@ -93,6 +101,7 @@ int main(int argc, char** argv) {
     // Create subscribers
     ros::Subscriber subimu = nh.subscribe(topic_imu.c_str(), 9999, callback_inertial);
     ros::Subscriber subcam;
+    std::vector<ros::Subscriber> subcams;
     if(max_cameras == 1) {
         ROS_INFO("subscribing to: %s", topic_camera0.c_str());
         subcam = nh.subscribe(topic_camera0.c_str(), 1, callback_monocular);
@@ -100,6 +109,16 @@ int main(int argc, char** argv) {
         ROS_INFO("subscribing to: %s", topic_camera0.c_str());
         ROS_INFO("subscribing to: %s", topic_camera1.c_str());
         sync.registerCallback(boost::bind(&callback_stereo, _1, _2));
+    } else if(max_cameras > 2) {
+        // Each camera has its own callback, and we process once we have an image from all of them
+        time_cams.resize((size_t)max_cameras, -1);
+        img_cams.resize((size_t)max_cameras);
+        for(int i=0; i<max_cameras; i++) {
+            std::string topic_camera;
+            nh.param<std::string>("topic_camera"+std::to_string(i), topic_camera, "/cam"+std::to_string(i)+"/image_raw");
+            ROS_INFO("subscribing to: %s", topic_camera.c_str());
+            subcams.push_back(nh.subscribe<sensor_msgs::Image>(topic_camera.c_str(), 1, boost::bind(&callback_multicam, _1, (size_t)i)));
+        }
     } else {
         ROS_ERROR("INVALID MAX CAMERAS SELECTED!!!");
         std::exit(EXIT_FAILURE);
@@ -116,6 +135,9 @@ int main(int argc, char** argv) {
     // Final visualization
     viz->visualize_final();
 
+    // Save our loop closure map for the next run
+    sys->save_map();
+
     // Finally delete our system
     delete sys;
     delete viz;
@@ -218,18 +240,40 @@ void callback_stereo(const sensor_msgs::ImageConstPtr& msg0, const sensor_msgs::
 
 
 
+void callback_multicam(const sensor_msgs::ImageConstPtr& msg, size_t cam_id) {
 
+    // Get the image
+    cv_bridge::CvImageConstPtr cv_ptr;
+    try {
+        cv_ptr = cv_bridge::toCvShare(msg, sensor_msgs::image_encodings::MONO8);
+    } catch (cv_bridge::Exception &e) {
+        ROS_ERROR("cv_bridge exception: %s", e.what());
+        return;
+    }
+    time_cams.at(cam_id) = cv_ptr->header.stamp.toSec();
+    img_cams.at(cam_id) = cv_ptr->image.clone();
 
+    // Wait till we have an image from all cameras at this time
+    for(size_t i=0; i<img_cams.size(); i++) {
+        if(img_cams.at(i).rows == 0 || std::abs(time_cams.at(i)-time_cams.at(cam_id)) > multicam_max_dt)
+            return;
+    }
 
+    // send the last set to our VIO system (if we have filled our buffer)
+    if(!imgs_buffer.empty()) {
+        std::vector<size_t> cam_ids;
+        for(size_t i=0; i<imgs_buffer.size(); i++) {
+            cam_ids.push_back(i);
+        }
+        sys->feed_measurement_multicam(time_buffer, imgs_buffer, cam_ids);
+        viz->visualize();
+    }
 
+    // move buffer forward, and wait for a new image from all cameras
+    time_buffer = time_cams.at(0);
+    imgs_buffer = img_cams;
+    for(cv::Mat &img : img_cams) {
+        img.release();
+    }
 
-
-
-
-
-
-
-
-
-
-
+}
@@ -120,6 +120,39 @@ void Propagator::propagate_and_clone(State* state, double timestamp) {
 }
 
 
+bool Propagator::integrate_gyro(State *state, double time0, double time1, Eigen::Matrix3d &R_I0toI1) {
+
+    // Default to no rotation
+    R_I0toI1.setIdentity();
+
+    // Get our imu times for these camera times (t_imu = t_cam + calib_dt)
+    double t_off = state->calib_dt_CAMtoIMU()->value()(0);
+    double t0 = time0+t_off;
+    double t1 = time1+t_off;
+
+    // Make sure we have readings that span the whole interval
+    // We check this here so we do not print errors when we are just waiting on data
+    if(t1 <= t0 || imu_data.empty() || imu_data.at(0).timestamp > t0 || imu_data.at(imu_data.size()-1).timestamp < t1)
+        return false;
+
+    // Get the readings over this interval
+    vector<IMUDATA> prop_data = Propagator::select_imu_readings(imu_data,t0,t1);
+    if(prop_data.size() < 2)
+        return false;
+
+    // Integrate our bias corrected angular velocity (JPL so R_GtoI1 = exp(-w*dt)*R_GtoI0)
+    Eigen::Vector3d bias_g = state->imu()->bias_g();
+    for(size_t i=0; i<prop_data.size()-1; i++) {
+        double dt = prop_data.at(i+1).timestamp-prop_data.at(i).timestamp;
+        Eigen::Vector3d w_hat = 0.5*(prop_data.at(i).wm+prop_data.at(i+1).wm)-bias_g;
+        R_I0toI1 = exp_so3(-w_hat*dt)*R_I0toI1;
+    }
+    return true;
+
+}
+
+
+
 std::vector<Propagator::IMUDATA> Propagator::select_imu_readings(const std::vector<IMUDATA>& imu_data, double time0, double time1) {
 
     // Our vector imu readings
@@ -141,6 +141,22 @@ namespace ov_msckf {
         void propagate_and_clone(State *state, double timestamp);
 
 
+        /**
+         * @brief Integrates the gyroscope readings to get the relative rotation between two camera times
+         *
+         * This uses the current time offset and gyroscope bias estimate in the state.
+         * It is cheap to compute and can be used by the trackers to predict where features will be in the next image.
+         * Note that this does not change the state.
+         *
+         * @param state Pointer to state
+         * @param time0 Start camera timestamp
+         * @param time1 End camera timestamp
+         * @param R_I0toI1 Rotation from the IMU frame at time0 to the IMU frame at time1
+         * @return False if we do not have the inertial readings to integrate over this interval
+         */
+        bool integrate_gyro(State *state, double time0, double time1, Eigen::Matrix3d &R_I0toI1);
+
+
         /**
          * @brief Helper function that given current imu data, will select imu readings between the two times.
          *
@@ -0,0 +1,106 @@
+/*
+ * OpenVINS: An Open Platform for Visual-Inertial Research
+ * Copyright (C) 2019 Patrick Geneva
+ * Copyright (C) 2019 Kevin Eckenhoff
+ * Copyright (C) 2019 Guoquan Huang
+ * Copyright (C) 2019 OpenVINS Contributors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <cmath>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+
+
+#include <Eigen/Dense>
+
+#include "mappoint/PoseGraph.h"
+
+
+using namespace ov_msckf;
+
+
+// Number of keyframes on our circle, we come back to the first one at the end
+int num_keyframes = 100;
+
+// Radius of the circle and how much we climb over it (meters)
+double radius = 5.0;
+double height = 0.1;
+
+// Drift of the VIO in yaw (radians per keyframe) and its scale error
+double drift_yaw = 0.003;
+double drift_scale = 0.01;
+
+// How much of the VIO error of the last keyframe needs to be corrected
+// The loop is a single edge against a chain of consistent VIO edges, so some of the error stays spread over the chain
+double min_correction = 0.75;
+
+
+// Main function
+int main(int argc, char** argv)
+{
+
+    // Our true trajectory, a circle with a bit of roll so the roll and pitch are not trivial
+    const Eigen::Matrix3d R_rp = Eigen::AngleAxisd(0.05, Eigen::Vector3d::UnitX()).toRotationMatrix();
+    std::vector<Eigen::Matrix3d> R_true;
+    std::vector<Eigen::Vector3d> p_true;
+    for(int k=0; k<=num_keyframes; k++) {
+        const double theta = 2*M_PI*k/num_keyframes;
+        R_true.push_back(PoseGraph::rot_z(theta)*R_rp);
+        p_true.push_back(Eigen::Vector3d(radius*std::sin(theta), radius-radius*std::cos(theta), height*k/num_keyframes));
+    }
+
+    // Our VIO, which integrates the true relative poses with a yaw drift and a scale error
+    std::vector<Eigen::Matrix3d> R_vio = {R_true.at(0)};
+    std::vector<Eigen::Vector3d> p_vio = {p_true.at(0)};
+    for(int k=1; k<=num_keyframes; k++) {
+        const Eigen::Matrix3d R_rel = R_true.at(k-1).transpose()*R_true.at(k);
+        const Eigen::Vector3d t_rel = R_true.at(k-1).transpose()*(p_true.at(k)-p_true.at(k-1));
+        p_vio.push_back(p_vio.back()+(1+drift_scale)*R_vio.back()*t_rel);
+        R_vio.push_back(PoseGraph::rot_z(drift_yaw)*R_vio.back()*R_rel);
+    }
+
+    // Build our graph, and loop the last keyframe to the first with their true relative pose
+    PoseGraph graph;
+    graph.set_options(10);
+    for(int k=0; k<=num_keyframes; k++) {
+        graph.feed_vio_pose(k, R_vio.at(k).transpose(), p_vio.at(k));
+        graph.add_keyframe(k);
+    }
+    const Eigen::Matrix3d R_loop = R_vio.at(0)*R_true.at(0).transpose()*R_true.at(num_keyframes);
+    const Eigen::Vector3d p_loop = p_vio.at(0)+R_vio.at(0)*R_true.at(0).transpose()*(p_true.at(num_keyframes)-p_true.at(0));
+    graph.add_loop(num_keyframes, 0, R_loop.transpose(), p_loop);
+    graph.optimize();
+
+    // The corrected pose of the last keyframe should be much closer to the truth
+    Eigen::Matrix3d R_drift;
+    Eigen::Vector3d p_drift;
+    const bool has_drift = graph.get_drift(R_drift, p_drift);
+    const Eigen::Vector3d p_corrected = R_drift*p_vio.back()+p_drift;
+    const double error_pos_vio = (p_vio.back()-p_true.back()).norm();
+    const double error_pos = (p_corrected-p_true.back()).norm();
+    const double error_yaw_vio = std::abs(PoseGraph::yaw(R_vio.back())-PoseGraph::yaw(R_true.back()));
+    const double error_yaw = std::abs(PoseGraph::yaw(R_drift*R_vio.back())-PoseGraph::yaw(R_true.back()));
+    const bool success = has_drift && error_pos < (1-min_correction)*error_pos_vio && error_yaw < (1-min_correction)*error_yaw_vio;
+
+    // Debug print
+    printf("[POSE GRAPH]: %d keyframes, %d loops\n", (int)graph.num_nodes(), (int)graph.num_loops());
+    printf("\t- vio error:       %.4f m, %.4f rad\n", error_pos_vio, error_yaw_vio);
+    printf("\t- corrected error: %.4f m, %.4f rad (%s)\n", error_pos, error_yaw, success ? "converged" : "FAILED");
+
+    // Done!
+    return success? EXIT_SUCCESS : EXIT_FAILURE;
+
+}